@@ -3,6 +3,7 @@
 #include <filesystem>
 #include <iostream>
 #include <fstream>
+#include <iterator>
 #include <string>
 #include <vector>
 #include <limits.h>
@@ -10,6 +11,11 @@
 #include <cxxopts.hpp>
 #include <spdlog/spdlog.h>
 // project headers
+#include <sse/GCodeCompression.hpp>
+#include <sse/GCodeIndex.hpp>
+#include <sse/GCodeParser.hpp>
+#include <sse/GCodeStream.hpp>
+#include <sse/GCodeWriter.hpp>
 #include <sse/Object.hpp>
 #include <sse/slicer.hpp>
 #include <sse/version.hpp>
@@ -38,6 +44,11 @@ int main(int argc, char **argv) {
   fs::path profile_filename;
   vector<string> files;
   bool autoplace = false;
+  bool compact_gcode = false;
+  bool mapped_gcode = false;
+  bool subroutines = false;
+  bool layer_index = false;
+  sse::Dialect dialect = sse::Dialect::marlin;
   fs::path outfile;
 
 
@@ -50,7 +61,8 @@ int main(int argc, char **argv) {
       ("h,help", "Help")
       ("v,verbose", "Verbosity")
       ("version", "Program Version")
-      ("o,output", "Output File", cxxopts::value<string>())
+      ("analyze", "Print statistics of a gcode file, then quit", cxxopts::value<string>(), "FILE")
+      ("o,output", "Output File; .bgcode for binary gcode, .gz or .zst to compress", cxxopts::value<string>())
       ("p,profile", "Settings profile", cxxopts::value<string>(), "FILE")
       // supports group
       ("supports", "Generate Supports", cxxopts::value<bool>())
@@ -70,6 +82,13 @@ int main(int argc, char **argv) {
       // placement group
       ("a,autoplace", "Automatically center/touch buildplate")
 
+      // output group
+      ("compact_gcode", "Omit unchanged gcode words and round to printer resolution")
+      ("mapped_gcode", "Generate every layer, then write them in parallel to a preallocated file")
+      ("subroutines", "Write repeated slices once, as subroutines. linuxcnc and machinekit only")
+      ("layer_index", "Write the offset, z, filament and time of every layer to OUTPUT.idx; uncompressed text gcode only")
+      ("dialect", "Firmware dialect. type: string, values: marlin, marlin_numbered, klipper, linuxcnc, machinekit, redeem, default: marlin", cxxopts::value<string>())
+
       // extrusion group
       ("l,layer_height", "Layer Height: type: decimal, default: 0.3", cxxopts::value(layer_height))
       ("s,shells", "Number of shells: type: integer, default: 3", cxxopts::value(num_shells))
@@ -97,11 +116,52 @@ int main(int argc, char **argv) {
       return 0;
     }
 
+    // summarize a gcode file then quit
+    if (result.count("analyze")) {
+      const auto analysis = sse::analyze_gcode_file(result["analyze"].as<string>());
+      fmt::print("lines: {:d} ({:d} unparsed)\n", analysis.lines, analysis.unparsed);
+      fmt::print("layers: {:d}\n", analysis.layers.size());
+      fmt::print("moves: {:d} extrusions, {:d} travels, {:d} arcs, {:d} beziers, {:d} retractions, {:d} z moves\n",
+                 analysis.extrusions, analysis.travels, analysis.arcs, analysis.beziers, analysis.retractions,
+                 analysis.z_moves);
+      fmt::print("distance: {:.1f}mm printed, {:.1f}mm travelled\n", analysis.print_distance,
+                 analysis.travel_distance);
+      fmt::print("filament: {:.1f}mm\n", analysis.filament);
+      fmt::print("redundant: {:d} of {:d} words, {:d} commands\n", analysis.redundant_words, analysis.words,
+                 analysis.redundant_commands);
+      return 0;
+    }
+
     // automatically position models on the build plate
     if (result.count("autoplace")) {
       autoplace = true;
     }
 
+    // omit modal words, round to 1um
+    if (result.count("compact_gcode")) {
+      compact_gcode = true;
+    }
+
+    // hold the whole output in memory, then write it with every thread
+    if (result.count("mapped_gcode")) {
+      mapped_gcode = true;
+    }
+
+    // call repeated slices, rather than writing their moves again
+    if (result.count("subroutines")) {
+      subroutines = true;
+    }
+
+    // index of the layers, for seeking to one
+    if (result.count("layer_index")) {
+      layer_index = true;
+    }
+
+    // firmware dialect
+    if (result.count("dialect")) {
+      dialect = sse::parse_dialect(result["dialect"].as<string>());
+    }
+
     // load profile
     if (result.count("p")) {
       profile_filename = fs::path(result["profile"].as<string>());
@@ -122,10 +182,40 @@ int main(int argc, char **argv) {
       cout << "output file: " << outfile << '\n';
     }
 
+    // output options that don't apply to the output file
+    if (mapped_gcode && subroutines) {
+      throw std::invalid_argument("--mapped_gcode and --subroutines can't be combined");
+    }
+    if (outfile.extension() == ".bgcode") {
+      // binary gcode is only read by Marlin
+      if (dialect != sse::Dialect::marlin) {
+        throw std::invalid_argument("binary gcode is always written for marlin, not " + result["dialect"].as<string>());
+      }
+      if (mapped_gcode || subroutines || layer_index) {
+        cerr << "Warning: --mapped_gcode, --subroutines and --layer_index don't apply to binary gcode, ignoring\n";
+        mapped_gcode = subroutines = layer_index = false;
+      }
+    } else if (sse::stream_compression(outfile) != sse::StreamCompression::none) {
+      // compressed sizes aren't known up front, so compressed files are always streamed
+      if (mapped_gcode) {
+        cerr << "Warning: compressed gcode is always streamed, ignoring --mapped_gcode\n";
+        mapped_gcode = false;
+      }
+      // the offsets in the index are into the uncompressed gcode
+      if (layer_index) {
+        cerr << "Warning: the layer index can't seek into compressed gcode, not writing one\n";
+        layer_index = false;
+      }
+    }
+
   } catch (const cxxopts::OptionException &e) {
     // no files to slice, error and exit
     cerr << "ERROR PARSING OPTIONS: " << e.what() << '\n';
     exit(1);
+  } catch (const std::invalid_argument &e) {
+    // e.g. unknown dialect
+    cerr << "ERROR PARSING OPTIONS: " << e.what() << '\n';
+    exit(1);
   }
 
   // TODO: configurable log level
@@ -169,22 +259,41 @@ int main(int argc, char **argv) {
       s.generate_shells(slice, line_width, num_shells);
       s.generate_infill(slice, infill_density, line_width);
     }
-    slices.insert(slices.end(), result.begin(), result.end());
+    slices.insert(slices.end(), std::make_move_iterator(result.begin()), std::make_move_iterator(result.end()));
   }
 
-  // turn the slices into gcode
-  auto gcode = sse::collate_gcode(slices);
-
-  ofstream outstream;
-  outstream.open(outfile);
-
-  if(!outstream) {
-    cerr << "file: " << outfile << "could not be opened\n";
+  // turn the slices into gcode, and write it to the file
+  try {
+    const auto precision = compact_gcode ? sse::GCodePrecision::compact() : sse::GCodePrecision{};
+    const auto mode = compact_gcode ? sse::ModalMode::words : sse::ModalMode::off;
+    if (outfile.extension() == ".bgcode") {
+      ofstream bgcode(outfile, ios::binary);
+      sse::write_bgcode(slices, bgcode, {}, precision, mode);
+    } else {
+      std::vector<sse::LayerIndexEntry> index;
+      if (mapped_gcode) {
+        index = sse::write_gcode_mapped(slices, outfile, precision, mode, 0, dialect);
+      } else if (subroutines) {
+        sse::GCodeStream gcode(outfile);
+        index = sse::write_gcode_subroutines(slices, gcode, precision, mode, 0, dialect);
+        gcode.finish();
+      } else {
+        sse::GCodeStream gcode(outfile);
+        index = sse::write_gcode(slices, gcode, precision, mode, 0, dialect);
+        gcode.finish();
+      }
+      if (layer_index) {
+        sse::write_layer_index(sse::layer_index_path(outfile), index);
+      }
+    }
+  } catch (const std::runtime_error &e) {
+    cerr << "file: " << outfile << " could not be written: " << e.what() << '\n';
+    return 1;
+  } catch (const std::invalid_argument &e) {
+    // e.g. compression this build doesn't support
+    cerr << "file: " << outfile << " could not be written: " << e.what() << '\n';
     return 1;
   }
 
-  outstream << gcode << std::endl;
-  outstream.close();
-
   return 0;
 }
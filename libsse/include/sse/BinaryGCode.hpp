@@ -0,0 +1,189 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file BinaryGCode.hpp
+ * @brief Binary gcode (bgcode) files, with compressed blocks
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+// project headers
+#include "sse/libsse_export.hpp"
+
+namespace sse {
+
+/**
+ * @brief Kinds of block in a bgcode file
+ *
+ * The values are those of version 1 of the format. Blocks are written in
+ * this order: metadata, then gcode.
+ */
+enum class BlockType : std::uint16_t {
+  file_metadata = 0,
+  gcode = 1,
+  slicer_metadata = 2,
+  printer_metadata = 3,
+  print_metadata = 4,
+  thumbnail = 5
+};
+
+/**
+ * @brief Compression of a block's data
+ */
+enum class BlockCompression : std::uint16_t {
+  none = 0,
+  //! zlib stream; only supported when built with zlib
+  deflate = 1,
+  //! heatshrink, window 2^11, lookahead 2^4
+  heatshrink_11_4 = 2,
+  //! heatshrink, window 2^12, lookahead 2^4
+  heatshrink_12_4 = 3
+};
+
+/**
+ * @brief Encoding of a gcode block's text, before compression
+ */
+enum class GCodeEncoding : std::uint16_t {
+  none = 0,
+  //! MeatPack, without comments, see meatpack_encode()
+  meatpack = 1,
+  //! MeatPack, with comments
+  meatpack_comments = 2
+};
+
+/**
+ * @brief How to write a bgcode file
+ */
+struct LIBSSE_EXPORT BinaryGCodeSettings {
+  BlockCompression compression = BlockCompression::heatshrink_12_4;
+  GCodeEncoding encoding = GCodeEncoding::meatpack;
+  //! append a CRC32 to every block
+  bool checksum = true;
+  //! most text in one gcode block; longer gcode is split at line ends
+  std::size_t block_size = 65536;
+};
+
+//! key/value pairs of a metadata block, in order
+using BinaryGCodeMetadata = std::vector<std::pair<std::string, std::string>>;
+
+//! slicer metadata key of the layer index, see BinaryGCodeReader::layer()
+constexpr std::string_view bgcode_layer_key = "layer_blocks";
+
+/**
+ * @brief write_bgcode_header Append the file header
+ * @param out File contents
+ * @param settings Whether blocks have checksums
+ */
+LIBSSE_EXPORT void write_bgcode_header(std::string &out, const BinaryGCodeSettings &settings);
+
+/**
+ * @brief write_bgcode_metadata Append a metadata block, as INI text
+ * @param out File contents
+ * @param type Kind of metadata block
+ * @param metadata Key/value pairs
+ * @param settings Whether the block has a checksum; metadata isn't compressed
+ */
+LIBSSE_EXPORT void write_bgcode_metadata(std::string &out, BlockType type, const BinaryGCodeMetadata &metadata,
+                                         const BinaryGCodeSettings &settings);
+
+/**
+ * @brief write_bgcode_gcode Append gcode, as one or more gcode blocks
+ *
+ * Blocks are encoded and compressed independently, so any number of calls
+ * can run in parallel, into separate strings.
+ *
+ * @param out File contents
+ * @param gcode Text gcode, lines ending with '\n'
+ * @param settings Encoding, compression and size of the blocks
+ * @return Number of blocks appended
+ * @throw invalid_argument if the compression isn't supported by this build, or block_size is 0
+ */
+LIBSSE_EXPORT std::size_t write_bgcode_gcode(std::string &out, std::string_view gcode,
+                                             const BinaryGCodeSettings &settings);
+
+/**
+ * @brief The BinaryGCodeReader class
+ *
+ * Decodes a whole bgcode file up front, verifying every checksum. Thumbnail
+ * blocks are skipped.
+ */
+class LIBSSE_EXPORT BinaryGCodeReader {
+public:
+  /**
+   * @brief BinaryGCodeReader Decode a file
+   * @param file File contents
+   * @throw runtime_error if the file is truncated or corrupt, or uses an unsupported compression
+   */
+  explicit BinaryGCodeReader(std::string_view file);
+
+  /**
+   * @brief metadata Key/value pairs of a metadata block
+   * @param type Kind of metadata block
+   * @return Pairs, empty if there's no such block
+   */
+  [[nodiscard]] const BinaryGCodeMetadata &metadata(BlockType type) const;
+
+  /**
+   * @brief gcode Text of every gcode block
+   *
+   * With MeatPack, spaces are removed from commands, and without
+   * comments, comments too.
+   */
+  [[nodiscard]] std::string gcode() const;
+
+  /**
+   * @brief block_count Number of gcode blocks
+   */
+  [[nodiscard]] inline std::size_t block_count() const noexcept {
+    return blocks.size();
+  }
+
+  /**
+   * @brief layer_count Number of layers in the layer index
+   */
+  [[nodiscard]] inline std::size_t layer_count() const noexcept {
+    return layers.empty() ? 0 : layers.size() - 1;
+  }
+
+  /**
+   * @brief layer Text of one layer, found with the layer index
+   * @param number Layer number
+   * @throw out_of_range if the file has no such layer
+   */
+  [[nodiscard]] std::string layer(std::size_t number) const;
+
+private:
+  //! decoded text of each gcode block
+  std::vector<std::string> blocks;
+  //! indexed by BlockType; gcode and thumbnails are unused
+  std::vector<BinaryGCodeMetadata> metadata_blocks;
+  //! first gcode block of each layer, then the first block after the last layer
+  std::vector<std::size_t> layers;
+};
+
+} // namespace sse
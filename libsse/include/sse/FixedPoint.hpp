@@ -0,0 +1,139 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file FixedPoint.hpp
+ * @brief Integer coordinates, and exact geometric predicates on them
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <cstdint>
+#include <vector>
+// external headers
+#include "cavc/polyline.hpp"
+// project headers
+#include "sse/libsse_export.hpp"
+
+namespace sse {
+
+//! fixed point units per mm, i.e. 1 unit = 1nm
+constexpr double fixed_point_scale = 1e6;
+//! largest coordinate, ~1073mm. Small enough for orient2d() to be exact in 64 bits
+constexpr std::int64_t fixed_point_max = (std::int64_t{1} << 30) - 1;
+
+/**
+ * @brief Point in fixed point coordinates
+ */
+struct LIBSSE_EXPORT FixedPoint {
+  std::int64_t x;
+  std::int64_t y;
+
+  [[nodiscard]] inline bool operator==(const FixedPoint &other) const noexcept {
+    return x == other.x && y == other.y;
+  }
+  [[nodiscard]] inline bool operator!=(const FixedPoint &other) const noexcept {
+    return !(*this == other);
+  }
+};
+
+/**
+ * @brief Polyline in fixed point coordinates
+ *
+ * Coordinates are stored in separate arrays, so loops over the segments
+ * stream through memory, and can be vectorized where 64 bit multiplies are.
+ */
+struct LIBSSE_EXPORT FixedPolyline {
+  std::vector<std::int64_t> xs;
+  std::vector<std::int64_t> ys;
+  //! bulges are dimensionless, and stay floating point
+  std::vector<double> bulges;
+  bool closed = false;
+
+  [[nodiscard]] inline std::size_t size() const noexcept {
+    return xs.size();
+  }
+
+  [[nodiscard]] inline FixedPoint point(std::size_t i) const noexcept {
+    return {xs[i], ys[i]};
+  }
+};
+
+/**
+ * @brief to_fixed Convert a coordinate to fixed point, rounding to the nearest unit
+ * @param value Coordinate (mm)
+ * @throw out_of_range if the coordinate is larger than fixed_point_max
+ */
+[[nodiscard]] LIBSSE_EXPORT std::int64_t to_fixed(double value);
+
+[[nodiscard]] inline double from_fixed(std::int64_t value) noexcept {
+  return static_cast<double>(value) / fixed_point_scale;
+}
+
+[[nodiscard]] inline FixedPoint to_fixed(const cavc::Vector2<double> &point) {
+  return {to_fixed(point.x()), to_fixed(point.y())};
+}
+
+[[nodiscard]] inline cavc::Vector2<double> from_fixed(const FixedPoint &point) noexcept {
+  return {from_fixed(point.x), from_fixed(point.y)};
+}
+
+/**
+ * @brief to_fixed Snap a polyline to the fixed point grid
+ *
+ * Vertices that snap onto the previous vertex are dropped, along with the
+ * zero length segments between them.
+ *
+ * @param pline Polyline to convert
+ * @throw out_of_range if a coordinate is larger than fixed_point_max
+ */
+[[nodiscard]] LIBSSE_EXPORT FixedPolyline to_fixed(const cavc::Polyline<double> &pline);
+
+/**
+ * @brief from_fixed Convert a fixed point polyline back to floating point
+ */
+[[nodiscard]] LIBSSE_EXPORT cavc::Polyline<double> from_fixed(const FixedPolyline &pline);
+
+/**
+ * @brief snap Round the vertices of a polyline to the fixed point grid, in place
+ * @param pline Polyline to snap
+ * @throw out_of_range if a coordinate is larger than fixed_point_max
+ */
+LIBSSE_EXPORT void snap(cavc::Polyline<double> &pline);
+
+/**
+ * @brief orient2d Exact orientation of three points
+ * @return Twice the signed area of triangle abc: positive if c is left of ab,
+ * negative if right, zero if collinear
+ */
+[[nodiscard]] inline std::int64_t orient2d(const FixedPoint &a, const FixedPoint &b, const FixedPoint &c) noexcept {
+  // each product is < 2^62, see fixed_point_max
+  return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+/**
+ * @brief segments_intersect Exact test whether two closed line segments intersect
+ * @return true if segments ab and cd share at least one point
+ */
+[[nodiscard]] LIBSSE_EXPORT bool segments_intersect(const FixedPoint &a, const FixedPoint &b, const FixedPoint &c,
+                                                    const FixedPoint &d) noexcept;
+
+} // namespace sse
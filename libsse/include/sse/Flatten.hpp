@@ -0,0 +1,124 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Flatten.hpp
+ * @brief Convert the wires of a planar face into polylines of lines and arcs
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <vector>
+// OCCT headers
+#include <Adaptor3d_Curve.hxx>
+#include <NCollection_DataMap.hxx>
+#include <TopTools_ShapeMapHasher.hxx>
+#include <TopoDS_Edge.hxx>
+#include <TopoDS_Shape.hxx>
+#include <TopoDS_Wire.hxx>
+// external headers
+#include "cavc/polyline.hpp"
+// project headers
+#include "sse/libsse_export.hpp"
+
+//! maximum distance (mm) between a curve and the arcs that replace it
+#define SSE_FALLBACK_CHORDAL_TOLERANCE 0.01
+
+namespace sse {
+
+/**
+ * @brief Flattened edges, so edges shared between wires are only fitted once
+ *
+ * Edges are keyed on their underlying TShape and location, regardless of
+ * orientation. Each entry holds the vertices of the edge in the direction of
+ * its geometry, including the end point.
+ *
+ * n.b. the tolerance isn't part of the key, so a cache must only be shared
+ * between calls with the same tolerance. Not thread safe.
+ */
+class LIBSSE_EXPORT EdgeCache {
+
+public:
+  /**
+   * @brief find Look up a flattened edge
+   * @param edge Edge to look up
+   * @return Vertices of the edge, or nullptr if it hasn't been flattened yet
+   */
+  [[nodiscard]] const std::vector<cavc::PlineVertex<double>> *find(const TopoDS_Edge &edge) const;
+
+  /**
+   * @brief insert Store a flattened edge
+   * @param edge Edge that was flattened
+   * @param vertexes Vertices of the edge in the direction of its geometry, including the end point
+   * @return Stored vertices
+   */
+  const std::vector<cavc::PlineVertex<double>> &insert(const TopoDS_Edge &edge,
+                                                       std::vector<cavc::PlineVertex<double>> vertexes);
+
+  /**
+   * @brief clear Remove every edge
+   */
+  void clear();
+
+  /**
+   * @brief size Number of edges in the cache
+   */
+  [[nodiscard]] inline int size() const noexcept {
+    return edges.Extent();
+  }
+
+private:
+  NCollection_DataMap<TopoDS_Shape, std::vector<cavc::PlineVertex<double>>, TopTools_ShapeMapHasher> edges;
+};
+
+/**
+ * @brief fit_biarcs Approximate a section of a curve with arcs
+ *
+ * The curve is projected onto the XY plane and split in two until a biarc
+ * (a pair of tangent arcs matching the position and tangent of the curve at
+ * both ends) is within tolerance of it. Tangent discontinuities, e.g. BSpline
+ * knots with reduced multiplicity, are always split.
+ *
+ * @param curve Curve to approximate
+ * @param first Start parameter
+ * @param last End parameter, must be greater than first
+ * @param tolerance Maximum distance between the curve and the arcs (mm)
+ * @param result List to append the vertices to. The vertex at the end parameter is not added
+ */
+LIBSSE_EXPORT void fit_biarcs(const Adaptor3d_Curve &curve, double first, double last, double tolerance,
+                              std::vector<cavc::PlineVertex<double>> &result);
+
+/**
+ * @brief flatten_wire Convert a closed wire into a closed polyline
+ *
+ * Lines and circles are converted exactly, every other type of curve is
+ * approximated with arcs, see fit_biarcs().
+ *
+ * @param wire Wire to convert
+ * @param tolerance Maximum distance between curves and the arcs that replace them (mm)
+ * @param cache Previously flattened edges, optional
+ * @return Closed polyline, empty if the wire is open
+ */
+[[nodiscard]] LIBSSE_EXPORT cavc::Polyline<double> flatten_wire(TopoDS_Wire wire,
+                                                                double tolerance = SSE_FALLBACK_CHORDAL_TOLERANCE,
+                                                                EdgeCache *cache = nullptr);
+
+} // namespace sse
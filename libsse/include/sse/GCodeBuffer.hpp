@@ -0,0 +1,165 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file GCodeBuffer.hpp
+ * @brief Reusable, chunked output buffer for gcode
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+// external headers
+#include <spdlog/fmt/compile.h>
+#include <spdlog/fmt/fmt.h>
+// project headers
+#include "sse/GCodeNumber.hpp"
+#include "sse/libsse_export.hpp"
+
+namespace sse {
+
+/**
+ * @brief The GCodeBuffer class
+ *
+ * Gcode is formatted directly into fixed size chunks, so there are no
+ * temporary strings per line or per path, and a full chunk is never
+ * reallocated. clear() keeps the chunks, so a buffer that's reused for
+ * every layer stops allocating once it has grown to the size of the
+ * largest layer.
+ */
+class LIBSSE_EXPORT GCodeBuffer {
+
+public:
+  //! default chunk size (bytes)
+  static constexpr std::size_t default_chunk_size = 1 << 20;
+
+  /**
+   * @brief Create an empty buffer
+   * @param chunk_size Capacity of each chunk (bytes)
+   */
+  explicit GCodeBuffer(std::size_t chunk_size = default_chunk_size);
+
+  /**
+   * @brief format Format text at the end of the buffer
+   *
+   * n.b. lines longer than max_line_length may reallocate a chunk
+   */
+  template <typename... Args> inline void format(fmt::format_string<Args...> format, Args &&...args) {
+    reserve_line();
+    fmt::format_to(std::back_inserter(chunks[current]), format, std::forward<Args>(args)...);
+  }
+
+  /**
+   * @brief format_compiled Format text at the end of the buffer, with a format string compiled by FMT_COMPILE
+   *
+   * e.g. buffer.format_compiled(FMT_COMPILE(";LAYER: {:d}\n"), layer);
+   */
+  template <typename S, typename... Args> inline void format_compiled(const S &format, Args &&...args) {
+    reserve_line();
+    fmt::format_to(std::back_inserter(chunks[current]), format, std::forward<Args>(args)...);
+  }
+
+  /**
+   * @brief append Copy text to the end of the buffer
+   */
+  void append(std::string_view text);
+
+  /**
+   * @brief append Copy a line to the end of the buffer
+   */
+  inline void append(const GCodeLine &line) {
+    reserve_line();
+    chunks[current].append(line.str());
+  }
+
+  /**
+   * @brief clear Remove all text, keeping the allocated chunks
+   */
+  void clear() noexcept;
+
+  /**
+   * @brief size Length of the text (bytes)
+   */
+  [[nodiscard]] std::size_t size() const noexcept;
+
+  [[nodiscard]] inline bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  /**
+   * @brief chunk_count Number of allocated chunks, including unused ones
+   */
+  [[nodiscard]] inline std::size_t chunk_count() const noexcept {
+    return chunks.size();
+  }
+
+  /**
+   * @brief str Copy the text into one string
+   */
+  [[nodiscard]] std::string str() const;
+
+  /**
+   * @brief write Write the text to a stream
+   */
+  void write(std::ostream &out) const;
+
+  /**
+   * @brief for_each_chunk Visit the text, one chunk at a time
+   * @param visitor Called with a std::string_view of each chunk, in order
+   */
+  template <typename Visitor> void for_each_chunk(Visitor &&visitor) const {
+    for (std::size_t i = 0; i <= current; ++i) {
+      visitor(std::string_view(chunks[i]));
+    }
+  }
+
+private:
+  //! longest line format() expects; a new chunk is started when there's less space left
+  static constexpr std::size_t max_line_length = 256;
+  static_assert(GCodeLine::capacity <= max_line_length, "a GCodeLine must fit in the reserved space");
+
+  //! chunks[0..current] hold text, the rest are empty and ready for reuse
+  std::vector<std::string> chunks;
+  std::size_t current = 0;
+  std::size_t chunk_size;
+
+  /**
+   * @brief reserve_line Make sure the current chunk has space for a line
+   */
+  inline void reserve_line() {
+    const auto &chunk = chunks[current];
+    if (chunk.capacity() - chunk.size() < max_line_length) {
+      next_chunk();
+    }
+  }
+
+  /**
+   * @brief next_chunk Move on to the next chunk, allocating it if needed
+   */
+  void next_chunk();
+};
+
+} // namespace sse
@@ -0,0 +1,180 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file GCodeCompression.hpp
+ * @brief Compression of gcode: MeatPack and heatshrink for binary gcode, gzip and zstd for files
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+// project headers
+#include "sse/libsse_export.hpp"
+
+namespace fs = std::filesystem;
+
+namespace sse {
+
+/**
+ * @brief meatpack_encode Pack gcode into 4 bits per common character
+ *
+ * Follows the MeatPack protocol: the output starts with the signals that
+ * enable packing and no-spaces mode. Digits, '.', '\n', 'G', 'X' and 'E'
+ * take a nibble each, other characters a nibble and a byte. Spaces are
+ * removed from commands, and empty lines are dropped.
+ *
+ * @param gcode Text gcode, lines ending with '\n'
+ * @param comments Keep comments; otherwise they're removed
+ * @return Packed bytes
+ */
+[[nodiscard]] LIBSSE_EXPORT std::string meatpack_encode(std::string_view gcode, bool comments = false);
+
+/**
+ * @brief meatpack_decode Unpack MeatPack encoded gcode
+ * @param packed Output of meatpack_encode(), or any MeatPack stream
+ * @return Text gcode, without spaces in commands
+ * @throw runtime_error if the stream is truncated
+ */
+[[nodiscard]] LIBSSE_EXPORT std::string meatpack_decode(std::string_view packed);
+
+/**
+ * @brief heatshrink_compress Compress with heatshrink's LZSS format
+ *
+ * Each item is a 1 bit tag, then either a literal byte, or a back reference
+ * of window_bits for the distance and lookahead_bits for the length, both
+ * minus 1. Bits are written most significant first, and the last byte is
+ * padded with 0s.
+ *
+ * @param data Data to compress
+ * @param window_bits log2 of the window size, e.g. 11 or 12
+ * @param lookahead_bits log2 of the longest back reference, e.g. 4
+ * @return Compressed data
+ * @throw invalid_argument if the parameters are out of range
+ */
+[[nodiscard]] LIBSSE_EXPORT std::string heatshrink_compress(std::string_view data, int window_bits,
+                                                            int lookahead_bits);
+
+/**
+ * @brief heatshrink_decompress Decompress heatshrink's LZSS format
+ * @param data Compressed data
+ * @param window_bits, lookahead_bits Parameters it was compressed with
+ * @param size Size of the decompressed data
+ * @return Decompressed data
+ * @throw runtime_error if the data is corrupt
+ */
+[[nodiscard]] LIBSSE_EXPORT std::string heatshrink_decompress(std::string_view data, int window_bits,
+                                                              int lookahead_bits, std::size_t size);
+
+/**
+ * @brief Formats of compressed gcode files
+ */
+enum class StreamCompression : std::uint8_t {
+  none,
+  //! gzip, i.e. deflate with a gzip header; needs zlib
+  gzip,
+  //! deflate with a zlib header; needs zlib
+  zlib,
+  //! Zstandard; needs libzstd
+  zstd
+};
+
+/**
+ * @brief stream_compression Format of a file, from its extension
+ * @param file e.g. part.gcode.gz
+ * @return gzip for .gz, zstd for .zst, otherwise none
+ */
+[[nodiscard]] LIBSSE_EXPORT StreamCompression stream_compression(const fs::path &file);
+
+/**
+ * @brief stream_compression_supported Whether this build can write and read a format
+ */
+[[nodiscard]] LIBSSE_EXPORT bool stream_compression_supported(StreamCompression compression) noexcept;
+
+/**
+ * @brief The StreamCompressor class
+ *
+ * Compresses text as it's produced, into one gzip member, zlib stream or
+ * zstd frame. zstd can compress blocks of the input in parallel, on worker
+ * threads of its own.
+ */
+class LIBSSE_EXPORT StreamCompressor {
+
+public:
+  /**
+   * @brief Start a compressed stream
+   * @param compression Format
+   * @param level Compression level; 0 for the format's default
+   * @param threads Worker threads for zstd; 0 to compress on the calling thread
+   * @throw invalid_argument if this build doesn't support the format
+   */
+  explicit StreamCompressor(StreamCompression compression, int level = 0, unsigned threads = 0);
+
+  ~StreamCompressor();
+
+  StreamCompressor(const StreamCompressor &) = delete;
+  StreamCompressor &operator=(const StreamCompressor &) = delete;
+
+  /**
+   * @brief compress Compress more input
+   *
+   * Output is buffered by the compressor, so it may lag behind the input
+   * until finish().
+   *
+   * @param input Text to compress
+   * @param out Compressed data is appended here
+   * @throw runtime_error if compression failed
+   */
+  void compress(std::string_view input, std::string &out);
+
+  /**
+   * @brief finish Flush everything, and end the stream
+   * @param out Compressed data is appended here
+   * @throw runtime_error if compression failed
+   */
+  void finish(std::string &out);
+
+private:
+  struct State;
+
+  StreamCompression compression;
+  std::unique_ptr<State> state;
+};
+
+/**
+ * @brief stream_decompress Decompress a whole file
+ *
+ * Concatenated gzip members and zstd frames are decompressed in turn.
+ *
+ * @param data Compressed data
+ * @param compression Format
+ * @return Decompressed data
+ * @throw invalid_argument if this build doesn't support the format
+ * @throw runtime_error if the data is corrupt or truncated
+ */
+[[nodiscard]] LIBSSE_EXPORT std::string stream_decompress(std::string_view data, StreamCompression compression);
+
+} // namespace sse
@@ -0,0 +1,189 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file GCodeDialect.hpp
+ * @brief Compile-time policies for the gcode dialect of each firmware
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <string_view>
+// external headers
+#include <spdlog/spdlog.h>
+// project headers
+#include "sse/libsse_export.hpp"
+
+namespace sse {
+
+/**
+ * @brief How comments are written
+ */
+enum class CommentStyle : std::uint8_t {
+  //! ; to the end of the line
+  semicolon,
+  //! (in parentheses), e.g. LinuxCNC
+  parentheses
+};
+
+/**
+ * @brief How E words are interpreted
+ */
+enum class ExtrusionMode : std::uint8_t {
+  //! E is the extruder position, M82
+  absolute,
+  //! E is the distance to extrude, M83
+  relative
+};
+
+/*
+ * Each dialect is a policy for BasicGCodeWriter, with these members:
+ *   name: written as ;FLAVOR: in the header
+ *   arcs: G2/G3 are supported; otherwise arcs are written as lines
+ *   splines: G5 cubic beziers are supported; otherwise beziers are written as lines
+ *   subroutines: O-word subroutines and G52 offsets are supported, see write_gcode_subroutines()
+ *   extrusion: extrusion mode
+ *   comments: comment style
+ *   line_numbers: commands are written with line numbers and checksums
+ *   printer_commands: 3D printer M-codes (temperatures, fan, M82/M83, M84) and G28 homing are supported;
+ *     otherwise the header and footer only use standard RS274 codes
+ *   extruder_axis: default letter of the extruder axis; only dialects with printer_commands have an E axis
+ *
+ * The writer is compiled separately for each dialect, so none of these are
+ * checked at runtime.
+ */
+
+//! Marlin 2.0; G5 needs BEZIER_CURVE_SUPPORT, which is off by default
+struct Marlin {
+  static constexpr std::string_view name = "Marlin";
+  static constexpr bool arcs = true;
+  static constexpr bool splines = false;
+  static constexpr bool subroutines = false;
+  static constexpr ExtrusionMode extrusion = ExtrusionMode::absolute;
+  static constexpr CommentStyle comments = CommentStyle::semicolon;
+  static constexpr bool line_numbers = false;
+  static constexpr bool printer_commands = true;
+  static constexpr char extruder_axis = 'E';
+};
+
+//! Marlin 2.0, with line numbers and checksums for hosts streaming the file over serial
+struct MarlinNumbered : Marlin {
+  static constexpr bool line_numbers = true;
+};
+
+//! Klipper; arcs need the optional [gcode_arcs] module, so they're written as lines, and there's no G5.
+//! Macros are defined in printer.cfg, not in gcode files, so there are no subroutines
+struct Klipper {
+  static constexpr std::string_view name = "Klipper";
+  static constexpr bool arcs = false;
+  static constexpr bool splines = false;
+  static constexpr bool subroutines = false;
+  static constexpr ExtrusionMode extrusion = ExtrusionMode::relative;
+  static constexpr CommentStyle comments = CommentStyle::semicolon;
+  static constexpr bool line_numbers = false;
+  static constexpr bool printer_commands = true;
+  static constexpr char extruder_axis = 'E';
+};
+
+//! LinuxCNC; E is only a word of G76 there, so the extruder is a rotary or auxiliary axis, A by default.
+//! Heaters and fans are left to the machine's configuration
+struct LinuxCNC {
+  static constexpr std::string_view name = "LinuxCNC";
+  static constexpr bool arcs = true;
+  static constexpr bool splines = true;
+  static constexpr bool subroutines = true;
+  static constexpr ExtrusionMode extrusion = ExtrusionMode::absolute;
+  static constexpr CommentStyle comments = CommentStyle::parentheses;
+  static constexpr bool line_numbers = false;
+  static constexpr bool printer_commands = false;
+  static constexpr char extruder_axis = 'A';
+};
+
+//! Machinekit, i.e. LinuxCNC
+struct Machinekit : LinuxCNC {
+  static constexpr std::string_view name = "Machinekit";
+};
+
+//! Redeem
+struct Redeem : Marlin {
+  static constexpr std::string_view name = "Redeem";
+};
+
+/**
+ * @brief Dialect chosen at runtime, see with_dialect()
+ */
+enum class Dialect : std::uint8_t { marlin, marlin_numbered, klipper, linuxcnc, machinekit, redeem };
+
+/**
+ * @brief parse_dialect Look up a dialect by name
+ * @param name e.g. "marlin", "klipper"
+ * @throw invalid_argument if the name isn't a dialect
+ */
+[[nodiscard]] inline Dialect parse_dialect(std::string_view name) {
+  constexpr std::pair<std::string_view, Dialect> dialects[] = {{"marlin", Dialect::marlin},
+                                                                {"marlin_numbered", Dialect::marlin_numbered},
+                                                                {"klipper", Dialect::klipper},
+                                                                {"linuxcnc", Dialect::linuxcnc},
+                                                                {"machinekit", Dialect::machinekit},
+                                                                {"redeem", Dialect::redeem}};
+
+  for (const auto &[key, dialect] : dialects) {
+    if (key == name) {
+      return dialect;
+    }
+  }
+
+  spdlog::error("Unknown gcode dialect: {}", name);
+  throw std::invalid_argument("unknown gcode dialect");
+}
+
+/**
+ * @brief with_dialect Call a function with the policy of a dialect
+ *
+ * The switch happens once, e.g. per file, and everything the function
+ * calls is compiled for the policy.
+ *
+ * @param dialect Dialect
+ * @param f Called with a default constructed policy, e.g. Marlin{}
+ * @return Result of f
+ */
+template <typename F> decltype(auto) with_dialect(Dialect dialect, F &&f) {
+  switch (dialect) {
+  case Dialect::marlin_numbered:
+    return f(MarlinNumbered{});
+  case Dialect::klipper:
+    return f(Klipper{});
+  case Dialect::linuxcnc:
+    return f(LinuxCNC{});
+  case Dialect::machinekit:
+    return f(Machinekit{});
+  case Dialect::redeem:
+    return f(Redeem{});
+  case Dialect::marlin:
+    break;
+  }
+  return f(Marlin{});
+}
+
+} // namespace sse
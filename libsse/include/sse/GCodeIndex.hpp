@@ -0,0 +1,142 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file GCodeIndex.hpp
+ * @brief Index of the layers of a gcode file, for seeking to a layer
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+// project headers
+#include "sse/libsse_export.hpp"
+
+namespace fs = std::filesystem;
+
+namespace sse {
+
+/**
+ * @brief Where one layer is in a gcode file, and the totals at its end
+ */
+struct LIBSSE_EXPORT LayerIndexEntry {
+  //! position of the layer's first byte, i.e. its layer comment (bytes)
+  std::uint64_t offset;
+  //! length of the layer's text (bytes)
+  std::uint64_t size;
+  double z;
+  //! filament used up to the end of the layer (mm)
+  double filament;
+  //! estimated print time up to the end of the layer (s), see toolpath_stats()
+  double time;
+};
+
+//! first line of an index file, with its version
+constexpr std::string_view layer_index_magic = "; StepSlicerEngine layer index 1";
+
+/**
+ * @brief layer_index_path Where the index of a gcode file is kept, i.e. the file name with .idx appended
+ * @param gcode Gcode file
+ */
+[[nodiscard]] LIBSSE_EXPORT fs::path layer_index_path(const fs::path &gcode);
+
+/**
+ * @brief write_layer_index Save an index to a file
+ *
+ * The index is text, one line per layer, with the offset, size, z,
+ * filament and time separated by spaces, so e.g. a previewer can read it
+ * without this library.
+ *
+ * @param file Index file, created or truncated, see layer_index_path()
+ * @param layers Entry of each layer, in order
+ * @throw runtime_error if the file can't be written
+ */
+LIBSSE_EXPORT void write_layer_index(const fs::path &file, const std::vector<LayerIndexEntry> &layers);
+
+/**
+ * @brief read_layer_index Load an index from a file
+ * @param file Index file, see write_layer_index()
+ * @return Entry of each layer, in order
+ * @throw runtime_error if the file can't be read, or isn't an index
+ */
+[[nodiscard]] LIBSSE_EXPORT std::vector<LayerIndexEntry> read_layer_index(const fs::path &file);
+
+/**
+ * @brief The GCodeLayerReader class
+ *
+ * Opens a gcode file with its index, and reads single layers by seeking
+ * straight to them, e.g. to resume a print, or preview a layer of a file
+ * too large to scan. Offsets are into the uncompressed text, so compressed
+ * files can't be read this way.
+ */
+class LIBSSE_EXPORT GCodeLayerReader {
+
+public:
+  /**
+   * @brief Open a gcode file and load its index
+   * @param gcode Gcode file; its index is read from layer_index_path()
+   * @throw invalid_argument if the file is compressed, see stream_compression()
+   * @throw runtime_error if either file can't be read, or the index doesn't match the file
+   */
+  explicit GCodeLayerReader(const fs::path &gcode);
+
+  /**
+   * @brief layer_count Number of layers in the index
+   */
+  [[nodiscard]] inline std::size_t layer_count() const noexcept {
+    return layers.size();
+  }
+
+  /**
+   * @brief info Position and totals of a layer
+   * @param number Layer number
+   * @throw out_of_range if there's no such layer
+   */
+  [[nodiscard]] const LayerIndexEntry &info(std::size_t number) const;
+
+  /**
+   * @brief find First layer at or above a height
+   * @param z Height (mm)
+   * @return Layer number, or layer_count() if every layer is below z
+   */
+  [[nodiscard]] std::size_t find(double z) const noexcept;
+
+  /**
+   * @brief layer Read the text of one layer
+   * @param number Layer number
+   * @throw out_of_range if there's no such layer
+   * @throw runtime_error if reading failed
+   */
+  [[nodiscard]] std::string layer(std::size_t number);
+
+private:
+  std::ifstream file;
+  std::vector<LayerIndexEntry> layers;
+};
+
+} // namespace sse
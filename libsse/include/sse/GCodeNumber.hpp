@@ -0,0 +1,130 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file GCodeNumber.hpp
+ * @brief Fast fixed precision formatting of gcode words
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <array>
+#include <cstddef>
+#include <string_view>
+// project headers
+#include "sse/libsse_export.hpp"
+
+namespace sse {
+
+/**
+ * @brief Decimal places of each kind of gcode word
+ *
+ * Trailing zeros are trimmed, so these are the maximum number of decimal
+ * places. Arc centers (I, J) use the xy precision.
+ */
+struct LIBSSE_EXPORT GCodePrecision {
+  int xy = 6;
+  int z = 6;
+  int e = 6;
+  //! feedrate
+  int f = 0;
+
+  /**
+   * @brief compact Precision matching the resolution of typical printers; 1um for axes, 10nm for the extruder
+   */
+  [[nodiscard]] static constexpr GCodePrecision compact() noexcept {
+    return {3, 3, 5, 0};
+  }
+};
+
+//! highest precision write_number() supports
+constexpr int max_number_precision = 9;
+
+//! longest text write_number() writes
+constexpr std::size_t max_number_length = 32;
+
+/**
+ * @brief number_units Round a number to a whole count of 10^-precision units
+ *
+ * Numbers with the same units are written identically by write_number()
+ *
+ * @param value Number to round
+ * @param precision Decimal places, clamped to [0, max_number_precision]
+ */
+[[nodiscard]] LIBSSE_EXPORT double number_units(double value, int precision) noexcept;
+
+/**
+ * @brief write_number Write a number with fixed precision, trimming trailing zeros
+ *
+ * e.g. 10.5 with precision 3 is "10.5", 10 is "10", and -0.0001 is "0"
+ *
+ * The number is rounded to an integer count of 10^-precision units, and the
+ * digits are written with integer arithmetic. Numbers too large for that,
+ * inf and nan fall back to fmt.
+ *
+ * @param out Destination, with space for max_number_length characters
+ * @param value Number to write
+ * @param precision Decimal places, clamped to [0, max_number_precision]
+ * @return Pointer past the last character written
+ */
+LIBSSE_EXPORT char *write_number(char *out, double value, int precision) noexcept;
+
+/**
+ * @brief The GCodeLine class
+ *
+ * Builds one line of gcode, e.g. "G1 X10.5 Y3 E0.25", on the stack.
+ */
+class LIBSSE_EXPORT GCodeLine {
+
+public:
+  //! longest line, including the newline
+  static constexpr std::size_t capacity = 256;
+
+  /**
+   * @brief Start a line
+   * @param command Command, e.g. "G1", or empty for a line of words
+   * @throw length_error if the command doesn't fit
+   */
+  explicit GCodeLine(std::string_view command);
+
+  /**
+   * @brief word Append a word, e.g. " X10.5"
+   * @param letter Letter of the word
+   * @param value Number of the word
+   * @param precision Decimal places, see write_number()
+   * @throw length_error if the word doesn't fit
+   */
+  GCodeLine &word(char letter, double value, int precision);
+
+  /**
+   * @brief str Text of the line, including the newline
+   */
+  [[nodiscard]] inline std::string_view str() const noexcept {
+    return {text.data(), length + 1};
+  }
+
+private:
+  std::array<char, capacity> text;
+  //! length of the line, excluding the newline
+  std::size_t length = 0;
+};
+
+} // namespace sse
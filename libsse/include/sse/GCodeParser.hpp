@@ -0,0 +1,285 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file GCodeParser.hpp
+ * @brief Fast gcode parsing, and statistics of a whole program, e.g. to check the output of the slicer
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+// project headers
+#include "sse/libsse_export.hpp"
+
+namespace fs = std::filesystem;
+
+namespace sse {
+
+/**
+ * @brief One line of gcode, parsed into words
+ *
+ * Words are indexed by their letter, in upper case. A letter without a
+ * number, e.g. the X of G28 X, is present with a NaN value.
+ */
+struct LIBSSE_EXPORT GCodeCommand {
+  //! bit n is set if the word of the nth letter of the alphabet is present
+  std::uint32_t words = 0;
+  //! value of each word, only valid if the word is present
+  std::array<double, 26> values;
+  //! text of the comment, without ';' or parentheses; empty if there's none
+  std::string_view comment;
+
+  [[nodiscard]] inline bool has(char letter) const noexcept {
+    return words & (1u << (letter - 'A'));
+  }
+
+  [[nodiscard]] inline double value(char letter) const noexcept {
+    return values[static_cast<std::size_t>(letter - 'A')];
+  }
+
+  /**
+   * @brief is Whether the command is e.g. G1
+   * @param letter Command letter, 'G', 'M' or 'T'
+   * @param number Command number
+   */
+  [[nodiscard]] inline bool is(char letter, int number) const noexcept {
+    return has(letter) && value(letter) == number;
+  }
+};
+
+/**
+ * @brief find_line_end Find the end of a line, 16 or 32 bytes at a time where SSE2 or AVX2 is available
+ * @param begin Start of the text
+ * @param end End of the text
+ * @return Position of the next '\n', or end if there's none
+ */
+[[nodiscard]] LIBSSE_EXPORT const char *find_line_end(const char *begin, const char *end) noexcept;
+
+/**
+ * @brief parse_number Parse a decimal number, e.g. -12.345
+ *
+ * Numbers have no exponent, so a number ends at the next letter, e.g. the
+ * E of X10E2 starts another word. Numbers with at most 15 significant
+ * digits, i.e. any number the slicer writes, are converted exactly with one
+ * multiplication or division. Longer ones are passed to std::from_chars(),
+ * or read in the classic locale where the standard library has no floating
+ * point from_chars(), so the result never depends on the locale.
+ *
+ * @param begin Start of the number
+ * @param end End of the text
+ * @param value Parsed number
+ * @return Position after the number, or nullptr if there's no number at begin
+ */
+[[nodiscard]] LIBSSE_EXPORT const char *parse_number(const char *begin, const char *end, double &value) noexcept;
+
+/**
+ * @brief parse_line Parse a line into words
+ *
+ * Line numbers (N) are parsed like any other word, and checksums (*) are
+ * ignored. Lines that aren't letter and number words, e.g. O-words with a
+ * keyword like o1 call, or Klipper's extended commands, can't be parsed.
+ *
+ * @param line Line, without the newline
+ * @param command Parsed words and comment
+ * @return false if the line can't be parsed
+ */
+LIBSSE_EXPORT bool parse_line(std::string_view line, GCodeCommand &command) noexcept;
+
+/**
+ * @brief Bounding box and totals of one layer, see GCodeAnalysis::layers
+ */
+struct LIBSSE_EXPORT GCodeLayerStats {
+  //! z at the end of the layer
+  double z = 0;
+  //! bounding box of the end points of extruding moves; min > max if there are none
+  double min_x = std::numeric_limits<double>::infinity();
+  double min_y = std::numeric_limits<double>::infinity();
+  double max_x = -std::numeric_limits<double>::infinity();
+  double max_y = -std::numeric_limits<double>::infinity();
+  //! number of extruding moves
+  std::size_t extrusions = 0;
+  //! filament used (mm), i.e. net extruder movement
+  double filament = 0;
+};
+
+/**
+ * @brief Totals over a gcode program
+ */
+struct LIBSSE_EXPORT GCodeAnalysis {
+  //! lines of the program's text; the other totals count subroutine bodies at every call
+  std::size_t lines = 0;
+  //! lines with at least one word
+  std::size_t commands = 0;
+  std::size_t comments = 0;
+  //! lines that couldn't be parsed, see parse_line(), and calls to unknown subroutines
+  std::size_t unparsed = 0;
+
+  //! moves in XY that don't extrude
+  std::size_t travels = 0;
+  //! moves in XY that extrude, of any kind
+  std::size_t extrusions = 0;
+  //! G2 and G3 moves
+  std::size_t arcs = 0;
+  //! G5 moves
+  std::size_t beziers = 0;
+  //! moves of only the extruder, that move it backwards
+  std::size_t retractions = 0;
+  //! moves that change Z
+  std::size_t z_moves = 0;
+
+  //! XY length of extruding moves (mm)
+  double print_distance = 0;
+  //! XY length of moves that don't extrude (mm)
+  double travel_distance = 0;
+  //! filament used (mm), i.e. net extruder movement
+  double filament = 0;
+
+  //! words of motion commands, excluding the command itself
+  std::size_t words = 0;
+  //! words that repeat the value their axis or feedrate already had, see ModalMode::words
+  std::size_t redundant_words = 0;
+  //! motion commands that repeat the motion mode already in effect, see ModalMode::commands
+  std::size_t redundant_commands = 0;
+
+  //! one entry per layer comment, see BasicGCodeWriter::layer(); moves before the first layer aren't counted
+  std::vector<GCodeLayerStats> layers;
+};
+
+/**
+ * @brief The GCodeAnalyzer class
+ *
+ * Follows the state of the machine through a gcode program, and adds up
+ * its moves. Text is fed in pieces of any size, e.g. blocks read from a
+ * file, so a program never has to be held in memory; lines split between
+ * pieces are joined.
+ *
+ * Positions are followed with absolute or relative (G90, G91) coordinates
+ * and extrusion (M82, M83), G92, and local offsets (G52). Subroutines
+ * (oN sub ... oN endsub) are recorded, and followed at every oN call, as if
+ * their lines were written there; see BasicGCodeWriter::call(). Other
+ * O-words, e.g. loops and conditions, count as unparsed lines, and their
+ * bodies are analyzed once, as written. Work coordinate systems (G54-G59)
+ * and rotary axes aren't followed.
+ */
+class LIBSSE_EXPORT GCodeAnalyzer {
+
+public:
+  /**
+   * @brief Create an analyzer
+   * @param extruder_axis Word that moves the extruder, see BasicGCodeWriter::set_extruder_axis()
+   * @throw invalid_argument if the axis isn't one of E, A, B, C, U, V or W
+   */
+  explicit GCodeAnalyzer(char extruder_axis = 'E');
+
+  /**
+   * @brief feed Analyze the next piece of a program
+   * @param text Any amount of text
+   */
+  void feed(std::string_view text);
+
+  /**
+   * @brief finish Analyze the last line, if it has no newline
+   * @return Totals over every line fed
+   */
+  [[nodiscard]] GCodeAnalysis finish();
+
+private:
+  GCodeAnalysis result;
+  GCodeCommand command;
+  //! start of a line split between pieces
+  std::string partial;
+
+  //! word index of the extruder
+  std::size_t axis_e;
+  //! subroutine bodies by name, one line per line
+  std::unordered_map<std::string, std::string> subroutines;
+  //! name of the subroutine being recorded
+  std::optional<std::string> recording;
+  //! number of subroutine calls being followed
+  int call_depth = 0;
+
+  //! machine state, with offsets applied
+  double x = 0;
+  double y = 0;
+  double z = 0;
+  double e = 0;
+  double f = 0;
+  //! local offset, see G52
+  double offset_x = 0;
+  double offset_y = 0;
+  double offset_z = 0;
+  bool known_xy = false;
+  bool relative_xyz = false;
+  bool relative_e = false;
+  //! motion mode, 0-3 or 5; -1 if unknown
+  int motion = -1;
+  //! whether each of X, Y, Z, E and F has been set
+  std::uint32_t known = 0;
+
+  /**
+   * @brief line Analyze one line of the program, without the newline, or record it in a subroutine
+   */
+  void line(std::string_view text);
+
+  /**
+   * @brief execute Analyze one line, from the program or a subroutine
+   */
+  void execute(std::string_view text);
+
+  /**
+   * @brief move Analyze a motion command
+   */
+  void move(int mode);
+};
+
+/**
+ * @brief analyze_gcode Analyze a whole program
+ * @param gcode Text of the program
+ * @param extruder_axis Word that moves the extruder, see GCodeAnalyzer
+ * @return Totals
+ */
+[[nodiscard]] LIBSSE_EXPORT GCodeAnalysis analyze_gcode(std::string_view gcode, char extruder_axis = 'E');
+
+/**
+ * @brief analyze_gcode_file Analyze a file, reading it a block at a time
+ *
+ * Compressed files, see stream_compression(), are decompressed in memory first.
+ *
+ * @param file Gcode file
+ * @param extruder_axis Word that moves the extruder, see GCodeAnalyzer
+ * @return Totals
+ * @throw runtime_error if the file can't be read
+ * @throw invalid_argument if the file's compression isn't supported by this build
+ */
+[[nodiscard]] LIBSSE_EXPORT GCodeAnalysis analyze_gcode_file(const fs::path &file, char extruder_axis = 'E');
+
+} // namespace sse
@@ -0,0 +1,250 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file GCodeStream.hpp
+ * @brief Write gcode to a file, while later layers are still being generated
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+// project headers
+#include "sse/GCodeBuffer.hpp"
+#include "sse/GCodeCompression.hpp"
+#include "sse/libsse_export.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+//! write with POSIX file descriptors, writev() and mmap(), instead of std::ofstream
+#define SSE_POSIX_IO
+#endif
+
+namespace fs = std::filesystem;
+
+namespace sse {
+
+/**
+ * @brief The GCodeStream class
+ *
+ * Writes blocks of gcode, e.g. layers, to a file on a background thread.
+ * Blocks are submitted by index from any number of threads, in any order,
+ * and written in index order, so the file never has to be held in memory.
+ *
+ * At most window blocks past the last one written are held at once;
+ * submitting a block further ahead blocks until the writer catches up.
+ * Written buffers are recycled through acquire().
+ *
+ * Files ending in .gz or .zst are compressed as they're written, see
+ * stream_compression(). gzip is compressed by the writer thread, zstd by
+ * worker threads of its own, so neither holds up generating layers.
+ */
+class LIBSSE_EXPORT GCodeStream {
+
+public:
+  //! default number of blocks held for reordering
+  static constexpr std::size_t default_window = 64;
+
+  /**
+   * @brief Create or truncate a file, and start the writer thread
+   * @param file Output file
+   * @param window Number of blocks held for reordering
+   * @throw invalid_argument if the window is 0, or the file's compression isn't supported
+   * @throw runtime_error if the file can't be opened
+   */
+  explicit GCodeStream(const fs::path &file, std::size_t window = default_window);
+
+  //! aborts if finish() wasn't called
+  ~GCodeStream();
+
+  GCodeStream(const GCodeStream &) = delete;
+  GCodeStream &operator=(const GCodeStream &) = delete;
+
+  /**
+   * @brief acquire Get an empty buffer, reusing one that's already been written if possible
+   */
+  [[nodiscard]] GCodeBuffer acquire();
+
+  /**
+   * @brief submit Queue a block to be written
+   *
+   * Blocks while index is window or more blocks ahead of the writer.
+   *
+   * @param index Position of the block in the file, starting at 0
+   * @param buffer Text of the block
+   * @throw invalid_argument if the index has already been submitted
+   * @throw runtime_error if the stream has been aborted, or writing failed
+   */
+  void submit(std::size_t index, GCodeBuffer &&buffer);
+
+  /**
+   * @brief abort Stop writing, and make every waiting and future submit() throw
+   *
+   * Call this when a block won't be submitted, e.g. generating it failed,
+   * so threads waiting for it are released.
+   */
+  void abort() noexcept;
+
+  /**
+   * @brief finish Write every submitted block, and close the file
+   * @throw runtime_error if blocks are missing, the stream was aborted, or writing failed
+   */
+  void finish();
+
+  /**
+   * @brief bytes_written Size of the file so far, after compression
+   */
+  [[nodiscard]] std::uint64_t bytes_written() const noexcept;
+
+private:
+  std::size_t window;
+  //! blocks waiting to be written; block i is in slots[i % window]
+  std::vector<std::optional<GCodeBuffer>> slots;
+  //! index of the next block the writer will take
+  std::size_t next = 0;
+  //! number of blocks submitted
+  std::size_t submitted = 0;
+  bool finishing = false;
+  bool aborted = false;
+  std::exception_ptr error;
+  std::atomic<std::uint64_t> written{0};
+  std::vector<GCodeBuffer> spare;
+
+  mutable std::mutex mutex;
+  //! a slot became free, or the stream was aborted
+  std::condition_variable space;
+  //! a block was submitted, or the stream is finishing
+  std::condition_variable ready;
+
+#ifdef SSE_POSIX_IO
+  int fd = -1;
+#else
+  std::ofstream file;
+#endif
+  //! only for compressed files; only used by the writer thread
+  std::unique_ptr<StreamCompressor> compressor;
+  std::string compressed;
+  std::thread writer;
+
+  /**
+   * @brief run Writer thread; writes blocks in order until finishing or aborted
+   */
+  void run();
+
+  /**
+   * @brief write Write blocks to the file
+   * @throw runtime_error if writing failed
+   */
+  void write(const std::vector<GCodeBuffer> &blocks);
+
+  /**
+   * @brief write Write bytes to the file
+   * @throw runtime_error if writing failed
+   */
+  void write(std::string_view data);
+
+  /**
+   * @brief close Close the file
+   * @throw runtime_error if closing failed
+   */
+  void close();
+};
+
+/**
+ * @brief The GCodeMappedFile class
+ *
+ * Writes blocks of gcode whose sizes are known up front, e.g. layers that
+ * have already been generated, at their offsets in a file. The file is
+ * allocated at its final size and memory mapped, so any number of threads
+ * can copy their blocks into it at once, with no ordering between them.
+ *
+ * Space is allocated with posix_fallocate() where supported, so running out
+ * of disk space fails in the constructor rather than with SIGBUS on a write
+ * to the mapping. Without POSIX IO, blocks are written with seek and write,
+ * one at a time.
+ */
+class LIBSSE_EXPORT GCodeMappedFile {
+
+public:
+  /**
+   * @brief Create or truncate a file, allocate its space, and map it
+   * @param file Output file
+   * @param size Final size of the file (bytes)
+   * @throw runtime_error if the file can't be opened, allocated or mapped
+   */
+  GCodeMappedFile(const fs::path &file, std::uint64_t size);
+
+  //! unmaps and closes the file if finish() wasn't called
+  ~GCodeMappedFile();
+
+  GCodeMappedFile(const GCodeMappedFile &) = delete;
+  GCodeMappedFile &operator=(const GCodeMappedFile &) = delete;
+
+  /**
+   * @brief write Copy a block to its offset in the file
+   *
+   * Safe to call from several threads at once, as long as the blocks don't
+   * overlap.
+   *
+   * @param offset Position of the block in the file (bytes)
+   * @param block Text of the block
+   * @throw out_of_range if the block doesn't fit in the file
+   * @throw runtime_error if writing failed
+   */
+  void write(std::uint64_t offset, const GCodeBuffer &block);
+
+  /**
+   * @brief finish Unmap and close the file
+   * @throw runtime_error if closing failed
+   */
+  void finish();
+
+  /**
+   * @brief size Size of the file (bytes)
+   */
+  [[nodiscard]] inline std::uint64_t size() const noexcept {
+    return length;
+  }
+
+private:
+  std::uint64_t length;
+
+#ifdef SSE_POSIX_IO
+  int fd = -1;
+  char *data = nullptr;
+#else
+  std::mutex mutex;
+  std::ofstream file;
+#endif
+};
+
+} // namespace sse
@@ -16,112 +16,313 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#pragma once
+/**
+ * @file GCodeWriter.hpp
+ * @brief Emit gcode commands, optionally omitting modal words
+ *
+ * @author Karl Nilsson
+ *
+ */
 
-#include <spdlog/spdlog.h>
-#include <chrono>
-#include <map>
-
-#include <TopExp.hxx>
-#include <TopExp_Explorer.hxx>
-
-#include <TopAbs.hxx>
-#include <TopoDS.hxx>
-#include <TopoDS_Wire.hxx>
-#include <TopoDS_Edge.hxx>
-#include <TopoDS_Vertex.hxx>
-#include <Standard_TypeMismatch.hxx>
-
-#include <BRepTools.hxx>
-#include <BRepTools_WireExplorer.hxx>
-#include <BRep_Tool.hxx>
-#include <BRepAdaptor_Curve.hxx>
-#include <Standard_Real.hxx>
-
-#include <Geom_BSplineCurve.hxx>
-#include <Geom_BezierCurve.hxx>
-#include <Geom_BoundedCurve.hxx>
-#include <Geom_TrimmedCurve.hxx>
-#include <Geom_Curve.hxx>
-#include <Geom_Circle.hxx>
-#include <Geom_Curve.hxx>
-#include <Geom_Ellipse.hxx>
-#include <Geom_Line.hxx>
-#include <Geom_TrimmedCurve.hxx>
-#include <GeomAdaptor.hxx>
-#include <GeomAdaptor_Curve.hxx>
-#include <GeomAdaptor_HCurve.hxx>
-
-#include <gp.hxx>
-#include <gp_Lin.hxx>
-#include <gp_Circ.hxx>
-#include <gp_Parab.hxx>
-
-#include <sse/Settings.hpp>
-
-// start off with a buffer size of 1MB
-#define INITIAL_GCODE_SIZE 1048576
+#pragma once
+// stl headers
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+// project headers
+#include "sse/GCodeBuffer.hpp"
+#include "sse/GCodeDialect.hpp"
+#include "sse/GCodeNumber.hpp"
+#include "sse/Subroutines.hpp"
+#include "sse/Toolpath.hpp"
+#include "sse/libsse_export.hpp"
 
 namespace sse {
 
-class GCodeWriter{
+/**
+ * @brief How much modal state GCodeWriter relies on
+ */
+enum class ModalMode : std::uint8_t {
+  //! every word is written
+  off,
+  //! unchanged axes, extruder position and feedrate are omitted; supported by every firmware
+  words,
+  //! also omit a motion command that repeats the previous one, e.g. LinuxCNC and grbl. Not supported by Marlin
+  commands
+};
+
+/**
+ * @brief The BasicGCodeWriter class
+ *
+ * Writes motion commands to a GCodeBuffer, tracking the modal state of the
+ * machine: the motion mode (G0-G3, G5), feedrate, and the position of each axis
+ * as it was written, i.e. after rounding to the precision. With a modal
+ * mode, words that wouldn't change that state are omitted, and so are
+ * commands left without any words. Arc centers (I, J) and bezier control
+ * points (I, J, P, Q) are incremental, so they are always written.
+ *
+ * Text appended with append() can change the state, so the writer forgets
+ * it, and writes every word of the next command.
+ *
+ * The dialect is a policy, see GCodeDialect.hpp; the writer is compiled
+ * once per dialect, and instantiated for every dialect in Dialect.
+ */
+template <typename Dialect> class LIBSSE_EXPORT BasicGCodeWriter {
 
 public:
-    GCodeWriter();
-
-    /**
-     * @brief Create the comment header for the program
-     */
-    void create_header();
-
-    /**
-     * @brief Add a comment line to the program
-     * @param comment
-     */
-    inline void add_comment(const std::string &comment) {data.append(";" + comment);}
-
-    /**
-     * @brief Add a rapid move to the program
-     * @param x
-     * @param y
-     * @param z
-     */
-    void add_rapid(double x, double y, double z);
-    std::string add_rapid(gp_Pnt destination);
-
-    /**
-     * @brief Add a linear move to the program
-     * @param l
-     */
-    std::string add_line(Geom_Line l);
-    std::string add_line(Handle(Geom_Line) l);
-    std::string add_line(gp_Lin l);
-
-    /**
-     * @brief Generate a valid arc move for the program
-     * @param c
-     */
-    std::string add_arc(Handle(Geom_Circle) c);
-
-    void add_bezier(Geom_BezierCurve b);
-
-    void add_bslpine(Geom_BSplineCurve b);
-
-    void add_nurbs();
-
-    std::string add_segment(GeomAdaptor_Curve c);
-    std::string add_segment(Handle(Geom_Curve) c);
-    std::string add_segment(Geom_TrimmedCurve c);
-
-    void add_wire(TopoDS_Wire w);
-    void retract(double distance);
-    void purge();
-    inline std::string get_data() {return this->data;}
+  using dialect = Dialect;
+
+  /**
+   * @brief Create a writer
+   * @param out Buffer to write to
+   * @param precision Decimal places of each kind of word
+   * @param mode Modal words to omit
+   */
+  explicit BasicGCodeWriter(GCodeBuffer &out, GCodePrecision precision = {},
+                            ModalMode mode = ModalMode::off) noexcept;
+
+  [[nodiscard]] inline const GCodePrecision &precision() const noexcept {
+    return number_precision;
+  }
+
+  [[nodiscard]] inline ModalMode mode() const noexcept {
+    return modal_mode;
+  }
+
+  /**
+   * @brief extruder_axis Letter of the axis the extruder moves, Dialect::extruder_axis unless set
+   */
+  [[nodiscard]] inline char extruder_axis() const noexcept {
+    return extruder_letter;
+  }
+
+  /**
+   * @brief set_extruder_axis Move the extruder as another axis, e.g. U
+   * @param axis A, B, C, U, V or W
+   * @throw invalid_argument if the axis isn't one of those, or the dialect has an E axis
+   */
+  void set_extruder_axis(char axis);
+
+  /**
+   * @brief buffer Buffer the writer writes to
+   *
+   * n.b. text written directly must not change the state of the machine,
+   * and must follow the dialect. Otherwise use append()
+   */
+  [[nodiscard]] inline GCodeBuffer &buffer() noexcept {
+    return out;
+  }
+
+  /**
+   * @brief linear Extruding linear move, G1
+   * @param x, y End point
+   * @param e Extruder position
+   * @param f Feedrate
+   */
+  void linear(double x, double y, double e, double f);
+
+  /**
+   * @brief arc Extruding arc move, G2/G3
+   *
+   * Written as lines if the dialect doesn't support arcs
+   *
+   * @param clockwise G2 if true, G3 otherwise
+   * @param x, y End point
+   * @param i, j Center, relative to the start point
+   * @param e Extruder position
+   * @param f Feedrate
+   */
+  void arc(bool clockwise, double x, double y, double i, double j, double e, double f);
+
+  /**
+   * @brief bezier Extruding cubic bezier move, G5
+   *
+   * Written as lines if the dialect doesn't support splines, with the
+   * extruder position in proportion to the length of each line
+   *
+   * @param x, y End point
+   * @param controls Control points, see BezierControls
+   * @param e Extruder position
+   * @param f Feedrate
+   */
+  void bezier(double x, double y, const BezierControls &controls, double e, double f);
+
+  /**
+   * @brief travel Rapid move in XY, G0
+   */
+  void travel(double x, double y);
+
+  /**
+   * @brief travel_z Rapid move in Z, G0
+   * @param z Z position
+   * @param f Feedrate, or the current feedrate if empty
+   */
+  void travel_z(double z, std::optional<double> f = std::nullopt);
+
+  /**
+   * @brief extrude Move only the extruder, e.g. retraction, G1
+   * @param e Extruder position
+   * @param f Feedrate
+   */
+  void extrude(double e, double f);
+
+  /**
+   * @brief reset_extruder Set the extruder position to 0, G92 E0, or the extruder axis
+   *
+   * Nothing is written with relative extrusion
+   */
+  void reset_extruder();
+
+  /**
+   * @brief layer Start a layer
+   *
+   * Forgets the modal state, writes a ;LAYER: comment, and restarts line
+   * numbers, so the output of a layer doesn't depend on earlier layers.
+   *
+   * @param number Layer number
+   */
+  void layer(std::size_t number);
+
+  /**
+   * @brief comment Append text that doesn't change the state of the machine
+   * @param text Comment lines, including the ';' and newline; converted to the comment style
+   */
+  void comment(std::string_view text);
+
+  /**
+   * @brief append Append arbitrary gcode, e.g. a header, and forget the modal state
+   *
+   * Comments are converted to the comment style, and commands are numbered
+   * if the dialect has line numbers.
+   */
+  void append(std::string_view text);
+
+  /**
+   * @brief subroutine Define a subroutine, o<number> sub ... o<number> endsub
+   *
+   * The modal state is forgotten before and after the body, so the body is
+   * the same wherever it's called from.
+   *
+   * @param number Subroutine number
+   * @param body Moves, relative to the offset the subroutine is called with
+   * @throw invalid_argument if the dialect doesn't have subroutines
+   */
+  void subroutine(std::size_t number, const Toolpath &body);
+
+  /**
+   * @brief call Call a subroutine with an offset, G52 ... o<number> call
+   *
+   * The offset is cancelled afterwards, and the modal state forgotten.
+   *
+   * @param number Subroutine number
+   * @param x, y, z Offset, i.e. the position before the subroutine's first move
+   * @throw invalid_argument if the dialect doesn't have subroutines
+   */
+  void call(std::size_t number, double x, double y, double z);
+
+  /**
+   * @brief invalidate Forget the modal state, so the next command writes every word
+   *
+   * With relative extrusion, the extruder position is kept.
+   */
+  void invalidate() noexcept;
+
 private:
-    std::map<double,std::vector<std::string>> data_map;
-    std::string data;
-    sse::Settings &config;
-    void move_pre(GeomAdaptor_Curve c);
+  //! position of each axis and feedrate, as written; empty if unknown
+  struct State {
+    std::optional<int> motion;
+    std::optional<double> x;
+    std::optional<double> y;
+    std::optional<double> z;
+    //! n.b. the absolute extruder position, even with relative extrusion
+    std::optional<double> e;
+    std::optional<double> f;
+  };
+
+  GCodeBuffer &out;
+  GCodePrecision number_precision;
+  ModalMode modal_mode;
+  char extruder_letter = Dialect::extruder_axis;
+  State state;
+  //! number of the next line, if the dialect has line numbers
+  std::uint64_t line_number = 0;
+
+  /**
+   * @brief position Position as it was written
+   * @param e Extruder position to use if it's unknown
+   * @return x, y and extruder position, or empty if x or y is unknown
+   */
+  [[nodiscard]] std::optional<std::array<double, 3>> position(double e) const;
+
+  /**
+   * @brief start Start a motion command, omitting the command if it's modal
+   * @param motion Motion mode, 0-3 or 5
+   */
+  [[nodiscard]] GCodeLine start(int motion) const;
+
+  /**
+   * @brief word Append a word, unless it's modal and unchanged
+   * @param value Value of the word
+   * @param precision Decimal places of the word
+   * @param current Current value of the word, in units of the precision; updated if the word is written
+   * @return true if the word was written
+   */
+  bool word(GCodeLine &line, char letter, double value, int precision, std::optional<double> &current) const;
+
+  /**
+   * @brief extruder_word Append the extruder axis' word, converted to the extrusion mode
+   * @param e Extruder position
+   * @return true if the word was written
+   */
+  bool extruder_word(GCodeLine &line, double e);
+
+  /**
+   * @brief finish Write a motion command
+   * @param motion Motion mode of the command
+   * @param written At least one word was written; otherwise the command is skipped
+   */
+  void finish(const GCodeLine &line, int motion, bool written);
+
+  /**
+   * @brief write_line Write a command, numbered if the dialect has line numbers
+   * @param line Command, including the newline
+   */
+  void write_line(std::string_view line);
 };
 
-}
+//! writer for the default dialect
+using GCodeWriter = BasicGCodeWriter<Marlin>;
+
+/**
+ * @brief write_toolpath Write the moves of a toolpath as gcode
+ *
+ * Each feature starts with a ;TYPE: comment.
+ *
+ * @param path Toolpath
+ * @param out Writer to append the gcode to
+ */
+template <typename Dialect> LIBSSE_EXPORT void write_toolpath(const Toolpath &path, BasicGCodeWriter<Dialect> &out);
+
+/**
+ * @brief write_toolpath Write the moves of a toolpath, with repeated moves replaced by subroutine calls
+ *
+ * Subroutine n is called as o<n + 1>, see find_subroutines().
+ *
+ * @param path Toolpath
+ * @param calls Calls into the toolpath, in order
+ * @param out Writer to append the gcode to
+ */
+template <typename Dialect>
+LIBSSE_EXPORT void write_toolpath(const Toolpath &path, const std::vector<SubroutineCall> &calls,
+                                  BasicGCodeWriter<Dialect> &out);
+
+// compiled in GCodeWriter.cpp
+extern template class BasicGCodeWriter<Marlin>;
+extern template class BasicGCodeWriter<MarlinNumbered>;
+extern template class BasicGCodeWriter<Klipper>;
+extern template class BasicGCodeWriter<LinuxCNC>;
+extern template class BasicGCodeWriter<Machinekit>;
+extern template class BasicGCodeWriter<Redeem>;
+
+} // namespace sse
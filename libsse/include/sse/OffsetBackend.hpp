@@ -0,0 +1,109 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file OffsetBackend.hpp
+ * @brief Algorithms for offsetting the outline of a slice into shells
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <memory>
+#include <string>
+#include <vector>
+// OCCT headers
+#include <TopoDS_Face.hxx>
+// project headers
+#include "sse/Slice.hpp"
+#include "sse/libsse_export.hpp"
+
+#define SSE_FALLBACK_OFFSET_BACKEND "cavc"
+
+namespace sse {
+
+/**
+ * @brief Interface for shell offset algorithms
+ *
+ * n.b. implementations must be stateless, so one instance can be shared by
+ * every slice
+ */
+class LIBSSE_EXPORT OffsetBackend {
+
+public:
+  virtual ~OffsetBackend() = default;
+
+  /**
+   * @brief offset Offset the outline of a slice inwards
+   * @param face Planar face that the outline was extracted from, may be null if the slice released it
+   * @param outline Outline of the face; counter-clockwise outer loop, clockwise islands
+   * @param distances Offset distances (mm), positive is inwards
+   * @return One shell per distance
+   * @throw invalid_argument if an offset doesn't have exactly one outer loop
+   */
+  [[nodiscard]] virtual std::vector<Shell> offset(const TopoDS_Face &face, const Shell &outline,
+                                                  const std::vector<double> &distances) const = 0;
+
+  /**
+   * @brief name Name of the backend, as used in settings
+   */
+  [[nodiscard]] virtual const char *name() const noexcept = 0;
+};
+
+/**
+ * @brief Offset the flattened outline with CavalierContours
+ */
+class LIBSSE_EXPORT CavcOffsetBackend : public OffsetBackend {
+
+public:
+  [[nodiscard]] std::vector<Shell> offset(const TopoDS_Face &face, const Shell &outline,
+                                          const std::vector<double> &distances) const override;
+
+  [[nodiscard]] inline const char *name() const noexcept override {
+    return "cavc";
+  }
+};
+
+/**
+ * @brief Offset the face with BRepOffsetAPI_MakeOffset, and flatten the result
+ *
+ * The offset is computed on the exact geometry, so free-form curves are only
+ * approximated once, at the end.
+ */
+class LIBSSE_EXPORT OcctOffsetBackend : public OffsetBackend {
+
+public:
+  [[nodiscard]] std::vector<Shell> offset(const TopoDS_Face &face, const Shell &outline,
+                                          const std::vector<double> &distances) const override;
+
+  [[nodiscard]] inline const char *name() const noexcept override {
+    return "occt";
+  }
+};
+
+/**
+ * @brief make_offset_backend Create an offset backend by name
+ * @param name "cavc" or "occt"
+ * @return Offset backend
+ * @throw invalid_argument if there is no backend with that name
+ */
+[[nodiscard]] LIBSSE_EXPORT std::unique_ptr<OffsetBackend> make_offset_backend(const std::string &name);
+
+} // namespace sse
@@ -0,0 +1,229 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file PathStore.hpp
+ * @brief Compact storage for the paths of a slice
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <cstdint>
+#include <vector>
+// external headers
+#include "cavc/polyline.hpp"
+// project headers
+#include "sse/FixedPoint.hpp"
+#include "sse/libsse_export.hpp"
+
+namespace sse {
+
+#if defined(SSE_FIXED_POINT) && defined(SSE_COMPACT_PATHS)
+#error "SSE_FIXED_POINT and SSE_COMPACT_PATHS are mutually exclusive"
+#endif
+
+#if defined(SSE_FIXED_POINT)
+//! integer nm, see FixedPoint.hpp
+using path_coordinate = std::int64_t;
+using path_bulge = double;
+#elif defined(SSE_COMPACT_PATHS)
+//! single precision is accurate to ~0.03um at 500mm from the origin
+using path_coordinate = float;
+using path_bulge = float;
+#else
+using path_coordinate = double;
+using path_bulge = double;
+#endif
+
+/**
+ * @brief What a path is used for
+ */
+enum class PathKind : std::uint8_t {
+  //! boundary of the slice
+  outline,
+  //! shell, i.e. perimeter
+  wall,
+  //! boundary that infill is clipped to
+  infill_boundary,
+  //! infill
+  infill
+};
+
+/**
+ * @brief Kinds of segment in a path, so loops over the segments can be specialized
+ */
+enum class PathShape : std::uint8_t {
+  //! only line segments, i.e. a polygon
+  lines,
+  //! only arcs
+  arcs,
+  //! lines and arcs
+  mixed
+};
+
+/**
+ * @brief Location and attributes of one path in a PathStore
+ */
+struct LIBSSE_EXPORT PathInfo {
+  //! index of the first vertex
+  std::uint32_t begin;
+  //! index past the last vertex
+  std::uint32_t end;
+  PathKind kind;
+  //! segment kinds, classified when the path is added
+  PathShape shape;
+  //! closed loop
+  bool closed;
+  //! clockwise loop inside the outer loop
+  bool island;
+  //! shell number, for walls
+  std::uint16_t shell;
+
+  [[nodiscard]] inline std::size_t size() const noexcept {
+    return end - begin;
+  }
+};
+
+/**
+ * @brief The PathStore class
+ *
+ * Stores every vertex of a slice's paths contiguously, as separate x, y and
+ * bulge arrays, with a table of where each path starts and ends. This
+ * replaces a heap allocation per polyline with a handful per slice.
+ *
+ * Build with SSE_COMPACT_PATHS to store single precision coordinates, or
+ * with SSE_FIXED_POINT to snap coordinates to a 1nm integer grid. Coordinates
+ * are converted back to mm as they're read.
+ */
+class LIBSSE_EXPORT PathStore {
+
+public:
+  /**
+   * @brief add Append a path
+   * @param pline Path to append. Empty paths are skipped
+   * @param kind What the path is used for
+   * @param island Path is an island of a shell
+   * @param shell Shell number
+   */
+  void add(const cavc::Polyline<double> &pline, PathKind kind, bool island = false, std::uint16_t shell = 0);
+
+  /**
+   * @brief erase Remove every path of a kind
+   * @param kind Kind of path to remove
+   */
+  void erase(PathKind kind);
+
+  /**
+   * @brief clear Remove every path
+   */
+  void clear() noexcept;
+
+  /**
+   * @brief shrink_to_fit Release unused capacity
+   */
+  void shrink_to_fit();
+
+  /**
+   * @brief polyline Copy a path into a polyline
+   * @param path Index of path
+   * @return Polyline
+   */
+  [[nodiscard]] cavc::Polyline<double> polyline(std::size_t path) const;
+
+  /**
+   * @brief size Number of paths
+   */
+  [[nodiscard]] inline std::size_t size() const noexcept {
+    return paths.size();
+  }
+
+  [[nodiscard]] inline bool empty() const noexcept {
+    return paths.empty();
+  }
+
+  /**
+   * @brief vertex_count Number of vertices in every path
+   */
+  [[nodiscard]] inline std::size_t vertex_count() const noexcept {
+    return xs.size();
+  }
+
+  /**
+   * @brief info Location and attributes of a path
+   * @param path Index of path
+   */
+  [[nodiscard]] inline const PathInfo &info(std::size_t path) const noexcept {
+    return paths[path];
+  }
+
+  /**
+   * @brief vertex Get a vertex
+   * @param i Index of vertex, see PathInfo::begin
+   */
+  [[nodiscard]] inline double x(std::size_t i) const noexcept {
+#ifdef SSE_FIXED_POINT
+    return from_fixed(xs[i]);
+#else
+    return static_cast<double>(xs[i]);
+#endif
+  }
+
+  [[nodiscard]] inline double y(std::size_t i) const noexcept {
+#ifdef SSE_FIXED_POINT
+    return from_fixed(ys[i]);
+#else
+    return static_cast<double>(ys[i]);
+#endif
+  }
+
+  [[nodiscard]] inline cavc::PlineVertex<double> vertex(std::size_t i) const noexcept {
+#ifdef SSE_FIXED_POINT
+    return {from_fixed(xs[i]), from_fixed(ys[i]), bulges[i]};
+#else
+    return {static_cast<double>(xs[i]), static_cast<double>(ys[i]), static_cast<double>(bulges[i])};
+#endif
+  }
+
+  //! raw vertex arrays, for batch processing
+  [[nodiscard]] inline const path_coordinate *x_data() const noexcept {
+    return xs.data();
+  }
+  [[nodiscard]] inline const path_coordinate *y_data() const noexcept {
+    return ys.data();
+  }
+  [[nodiscard]] inline const path_bulge *bulge_data() const noexcept {
+    return bulges.data();
+  }
+
+  /**
+   * @brief memory_usage Heap memory held by the store
+   * @return size in bytes
+   */
+  [[nodiscard]] std::size_t memory_usage() const noexcept;
+
+private:
+  std::vector<path_coordinate> xs;
+  std::vector<path_coordinate> ys;
+  std::vector<path_bulge> bulges;
+  std::vector<PathInfo> paths;
+};
+
+} // namespace sse
@@ -0,0 +1,91 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Segments.hpp
+ * @brief Batch computation of segment lengths, extrusion and arc centers
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <utility>
+#include <vector>
+// project headers
+#include "sse/PathStore.hpp"
+#include "sse/libsse_export.hpp"
+
+namespace sse {
+
+/**
+ * @brief Per segment results for one path, in the order the segments are printed
+ *
+ * Structure of arrays, filled by compute_segments().
+ */
+struct LIBSSE_EXPORT SegmentBatch {
+  //! segment length (mm)
+  std::vector<double> length;
+  //! cumulative extrusion at the end of the segment (mm of filament)
+  std::vector<double> extrusion;
+  //! arc center relative to the start of the segment, i.e. G2/G3 I and J; zero for lines
+  std::vector<double> center_i;
+  std::vector<double> center_j;
+
+  [[nodiscard]] inline std::size_t size() const noexcept {
+    return length.size();
+  }
+};
+
+/**
+ * @brief segment_vertices Vertices of a segment of a path
+ *
+ * Segments are printed in the same order as cavc::Polyline::visitSegIndices,
+ * i.e. closed paths start with the closing segment.
+ *
+ * @param path Path
+ * @param k Index of the segment, in printing order
+ * @return Indices of the start and end vertex
+ */
+[[nodiscard]] inline std::pair<std::size_t, std::size_t> segment_vertices(const PathInfo &path,
+                                                                          std::size_t k) noexcept {
+  if (path.closed) {
+    if (k == 0) {
+      return {path.end - 1, path.begin};
+    }
+    --k;
+  }
+  return {path.begin + k, path.begin + k + 1};
+}
+
+/**
+ * @brief compute_segments Compute the length, cumulative extrusion and arc center of every segment of a path
+ *
+ * The lengths of straight paths are computed with SIMD instructions where
+ * available (AVX, or SSE2), with a scalar fallback.
+ *
+ * @param paths Path storage
+ * @param path Path with at least 2 vertices
+ * @param extrusion_ratio Filament extruded per mm of path
+ * @param batch Results. Existing storage is reused
+ */
+LIBSSE_EXPORT void compute_segments(const PathStore &paths, const PathInfo &path, double extrusion_ratio,
+                                    SegmentBatch &batch);
+
+} // namespace sse
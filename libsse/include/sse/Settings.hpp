@@ -21,6 +21,7 @@
 // std headers
 #include <filesystem>
 #include <cstdarg>
+#include <string>
 // external headers
 #include <toml.hpp>
 // project headers
@@ -54,12 +55,25 @@ public:
 
   /**
    * @brief Get a setting by name, with a designated fallback
-   * @param setting Setting name
+   * @param setting Setting name. Dots select nested tables, e.g. "printer.extruder_1.retraction_distance"
    * @param fallback Fallback value
    * @return return Setting if it exists, fallback otherwise
    */
   template <typename T> [[nodiscard]] T get_setting_fallback(const std::string& setting, const T& fallback) {
-    return toml::find_or(root, setting, fallback);
+    const toml::value *node = &root;
+    std::size_t begin = 0;
+    for (auto dot = setting.find('.'); dot != std::string::npos; dot = setting.find('.', begin)) {
+      const auto table = setting.substr(begin, dot - begin);
+      if (!node->is_table() || !node->contains(table)) {
+        return fallback;
+      }
+      node = &node->at(table);
+      begin = dot + 1;
+    }
+    if (!node->is_table()) {
+      return fallback;
+    }
+    return toml::find_or(*node, setting.substr(begin), fallback);
   }
 
   /**
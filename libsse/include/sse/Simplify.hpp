@@ -0,0 +1,96 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Simplify.hpp
+ * @brief Reduce the number of vertices in a polyline, within a tolerance
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// std headers
+#include <cstddef>
+#include <vector>
+// external headers
+#include "cavc/polyline.hpp"
+// project headers
+#include "sse/libsse_export.hpp"
+
+#define SSE_FALLBACK_SIMPLIFY_OUTER_WALL 0.005
+#define SSE_FALLBACK_SIMPLIFY_INNER_WALL 0.01
+#define SSE_FALLBACK_SIMPLIFY_INFILL_BOUNDARY 0.02
+
+namespace sse {
+
+/**
+ * @brief Simplification tolerance per feature (mm), 0 to disable
+ */
+struct LIBSSE_EXPORT SimplifySettings {
+  //! outline of the slice, which all shells are offset from
+  double outer_wall = SSE_FALLBACK_SIMPLIFY_OUTER_WALL;
+  //! shells other than the outermost
+  double inner_wall = SSE_FALLBACK_SIMPLIFY_INNER_WALL;
+  //! boundary that infill is clipped to
+  double infill_boundary = SSE_FALLBACK_SIMPLIFY_INFILL_BOUNDARY;
+};
+
+/**
+ * @brief merge_collinear Remove vertices between collinear line segments, and duplicate vertices
+ * @param pline Polyline to simplify, modified in place
+ */
+LIBSSE_EXPORT void merge_collinear(cavc::Polyline<double> &pline);
+
+/**
+ * @brief refit_arcs Replace runs of short line segments that lie on a circle with a single arc
+ * @param pline Polyline to simplify, modified in place
+ * @param tolerance Maximum distance between the line segments and the arc (mm)
+ */
+LIBSSE_EXPORT void refit_arcs(cavc::Polyline<double> &pline, double tolerance);
+
+/**
+ * @brief refit_arcs Replace runs of short line segments that lie on a circle with a single arc
+ * @param pline Polyline to simplify, modified in place
+ * @param tolerance Maximum distance between the line segments and the arc (mm)
+ * @param sources Set to the index of each remaining vertex in the original polyline
+ */
+LIBSSE_EXPORT void refit_arcs(cavc::Polyline<double> &pline, double tolerance, std::vector<std::size_t> &sources);
+
+/**
+ * @brief douglas_peucker Remove vertices from runs of line segments with the Douglas-Peucker algorithm
+ *
+ * Arcs are left untouched, and their end points are kept.
+ *
+ * @param pline Polyline to simplify, modified in place
+ * @param tolerance Maximum distance between a removed vertex and the resulting line (mm)
+ */
+LIBSSE_EXPORT void douglas_peucker(cavc::Polyline<double> &pline, double tolerance);
+
+/**
+ * @brief simplify Run all simplification stages on a polyline
+ *
+ * Closed polylines are rotated to start at a corner, or at the end of an
+ * arc, since the first vertex is never removed.
+ *
+ * @param pline Polyline to simplify, modified in place
+ * @param tolerance Maximum deviation from the original polyline (mm). No-op if <= 0
+ */
+LIBSSE_EXPORT void simplify(cavc::Polyline<double> &pline, double tolerance);
+
+} // namespace sse
@@ -27,20 +27,31 @@
 #pragma once
 // OCCT headers
 #include <TopTools_HSequenceOfShape.hxx>
-#include <TopTools_ListOfShape.hxx>
 #include <TopoDS_Face.hxx>
 #include <TopoDS_Wire.hxx>
 // stl headers
+#include <optional>
 #include <vector>
 // external headers
 #include <spdlog/spdlog.h>
 #include "cavc/polylineoffsetislands.hpp"
 // project headers
+#include "sse/GCodeWriter.hpp"
 #include "sse/Object.hpp"
+#include "sse/PathStore.hpp"
+#include "sse/Simplify.hpp"
 #include "sse/libsse_export.hpp"
 
+#define SSE_FALLBACK_RETRACTION_DISTANCE 1.0
+#define SSE_FALLBACK_RETRACTION_SPEED 40.0
+#define SSE_FALLBACK_Z_HOP 0.0
+
 namespace sse {
 
+  class EdgeCache;
+  class OffsetBackend;
+  struct ToolpathScratch;
+
   // this struct simply cuts out the spatial index from the offsetloopset, because the former has a unique_ptr, thus can't be copied
   // TODO: figure out a better solution to this problem
   struct LIBSSE_EXPORT Shell {
@@ -65,8 +76,22 @@ namespace sse {
     std::vector<cavc::Polyline<double>> islands;
   };
 
+  /**
+   * @brief Settings for travel moves between toolpaths
+   */
+  struct LIBSSE_EXPORT TravelSettings {
+    //! length of filament to retract before a travel that crosses the outline (mm), 0 to disable
+    double retraction_distance = SSE_FALLBACK_RETRACTION_DISTANCE;
+    //! retraction feedrate (mm/min)
+    double retraction_speed = SSE_FALLBACK_RETRACTION_SPEED * 60;
+    //! lift the nozzle by this much while retracted (mm), 0 to disable
+    double z_hop = SSE_FALLBACK_Z_HOP;
+  };
+
 /**
  * @brief The Slice class
+ *
+ * Slices own all of their toolpaths, so they can be moved but not copied.
  */
 class LIBSSE_EXPORT Slice {
 
@@ -79,14 +104,29 @@ public:
    */
   explicit Slice(const Object *parent, TopoDS_Face face, double thickness);
 
+  Slice(const Slice &) = delete;
+  Slice &operator=(const Slice &) = delete;
+  Slice(Slice &&) = default;
+  Slice &operator=(Slice &&) = default;
+  ~Slice() = default;
+
 
   /**
    * @brief Generate shells for the slice
+   *
+   * The face is released once its outline has been extracted, calling this
+   * again offsets the stored outline.
+   *
    * @param num_shells Number of shells (offsets) to generate
    * @param line_width Extrusion width (mm)
    * @param overlap Ratio of overlap between innermost shell and infill. 0 = no overlap, -1.0 = 1x line_width gap
+   * @param simplify Tolerances for removing vertices from the outline and shells
+   * @param backend Offset algorithm, defaults to CavcOffsetBackend if null
+   * @param edges Edges flattened for other faces, which are shared with this face's wires. Optional, see EdgeCache
    */
-  void generate_shells(const int num_shells, const double line_width, const double overlap = 0.0);
+  void generate_shells(const int num_shells, const double line_width, const double overlap = 0.0,
+                       const SimplifySettings &simplify = {}, const OffsetBackend *backend = nullptr,
+                       EdgeCache *edges = nullptr);
 
   /**
    * @brief Generate infill for the slice
@@ -115,24 +155,95 @@ public:
 
   /**
    * @brief gcode Return gcode representation
+   *
+   * Travels between toolpaths are routed inside the outline of the slice
+   * where possible; the remaining travels retract.
+   *
+   * @param filament_diameter Filament diameter (mm)
+   * @param extrusion_width Extrusion width (mm)
+   * @param extrusion_multiplier Extrusion multiplier
+   * @param travel Retraction settings
+   * @param from Position of the nozzle before the slice, if known
    * @return GCode representation of moves
    */
-  [[nodiscard]] std::string gcode(double extrusion_multiplier, double extrusion_width, double filament_diameter) const;
+  [[nodiscard]] std::string gcode(double filament_diameter, double extrusion_width, double extrusion_multiplier,
+                                  const TravelSettings &travel = {},
+                                  const std::optional<cavc::Vector2<double>> &from = std::nullopt) const;
+
+  /**
+   * @brief write_gcode Write gcode representation
+   *
+   * Same as gcode(), without building a string
+   *
+   * @param out Writer to append the gcode to
+   * @param filament_diameter Filament diameter (mm)
+   * @param extrusion_width Extrusion width (mm)
+   * @param extrusion_multiplier Extrusion multiplier
+   * @param travel Retraction settings
+   * @param from Position of the nozzle before the slice, if known
+   */
+  void write_gcode(GCodeWriter &out, double filament_diameter, double extrusion_width, double extrusion_multiplier,
+                   const TravelSettings &travel = {},
+                   const std::optional<cavc::Vector2<double>> &from = std::nullopt) const;
+
+  /**
+   * @brief toolpath Append the moves of the slice to a toolpath
+   *
+   * The moves gcode() is written from, for emitters other than gcode text,
+   * or to write the same moves more than once.
+   *
+   * @param out Toolpath to append the moves to
+   * @param filament_diameter Filament diameter (mm)
+   * @param extrusion_width Extrusion width (mm)
+   * @param extrusion_multiplier Extrusion multiplier
+   * @param travel Retraction settings
+   * @param from Position of the nozzle before the slice, if known
+   */
+  void toolpath(Toolpath &out, double filament_diameter, double extrusion_width, double extrusion_multiplier,
+                const TravelSettings &travel = {},
+                const std::optional<cavc::Vector2<double>> &from = std::nullopt) const;
+
+  /**
+   * @brief toolpath Append the moves of the slice to a toolpath, reusing storage between slices
+   * @param scratch Travel planner and segment storage, e.g. one per thread
+   */
+  void toolpath(Toolpath &out, double filament_diameter, double extrusion_width, double extrusion_multiplier,
+                const TravelSettings &travel, const std::optional<cavc::Vector2<double>> &from,
+                ToolpathScratch &scratch) const;
+
+  /**
+   * @brief entry_point Position of the first move of the slice's toolpath
+   * @return Entry point, or nothing if the slice has no toolpath
+   */
+  [[nodiscard]] std::optional<cavc::Vector2<double>> entry_point() const;
+
+  /**
+   * @brief exit_point Position of the last move of the slice's toolpath
+   * @return Exit point, or nothing if the slice has no toolpath
+   */
+  [[nodiscard]] std::optional<cavc::Vector2<double>> exit_point() const;
+
+  /**
+   * @brief get_shells Get the shells, outermost first
+   * @return copy of the shells
+   */
+  [[nodiscard]] std::vector<Shell> get_shells() const;
+
+  /**
+   * @brief get_paths Get the outline, shells and infill of the slice
+   */
+  [[nodiscard]] inline const PathStore &get_paths() const noexcept {
+    return paths;
+  }
 
 
 private:
   //! Parent object, from which this slice was created
   const Object *parent;
-  //! face
+  //! face, null after generate_shells()
   TopoDS_Face face;
-  //! list of wires
-  TopTools_ListOfShape wires;
-  //! list of offsets
-  std::vector<Shell> shells;
-  //! innermost polyline(s), used for clipping infill
-  Shell innermost_shell;
-  //! infill
-  std::vector<cavc::Polyline<double>> infill_polylines;
+  //! outline, shells, infill boundary and infill
+  PathStore paths;
   //! z height
   double z;
   //! thickness, same as layer height
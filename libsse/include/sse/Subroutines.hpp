@@ -0,0 +1,94 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Subroutines.hpp
+ * @brief Find repeated toolpaths, so they can be written once as subroutines
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <cstddef>
+#include <vector>
+// project headers
+#include "sse/GCodeNumber.hpp"
+#include "sse/Toolpath.hpp"
+#include "sse/libsse_export.hpp"
+
+//! shorter repeats aren't worth a subroutine call
+#define SSE_FALLBACK_SUBROUTINE_MIN_MOVES 32
+
+namespace sse {
+
+/**
+ * @brief A run of moves of a layer that is replaced by a subroutine call
+ */
+struct LIBSSE_EXPORT SubroutineCall {
+  //! index of the first move replaced
+  std::size_t begin;
+  //! index past the last move replaced
+  std::size_t end;
+  //! index of the subroutine, see Subroutines::bodies
+  std::size_t subroutine;
+  //! offset the subroutine is called with, i.e. the position before the first move
+  double x;
+  double y;
+  double z;
+};
+
+/**
+ * @brief Repeated toolpaths, see find_subroutines()
+ */
+struct LIBSSE_EXPORT Subroutines {
+  //! moves of each subroutine, relative to the offset it's called with
+  std::vector<Toolpath> bodies;
+  //! calls in each layer, in order
+  std::vector<std::vector<SubroutineCall>> calls;
+
+  /**
+   * @brief call_count Number of calls in every layer
+   */
+  [[nodiscard]] std::size_t call_count() const noexcept;
+};
+
+/**
+ * @brief find_subroutines Find the slices of toolpaths that repeat, modulo a translation
+ *
+ * Each slice's moves start with an outer wall feature (see
+ * Slice::toolpath()), then a travel from wherever the previous slice ended,
+ * then moves that only depend on the slice: the extruder is reset before
+ * every extrusion. Those moves are compared, relative to the position and
+ * layer height they start at, after rounding to the precision they would be
+ * written with. Moves that are found more than once, e.g. identical copies
+ * of an object, or the layers of a prism, become a subroutine, and every
+ * occurrence a call.
+ *
+ * @param layers Toolpath of each layer, from generate_toolpaths()
+ * @param precision Decimal places the moves are written with
+ * @param min_moves Slices with fewer moves than this are always written in place
+ * @return Subroutines and calls; there is a list of calls for every layer
+ */
+[[nodiscard]] LIBSSE_EXPORT Subroutines find_subroutines(const std::vector<ToolpathLayer> &layers,
+                                                         const GCodePrecision &precision = {},
+                                                         std::size_t min_moves = SSE_FALLBACK_SUBROUTINE_MIN_MOVES);
+
+} // namespace sse
@@ -0,0 +1,394 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Toolpath.hpp
+ * @brief Typed moves between slicing and gcode output
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+// project headers
+#include "sse/libsse_export.hpp"
+
+#define SSE_FALLBACK_ARC_TOLERANCE 0.0
+#define SSE_FALLBACK_SPLINE_TOLERANCE 0.0
+
+namespace sse {
+
+/**
+ * @brief Kind of move in a Toolpath
+ */
+enum class MoveType : std::uint8_t {
+  //! rapid move in XY
+  travel,
+  //! rapid move in Z; x is the Z position
+  travel_z,
+  //! extruding linear move
+  line,
+  //! extruding clockwise arc
+  arc_cw,
+  //! extruding counter-clockwise arc
+  arc_ccw,
+  //! extruding cubic bezier
+  bezier,
+  //! extruder only move, i.e. retraction or priming
+  retract,
+  //! set the extruder position to 0
+  reset_extruder,
+  //! start of a feature, see ToolpathMove::feature
+  feature
+};
+
+/**
+ * @brief What the moves of a toolpath are printing
+ */
+enum class Feature : std::uint8_t {
+  //! before the first feature, e.g. layer changes
+  none,
+  //! outermost shell
+  outer_wall,
+  //! other shells
+  inner_wall,
+  //! infill
+  fill
+};
+
+/**
+ * @brief One move of a Toolpath
+ *
+ * Fields that a type of move doesn't use are 0, or NaN for the feedrate.
+ */
+struct LIBSSE_EXPORT ToolpathMove {
+  //! end point; x is the Z position for travel_z
+  double x;
+  double y;
+  //! extruder position
+  double e;
+  //! feedrate, NaN to keep the current feedrate
+  double f;
+  //! index of the arc center, for arcs, see Toolpath::center(); or of the control points, for beziers
+  std::uint32_t arc;
+  MoveType type;
+  //! feature the move belongs to
+  Feature feature;
+
+  [[nodiscard]] inline bool is_arc() const noexcept {
+    return type == MoveType::arc_cw || type == MoveType::arc_ccw;
+  }
+
+  [[nodiscard]] inline bool is_extrusion() const noexcept {
+    return type == MoveType::line || is_arc() || type == MoveType::bezier;
+  }
+
+  [[nodiscard]] inline std::optional<double> feedrate() const noexcept {
+    return std::isnan(f) ? std::nullopt : std::optional<double>(f);
+  }
+};
+
+/**
+ * @brief Center of an arc, relative to its start point
+ */
+struct LIBSSE_EXPORT ArcCenter {
+  double i;
+  double j;
+};
+
+/**
+ * @brief Control points of a cubic bezier, as written by G5
+ */
+struct LIBSSE_EXPORT BezierControls {
+  //! first control point, relative to the start point
+  double i;
+  double j;
+  //! second control point, relative to the end point
+  double p;
+  double q;
+};
+
+/**
+ * @brief The Toolpath class
+ *
+ * Moves of a slice or layer, in printing order, as typed and tagged
+ * records instead of text. Slices produce a toolpath once, and emitters
+ * turn it into gcode (see write_toolpath()), or summarize it (see
+ * toolpath_stats()), without redoing any geometry. Coordinates are stored
+ * exactly as they were computed, so emitting a toolpath writes the same
+ * text as writing the moves directly.
+ *
+ * Arc centers and bezier control points are only stored for the moves that
+ * use them, in separate arrays, so the moves are a fixed 40 bytes each.
+ */
+class LIBSSE_EXPORT Toolpath {
+
+public:
+  /**
+   * @brief travel Rapid move in XY
+   */
+  void travel(double x, double y);
+
+  /**
+   * @brief travel_z Rapid move in Z
+   * @param z Z position
+   * @param f Feedrate, or the current feedrate if empty
+   */
+  void travel_z(double z, std::optional<double> f = std::nullopt);
+
+  /**
+   * @brief linear Extruding linear move
+   * @param x, y End point
+   * @param e Extruder position
+   * @param f Feedrate
+   */
+  void linear(double x, double y, double e, double f);
+
+  /**
+   * @brief arc Extruding arc move
+   * @param clockwise Direction of the arc
+   * @param x, y End point
+   * @param i, j Center, relative to the start point
+   * @param e Extruder position
+   * @param f Feedrate
+   */
+  void arc(bool clockwise, double x, double y, double i, double j, double e, double f);
+
+  /**
+   * @brief bezier Extruding cubic bezier move
+   * @param x, y End point
+   * @param controls Control points
+   * @param e Extruder position
+   * @param f Feedrate
+   */
+  void bezier(double x, double y, const BezierControls &controls, double e, double f);
+
+  /**
+   * @brief extrude Move only the extruder, i.e. retract or prime
+   * @param e Extruder position
+   * @param f Feedrate
+   */
+  void extrude(double e, double f);
+
+  /**
+   * @brief reset_extruder Set the extruder position to 0
+   */
+  void reset_extruder();
+
+  /**
+   * @brief feature Start a feature; following moves are tagged with it
+   *
+   * n.b. a feature can be started again, e.g. once per inner shell
+   */
+  void feature(Feature feature);
+
+  /**
+   * @brief clear Remove every move, keeping the allocated memory
+   */
+  void clear() noexcept;
+
+  [[nodiscard]] inline std::size_t size() const noexcept {
+    return moves.size();
+  }
+
+  [[nodiscard]] inline bool empty() const noexcept {
+    return moves.empty();
+  }
+
+  [[nodiscard]] inline const ToolpathMove &operator[](std::size_t i) const noexcept {
+    return moves[i];
+  }
+
+  [[nodiscard]] inline std::vector<ToolpathMove>::const_iterator begin() const noexcept {
+    return moves.begin();
+  }
+
+  [[nodiscard]] inline std::vector<ToolpathMove>::const_iterator end() const noexcept {
+    return moves.end();
+  }
+
+  /**
+   * @brief center Center of an arc
+   * @param move Arc move
+   */
+  [[nodiscard]] inline const ArcCenter &center(const ToolpathMove &move) const noexcept {
+    return centers[move.arc];
+  }
+
+  /**
+   * @brief controls Control points of a bezier
+   * @param move Bezier move
+   */
+  [[nodiscard]] inline const BezierControls &controls(const ToolpathMove &move) const noexcept {
+    return beziers[move.arc];
+  }
+
+  /**
+   * @brief memory_usage Heap memory held by the toolpath
+   * @return size in bytes
+   */
+  [[nodiscard]] std::size_t memory_usage() const noexcept;
+
+private:
+  std::vector<ToolpathMove> moves;
+  std::vector<ArcCenter> centers;
+  std::vector<BezierControls> beziers;
+  Feature current = Feature::none;
+
+  inline void add(MoveType type, double x, double y, double e, double f, std::uint32_t arc = 0) {
+    moves.push_back({x, y, e, f, arc, type, current});
+  }
+};
+
+/**
+ * @brief The toolpath of one layer
+ */
+struct LIBSSE_EXPORT ToolpathLayer {
+  double z;
+  double thickness;
+  //! moves, starting with the layer change
+  Toolpath path;
+};
+
+/**
+ * @brief Totals over a toolpath
+ */
+struct LIBSSE_EXPORT ToolpathStats {
+  //! number of extruding lines, arcs and beziers
+  std::size_t extrusions = 0;
+  std::size_t arcs = 0;
+  std::size_t beziers = 0;
+  std::size_t retractions = 0;
+  //! XY length of extruding moves (mm)
+  double print_distance = 0;
+  //! XY length of rapid moves (mm)
+  double travel_distance = 0;
+  //! filament used (mm), i.e. net extruder movement
+  double filament = 0;
+  //! time spent on moves with a feedrate (s); rapid moves aren't included
+  double print_time = 0;
+};
+
+/**
+ * @brief toolpath_stats Summarize a toolpath
+ *
+ * Distances are only counted from the first move with a known XY start point.
+ *
+ * @param path Toolpath
+ * @return Totals
+ */
+[[nodiscard]] LIBSSE_EXPORT ToolpathStats toolpath_stats(const Toolpath &path);
+
+/**
+ * @brief Result of fit_arcs()
+ */
+struct LIBSSE_EXPORT ArcFitStats {
+  //! line moves that could be fitted, i.e. with a known start point
+  std::size_t lines = 0;
+  //! line moves that were replaced by arcs
+  std::size_t replaced = 0;
+  //! arcs that replaced them
+  std::size_t arcs = 0;
+};
+
+/**
+ * @brief fit_arcs Replace runs of line moves that lie on a circle with arc moves
+ *
+ * Tessellated curves, e.g. infill or walls that weren't simplified, become
+ * a few G2/G3 moves instead of many short G1 moves. A run is consecutive
+ * line moves with the same feedrate and extrusion per mm, and is fitted
+ * with refit_arcs(), so every arc ends on one of the original points, with
+ * its original extruder position. Other moves are kept as they are.
+ *
+ * @param path Toolpath, modified in place
+ * @param tolerance Maximum distance between the line moves and the arcs (mm), 0 to disable
+ * @return Number of lines and arcs
+ */
+LIBSSE_EXPORT ArcFitStats fit_arcs(Toolpath &path, double tolerance);
+
+/**
+ * @brief fit_arcs Fit arcs to a toolpath, into another toolpath
+ * @param path Toolpath to fit
+ * @param tolerance Maximum distance between the line moves and the arcs (mm), 0 to copy the toolpath
+ * @param out Fitted toolpath, not path. Cleared first, so its storage is reused
+ * @return Number of lines and arcs
+ */
+LIBSSE_EXPORT ArcFitStats fit_arcs(const Toolpath &path, double tolerance, Toolpath &out);
+
+/**
+ * @brief Result of fit_beziers()
+ */
+struct LIBSSE_EXPORT BezierFitStats {
+  //! line and arc moves that could be fitted, i.e. with a known start point
+  std::size_t moves = 0;
+  //! moves that were replaced by beziers
+  std::size_t replaced = 0;
+  //! beziers that replaced them
+  std::size_t beziers = 0;
+};
+
+/**
+ * @brief fit_beziers Replace smooth runs of line and arc moves with cubic bezier moves
+ *
+ * Curves that were flattened into many lines or arcs, e.g. BSpline section
+ * curves after fit_biarcs(), become a few G5 moves. A run is consecutive
+ * line and arc moves with the same feedrate and extrusion per mm, that
+ * turn less than 15 degrees where they meet. Each run is fitted with
+ * Schneider's least squares algorithm, and split at the move ends furthest
+ * from the curve until every bezier is within tolerance. Beziers end on
+ * the end point of an original move, with its extruder position, and are
+ * tangent where they meet. A move that can't be fitted with another is
+ * kept as it is.
+ *
+ * @param path Toolpath, modified in place
+ * @param tolerance Maximum distance between the moves and the beziers (mm), 0 to disable
+ * @return Number of moves and beziers
+ */
+LIBSSE_EXPORT BezierFitStats fit_beziers(Toolpath &path, double tolerance);
+
+/**
+ * @brief fit_beziers Fit beziers to a toolpath, into another toolpath
+ * @param path Toolpath to fit
+ * @param tolerance Maximum distance between the moves and the beziers (mm), 0 to copy the toolpath
+ * @param out Fitted toolpath, not path. Cleared first, so its storage is reused
+ * @return Number of moves and beziers
+ */
+LIBSSE_EXPORT BezierFitStats fit_beziers(const Toolpath &path, double tolerance, Toolpath &out);
+
+/**
+ * @brief flatten_bezier Points along a cubic bezier, for writing it as lines
+ *
+ * Points are evenly spaced in the curve parameter, with enough of them that
+ * every line is within tolerance of the curve.
+ *
+ * @param x0, y0 Start point
+ * @param x, y End point
+ * @param controls Control points
+ * @param tolerance Maximum distance between the curve and the lines (mm)
+ * @return Points after the start point, ending exactly at the end point
+ */
+[[nodiscard]] LIBSSE_EXPORT std::vector<std::pair<double, double>>
+flatten_bezier(double x0, double y0, double x, double y, const BezierControls &controls, double tolerance);
+
+} // namespace sse
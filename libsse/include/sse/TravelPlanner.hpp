@@ -0,0 +1,167 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file TravelPlanner.hpp
+ * @brief Route travel moves inside a slice, to avoid crossing its perimeter
+ *
+ * @author Karl Nilsson
+ *
+ */
+
+#pragma once
+// stl headers
+#include <cstdint>
+#include <vector>
+// external headers
+#include "cavc/polyline.hpp"
+#include "cavc/staticspatialindex.hpp"
+// project headers
+#include "sse/PathStore.hpp"
+#include "sse/Segments.hpp"
+#include "sse/Slice.hpp"
+#include "sse/libsse_export.hpp"
+
+namespace sse {
+
+/**
+ * @brief A planned travel move
+ */
+struct LIBSSE_EXPORT Travel {
+  //! points to visit, in order, ending with the destination
+  std::vector<cavc::Vector2<double>> path;
+  //! the travel crosses the outline of the slice, so the nozzle must retract
+  bool retract = false;
+};
+
+/**
+ * @brief The TravelPlanner class
+ *
+ * Plan travel moves that stay inside the outline of a slice ("combing"), so
+ * the nozzle doesn't ooze onto the outside of the part. When the straight line
+ * between two points leaves the outline, the travel is routed through the
+ * vertices of the innermost shell, with A* over a visibility graph that is
+ * built lazily and cached for the lifetime of the planner. Only when no route
+ * exists does the travel go in a straight line, with a retraction.
+ *
+ * The loops are read from the slice's PathStore, and reset() keeps the
+ * planner's storage, so one planner per thread can plan every slice.
+ *
+ * n.b. the planner caches visibility internally, so a single instance must not
+ * be used from multiple threads at once
+ */
+class LIBSSE_EXPORT TravelPlanner {
+
+public:
+  /**
+   * @brief Create a travel planner with nothing to avoid, see reset()
+   */
+  TravelPlanner() = default;
+
+  /**
+   * @brief Create a travel planner for a slice
+   * @param outline Boundary that travels shouldn't cross
+   * @param comb Loops to route travels along, i.e. the innermost shell
+   */
+  TravelPlanner(const Shell &outline, const Shell &comb);
+
+  // the boundaries can refer to the planner's own copy of the loops
+  TravelPlanner(const TravelPlanner &) = delete;
+  TravelPlanner &operator=(const TravelPlanner &) = delete;
+
+  /**
+   * @brief reset Plan travels for another slice, reusing the planner's storage
+   * @param paths Paths of the slice, with its outline. Must outlive the planner, or the next reset()
+   * @param comb_shell Shell to route travels along, i.e. the innermost one
+   */
+  void reset(const PathStore &paths, std::uint16_t comb_shell);
+
+  /**
+   * @brief Plan a travel move
+   * @param from Start position
+   * @param to Destination
+   * @param result Planned travel. Existing storage is reused
+   */
+  void plan(const cavc::Vector2<double> &from, const cavc::Vector2<double> &to, Travel &result) const;
+
+  /**
+   * @brief Plan a travel move
+   * @param from Start position
+   * @param to Destination
+   * @return Planned travel
+   */
+  [[nodiscard]] Travel plan(const cavc::Vector2<double> &from, const cavc::Vector2<double> &to) const;
+
+  /**
+   * @brief Check whether the straight line between two points crosses the outline
+   * @param a Start point
+   * @param b End point
+   * @return true if the line intersects the outline
+   */
+  [[nodiscard]] bool crosses_outline(const cavc::Vector2<double> &a, const cavc::Vector2<double> &b) const;
+
+  /**
+   * @brief node_count Number of points available to route travels through
+   * @return number of nodes in the visibility graph
+   */
+  [[nodiscard]] inline std::size_t node_count() const noexcept {
+    return nodes.size();
+  }
+
+private:
+  //! loop of the outline, with a spatial index of its segments
+  struct Boundary {
+    PathInfo loop;
+    cavc::StaticSpatialIndex<double> index;
+  };
+
+  //! loops of the Shell constructor
+  PathStore shells;
+  //! paths the boundaries are read from
+  const PathStore *paths = nullptr;
+  //! loops that travels shouldn't cross
+  std::vector<Boundary> boundaries;
+  //! points to route travels through
+  std::vector<cavc::Vector2<double>> nodes;
+  //! points that split clockwise arcs, added to nodes while there's room
+  std::vector<cavc::Vector2<double>> arc_nodes;
+  //! cached visibility between each pair of nodes, see visible()
+  mutable std::vector<std::uint8_t> visibility;
+  //! A* scratch space, reused between travels
+  mutable std::vector<double> distance;
+  mutable std::vector<std::size_t> parent;
+  mutable std::vector<bool> closed;
+
+  /**
+   * @brief Check whether two nodes can see each other, using the cache
+   * @param i index of first node
+   * @param j index of second node
+   */
+  [[nodiscard]] bool visible(std::size_t i, std::size_t j) const;
+};
+
+/**
+ * @brief Storage for Slice::toolpath(), reused for every slice a thread generates
+ */
+struct LIBSSE_EXPORT ToolpathScratch {
+  TravelPlanner planner;
+  Travel travel;
+  SegmentBatch batch;
+};
+
+} // namespace sse
@@ -21,6 +21,7 @@
 // std includes
 #include <filesystem>
 #include <memory>
+#include <ostream>
 #include <string>
 #include <vector>
 // OCCT includes
@@ -29,8 +30,13 @@
 // external includes
 #include <spdlog/spdlog.h>
 // project includes
+#include "sse/BinaryGCode.hpp"
+#include "sse/Flatten.hpp"
+#include "sse/GCodeIndex.hpp"
+#include "sse/GCodeWriter.hpp"
 #include "sse/Slice.hpp"
 #include "sse/Settings.hpp"
+#include "sse/Toolpath.hpp"
 #include "sse/libsse_export.hpp"
 
 #define SSE_MAXIMUM_NUM_OBJECTS 1000
@@ -43,11 +49,177 @@ namespace fs = std::filesystem;
 
 namespace sse {
 
+class GCodeStream;
+
 /**
  * @brief collate_gcode Combine all gcode text into one string
+ * @param slices List of slices
+ * @param threads Number of worker threads; 0 for one per hardware thread
  * @return
  */
-[[nodiscard]] LIBSSE_EXPORT std::string collate_gcode(std::vector<Slice> &slices);
+[[nodiscard]] LIBSSE_EXPORT std::string collate_gcode(const std::vector<Slice> &slices, unsigned threads = 0);
+
+/**
+ * @brief write_gcode Write the gcode for all slices, generating layers in parallel
+ *
+ * Same as collate_gcode(), without building one large string. Each batch
+ * of layers is rendered by worker threads into buffers of their own, then
+ * appended in order, so the output is the same whatever the number of
+ * threads.
+ *
+ * @param slices List of slices
+ * @param out Writer to append the gcode to, see BasicGCodeWriter for modal output and dialects
+ * @param threads Number of worker threads; 0 for one per hardware thread
+ * @throw runtime_error if the output exceeds 1GiB
+ */
+template <typename Dialect>
+LIBSSE_EXPORT void write_gcode(const std::vector<Slice> &slices, BasicGCodeWriter<Dialect> &out, unsigned threads = 0);
+
+/**
+ * @brief write_gcode Write the gcode for all slices to a stream, generating layers in parallel
+ *
+ * Layers are written by worker threads, and streamed to the file as they
+ * complete, so there's no limit on the size of the output. The output is
+ * the same as the other write_gcode() overload with the same precision,
+ * mode and dialect, whatever the number of threads. n.b. call out.finish() afterwards.
+ *
+ * @param slices List of slices
+ * @param out Stream to write the gcode to
+ * @param precision Decimal places of each kind of word
+ * @param mode Modal words to omit
+ * @param threads Number of worker threads; 0 for one per hardware thread
+ * @param dialect Firmware dialect
+ * @return Index of the layers, e.g. for write_layer_index(); offsets are before compression
+ */
+LIBSSE_EXPORT std::vector<LayerIndexEntry> write_gcode(const std::vector<Slice> &slices, GCodeStream &out,
+                                                       GCodePrecision precision = {}, ModalMode mode = ModalMode::off,
+                                                       unsigned threads = 0, Dialect dialect = Dialect::marlin);
+
+/**
+ * @brief write_gcode_subroutines Write the gcode for all slices to a stream, with repeated slices written once
+ *
+ * Every layer is generated first. Slices whose moves repeat, modulo a
+ * translation, e.g. identical copies of an object or the layers of a prism,
+ * are written once as a subroutine after the header, and called with their
+ * offset wherever they occur, see find_subroutines(). Layers are then
+ * written in parallel, like write_gcode(). Dialects without subroutines,
+ * i.e. other than LinuxCNC and Machinekit, are written like write_gcode().
+ * n.b. call out.finish() afterwards.
+ *
+ * @param slices List of slices
+ * @param out Stream to write the gcode to
+ * @param precision Decimal places of each kind of word
+ * @param mode Modal words to omit
+ * @param threads Number of worker threads; 0 for one per hardware thread
+ * @param dialect Firmware dialect
+ * @return Index of the layers, e.g. for write_layer_index(); offsets are before compression
+ */
+LIBSSE_EXPORT std::vector<LayerIndexEntry>
+write_gcode_subroutines(const std::vector<Slice> &slices, GCodeStream &out, GCodePrecision precision = {},
+                        ModalMode mode = ModalMode::off, unsigned threads = 0, Dialect dialect = Dialect::linuxcnc);
+
+/**
+ * @brief generate_toolpaths Generate the moves of every layer, generating layers in parallel
+ *
+ * The geometry is only processed once; the layers can then be written as
+ * gcode any number of times, with any precision, mode and dialect, or summarized
+ * with toolpath_stats(). Arcs are only fitted for a dialect that writes them
+ * as G2/G3, and beziers for one that writes them as G5; the others would
+ * write them as lines.
+ *
+ * @param slices List of slices
+ * @param threads Number of worker threads; 0 for one per hardware thread
+ * @param dialect Firmware dialect the layers are meant for
+ * @return Layers, in printing order
+ */
+[[nodiscard]] LIBSSE_EXPORT std::vector<ToolpathLayer>
+generate_toolpaths(const std::vector<Slice> &slices, unsigned threads = 0, Dialect dialect = Dialect::marlin);
+
+/**
+ * @brief write_gcode Write the gcode for toolpaths from generate_toolpaths()
+ *
+ * Same as the write_gcode() overload for slices, with the same writer
+ *
+ * @param layers Toolpath of each layer, in printing order
+ * @param out Writer to append the gcode to
+ */
+template <typename Dialect>
+LIBSSE_EXPORT void write_gcode(const std::vector<ToolpathLayer> &layers, BasicGCodeWriter<Dialect> &out);
+
+/**
+ * @brief write_gcode_mapped Write the gcode for all slices to a file, generating and writing layers in parallel
+ *
+ * Every layer is generated first, to find its size, then the file is
+ * allocated at its final size and memory mapped, and worker threads write
+ * each layer at its offset. Nothing is written in sequence. Up to 256MiB of
+ * layers are kept in memory until the file is mapped; the rest are generated
+ * again, so memory use is bounded at the cost of generating large files twice.
+ * The output is the same as write_gcode() with the same precision, mode and
+ * dialect.
+ *
+ * @param slices List of slices
+ * @param file Output file, created or truncated
+ * @param precision Decimal places of each kind of word
+ * @param mode Modal words to omit
+ * @param threads Number of worker threads; 0 for one per hardware thread
+ * @param dialect Firmware dialect
+ * @return Index of the layers, e.g. for write_layer_index()
+ * @throw runtime_error if the file can't be written
+ */
+LIBSSE_EXPORT std::vector<LayerIndexEntry> write_gcode_mapped(const std::vector<Slice> &slices, const fs::path &file,
+                                                              GCodePrecision precision = {},
+                                                              ModalMode mode = ModalMode::off, unsigned threads = 0,
+                                                              Dialect dialect = Dialect::marlin);
+
+/**
+ * @brief write_bgcode Write the gcode for all slices as binary gcode, generating layers in parallel
+ *
+ * Metadata blocks come first, including a layer index in the slicer
+ * metadata, see BinaryGCodeReader::layer(). Each layer starts a new gcode
+ * block, and is encoded and compressed by the worker thread that generated
+ * it. Decoded with GCodeEncoding::none, the text is the same as
+ * collate_gcode() with the same precision and mode; bgcode is only read by
+ * Marlin firmware, so there's no dialect.
+ *
+ * @param slices List of slices
+ * @param out Stream to write the file to, opened in binary mode
+ * @param settings Encoding, compression and size of the blocks
+ * @param precision Decimal places of each kind of word
+ * @param mode Modal words to omit
+ * @param threads Number of worker threads; 0 for one per hardware thread
+ * @throw runtime_error if the stream can't be written
+ */
+LIBSSE_EXPORT void write_bgcode(const std::vector<Slice> &slices, std::ostream &out,
+                                const BinaryGCodeSettings &settings = {}, GCodePrecision precision = {},
+                                ModalMode mode = ModalMode::off, unsigned threads = 0);
+
+/**
+ * @brief order_slices Sort slices by layer, and order the slices within each layer to minimize travel
+ *
+ * The slices of each layer are visited in a tour over their entry points,
+ * starting from the exit point of the previous layer. The first layer starts
+ * at the origin.
+ *
+ * @param slices List of slices to order, modified in place
+ */
+LIBSSE_EXPORT void order_slices(std::vector<Slice> &slices);
+
+/**
+ * @brief slice_order Order slices like order_slices(), without moving them
+ * @param slices List of slices
+ * @return Indices into slices, in printing order
+ */
+[[nodiscard]] LIBSSE_EXPORT std::vector<std::size_t> slice_order(const std::vector<Slice> &slices);
+
+/**
+ * @brief slice_order Order slices like order_slices(), without moving them
+ * @param slices List of slices
+ * @param layers Set to the position in the result where each layer starts; slices
+ * whose z positions differ by less than 1e-6 are in the same layer
+ * @return Indices into slices, in printing order
+ */
+[[nodiscard]] LIBSSE_EXPORT std::vector<std::size_t> slice_order(const std::vector<Slice> &slices,
+                                                                 std::vector<std::size_t> &layers);
 
 
 LIBSSE_EXPORT void setup_logger(spdlog::level::level_enum loglevel = spdlog::level::info);
@@ -187,6 +359,8 @@ public:
 
 private:
   Settings &settings;
+  //! edges flattened by generate_shells(), shared by the slices of the last object passed to slice_object()
+  EdgeCache edges;
 
   [[nodiscard]] TopTools_ListOfShape make_tools(const double layer_height,
                                   const double object_height);
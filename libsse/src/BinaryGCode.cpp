@@ -0,0 +1,368 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file BinaryGCode.cpp
+ * @brief Binary gcode (bgcode) files, with compressed blocks
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <array>
+#include <charconv>
+#include <stdexcept>
+// external headers
+#include <spdlog/spdlog.h>
+// project headers
+#include "sse/BinaryGCode.hpp"
+#include "sse/GCodeCompression.hpp"
+
+static constexpr std::string_view bgcode_magic = "GCDE";
+static constexpr std::uint32_t bgcode_version = 1;
+static constexpr std::uint16_t checksum_none = 0;
+static constexpr std::uint16_t checksum_crc32 = 1;
+//! metadata is encoded as INI text
+static constexpr std::uint16_t metadata_ini = 0;
+
+/**
+ * @brief CRC32 table, for the reflected polynomial 0xedb88320
+ */
+static constexpr std::array<std::uint32_t, 256> crc32_table = [] {
+  std::array<std::uint32_t, 256> table{};
+  for (std::uint32_t n = 0; n < 256; ++n) {
+    auto c = n;
+    for (int k = 0; k < 8; ++k) {
+      c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    }
+    table[n] = c;
+  }
+  return table;
+}();
+
+static std::uint32_t crc32(std::string_view data) noexcept {
+  std::uint32_t c = 0xffffffffu;
+  for (const auto byte : data) {
+    c = crc32_table[(c ^ static_cast<unsigned char>(byte)) & 0xff] ^ (c >> 8);
+  }
+  return c ^ 0xffffffffu;
+}
+
+/**
+ * @brief Append a little endian integer
+ */
+template <typename T> static void put(std::string &out, T value) {
+  for (std::size_t k = 0; k < sizeof(T); ++k) {
+    out.push_back(static_cast<char>((value >> (8 * k)) & 0xff));
+  }
+}
+
+/**
+ * @brief Append a block, with its header and checksum
+ * @param parameters Encoding, or the parameters of a thumbnail
+ * @param data Compressed data
+ * @param size Size of the data before compression
+ */
+static void put_block(std::string &out, sse::BlockType type, sse::BlockCompression compression,
+                      std::string_view parameters, std::string_view data, std::size_t size,
+                      const sse::BinaryGCodeSettings &settings) {
+  const auto start = out.size();
+  put(out, static_cast<std::uint16_t>(type));
+  put(out, static_cast<std::uint16_t>(compression));
+  put(out, static_cast<std::uint32_t>(size));
+  if (compression != sse::BlockCompression::none) {
+    put(out, static_cast<std::uint32_t>(data.size()));
+  }
+  out.append(parameters);
+  out.append(data);
+  if (settings.checksum) {
+    put(out, crc32(std::string_view(out).substr(start)));
+  }
+}
+
+/**
+ * @brief Compress a block's data
+ */
+static std::string compress(std::string_view data, sse::BlockCompression compression) {
+  switch (compression) {
+  case sse::BlockCompression::none: return std::string(data);
+  case sse::BlockCompression::deflate: {
+    // throws if there's no zlib
+    std::string result;
+    sse::StreamCompressor compressor(sse::StreamCompression::zlib);
+    compressor.compress(data, result);
+    compressor.finish(result);
+    return result;
+  }
+  case sse::BlockCompression::heatshrink_11_4: return sse::heatshrink_compress(data, 11, 4);
+  case sse::BlockCompression::heatshrink_12_4: return sse::heatshrink_compress(data, 12, 4);
+  default:
+    spdlog::error("bgcode: unsupported compression {}", static_cast<int>(compression));
+    throw std::invalid_argument("bgcode: unsupported compression");
+  }
+}
+
+static std::string decompress(std::string_view data, std::uint16_t compression, std::size_t size) {
+  switch (static_cast<sse::BlockCompression>(compression)) {
+  case sse::BlockCompression::none: return std::string(data);
+  case sse::BlockCompression::heatshrink_11_4: return sse::heatshrink_decompress(data, 11, 4, size);
+  case sse::BlockCompression::heatshrink_12_4: return sse::heatshrink_decompress(data, 12, 4, size);
+  case sse::BlockCompression::deflate:
+    if (sse::stream_compression_supported(sse::StreamCompression::zlib)) {
+      auto result = sse::stream_decompress(data, sse::StreamCompression::zlib);
+      if (result.size() != size) {
+        spdlog::error("BinaryGCodeReader: expected {} bytes, got {}", size, result.size());
+        throw std::runtime_error("BinaryGCodeReader: corrupt block");
+      }
+      return result;
+    }
+    // no zlib
+    [[fallthrough]];
+  default:
+    spdlog::error("BinaryGCodeReader: unsupported compression {}", compression);
+    throw std::runtime_error("BinaryGCodeReader: unsupported compression");
+  }
+}
+
+/**
+ * @brief Reads little endian integers, checking for the end of the file
+ */
+class FileReader {
+public:
+  explicit FileReader(std::string_view file) noexcept : file(file) {}
+
+  template <typename T> T get() {
+    const auto bytes = take(sizeof(T));
+    T value = 0;
+    for (std::size_t k = 0; k < sizeof(T); ++k) {
+      value |= static_cast<T>(static_cast<T>(static_cast<unsigned char>(bytes[k])) << (8 * k));
+    }
+    return value;
+  }
+
+  std::string_view take(std::size_t count) {
+    if (count > file.size() - position) {
+      spdlog::error("BinaryGCodeReader: truncated file");
+      throw std::runtime_error("BinaryGCodeReader: truncated file");
+    }
+    const auto result = file.substr(position, count);
+    position += count;
+    return result;
+  }
+
+  [[nodiscard]] std::size_t offset() const noexcept {
+    return position;
+  }
+
+  [[nodiscard]] bool done() const noexcept {
+    return position == file.size();
+  }
+
+private:
+  std::string_view file;
+  std::size_t position = 0;
+};
+
+/**
+ * @brief Parse INI text, one key=value pair per line
+ */
+static sse::BinaryGCodeMetadata parse_metadata(std::string_view text) {
+  sse::BinaryGCodeMetadata result;
+  while (!text.empty()) {
+    const auto end = text.find('\n');
+    const auto line = text.substr(0, end);
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+    const auto equals = line.find('=');
+    if (equals != std::string_view::npos) {
+      result.emplace_back(line.substr(0, equals), line.substr(equals + 1));
+    }
+  }
+  return result;
+}
+
+/**
+ * @brief Parse the layer index, a comma separated list of block numbers
+ */
+static std::vector<std::size_t> parse_layer_index(std::string_view text, std::size_t blocks) {
+  std::vector<std::size_t> result;
+  while (!text.empty()) {
+    std::size_t block = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), block);
+    if (error != std::errc() || block > blocks || (!result.empty() && block < result.back())) {
+      spdlog::error("BinaryGCodeReader: invalid layer index");
+      throw std::runtime_error("BinaryGCodeReader: invalid layer index");
+    }
+    result.push_back(block);
+    text.remove_prefix(static_cast<std::size_t>(end - text.data()));
+    if (!text.empty() && text.front() == ',') {
+      text.remove_prefix(1);
+    }
+  }
+  return result;
+}
+
+namespace sse {
+
+void write_bgcode_header(std::string &out, const BinaryGCodeSettings &settings) {
+  out.append(bgcode_magic);
+  put(out, bgcode_version);
+  put(out, settings.checksum ? checksum_crc32 : checksum_none);
+}
+
+void write_bgcode_metadata(std::string &out, BlockType type, const BinaryGCodeMetadata &metadata,
+                           const BinaryGCodeSettings &settings) {
+  std::string text;
+  for (const auto &[key, value] : metadata) {
+    text.append(key).append("=").append(value).append("\n");
+  }
+
+  std::string parameters;
+  put(parameters, metadata_ini);
+  put_block(out, type, BlockCompression::none, parameters, text, text.size(), settings);
+}
+
+std::size_t write_bgcode_gcode(std::string &out, std::string_view gcode, const BinaryGCodeSettings &settings) {
+  if (settings.block_size == 0) {
+    spdlog::error("write_bgcode_gcode: block size must be > 0");
+    throw std::invalid_argument("write_bgcode_gcode: block size must be > 0");
+  }
+
+  std::string parameters;
+  put(parameters, static_cast<std::uint16_t>(settings.encoding));
+
+  std::size_t count = 0;
+  while (!gcode.empty()) {
+    // split after the last line that fits, or after the first line if none do
+    auto end = gcode.size();
+    if (end > settings.block_size) {
+      end = gcode.rfind('\n', settings.block_size - 1);
+      if (end == std::string_view::npos) {
+        end = gcode.find('\n');
+      }
+      end = (end == std::string_view::npos) ? gcode.size() : end + 1;
+    }
+    const auto text = gcode.substr(0, end);
+    gcode.remove_prefix(end);
+
+    std::string encoded;
+    switch (settings.encoding) {
+    case GCodeEncoding::meatpack: encoded = meatpack_encode(text, false); break;
+    case GCodeEncoding::meatpack_comments: encoded = meatpack_encode(text, true); break;
+    default: encoded = std::string(text); break;
+    }
+
+    put_block(out, BlockType::gcode, settings.compression, parameters, compress(encoded, settings.compression),
+              encoded.size(), settings);
+    ++count;
+  }
+
+  return count;
+}
+
+BinaryGCodeReader::BinaryGCodeReader(std::string_view file) : metadata_blocks(6) {
+  FileReader in(file);
+  if (in.take(bgcode_magic.size()) != bgcode_magic) {
+    spdlog::error("BinaryGCodeReader: not a bgcode file");
+    throw std::runtime_error("BinaryGCodeReader: not a bgcode file");
+  }
+  const auto version = in.get<std::uint32_t>();
+  const auto checksum = in.get<std::uint16_t>();
+  if (version != bgcode_version || checksum > checksum_crc32) {
+    spdlog::error("BinaryGCodeReader: unsupported version {} / checksum {}", version, checksum);
+    throw std::runtime_error("BinaryGCodeReader: unsupported version");
+  }
+
+  while (!in.done()) {
+    const auto start = in.offset();
+    const auto type = in.get<std::uint16_t>();
+    const auto compression = in.get<std::uint16_t>();
+    const auto size = in.get<std::uint32_t>();
+    const auto compressed_size = (compression != 0) ? in.get<std::uint32_t>() : size;
+    // thumbnails have a format, width and height; everything else an encoding
+    const auto parameters = in.take(type == static_cast<std::uint16_t>(BlockType::thumbnail) ? 6 : 2);
+    const auto data = in.take(compressed_size);
+
+    if (checksum == checksum_crc32) {
+      const auto expected = crc32(file.substr(start, in.offset() - start));
+      if (in.get<std::uint32_t>() != expected) {
+        spdlog::error("BinaryGCodeReader: checksum mismatch in block at offset {}", start);
+        throw std::runtime_error("BinaryGCodeReader: checksum mismatch");
+      }
+    }
+
+    if (type == static_cast<std::uint16_t>(BlockType::thumbnail)) {
+      continue;
+    }
+    if (type > static_cast<std::uint16_t>(BlockType::thumbnail)) {
+      spdlog::error("BinaryGCodeReader: unknown block type {}", type);
+      throw std::runtime_error("BinaryGCodeReader: unknown block type");
+    }
+
+    auto decoded = decompress(data, compression, size);
+    const auto encoding = static_cast<std::uint16_t>(static_cast<unsigned char>(parameters[0]) |
+                                                     static_cast<unsigned char>(parameters[1]) << 8);
+    if (type == static_cast<std::uint16_t>(BlockType::gcode)) {
+      if (encoding != static_cast<std::uint16_t>(GCodeEncoding::none)) {
+        decoded = meatpack_decode(decoded);
+      }
+      blocks.push_back(std::move(decoded));
+    } else {
+      metadata_blocks[type] = parse_metadata(decoded);
+    }
+  }
+
+  for (const auto &[key, value] : metadata(BlockType::slicer_metadata)) {
+    if (key == bgcode_layer_key) {
+      layers = parse_layer_index(value, blocks.size());
+    }
+  }
+}
+
+const BinaryGCodeMetadata &BinaryGCodeReader::metadata(BlockType type) const {
+  return metadata_blocks.at(static_cast<std::size_t>(type));
+}
+
+std::string BinaryGCodeReader::gcode() const {
+  std::size_t size = 0;
+  for (const auto &block : blocks) {
+    size += block.size();
+  }
+
+  std::string result;
+  result.reserve(size);
+  for (const auto &block : blocks) {
+    result.append(block);
+  }
+  return result;
+}
+
+std::string BinaryGCodeReader::layer(std::size_t number) const {
+  if (number >= layer_count()) {
+    spdlog::error("BinaryGCodeReader: no layer {}, of {}", number, layer_count());
+    throw std::out_of_range("BinaryGCodeReader: no such layer");
+  }
+
+  std::string result;
+  for (auto i = layers[number]; i < layers[number + 1]; ++i) {
+    result.append(blocks[i]);
+  }
+  return result;
+}
+
+} // namespace sse
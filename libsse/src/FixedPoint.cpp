@@ -0,0 +1,118 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file FixedPoint.cpp
+ * @brief Integer coordinates, and exact geometric predicates on them
+ *
+ * Coordinates are limited to fixed_point_max, so the differences between
+ * them fit in 32 bits and every orientation test is exact in 64 bit
+ * integer arithmetic, without any epsilon.
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+// external headers
+#include <spdlog/spdlog.h>
+// project headers
+#include "sse/FixedPoint.hpp"
+
+[[nodiscard]] static inline int sign(std::int64_t value) noexcept {
+  return (value > 0) - (value < 0);
+}
+
+namespace sse {
+
+std::int64_t to_fixed(double value) {
+  const auto scaled = std::round(value * fixed_point_scale);
+
+  // n.b. also catches NaN
+  if (!(std::abs(scaled) <= static_cast<double>(fixed_point_max))) {
+    spdlog::error("FixedPoint: coordinate out of range: {}", value);
+    throw std::out_of_range("FixedPoint: coordinate out of range");
+  }
+
+  return static_cast<std::int64_t>(scaled);
+}
+
+FixedPolyline to_fixed(const cavc::Polyline<double> &pline) {
+  FixedPolyline result;
+  result.closed = pline.isClosed();
+  result.xs.reserve(pline.size());
+  result.ys.reserve(pline.size());
+  result.bulges.reserve(pline.size());
+
+  for (const auto &v : pline.vertexes()) {
+    const auto x = to_fixed(v.x());
+    const auto y = to_fixed(v.y());
+
+    if (result.size() != 0 && x == result.xs.back() && y == result.ys.back()) {
+      // zero length segment; the remaining vertex starts the next segment
+      result.bulges.back() = v.bulge();
+      continue;
+    }
+
+    result.xs.push_back(x);
+    result.ys.push_back(y);
+    result.bulges.push_back(v.bulge());
+  }
+
+  // zero length closing segment
+  if (result.closed && result.size() > 1 && result.point(0) == result.point(result.size() - 1)) {
+    result.xs.pop_back();
+    result.ys.pop_back();
+    result.bulges.pop_back();
+  }
+
+  return result;
+}
+
+cavc::Polyline<double> from_fixed(const FixedPolyline &pline) {
+  cavc::Polyline<double> result;
+  result.isClosed() = pline.closed;
+  result.vertexes().reserve(pline.size());
+
+  for (std::size_t i = 0; i < pline.size(); ++i) {
+    result.addVertex(from_fixed(pline.xs[i]), from_fixed(pline.ys[i]), pline.bulges[i]);
+  }
+
+  return result;
+}
+
+void snap(cavc::Polyline<double> &pline) {
+  pline = from_fixed(to_fixed(pline));
+}
+
+bool segments_intersect(const FixedPoint &a, const FixedPoint &b, const FixedPoint &c, const FixedPoint &d) noexcept {
+  const auto o1 = sign(orient2d(a, b, c));
+  const auto o2 = sign(orient2d(a, b, d));
+  const auto o3 = sign(orient2d(c, d, a));
+  const auto o4 = sign(orient2d(c, d, b));
+
+  // collinear segments only intersect if their bounding boxes overlap
+  const auto overlap = std::max(a.x, b.x) >= std::min(c.x, d.x) && std::max(c.x, d.x) >= std::min(a.x, b.x) &&
+                       std::max(a.y, b.y) >= std::min(c.y, d.y) && std::max(c.y, d.y) >= std::min(a.y, b.y);
+
+  return o1 * o2 <= 0 && o3 * o4 <= 0 && (o1 != 0 || o2 != 0 || overlap);
+}
+
+} // namespace sse
@@ -0,0 +1,351 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Flatten.cpp
+ * @brief Convert the wires of a planar face into polylines of lines and arcs
+ *
+ * Free-form curves are approximated with biarcs: two arcs that meet
+ * tangentially, and match the position and tangent of the curve at both
+ * ends. The arcs are joined at the point that makes the distance from each end
+ * to the intersection of its tangent with the other arc's equal.
+ *
+ * Required reading:
+ * https://www.ryanjuckett.com/biarc-interpolation/
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <algorithm>
+#include <cmath>
+#include <utility>
+// OCCT headers
+#include <BRepAdaptor_Curve.hxx>
+#include <BRepTools_WireExplorer.hxx>
+#include <BRep_Tool.hxx>
+#include <GeomAbs_Shape.hxx>
+#include <Standard_Version.hxx>
+#include <TColStd_Array1OfReal.hxx>
+#include <TopoDS.hxx>
+#include <gp_Circ.hxx>
+#include <gp_Pnt.hxx>
+#include <gp_Vec.hxx>
+// external headers
+#include <spdlog/spdlog.h>
+#include "cavc/plinesegment.hpp"
+// project headers
+#include "sse/Flatten.hpp"
+
+using point = cavc::Vector2<double>;
+using vertex = cavc::PlineVertex<double>;
+
+//! curve sections are split at most this many times
+constexpr int max_depth = 16;
+//! number of points on the curve that are checked against the biarc
+constexpr int error_samples = 7;
+//! tangents shorter than this are considered degenerate
+constexpr double min_tangent = 1e-12;
+//! biarcs sweeping more than a semicircle are split, to keep the bulge below 1
+constexpr double max_half_sweep = M_PI / 2;
+
+/**
+ * @brief A point on the curve, with its unit tangent, projected onto the XY plane
+ */
+struct CurvePoint {
+  point position;
+  point tangent;
+  bool valid;
+};
+
+[[nodiscard]] static CurvePoint evaluate(const Adaptor3d_Curve &curve, double u) {
+  gp_Pnt p;
+  gp_Vec v;
+  curve.D1(u, p, v);
+
+  const auto tangent = point(v.X(), v.Y());
+  const auto length = cavc::length(tangent);
+  if (length < min_tangent) {
+    return {point(p.X(), p.Y()), point(0, 0), false};
+  }
+
+  return {point(p.X(), p.Y()), point(tangent.x() / length, tangent.y() / length), true};
+}
+
+/**
+ * @brief bulge Bulge of the arc between two points, with a given tangent at one of them
+ * @param tangent Unit tangent
+ * @param chord Vector from the start of the arc to its end
+ * @param at_end The tangent is at the end of the arc, rather than at its start
+ * @param half_sweep Set to half of the arc's sweep angle
+ */
+[[nodiscard]] static double bulge(const point &tangent, const point &chord, bool at_end, double &half_sweep) {
+  // the angle between the chord and the tangent at either end is half the sweep
+  half_sweep = at_end ? std::atan2(cavc::perpDot(chord, tangent), cavc::dot(chord, tangent))
+                      : std::atan2(cavc::perpDot(tangent, chord), cavc::dot(tangent, chord));
+  return std::tan(half_sweep / 2);
+}
+
+/**
+ * @brief Biarc between two points, as two polyline vertices
+ */
+struct Biarc {
+  vertex first;
+  vertex joint;
+};
+
+/**
+ * @brief fit Find the biarc between two points
+ * @param start Start position and tangent
+ * @param end End position and tangent
+ * @param result Biarc
+ * @return false if there is no usable biarc between the points
+ */
+[[nodiscard]] static bool fit(const CurvePoint &start, const CurvePoint &end, Biarc &result) {
+  const auto v = end.position - start.position;
+  const auto t = start.tangent + end.tangent;
+  const auto vv = cavc::dot(v, v);
+  const auto vt = cavc::dot(v, t);
+  const auto denominator = 2 * (1 - cavc::dot(start.tangent, end.tangent));
+
+  // distance from each end to the control point on its tangent
+  double d;
+  if (denominator < cavc::utils::realThreshold<double>()) {
+    // parallel tangents; if the ends are side by side, the curve turns back on itself
+    if (vt <= cavc::utils::realThreshold<double>()) {
+      return false;
+    }
+    d = vv / (2 * vt);
+  } else {
+    d = (-vt + std::sqrt(vt * vt + denominator * vv)) / denominator;
+  }
+
+  if (!std::isfinite(d) || d <= 0) {
+    return false;
+  }
+
+  const auto joint = cavc::midpoint(start.position + d * start.tangent, end.position - d * end.tangent);
+
+  double first_half_sweep, second_half_sweep;
+  const auto first_bulge = bulge(start.tangent, joint - start.position, false, first_half_sweep);
+  const auto second_bulge = bulge(end.tangent, end.position - joint, true, second_half_sweep);
+
+  if (std::abs(first_half_sweep) > max_half_sweep || std::abs(second_half_sweep) > max_half_sweep) {
+    return false;
+  }
+
+  result.first = vertex(start.position, first_bulge);
+  result.joint = vertex(joint, second_bulge);
+  return true;
+}
+
+/**
+ * @brief distance Distance from a point to a biarc
+ */
+[[nodiscard]] static double distance(const Biarc &biarc, const point &end, const point &p) {
+  const auto a = cavc::closestPointOnSeg(biarc.first, biarc.joint, p);
+  const auto b = cavc::closestPointOnSeg(biarc.joint, vertex(end, 0), p);
+  return std::sqrt(std::min(cavc::distSquared(a, p), cavc::distSquared(b, p)));
+}
+
+/**
+ * @brief fit_section Recursively fit biarcs to a tangent-continuous section of a curve
+ */
+static void fit_section(const Adaptor3d_Curve &curve, double first, double last, const CurvePoint &start,
+                        const CurvePoint &end, double tolerance, int depth, std::vector<vertex> &result) {
+  Biarc biarc;
+  bool fits = start.valid && end.valid && fit(start, end, biarc);
+
+  for (int i = 1; fits && i <= error_samples; ++i) {
+    const auto u = first + (last - first) * i / (error_samples + 1);
+    const auto p = curve.Value(u);
+    fits = distance(biarc, end.position, point(p.X(), p.Y())) <= tolerance;
+  }
+
+  if (fits) {
+    result.push_back(biarc.first);
+    result.push_back(biarc.joint);
+    return;
+  }
+
+  if (depth >= max_depth) {
+    // give up; this only happens for degenerate curves
+    spdlog::debug("Flatten: curve section [{}, {}] did not converge, using a line", first, last);
+    result.emplace_back(start.position, 0);
+    return;
+  }
+
+  const auto middle = (first + last) / 2;
+  const auto mid = evaluate(curve, middle);
+  fit_section(curve, first, middle, start, mid, tolerance, depth + 1, result);
+  fit_section(curve, middle, last, mid, end, tolerance, depth + 1, result);
+}
+
+/**
+ * @brief flatten_edge Convert an edge into polyline vertices
+ * @return Vertices in the direction of the edge's geometry, including the end point
+ */
+[[nodiscard]] static std::vector<vertex> flatten_edge(const TopoDS_Edge &edge, double tolerance) {
+  std::vector<vertex> result;
+
+  // n.b. the adaptor ignores the orientation of the edge
+  const auto curve = BRepAdaptor_Curve(edge);
+  const auto first = curve.FirstParameter();
+  const auto last = curve.LastParameter();
+
+  switch (curve.GetType()) {
+  case GeomAbs_Line:
+    result.emplace_back(curve.Value(first).X(), curve.Value(first).Y(), 0);
+    break;
+
+  case GeomAbs_Circle: {
+    // parameter increases counter-clockwise around the circle's axis
+    const auto direction = curve.Circle().Axis().Direction().Z() > 0 ? 1.0 : -1.0;
+    const auto sweep = direction * (last - first);
+    // anything over a semicircle must be split
+    const auto pieces = std::max(1, static_cast<int>(std::ceil(std::abs(sweep) / M_PI - 1e-9)));
+    const auto bulge = std::tan(sweep / pieces / 4);
+
+    for (int i = 0; i < pieces; ++i) {
+      const auto p = curve.Value(first + (last - first) * i / pieces);
+      result.emplace_back(p.X(), p.Y(), bulge);
+    }
+    break;
+  }
+
+  default: {
+    // ellipses, BSplines, Beziers, offset curves, ...
+    sse::fit_biarcs(curve, first, last, tolerance, result);
+    break;
+  }
+  }
+
+  const auto end = curve.Value(last);
+  result.emplace_back(end.X(), end.Y(), 0);
+
+  return result;
+}
+
+/**
+ * @brief append Append a flattened edge to a polyline, without its end point
+ * @param pline Polyline to append to
+ * @param vertexes Vertices of the edge, in the direction of its geometry
+ * @param reversed The edge runs opposite to its geometry
+ */
+static void append(cavc::Polyline<double> &pline, const std::vector<vertex> &vertexes, bool reversed) {
+  if (vertexes.size() < 2) {
+    return;
+  }
+
+  if (!reversed) {
+    pline.vertexes().insert(pline.vertexes().end(), vertexes.cbegin(), vertexes.cend() - 1);
+    return;
+  }
+
+  // walking a segment backwards flips the direction of its arc
+  for (auto i = vertexes.size() - 1; i > 0; --i) {
+    pline.addVertex(vertexes[i].x(), vertexes[i].y(), -vertexes[i - 1].bulge());
+  }
+}
+
+namespace sse {
+
+const std::vector<cavc::PlineVertex<double>> *EdgeCache::find(const TopoDS_Edge &edge) const {
+  return edges.Seek(edge);
+}
+
+const std::vector<cavc::PlineVertex<double>> &EdgeCache::insert(const TopoDS_Edge &edge,
+                                                                std::vector<cavc::PlineVertex<double>> vertexes) {
+  return *edges.Bound(edge, std::move(vertexes));
+}
+
+void EdgeCache::clear() {
+  edges.Clear();
+}
+
+void fit_biarcs(const Adaptor3d_Curve &curve, double first, double last, double tolerance,
+                std::vector<cavc::PlineVertex<double>> &result) {
+  if (tolerance <= 0) {
+    spdlog::error("Flatten: tolerance must be positive, received {}", tolerance);
+    throw std::invalid_argument("Flatten: tolerance must be positive");
+  }
+
+  // biarcs are tangent continuous, so split at corners
+  const auto count = curve.NbIntervals(GeomAbs_C1);
+  TColStd_Array1OfReal bounds(1, count + 1);
+  curve.Intervals(bounds, GeomAbs_C1);
+
+  const auto initial_size = result.size();
+
+  for (int i = 1; i <= count; ++i) {
+    const auto a = std::max(bounds(i), first);
+    const auto b = std::min(bounds(i + 1), last);
+    if (b - a <= cavc::utils::realThreshold<double>()) {
+      continue;
+    }
+
+    fit_section(curve, a, b, evaluate(curve, a), evaluate(curve, b), tolerance, 0, result);
+  }
+
+  spdlog::trace("Flatten: fitted {} arcs to curve section [{}, {}]", result.size() - initial_size, first, last);
+}
+
+cavc::Polyline<double> flatten_wire(TopoDS_Wire wire, double tolerance, EdgeCache *cache) {
+  cavc::Polyline<double> result;
+  // we only care about closed wires
+  result.isClosed() = true;
+
+  // n.b. wires built by algorithms don't always have the closed flag set
+  if (!wire.Closed() && !BRep_Tool::IsClosed(wire)) {
+    spdlog::trace("Flatten: Wire is open, skipping");
+    return result;
+  }
+
+// reserve enough space for the child edges
+#if OCC_VERSION_HEX >= 0x070400
+  result.vertexes().reserve(wire.NbChildren());
+#endif
+
+  // reverse wire if necessary
+  if (wire.Orientation() == TopAbs_REVERSED) {
+    spdlog::trace("Flatten: Reversing wire");
+    wire.Reverse();
+  }
+
+  std::vector<vertex> uncached;
+
+  for (auto exp = BRepTools_WireExplorer(wire); exp.More(); exp.Next()) {
+    const auto &edge = exp.Current();
+    if (BRep_Tool::Degenerated(edge)) {
+      continue;
+    }
+
+    const auto *vertexes = cache ? cache->find(edge) : nullptr;
+    if (!vertexes) {
+      uncached = flatten_edge(edge, tolerance);
+      vertexes = cache ? &cache->insert(edge, std::move(uncached)) : &uncached;
+    }
+
+    // if the geometry is reversed from the topology, walk it backwards
+    append(result, *vertexes, edge.Orientation() == TopAbs_REVERSED);
+  }
+
+  return result;
+}
+
+} // namespace sse
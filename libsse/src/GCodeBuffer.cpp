@@ -0,0 +1,93 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file GCodeBuffer.cpp
+ * @brief Reusable, chunked output buffer for gcode
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <algorithm>
+#include <stdexcept>
+// external headers
+#include <spdlog/spdlog.h>
+// project headers
+#include "sse/GCodeBuffer.hpp"
+
+namespace sse {
+
+GCodeBuffer::GCodeBuffer(std::size_t chunk_size) : chunk_size{chunk_size} {
+  if (chunk_size < max_line_length) {
+    spdlog::error("GCodeBuffer: chunk size must be at least {} bytes", max_line_length);
+    throw std::invalid_argument("GCodeBuffer: chunk size too small");
+  }
+
+  chunks.emplace_back().reserve(chunk_size);
+}
+
+void GCodeBuffer::append(std::string_view text) {
+  while (!text.empty()) {
+    auto &chunk = chunks[current];
+    const auto space = chunk.capacity() - chunk.size();
+    if (space == 0) {
+      next_chunk();
+      continue;
+    }
+
+    const auto length = std::min(space, text.size());
+    chunk.append(text.data(), length);
+    text.remove_prefix(length);
+  }
+}
+
+void GCodeBuffer::clear() noexcept {
+  for (std::size_t i = 0; i <= current; ++i) {
+    chunks[i].clear();
+  }
+  current = 0;
+}
+
+std::size_t GCodeBuffer::size() const noexcept {
+  std::size_t result = 0;
+  for (std::size_t i = 0; i <= current; ++i) {
+    result += chunks[i].size();
+  }
+  return result;
+}
+
+std::string GCodeBuffer::str() const {
+  std::string result;
+  result.reserve(size());
+  for_each_chunk([&result](std::string_view chunk) { result += chunk; });
+  return result;
+}
+
+void GCodeBuffer::write(std::ostream &out) const {
+  for_each_chunk([&out](std::string_view chunk) { out.write(chunk.data(), static_cast<std::streamsize>(chunk.size())); });
+}
+
+void GCodeBuffer::next_chunk() {
+  ++current;
+  if (current == chunks.size()) {
+    chunks.emplace_back().reserve(chunk_size);
+  }
+}
+
+} // namespace sse
@@ -0,0 +1,643 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file GCodeCompression.cpp
+ * @brief Compression of gcode: MeatPack and heatshrink for binary gcode, gzip and zstd for files
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+// external headers
+#include <spdlog/spdlog.h>
+// project headers
+#include "sse/GCodeCompression.hpp"
+// optional dependencies, see libsse/CMakeLists.txt
+#ifdef SSE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef SSE_ZSTD
+#include <zstd.h>
+#endif
+
+//! first two bytes of a signal, which can't start a packed pair of ASCII characters
+static constexpr unsigned char meatpack_signal = 0xff;
+static constexpr unsigned char meatpack_enable_packing = 0xfb;
+static constexpr unsigned char meatpack_disable_packing = 0xfa;
+static constexpr unsigned char meatpack_enable_no_spaces = 0xf7;
+static constexpr unsigned char meatpack_disable_no_spaces = 0xf6;
+//! nibble for a character that follows as a whole byte
+static constexpr unsigned char meatpack_full = 0xf;
+
+//! characters of each nibble; 11 is ' ', or 'E' in no-spaces mode
+static constexpr char meatpack_table[] = "0123456789. \nGX";
+
+/**
+ * @brief Nibble of a character in no-spaces mode, or meatpack_full
+ */
+static unsigned char meatpack_code(char c) noexcept {
+  if (c >= '0' && c <= '9') {
+    return static_cast<unsigned char>(c - '0');
+  }
+  switch (c) {
+  case '.': return 10;
+  case 'E': return 11;
+  case '\n': return 12;
+  case 'G': return 13;
+  case 'X': return 14;
+  default: return meatpack_full;
+  }
+}
+
+/**
+ * @brief Reads fields of up to 16 bits, most significant bit first
+ */
+class BitReader {
+public:
+  explicit BitReader(std::string_view data) noexcept : data(data) {}
+
+  /**
+   * @brief read Read a field
+   * @return false if there aren't enough bits left
+   */
+  bool read(int count, unsigned &value) noexcept {
+    while (bits < count) {
+      if (position == data.size()) {
+        return false;
+      }
+      buffer = (buffer << 8) | static_cast<unsigned char>(data[position++]);
+      bits += 8;
+    }
+    bits -= count;
+    value = (buffer >> bits) & ((1u << count) - 1);
+    return true;
+  }
+
+private:
+  std::string_view data;
+  std::size_t position = 0;
+  std::uint32_t buffer = 0;
+  int bits = 0;
+};
+
+/**
+ * @brief Writes fields of up to 16 bits, most significant bit first
+ */
+class BitWriter {
+public:
+  void write(unsigned value, int count) {
+    buffer = (buffer << count) | (value & ((1u << count) - 1));
+    bits += count;
+    while (bits >= 8) {
+      bits -= 8;
+      out.push_back(static_cast<char>((buffer >> bits) & 0xff));
+    }
+  }
+
+  /**
+   * @brief finish Pad the last byte with 0s
+   */
+  std::string finish() {
+    if (bits > 0) {
+      out.push_back(static_cast<char>((buffer << (8 - bits)) & 0xff));
+      bits = 0;
+    }
+    return std::move(out);
+  }
+
+private:
+  std::string out;
+  std::uint32_t buffer = 0;
+  int bits = 0;
+};
+
+/**
+ * @brief Check heatshrink's limits on its parameters
+ */
+static void check_heatshrink_parameters(int window_bits, int lookahead_bits) {
+  if (window_bits < 4 || window_bits > 15 || lookahead_bits < 3 || lookahead_bits >= window_bits) {
+    spdlog::error("heatshrink: invalid window {} / lookahead {}", window_bits, lookahead_bits);
+    throw std::invalid_argument("heatshrink: invalid window / lookahead");
+  }
+}
+
+/**
+ * @brief Throw for a format this build can't write or read
+ */
+[[noreturn]] static void unsupported(sse::StreamCompression compression) {
+  spdlog::error("compressed gcode: format {} isn't supported by this build", static_cast<int>(compression));
+  throw std::invalid_argument("compressed gcode: unsupported format");
+}
+
+#ifdef SSE_ZLIB
+//! windowBits for deflateInit2() / inflateInit2(): 15 for zlib, +16 for gzip, +32 to detect either
+static constexpr int zlib_window_bits = 15;
+static constexpr int gzip_window_bits = zlib_window_bits + 16;
+static constexpr int detect_window_bits = zlib_window_bits + 32;
+
+//! longest input zlib takes at once, since its sizes are unsigned int
+static constexpr std::size_t zlib_max_input = 1u << 30;
+#endif
+
+//! room added to the output for each step
+static constexpr std::size_t output_step = 1 << 16;
+
+namespace sse {
+
+std::string meatpack_encode(std::string_view gcode, bool comments) {
+  // strip the lines first, so pairs run across line ends
+  std::string text;
+  text.reserve(gcode.size());
+  while (!gcode.empty()) {
+    const auto end = gcode.find('\n');
+    auto line = gcode.substr(0, end);
+    gcode.remove_prefix(end == std::string_view::npos ? gcode.size() : end + 1);
+
+    const auto start = text.size();
+    const auto comment = line.find(';');
+    for (const auto c : line.substr(0, comment)) {
+      if (c != ' ' && c != '\t' && c != '\r') {
+        text.push_back(c);
+      }
+    }
+    if (comments && comment != std::string_view::npos) {
+      text.append(line.substr(comment));
+    }
+    if (text.size() > start) {
+      text.push_back('\n');
+    }
+  }
+  // an odd character is paired with an empty line
+  if (text.size() % 2 != 0) {
+    text.push_back('\n');
+  }
+
+  std::string result;
+  result.reserve(text.size() * 3 / 5 + 6);
+  for (const auto signal : {meatpack_enable_packing, meatpack_enable_no_spaces}) {
+    result.push_back(static_cast<char>(meatpack_signal));
+    result.push_back(static_cast<char>(meatpack_signal));
+    result.push_back(static_cast<char>(signal));
+  }
+
+  for (std::size_t i = 0; i < text.size(); i += 2) {
+    const auto first = meatpack_code(text[i]);
+    const auto second = meatpack_code(text[i + 1]);
+    result.push_back(static_cast<char>(first | (second << 4)));
+    if (first == meatpack_full) {
+      result.push_back(text[i]);
+    }
+    if (second == meatpack_full) {
+      result.push_back(text[i + 1]);
+    }
+  }
+
+  return result;
+}
+
+std::string meatpack_decode(std::string_view packed) {
+  const auto truncated = [] {
+    spdlog::error("meatpack_decode: truncated stream");
+    throw std::runtime_error("meatpack_decode: truncated stream");
+  };
+
+  std::string result;
+  result.reserve(packed.size() * 2);
+  bool packing = false;
+  bool no_spaces = false;
+
+  std::size_t i = 0;
+  while (i < packed.size()) {
+    const unsigned byte = static_cast<unsigned char>(packed[i++]);
+
+    if (byte == meatpack_signal && i < packed.size() && static_cast<unsigned char>(packed[i]) == meatpack_signal) {
+      if (i + 1 >= packed.size()) {
+        truncated();
+      }
+      switch (static_cast<unsigned char>(packed[i + 1])) {
+      case meatpack_enable_packing: packing = true; break;
+      case meatpack_disable_packing: packing = false; break;
+      case meatpack_enable_no_spaces: no_spaces = true; break;
+      case meatpack_disable_no_spaces: no_spaces = false; break;
+      default: break;
+      }
+      i += 2;
+      continue;
+    }
+
+    if (!packing) {
+      result.push_back(static_cast<char>(byte));
+      continue;
+    }
+
+    for (const auto nibble : {byte & 0xfu, byte >> 4u}) {
+      if (nibble == meatpack_full) {
+        if (i == packed.size()) {
+          truncated();
+        }
+        result.push_back(packed[i++]);
+      } else if (nibble == 11 && no_spaces) {
+        result.push_back('E');
+      } else {
+        result.push_back(meatpack_table[nibble]);
+      }
+    }
+  }
+
+  return result;
+}
+
+std::string heatshrink_compress(std::string_view data, int window_bits, int lookahead_bits) {
+  check_heatshrink_parameters(window_bits, lookahead_bits);
+
+  const auto window = std::size_t{1} << window_bits;
+  const auto longest = std::size_t{1} << lookahead_bits;
+  // a back reference has to be smaller than its length in literals
+  const auto shortest = static_cast<std::size_t>((1 + window_bits + lookahead_bits) / 9 + 1);
+  const auto depth = 32;
+  const auto size = data.size();
+
+  // chains of earlier positions with the same two bytes
+  std::vector<std::int32_t> head(1 << 16, -1);
+  std::vector<std::int32_t> previous(size, -1);
+  const auto insert = [&](std::size_t position) {
+    if (position + 1 < size) {
+      const auto key = static_cast<unsigned char>(data[position]) << 8 | static_cast<unsigned char>(data[position + 1]);
+      previous[position] = head[key];
+      head[key] = static_cast<std::int32_t>(position);
+    }
+  };
+
+  BitWriter out;
+  std::size_t position = 0;
+  while (position < size) {
+    std::size_t best_length = 0;
+    std::size_t best_distance = 0;
+
+    if (position + 1 < size) {
+      const auto limit = std::min(longest, size - position);
+      const auto key = static_cast<unsigned char>(data[position]) << 8 | static_cast<unsigned char>(data[position + 1]);
+      auto candidate = head[key];
+      for (int k = 0; k < depth && candidate >= 0 && position - candidate <= window; ++k) {
+        std::size_t length = 0;
+        while (length < limit && data[candidate + length] == data[position + length]) {
+          ++length;
+        }
+        if (length > best_length) {
+          best_length = length;
+          best_distance = position - candidate;
+          if (length == limit) {
+            break;
+          }
+        }
+        candidate = previous[candidate];
+      }
+    }
+
+    if (best_length >= shortest) {
+      out.write(0, 1);
+      out.write(static_cast<unsigned>(best_distance - 1), window_bits);
+      out.write(static_cast<unsigned>(best_length - 1), lookahead_bits);
+      for (std::size_t k = 0; k < best_length; ++k) {
+        insert(position++);
+      }
+    } else {
+      out.write(1, 1);
+      out.write(static_cast<unsigned char>(data[position]), 8);
+      insert(position++);
+    }
+  }
+
+  return out.finish();
+}
+
+std::string heatshrink_decompress(std::string_view data, int window_bits, int lookahead_bits, std::size_t size) {
+  check_heatshrink_parameters(window_bits, lookahead_bits);
+
+  std::string result;
+  result.reserve(size);
+  BitReader in(data);
+
+  // padding is shorter than a literal, so an incomplete item ends the data
+  unsigned tag = 0;
+  while (result.size() < size && in.read(1, tag)) {
+    if (tag != 0) {
+      unsigned literal = 0;
+      if (!in.read(8, literal)) {
+        break;
+      }
+      result.push_back(static_cast<char>(literal));
+      continue;
+    }
+
+    unsigned index = 0;
+    unsigned count = 0;
+    if (!in.read(window_bits, index) || !in.read(lookahead_bits, count)) {
+      break;
+    }
+    const std::size_t distance = index + 1;
+    if (distance > result.size()) {
+      spdlog::error("heatshrink_decompress: back reference before the start");
+      throw std::runtime_error("heatshrink_decompress: corrupt data");
+    }
+    // byte by byte, since a reference can overlap what it produces
+    for (std::size_t k = 0; k <= count && result.size() < size; ++k) {
+      result.push_back(result[result.size() - distance]);
+    }
+  }
+
+  if (result.size() != size) {
+    spdlog::error("heatshrink_decompress: expected {} bytes, got {}", size, result.size());
+    throw std::runtime_error("heatshrink_decompress: corrupt data");
+  }
+
+  return result;
+}
+
+struct StreamCompressor::State {
+#ifdef SSE_ZLIB
+  z_stream zlib{};
+#endif
+#ifdef SSE_ZSTD
+  ZSTD_CCtx *zstd = nullptr;
+#endif
+};
+
+StreamCompression stream_compression(const fs::path &file) {
+  const auto extension = file.extension();
+  if (extension == ".gz") {
+    return StreamCompression::gzip;
+  }
+  if (extension == ".zst") {
+    return StreamCompression::zstd;
+  }
+  return StreamCompression::none;
+}
+
+bool stream_compression_supported(StreamCompression compression) noexcept {
+  switch (compression) {
+  case StreamCompression::none: return true;
+#ifdef SSE_ZLIB
+  case StreamCompression::gzip:
+  case StreamCompression::zlib: return true;
+#endif
+#ifdef SSE_ZSTD
+  case StreamCompression::zstd: return true;
+#endif
+  default: return false;
+  }
+}
+
+StreamCompressor::StreamCompressor(StreamCompression compression, int level, unsigned threads)
+    : compression{compression}, state{std::make_unique<State>()} {
+  if (!stream_compression_supported(compression)) {
+    unsupported(compression);
+  }
+
+  switch (compression) {
+#ifdef SSE_ZLIB
+  case StreamCompression::gzip:
+  case StreamCompression::zlib: {
+    const auto bits = (compression == StreamCompression::gzip) ? gzip_window_bits : zlib_window_bits;
+    if (deflateInit2(&state->zlib, level == 0 ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED, bits, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      spdlog::error("StreamCompressor: deflateInit2 failed");
+      throw std::runtime_error("StreamCompressor: can't start zlib");
+    }
+    break;
+  }
+#endif
+#ifdef SSE_ZSTD
+  case StreamCompression::zstd:
+    state->zstd = ZSTD_createCCtx();
+    if (state->zstd == nullptr) {
+      spdlog::error("StreamCompressor: ZSTD_createCCtx failed");
+      throw std::runtime_error("StreamCompressor: can't start zstd");
+    }
+    ZSTD_CCtx_setParameter(state->zstd, ZSTD_c_compressionLevel, level);
+    // fails if libzstd was built without threads, then it compresses on the calling thread
+    if (threads > 0 && ZSTD_isError(ZSTD_CCtx_setParameter(state->zstd, ZSTD_c_nbWorkers, static_cast<int>(threads)))) {
+      spdlog::debug("StreamCompressor: libzstd has no worker threads");
+    }
+    break;
+#endif
+  default:
+    (void)level;
+    (void)threads;
+    break;
+  }
+}
+
+StreamCompressor::~StreamCompressor() {
+#ifdef SSE_ZLIB
+  if (compression == StreamCompression::gzip || compression == StreamCompression::zlib) {
+    deflateEnd(&state->zlib);
+  }
+#endif
+#ifdef SSE_ZSTD
+  ZSTD_freeCCtx(state->zstd);
+#endif
+}
+
+#ifdef SSE_ZLIB
+/**
+ * @brief Run deflate() until it has taken all its input, or ended the stream
+ */
+static void deflate_all(z_stream &zlib, int flush, std::string &out) {
+  int result = Z_OK;
+  do {
+    const auto size = out.size();
+    out.resize(size + output_step);
+    zlib.next_out = reinterpret_cast<Bytef *>(out.data() + size);
+    zlib.avail_out = static_cast<uInt>(output_step);
+    result = deflate(&zlib, flush);
+    out.resize(out.size() - zlib.avail_out);
+    if (result == Z_STREAM_ERROR) {
+      spdlog::error("StreamCompressor: deflate failed");
+      throw std::runtime_error("StreamCompressor: deflate failed");
+    }
+  } while (zlib.avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+}
+#endif
+
+#ifdef SSE_ZSTD
+/**
+ * @brief Run ZSTD_compressStream2() until it has taken all its input, or flushed the frame
+ */
+static void zstd_all(ZSTD_CCtx *zstd, ZSTD_inBuffer &input, ZSTD_EndDirective mode, std::string &out) {
+  std::size_t remaining = 0;
+  do {
+    const auto size = out.size();
+    out.resize(size + ZSTD_CStreamOutSize());
+    ZSTD_outBuffer output{out.data() + size, ZSTD_CStreamOutSize(), 0};
+    remaining = ZSTD_compressStream2(zstd, &output, &input, mode);
+    out.resize(size + output.pos);
+    if (ZSTD_isError(remaining)) {
+      spdlog::error("StreamCompressor: zstd failed: {}", ZSTD_getErrorName(remaining));
+      throw std::runtime_error("StreamCompressor: zstd failed");
+    }
+  } while (input.pos < input.size || (mode == ZSTD_e_end && remaining != 0));
+}
+#endif
+
+void StreamCompressor::compress(std::string_view input, std::string &out) {
+  switch (compression) {
+#ifdef SSE_ZLIB
+  case StreamCompression::gzip:
+  case StreamCompression::zlib:
+    while (!input.empty()) {
+      const auto part = input.substr(0, zlib_max_input);
+      input.remove_prefix(part.size());
+      state->zlib.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(part.data()));
+      state->zlib.avail_in = static_cast<uInt>(part.size());
+      deflate_all(state->zlib, Z_NO_FLUSH, out);
+    }
+    break;
+#endif
+#ifdef SSE_ZSTD
+  case StreamCompression::zstd: {
+    ZSTD_inBuffer buffer{input.data(), input.size(), 0};
+    zstd_all(state->zstd, buffer, ZSTD_e_continue, out);
+    break;
+  }
+#endif
+  default:
+    out.append(input);
+    break;
+  }
+}
+
+void StreamCompressor::finish(std::string &out) {
+  switch (compression) {
+#ifdef SSE_ZLIB
+  case StreamCompression::gzip:
+  case StreamCompression::zlib:
+    state->zlib.next_in = nullptr;
+    state->zlib.avail_in = 0;
+    deflate_all(state->zlib, Z_FINISH, out);
+    break;
+#endif
+#ifdef SSE_ZSTD
+  case StreamCompression::zstd: {
+    ZSTD_inBuffer buffer{nullptr, 0, 0};
+    zstd_all(state->zstd, buffer, ZSTD_e_end, out);
+    break;
+  }
+#endif
+  default:
+    (void)out;
+    break;
+  }
+}
+
+std::string stream_decompress(std::string_view data, StreamCompression compression) {
+  if (!stream_compression_supported(compression)) {
+    unsupported(compression);
+  }
+
+  const auto corrupt = [](const char *reason) {
+    spdlog::error("stream_decompress: {}", reason);
+    throw std::runtime_error("stream_decompress: corrupt data");
+  };
+
+  std::string result;
+  switch (compression) {
+#ifdef SSE_ZLIB
+  case StreamCompression::gzip:
+  case StreamCompression::zlib: {
+    z_stream zlib{};
+    if (inflateInit2(&zlib, detect_window_bits) != Z_OK) {
+      corrupt("inflateInit2 failed");
+    }
+    // free the stream, however this scope is left
+    const auto end = std::unique_ptr<z_stream, int (*)(z_streamp)>(&zlib, inflateEnd);
+
+    bool ended = true;
+    while (!data.empty()) {
+      const auto part = data.substr(0, zlib_max_input);
+      zlib.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(part.data()));
+      zlib.avail_in = static_cast<uInt>(part.size());
+
+      // until the member ends, or inflate() needs more input
+      int status = Z_OK;
+      do {
+        const auto size = result.size();
+        result.resize(size + output_step);
+        zlib.next_out = reinterpret_cast<Bytef *>(result.data() + size);
+        zlib.avail_out = static_cast<uInt>(output_step);
+        status = inflate(&zlib, Z_NO_FLUSH);
+        result.resize(result.size() - zlib.avail_out);
+        if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+          corrupt(zlib.msg != nullptr ? zlib.msg : "inflate failed");
+        }
+      } while (status == Z_OK && (zlib.avail_in > 0 || zlib.avail_out == 0));
+      data.remove_prefix(part.size() - zlib.avail_in);
+
+      ended = (status == Z_STREAM_END);
+      if (ended) {
+        // the next gzip member, if there is one
+        inflateReset(&zlib);
+      }
+    }
+    if (!ended) {
+      corrupt("truncated stream");
+    }
+    break;
+  }
+#endif
+#ifdef SSE_ZSTD
+  case StreamCompression::zstd: {
+    const auto context = std::unique_ptr<ZSTD_DCtx, std::size_t (*)(ZSTD_DCtx *)>(ZSTD_createDCtx(), ZSTD_freeDCtx);
+    if (!context) {
+      corrupt("ZSTD_createDCtx failed");
+    }
+
+    ZSTD_inBuffer input{data.data(), data.size(), 0};
+    std::size_t remaining = 0;
+    while (input.pos < input.size) {
+      const auto size = result.size();
+      result.resize(size + ZSTD_DStreamOutSize());
+      ZSTD_outBuffer output{result.data() + size, ZSTD_DStreamOutSize(), 0};
+      remaining = ZSTD_decompressStream(context.get(), &output, &input);
+      result.resize(size + output.pos);
+      if (ZSTD_isError(remaining)) {
+        corrupt(ZSTD_getErrorName(remaining));
+      }
+    }
+    // 0 once a frame is complete
+    if (remaining != 0) {
+      corrupt("truncated stream");
+    }
+    break;
+  }
+#endif
+  default:
+    (void)corrupt;
+    result = data;
+    break;
+  }
+
+  return result;
+}
+
+} // namespace sse
@@ -0,0 +1,142 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file GCodeIndex.cpp
+ * @brief Index of the layers of a gcode file, for seeking to a layer
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+// external headers
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+// project headers
+#include "sse/GCodeCompression.hpp"
+#include "sse/GCodeIndex.hpp"
+
+namespace sse {
+
+fs::path layer_index_path(const fs::path &gcode) {
+  auto result = gcode;
+  result += ".idx";
+  return result;
+}
+
+void write_layer_index(const fs::path &file, const std::vector<LayerIndexEntry> &layers) {
+  std::string text(layer_index_magic);
+  text += "\n; offset size z filament time\n";
+  for (const auto &layer : layers) {
+    fmt::format_to(std::back_inserter(text), "{:d} {:d} {} {} {}\n", layer.offset, layer.size, layer.z,
+                   layer.filament, layer.time);
+  }
+
+  std::ofstream out(file, std::ios::binary | std::ios::trunc);
+  out.write(text.data(), static_cast<std::streamsize>(text.size()));
+  out.close();
+  if (!out) {
+    spdlog::error("write_layer_index: can't write {}", file.string());
+    throw std::runtime_error("write_layer_index: can't write file");
+  }
+}
+
+std::vector<LayerIndexEntry> read_layer_index(const fs::path &file) {
+  std::ifstream in(file, std::ios::binary);
+  std::string line;
+  if (!std::getline(in, line) || line != layer_index_magic) {
+    spdlog::error("read_layer_index: {} is missing, or not a layer index", file.string());
+    throw std::runtime_error("read_layer_index: not a layer index");
+  }
+
+  std::vector<LayerIndexEntry> result;
+  while (std::getline(in, line)) {
+    if (line.empty() || line.front() == ';') {
+      continue;
+    }
+
+    std::istringstream fields(line);
+    LayerIndexEntry entry{};
+    fields >> entry.offset >> entry.size >> entry.z >> entry.filament >> entry.time;
+    if (fields.fail()) {
+      spdlog::error("read_layer_index: invalid entry for layer {} in {}", result.size(), file.string());
+      throw std::runtime_error("read_layer_index: invalid entry");
+    }
+    result.push_back(entry);
+  }
+
+  return result;
+}
+
+GCodeLayerReader::GCodeLayerReader(const fs::path &gcode) {
+  if (stream_compression(gcode) != StreamCompression::none) {
+    spdlog::error("GCodeLayerReader: {} is compressed, so it can't be seeked", gcode.string());
+    throw std::invalid_argument("GCodeLayerReader: compressed file");
+  }
+
+  layers = read_layer_index(layer_index_path(gcode));
+
+  file.open(gcode, std::ios::binary);
+  if (!file) {
+    spdlog::error("GCodeLayerReader: can't open {}", gcode.string());
+    throw std::runtime_error("GCodeLayerReader: can't open file");
+  }
+
+  // the last layer has to end within the file, or the index is for another file
+  file.seekg(0, std::ios::end);
+  const auto size = static_cast<std::uint64_t>(file.tellg());
+  if (!layers.empty() && layers.back().offset + layers.back().size > size) {
+    spdlog::error("GCodeLayerReader: the index of {} runs past the end of the file", gcode.string());
+    throw std::runtime_error("GCodeLayerReader: index doesn't match the file");
+  }
+}
+
+const LayerIndexEntry &GCodeLayerReader::info(std::size_t number) const {
+  if (number >= layers.size()) {
+    spdlog::error("GCodeLayerReader: no layer {}, of {}", number, layers.size());
+    throw std::out_of_range("GCodeLayerReader: no such layer");
+  }
+  return layers[number];
+}
+
+std::size_t GCodeLayerReader::find(double z) const noexcept {
+  const auto it = std::lower_bound(layers.begin(), layers.end(), z,
+                                   [](const LayerIndexEntry &layer, double target) { return layer.z < target; });
+  return static_cast<std::size_t>(it - layers.begin());
+}
+
+std::string GCodeLayerReader::layer(std::size_t number) {
+  const auto &entry = info(number);
+
+  std::string result(entry.size, '\0');
+  file.clear();
+  file.seekg(static_cast<std::streamoff>(entry.offset));
+  file.read(result.data(), static_cast<std::streamsize>(result.size()));
+  if (!file) {
+    spdlog::error("GCodeLayerReader: can't read layer {}", number);
+    throw std::runtime_error("GCodeLayerReader: read failed");
+  }
+  return result;
+}
+
+} // namespace sse
@@ -0,0 +1,132 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file GCodeNumber.cpp
+ * @brief Fast fixed precision formatting of gcode words
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+// external headers
+#include <spdlog/spdlog.h>
+// project headers
+#include "sse/GCodeNumber.hpp"
+
+static constexpr std::int64_t integer_powers[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+static constexpr double double_powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+//! scaled numbers must be smaller than this to fit in an int64
+static constexpr double max_scaled = 9e18;
+
+namespace sse {
+
+double number_units(double value, int precision) noexcept {
+  // n.b. rounding the scaled value may round differently to printf, when the
+  // value is within an ulp of halfway between two outputs
+  return std::round(value * double_powers[std::clamp(precision, 0, max_number_precision)]);
+}
+
+char *write_number(char *out, double value, int precision) noexcept {
+  precision = std::clamp(precision, 0, max_number_precision);
+  const auto scaled = number_units(value, precision);
+
+  // also catches inf and nan
+  if (!(std::abs(scaled) < max_scaled)) {
+    return fmt::format_to_n(out, max_number_length, "{:.{}f}", value, precision).out;
+  }
+
+  auto units = static_cast<std::int64_t>(scaled);
+
+  // never write "-0"
+  if (units == 0) {
+    *out++ = '0';
+    return out;
+  }
+
+  if (units < 0) {
+    *out++ = '-';
+    units = -units;
+  }
+
+  const auto divisor = integer_powers[precision];
+  auto fraction = units % divisor;
+  out = std::to_chars(out, out + max_number_length, units / divisor).ptr;
+
+  if (fraction == 0) {
+    return out;
+  }
+
+  auto digits = precision;
+  while (fraction % 10 == 0) {
+    fraction /= 10;
+    --digits;
+  }
+
+  // write the fraction backwards, padding with leading zeros, e.g. 0.05
+  *out++ = '.';
+  auto *const end = out + digits;
+  for (auto *digit = end; digit != out;) {
+    *--digit = static_cast<char>('0' + fraction % 10);
+    fraction /= 10;
+  }
+
+  return end;
+}
+
+GCodeLine::GCodeLine(std::string_view command) {
+  if (command.size() >= capacity) {
+    spdlog::error("GCodeLine: command too long: {}", command);
+    throw std::length_error("GCodeLine: command too long");
+  }
+
+  std::memcpy(text.data(), command.data(), command.size());
+  length = command.size();
+  text[length] = '\n';
+}
+
+GCodeLine &GCodeLine::word(char letter, double value, int precision) {
+  // separator, letter, number and newline
+  if (capacity - length < max_number_length + 3) {
+    spdlog::error("GCodeLine: line too long: {}", std::string_view(text.data(), length));
+    throw std::length_error("GCodeLine: line too long");
+  }
+
+  auto *out = text.data() + length;
+  if (length > 0) {
+    *out++ = ' ';
+  }
+  *out++ = letter;
+  out = write_number(out, value, precision);
+  *out = '\n';
+  length = static_cast<std::size_t>(out - text.data());
+
+  return *this;
+}
+
+} // namespace sse
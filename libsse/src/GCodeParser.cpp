@@ -0,0 +1,603 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file GCodeParser.cpp
+ * @brief Fast gcode parsing, and statistics of a whole program, e.g. to check the output of the slicer
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <locale>
+#include <sstream>
+#include <stdexcept>
+// SIMD headers
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+// external headers
+#include <spdlog/spdlog.h>
+#include "cavc/mathutils.hpp"
+// project headers
+#include "sse/GCodeCompression.hpp"
+#include "sse/GCodeParser.hpp"
+#include "sse/Toolpath.hpp"
+
+//! powers of 10 that are exact doubles
+static constexpr double powers_of_10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                          1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+//! mantissas up to 10^15 are exact doubles, so one multiplication or division is correctly rounded
+static constexpr int max_exact_digits = 15;
+//! size of the blocks a file is read in (bytes)
+static constexpr std::size_t read_block_size = 1 << 20;
+//! the length of a bezier is measured along lines this close to it (mm)
+static constexpr double bezier_length_tolerance = 1e-4;
+//! deeper subroutine calls count as unparsed, e.g. a subroutine that calls itself
+static constexpr int max_call_depth = 16;
+
+//! word indices of the axes and feedrate; the extruder's is set per analyzer
+static constexpr std::size_t axis_x = 'X' - 'A';
+static constexpr std::size_t axis_y = 'Y' - 'A';
+static constexpr std::size_t axis_z = 'Z' - 'A';
+static constexpr std::size_t axis_f = 'F' - 'A';
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+/**
+ * @brief first_bit Index of the lowest set bit of a non-zero mask
+ */
+static inline unsigned first_bit(unsigned mask) noexcept {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+static inline bool is_digit(char c) noexcept {
+  return c >= '0' && c <= '9';
+}
+
+static inline bool is_letter(char c) noexcept {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+static inline bool is_space(char c) noexcept {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+/**
+ * @brief Split an O-word line, e.g. "o1 call", into the name of its subroutine and its keyword
+ * @param line Line, without the newline
+ * @param name Set to the name after the O, e.g. 1
+ * @param keyword Set to the keyword after the name, e.g. sub, endsub or call
+ * @return false if the line isn't an O-word with a keyword
+ */
+static bool parse_o_word(std::string_view line, std::string_view &name, std::string_view &keyword) noexcept {
+  auto p = line.data();
+  const auto end = p + line.size();
+  const auto skip_spaces = [&p, end] {
+    while (p < end && is_space(*p)) {
+      ++p;
+    }
+  };
+
+  skip_spaces();
+  // line number, e.g. N10 o1 call
+  if (p < end && (*p == 'N' || *p == 'n')) {
+    ++p;
+    while (p < end && is_digit(*p)) {
+      ++p;
+    }
+    skip_spaces();
+  }
+  if (p == end || (*p != 'o' && *p != 'O')) {
+    return false;
+  }
+
+  const auto name_begin = ++p;
+  while (p < end && !is_space(*p)) {
+    ++p;
+  }
+  name = std::string_view(name_begin, static_cast<std::size_t>(p - name_begin));
+  skip_spaces();
+  const auto keyword_begin = p;
+  while (p < end && is_letter(*p)) {
+    ++p;
+  }
+  keyword = std::string_view(keyword_begin, static_cast<std::size_t>(p - keyword_begin));
+  return !name.empty() && !keyword.empty();
+}
+
+namespace sse {
+
+const char *find_line_end(const char *begin, const char *end) noexcept {
+  auto p = begin;
+
+#if defined(__AVX2__)
+  const auto newline = _mm256_set1_epi8('\n');
+  for (; p + 32 <= end; p += 32) {
+    const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    const auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)));
+    if (mask != 0) {
+      return p + first_bit(mask);
+    }
+  }
+#elif defined(__SSE2__) || defined(_M_X64)
+  const auto newline = _mm_set1_epi8('\n');
+  for (; p + 16 <= end; p += 16) {
+    const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+    if (mask != 0) {
+      return p + first_bit(mask);
+    }
+  }
+#endif
+
+  // remainder, or everything without SIMD
+  for (; p < end; ++p) {
+    if (*p == '\n') {
+      return p;
+    }
+  }
+  return end;
+}
+
+const char *parse_number(const char *begin, const char *end, double &value) noexcept {
+  auto p = begin;
+  const bool negative = (p < end && *p == '-');
+  if (p < end && (*p == '-' || *p == '+')) {
+    ++p;
+  }
+  const auto unsigned_begin = p;
+
+  std::uint64_t mantissa = 0;
+  int digits = 0;
+  int scale = 0;
+  bool found = false;
+
+  for (; p < end && is_digit(*p); ++p) {
+    found = true;
+    // leading zeros aren't significant
+    if (mantissa == 0 && *p == '0') {
+      continue;
+    }
+    if (digits <= max_exact_digits) {
+      mantissa = mantissa * 10 + static_cast<std::uint64_t>(*p - '0');
+    } else {
+      ++scale;
+    }
+    ++digits;
+  }
+  if (p < end && *p == '.') {
+    ++p;
+    for (; p < end && is_digit(*p); ++p) {
+      found = true;
+      if (mantissa == 0 && *p == '0') {
+        --scale;
+        continue;
+      }
+      if (digits <= max_exact_digits) {
+        mantissa = mantissa * 10 + static_cast<std::uint64_t>(*p - '0');
+        --scale;
+      }
+      ++digits;
+    }
+  }
+
+  if (!found) {
+    return nullptr;
+  }
+
+  // n.b. there's no exponent: in gcode, a letter after a number always starts the next word, e.g. X10E2
+  double result = 0;
+  if (digits <= max_exact_digits && scale >= -22 && scale <= 22) {
+    const auto magnitude = static_cast<double>(mantissa);
+    result = (scale < 0) ? magnitude / powers_of_10[-scale] : magnitude * powers_of_10[scale];
+  } else {
+    // too many digits to be exact; the digits were scanned, so this reads exactly those, whatever the locale
+#if defined(__cpp_lib_to_chars)
+    if (std::from_chars(unsigned_begin, p, result, std::chars_format::fixed).ec != std::errc{}) {
+      result = (mantissa == 0) ? 0.0 : std::numeric_limits<double>::infinity();
+    }
+#else
+    // no floating point from_chars before GCC 11; the classic locale always reads '.' as the decimal point
+    std::istringstream text(std::string(unsigned_begin, p));
+    text.imbue(std::locale::classic());
+    text >> result;
+#endif
+  }
+  value = negative ? -result : result;
+  return p;
+}
+
+bool parse_line(std::string_view line, GCodeCommand &command) noexcept {
+  command.words = 0;
+  command.comment = {};
+
+  auto p = line.data();
+  const auto end = p + line.size();
+  while (p < end) {
+    const auto c = *p;
+    if (is_space(c)) {
+      ++p;
+      continue;
+    }
+    if (c == ';') {
+      command.comment = std::string_view(p + 1, static_cast<std::size_t>(end - p - 1));
+      break;
+    }
+    if (c == '(') {
+      const auto close = static_cast<const char *>(std::memchr(p, ')', static_cast<std::size_t>(end - p)));
+      if (!close) {
+        return false;
+      }
+      command.comment = std::string_view(p + 1, static_cast<std::size_t>(close - p - 1));
+      p = close + 1;
+      continue;
+    }
+    if (c == '*') {
+      // checksum, the end of a numbered line
+      break;
+    }
+    if (!is_letter(c)) {
+      return false;
+    }
+
+    const auto index = (c & ~0x20) - 'A';
+    ++p;
+    while (p < end && is_space(*p)) {
+      ++p;
+    }
+
+    double value;
+    if (const auto next = parse_number(p, end, value)) {
+      p = next;
+    } else if (p == end || *p == ';' || *p == '(' || *p == '*' || is_space(p[-1])) {
+      // a letter on its own, e.g. G28 X
+      value = std::numeric_limits<double>::quiet_NaN();
+    } else {
+      // e.g. a keyword
+      return false;
+    }
+
+    command.words |= 1u << index;
+    command.values[static_cast<std::size_t>(index)] = value;
+  }
+
+  return true;
+}
+
+GCodeAnalyzer::GCodeAnalyzer(char extruder_axis) {
+  if (std::string_view("EABCUVW").find(extruder_axis) == std::string_view::npos) {
+    spdlog::error("Invalid extruder axis: {}, expected one of E, A, B, C, U, V, W", extruder_axis);
+    throw std::invalid_argument("invalid extruder axis");
+  }
+  axis_e = static_cast<std::size_t>(extruder_axis - 'A');
+}
+
+void GCodeAnalyzer::feed(std::string_view text) {
+  auto p = text.data();
+  const auto end = p + text.size();
+
+  // finish the line split from the previous piece
+  if (!partial.empty()) {
+    const auto newline = find_line_end(p, end);
+    partial.append(p, static_cast<std::size_t>(newline - p));
+    if (newline == end) {
+      return;
+    }
+    line(partial);
+    partial.clear();
+    p = newline + 1;
+  }
+
+  while (p < end) {
+    const auto newline = find_line_end(p, end);
+    if (newline == end) {
+      partial.assign(p, static_cast<std::size_t>(end - p));
+      return;
+    }
+    line(std::string_view(p, static_cast<std::size_t>(newline - p)));
+    p = newline + 1;
+  }
+}
+
+GCodeAnalysis GCodeAnalyzer::finish() {
+  if (!partial.empty()) {
+    line(partial);
+    partial.clear();
+  }
+  return std::move(result);
+}
+
+void GCodeAnalyzer::line(std::string_view text) {
+  ++result.lines;
+
+  std::string_view name;
+  std::string_view keyword;
+  const auto o_word = parse_o_word(text, name, keyword);
+  if (recording) {
+    if (o_word && keyword == "endsub") {
+      ++result.commands;
+      recording.reset();
+    } else {
+      auto &body = subroutines[*recording];
+      body.append(text);
+      body.push_back('\n');
+    }
+    return;
+  }
+  if (o_word && keyword == "sub") {
+    ++result.commands;
+    recording.emplace(name);
+    subroutines[*recording].clear();
+    return;
+  }
+
+  execute(text);
+}
+
+void GCodeAnalyzer::execute(std::string_view text) {
+  std::string_view name;
+  std::string_view keyword;
+  if (parse_o_word(text, name, keyword)) {
+    const auto body = subroutines.find(std::string(name));
+    if (keyword != "call" || body == subroutines.end() || call_depth >= max_call_depth) {
+      ++result.unparsed;
+      return;
+    }
+
+    ++result.commands;
+    ++call_depth;
+    // n.b. every line of a body ends with a newline
+    const std::string_view lines = body->second;
+    for (std::size_t begin = 0; begin < lines.size();) {
+      const auto newline = lines.find('\n', begin);
+      execute(lines.substr(begin, newline - begin));
+      begin = newline + 1;
+    }
+    --call_depth;
+    return;
+  }
+
+  if (!parse_line(text, command)) {
+    ++result.unparsed;
+    return;
+  }
+
+  if (!command.comment.empty()) {
+    ++result.comments;
+    auto comment = command.comment;
+    comment.remove_prefix(std::min(comment.find_first_not_of(' '), comment.size()));
+    if (comment.substr(0, 6) == "LAYER:") {
+      result.layers.push_back({});
+      result.layers.back().z = z;
+    }
+  }
+
+  if (command.words == 0) {
+    return;
+  }
+  ++result.commands;
+
+  // position of an axis or the extruder, by word index
+  const auto axis = [this](std::size_t index) -> double & {
+    return index == axis_x ? x : index == axis_y ? y : index == axis_z ? z : e;
+  };
+  // local offset of an axis, by word index
+  const auto offset = [this](std::size_t index) -> double & {
+    return index == axis_x ? offset_x : index == axis_y ? offset_y : offset_z;
+  };
+
+  if (command.has('G')) {
+    const auto code = command.value('G');
+    if (code == 0 || code == 1 || code == 2 || code == 3 || code == 5) {
+      move(static_cast<int>(code));
+    } else if (code == 90 || code == 91) {
+      // n.b. the extruder too, as Marlin does, until M82 or M83
+      relative_xyz = relative_e = (code == 91);
+    } else if (code == 92) {
+      for (const auto index : {axis_x, axis_y, axis_z, axis_e}) {
+        if (command.words & (1u << index)) {
+          axis(index) = command.values[index] + (index == axis_e ? 0 : offset(index));
+          known |= 1u << index;
+        }
+      }
+      known_xy = (known & (1u << axis_x)) && (known & (1u << axis_y));
+    } else if (code == 52) {
+      // nothing moves; later coordinates are relative to the new origin
+      for (const auto index : {axis_x, axis_y, axis_z}) {
+        if (command.words & (1u << index)) {
+          offset(index) = command.values[index];
+        }
+      }
+    } else if (code == 28) {
+      const auto all = !(command.has('X') || command.has('Y') || command.has('Z'));
+      for (const auto index : {axis_x, axis_y, axis_z}) {
+        if (all || (command.words & (1u << index))) {
+          axis(index) = 0;
+          known |= 1u << index;
+        }
+      }
+      known_xy = (known & (1u << axis_x)) && (known & (1u << axis_y));
+    }
+  } else if (command.has('M')) {
+    if (command.is('M', 82) || command.is('M', 83)) {
+      relative_e = command.is('M', 83);
+    }
+  } else if (!command.has('T') && motion >= 0 &&
+             (command.words & ((1u << axis_x) | (1u << axis_y) | (1u << axis_z) | (1u << axis_e)))) {
+    // the motion command was omitted, see ModalMode::commands
+    move(motion);
+  }
+
+  if (!result.layers.empty()) {
+    result.layers.back().z = z;
+  }
+}
+
+void GCodeAnalyzer::move(int mode) {
+  if (command.has('G') && motion == mode) {
+    ++result.redundant_commands;
+  }
+  motion = mode;
+
+  // end point, and whether each word is redundant
+  auto target = [this](std::size_t axis, double current, bool relative, double offset) {
+    if (!(command.words & (1u << axis))) {
+      return current;
+    }
+    const auto value = command.values[axis];
+    ++result.words;
+    if ((known & (1u << axis)) && (relative ? value == 0 : value + offset == current)) {
+      ++result.redundant_words;
+    }
+    known |= 1u << axis;
+    return relative ? current + value : value + offset;
+  };
+  const auto to_x = target(axis_x, x, relative_xyz, offset_x);
+  const auto to_y = target(axis_y, y, relative_xyz, offset_y);
+  const auto to_z = target(axis_z, z, relative_xyz, offset_z);
+  const auto to_e = target(axis_e, e, relative_e, 0);
+  f = target(axis_f, f, false, 0);
+
+  const bool curve = (mode == 2 || mode == 3 || mode == 5);
+  const bool moved = (to_x != x || to_y != y || (curve && (command.has('I') || command.has('J'))));
+  const auto extruded = to_e - e;
+
+  double length = 0;
+  if (moved && known_xy) {
+    if (mode == 2 || mode == 3) {
+      const auto i = command.has('I') ? command.value('I') : 0.0;
+      const auto j = command.has('J') ? command.value('J') : 0.0;
+      const auto cx = x + i;
+      const auto cy = y + j;
+      auto sweep = std::atan2(to_y - cy, to_x - cx) - std::atan2(y - cy, x - cx);
+      if (mode == 2) {
+        sweep = -sweep;
+      }
+      // the same start and end point is a full circle
+      if (sweep <= 0) {
+        sweep += 2 * cavc::utils::pi<double>();
+      }
+      length = std::hypot(i, j) * sweep;
+    } else if (mode == 5) {
+      const auto word = [this](char letter) { return command.has(letter) ? command.value(letter) : 0.0; };
+      const BezierControls controls{word('I'), word('J'), word('P'), word('Q')};
+      auto px = x;
+      auto py = y;
+      for (const auto &[bx, by] : flatten_bezier(x, y, to_x, to_y, controls, bezier_length_tolerance)) {
+        length += std::hypot(bx - px, by - py);
+        px = bx;
+        py = by;
+      }
+    } else {
+      const auto dx = to_x - x;
+      const auto dy = to_y - y;
+      length = std::sqrt(dx * dx + dy * dy);
+    }
+  }
+
+  auto *layer = result.layers.empty() ? nullptr : &result.layers.back();
+  if (moved) {
+    if (mode == 2 || mode == 3) {
+      ++result.arcs;
+    } else if (mode == 5) {
+      ++result.beziers;
+    }
+
+    if (extruded > 0) {
+      ++result.extrusions;
+      result.print_distance += length;
+      if (layer) {
+        ++layer->extrusions;
+        layer->min_x = std::min(layer->min_x, to_x);
+        layer->min_y = std::min(layer->min_y, to_y);
+        layer->max_x = std::max(layer->max_x, to_x);
+        layer->max_y = std::max(layer->max_y, to_y);
+      }
+    } else {
+      ++result.travels;
+      result.travel_distance += length;
+    }
+  } else if (extruded < 0 && to_z == z) {
+    ++result.retractions;
+  }
+  if (to_z != z) {
+    ++result.z_moves;
+  }
+
+  result.filament += extruded;
+  if (layer) {
+    layer->filament += extruded;
+  }
+
+  x = to_x;
+  y = to_y;
+  z = to_z;
+  e = to_e;
+  known_xy = (known & (1u << axis_x)) && (known & (1u << axis_y));
+}
+
+GCodeAnalysis analyze_gcode(std::string_view gcode, char extruder_axis) {
+  GCodeAnalyzer analyzer(extruder_axis);
+  analyzer.feed(gcode);
+  return analyzer.finish();
+}
+
+GCodeAnalysis analyze_gcode_file(const fs::path &file, char extruder_axis) {
+  std::ifstream in(file, std::ios::binary);
+  if (!in) {
+    spdlog::error("analyze_gcode_file: can't open {}", file.string());
+    throw std::runtime_error("analyze_gcode_file: can't open file");
+  }
+
+  if (const auto compression = stream_compression(file); compression != StreamCompression::none) {
+    std::stringstream data;
+    data << in.rdbuf();
+    return analyze_gcode(stream_decompress(data.str(), compression), extruder_axis);
+  }
+
+  GCodeAnalyzer analyzer(extruder_axis);
+  std::string block(read_block_size, '\0');
+  while (in) {
+    in.read(block.data(), static_cast<std::streamsize>(block.size()));
+    analyzer.feed(std::string_view(block.data(), static_cast<std::size_t>(in.gcount())));
+  }
+  if (in.bad()) {
+    spdlog::error("analyze_gcode_file: can't read {}", file.string());
+    throw std::runtime_error("analyze_gcode_file: read failed");
+  }
+  return analyzer.finish();
+}
+
+} // namespace sse
@@ -0,0 +1,466 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file GCodeStream.cpp
+ * @brief Write gcode to a file, while later layers are still being generated
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+// external headers
+#include <spdlog/spdlog.h>
+// project headers
+#include "sse/GCodeStream.hpp"
+// system headers, n.b. after GCodeStream.hpp, which defines SSE_POSIX_IO
+#ifdef SSE_POSIX_IO
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef SSE_POSIX_IO
+#ifdef IOV_MAX
+static constexpr std::size_t max_iovecs = IOV_MAX;
+#else
+// minimum required by POSIX
+static constexpr std::size_t max_iovecs = 16;
+#endif
+#endif
+
+namespace sse {
+
+GCodeStream::GCodeStream(const fs::path &file, std::size_t window) : window{window}, slots(window) {
+  if (window == 0) {
+    spdlog::error("GCodeStream: window must be at least 1 block");
+    throw std::invalid_argument("GCodeStream: window must be > 0");
+  }
+
+  if (const auto compression = stream_compression(file); compression != StreamCompression::none) {
+    compressor = std::make_unique<StreamCompressor>(compression, 0,
+                                                    std::max(1u, std::thread::hardware_concurrency() / 4));
+  }
+
+#ifdef SSE_POSIX_IO
+  fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    spdlog::error("GCodeStream: can't open {}: {}", file.string(), std::strerror(errno));
+    throw std::runtime_error("GCodeStream: can't open file");
+  }
+#else
+  this->file.open(file, std::ios::binary | std::ios::trunc);
+  if (!this->file) {
+    spdlog::error("GCodeStream: can't open {}", file.string());
+    throw std::runtime_error("GCodeStream: can't open file");
+  }
+#endif
+
+  writer = std::thread(&GCodeStream::run, this);
+}
+
+GCodeStream::~GCodeStream() {
+  if (writer.joinable()) {
+    spdlog::warn("GCodeStream: destroyed without finish(), output is incomplete");
+    abort();
+    writer.join();
+  }
+
+  try {
+    close();
+  } catch (const std::runtime_error &) {
+    // already logged
+  }
+}
+
+GCodeBuffer GCodeStream::acquire() {
+  std::lock_guard lock(mutex);
+  if (spare.empty()) {
+    return GCodeBuffer();
+  }
+
+  auto result = std::move(spare.back());
+  spare.pop_back();
+  return result;
+}
+
+void GCodeStream::submit(std::size_t index, GCodeBuffer &&buffer) {
+  std::unique_lock lock(mutex);
+  space.wait(lock, [this, index] { return aborted || index < next + window; });
+
+  if (aborted) {
+    throw std::runtime_error("GCodeStream: aborted");
+  }
+
+  auto &slot = slots[index % window];
+  if (finishing || index < next || slot) {
+    spdlog::error("GCodeStream: block {} submitted twice, or after finish()", index);
+    throw std::invalid_argument("GCodeStream: block already submitted");
+  }
+
+  slot = std::move(buffer);
+  ++submitted;
+  lock.unlock();
+  ready.notify_one();
+}
+
+void GCodeStream::abort() noexcept {
+  {
+    std::lock_guard lock(mutex);
+    aborted = true;
+  }
+  space.notify_all();
+  ready.notify_all();
+}
+
+void GCodeStream::finish() {
+  {
+    std::lock_guard lock(mutex);
+    finishing = true;
+  }
+  ready.notify_all();
+
+  if (writer.joinable()) {
+    writer.join();
+  }
+  close();
+
+  std::lock_guard lock(mutex);
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  if (aborted) {
+    throw std::runtime_error("GCodeStream: aborted");
+  }
+  if (std::any_of(slots.begin(), slots.end(), [](const auto &slot) { return slot.has_value(); })) {
+    spdlog::error("GCodeStream: block {} was never submitted", next);
+    throw std::runtime_error("GCodeStream: missing block");
+  }
+}
+
+std::uint64_t GCodeStream::bytes_written() const noexcept {
+  return written;
+}
+
+void GCodeStream::run() {
+  std::vector<GCodeBuffer> blocks;
+
+  try {
+    while (true) {
+      {
+        std::unique_lock lock(mutex);
+        ready.wait(lock, [this] { return aborted || finishing || slots[next % window]; });
+        if (aborted) {
+          return;
+        }
+
+        // take every block that's ready, in order
+        while (slots[next % window]) {
+          auto &slot = slots[next % window];
+          blocks.push_back(std::move(*slot));
+          slot.reset();
+          ++next;
+        }
+      }
+
+      // finishing, and nothing left in order
+      if (blocks.empty()) {
+        if (compressor) {
+          compressed.clear();
+          compressor->finish(compressed);
+          write(std::string_view(compressed));
+        }
+        return;
+      }
+      space.notify_all();
+
+      if (compressor) {
+        compressed.clear();
+        for (const auto &block : blocks) {
+          block.for_each_chunk([this](std::string_view chunk) { compressor->compress(chunk, compressed); });
+        }
+        write(std::string_view(compressed));
+      } else {
+        write(blocks);
+      }
+
+      std::lock_guard lock(mutex);
+      for (auto &block : blocks) {
+        if (spare.size() < window) {
+          block.clear();
+          spare.push_back(std::move(block));
+        }
+      }
+      blocks.clear();
+    }
+  } catch (...) {
+    {
+      std::lock_guard lock(mutex);
+      error = std::current_exception();
+      aborted = true;
+    }
+    space.notify_all();
+  }
+}
+
+#ifdef SSE_POSIX_IO
+void GCodeStream::write(const std::vector<GCodeBuffer> &blocks) {
+  std::vector<iovec> iovecs;
+  for (const auto &block : blocks) {
+    block.for_each_chunk([&iovecs](std::string_view chunk) {
+      if (!chunk.empty()) {
+        iovecs.push_back({const_cast<char *>(chunk.data()), chunk.size()});
+      }
+    });
+  }
+
+  std::size_t first = 0;
+  while (first < iovecs.size()) {
+    const auto count = std::min(iovecs.size() - first, max_iovecs);
+    const auto result = ::writev(fd, iovecs.data() + first, static_cast<int>(count));
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      spdlog::error("GCodeStream: write failed: {}", std::strerror(errno));
+      throw std::runtime_error("GCodeStream: write failed");
+    }
+    written += static_cast<std::uint64_t>(result);
+
+    // skip the chunks that were written, and the written part of a partial chunk
+    auto remaining = static_cast<std::size_t>(result);
+    while (first < iovecs.size() && remaining >= iovecs[first].iov_len) {
+      remaining -= iovecs[first].iov_len;
+      ++first;
+    }
+    if (remaining > 0) {
+      iovecs[first].iov_base = static_cast<char *>(iovecs[first].iov_base) + remaining;
+      iovecs[first].iov_len -= remaining;
+    }
+  }
+}
+
+void GCodeStream::write(std::string_view data) {
+  while (!data.empty()) {
+    const auto result = ::write(fd, data.data(), data.size());
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      spdlog::error("GCodeStream: write failed: {}", std::strerror(errno));
+      throw std::runtime_error("GCodeStream: write failed");
+    }
+    written += static_cast<std::uint64_t>(result);
+    data.remove_prefix(static_cast<std::size_t>(result));
+  }
+}
+
+void GCodeStream::close() {
+  if (fd < 0) {
+    return;
+  }
+
+  const auto result = ::close(fd);
+  fd = -1;
+  if (result < 0) {
+    spdlog::error("GCodeStream: close failed: {}", std::strerror(errno));
+    throw std::runtime_error("GCodeStream: close failed");
+  }
+}
+#else
+void GCodeStream::write(const std::vector<GCodeBuffer> &blocks) {
+  for (const auto &block : blocks) {
+    block.write(file);
+    written += block.size();
+  }
+
+  if (!file) {
+    spdlog::error("GCodeStream: write failed");
+    throw std::runtime_error("GCodeStream: write failed");
+  }
+}
+
+void GCodeStream::write(std::string_view data) {
+  file.write(data.data(), static_cast<std::streamsize>(data.size()));
+  if (!file) {
+    spdlog::error("GCodeStream: write failed");
+    throw std::runtime_error("GCodeStream: write failed");
+  }
+  written += data.size();
+}
+
+void GCodeStream::close() {
+  if (!file.is_open()) {
+    return;
+  }
+
+  file.close();
+  if (!file) {
+    spdlog::error("GCodeStream: close failed");
+    throw std::runtime_error("GCodeStream: close failed");
+  }
+}
+#endif
+
+#ifdef SSE_POSIX_IO
+GCodeMappedFile::GCodeMappedFile(const fs::path &file, std::uint64_t size) : length{size} {
+  if (size > std::numeric_limits<std::size_t>::max() ||
+      size > static_cast<std::uint64_t>(std::numeric_limits<off_t>::max())) {
+    spdlog::error("GCodeMappedFile: {:d} bytes can't be mapped", size);
+    throw std::runtime_error("GCodeMappedFile: file too large");
+  }
+
+  // O_RDWR, since a shared mapping needs read access
+  fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    spdlog::error("GCodeMappedFile: can't open {}: {}", file.string(), std::strerror(errno));
+    throw std::runtime_error("GCodeMappedFile: can't open file");
+  }
+
+  if (size == 0) {
+    return;
+  }
+
+  auto fail = [this](const char *message) {
+    spdlog::error("GCodeMappedFile: {}: {}", message, std::strerror(errno));
+    ::close(fd);
+    fd = -1;
+    throw std::runtime_error(fmt::format("GCodeMappedFile: {}", message));
+  };
+
+  auto result = EOPNOTSUPP;
+#ifdef __linux__
+  result = ::posix_fallocate(fd, 0, static_cast<off_t>(size));
+#endif
+  if (result == EOPNOTSUPP || result == EINVAL) {
+    // no preallocation on this file system; the file is sparse
+    result = ::ftruncate(fd, static_cast<off_t>(size)) < 0 ? errno : 0;
+  }
+  if (result != 0) {
+    errno = result;
+    fail("can't allocate file");
+  }
+
+  auto *mapping = ::mmap(nullptr, static_cast<std::size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    fail("can't map file");
+  }
+  data = static_cast<char *>(mapping);
+}
+
+GCodeMappedFile::~GCodeMappedFile() {
+  try {
+    finish();
+  } catch (const std::runtime_error &) {
+    // already logged
+  }
+}
+
+void GCodeMappedFile::write(std::uint64_t offset, const GCodeBuffer &block) {
+  if (offset > length || block.size() > length - offset) {
+    spdlog::error("GCodeMappedFile: block of {:d} bytes at {:d} is past the end of the file", block.size(), offset);
+    throw std::out_of_range("GCodeMappedFile: block past the end of the file");
+  }
+  if (block.empty()) {
+    return;
+  }
+  if (data == nullptr) {
+    spdlog::error("GCodeMappedFile: write after finish()");
+    throw std::runtime_error("GCodeMappedFile: file is closed");
+  }
+
+  auto *out = data + offset;
+  block.for_each_chunk([&out](std::string_view chunk) {
+    std::memcpy(out, chunk.data(), chunk.size());
+    out += chunk.size();
+  });
+}
+
+void GCodeMappedFile::finish() {
+  // n.b. the page cache is shared, so there's nothing to msync() before unmapping
+  auto result = 0;
+  if (data != nullptr) {
+    result = ::munmap(data, static_cast<std::size_t>(length));
+    data = nullptr;
+  }
+  if (fd >= 0) {
+    result = ::close(fd) < 0 ? -1 : result;
+    fd = -1;
+  }
+
+  if (result < 0) {
+    spdlog::error("GCodeMappedFile: close failed: {}", std::strerror(errno));
+    throw std::runtime_error("GCodeMappedFile: close failed");
+  }
+}
+#else
+GCodeMappedFile::GCodeMappedFile(const fs::path &file, std::uint64_t size) : length{size} {
+  this->file.open(file, std::ios::binary | std::ios::trunc);
+  if (!this->file) {
+    spdlog::error("GCodeMappedFile: can't open {}", file.string());
+    throw std::runtime_error("GCodeMappedFile: can't open file");
+  }
+}
+
+GCodeMappedFile::~GCodeMappedFile() {
+  try {
+    finish();
+  } catch (const std::runtime_error &) {
+    // already logged
+  }
+}
+
+void GCodeMappedFile::write(std::uint64_t offset, const GCodeBuffer &block) {
+  if (offset > length || block.size() > length - offset) {
+    spdlog::error("GCodeMappedFile: block of {:d} bytes at {:d} is past the end of the file", block.size(), offset);
+    throw std::out_of_range("GCodeMappedFile: block past the end of the file");
+  }
+
+  std::lock_guard lock(mutex);
+  file.seekp(static_cast<std::streamoff>(offset));
+  block.write(file);
+  if (!file) {
+    spdlog::error("GCodeMappedFile: write failed");
+    throw std::runtime_error("GCodeMappedFile: write failed");
+  }
+}
+
+void GCodeMappedFile::finish() {
+  std::lock_guard lock(mutex);
+  if (!file.is_open()) {
+    return;
+  }
+
+  file.close();
+  if (!file) {
+    spdlog::error("GCodeMappedFile: close failed");
+    throw std::runtime_error("GCodeMappedFile: close failed");
+  }
+}
+#endif
+
+} // namespace sse
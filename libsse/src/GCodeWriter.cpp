@@ -17,127 +17,507 @@
  */
 
 /**
- * @brief
- * @author Karl Nilsson
- *
+ * @file GCodeWriter.cpp
+ * @brief Emit gcode commands, optionally omitting modal words
  *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+// external headers
+#include "cavc/mathutils.hpp"
+// project headers
+#include "sse/GCodeWriter.hpp"
+
+//! indexed by motion mode; G4 is a dwell, which isn't written as a motion command
+static constexpr std::string_view motion_commands[] = {"G0", "G1", "G2", "G3", "G4", "G5"};
+
+//! largest distance between a curve and the lines it's written as, for dialects without arcs or splines (mm)
+static constexpr double curve_tolerance = 0.005;
+
+/**
+ * @brief feature_comment Comment that starts a feature, in Cura's format
+ */
+static constexpr std::string_view feature_comment(sse::Feature feature) {
+  switch (feature) {
+  case sse::Feature::outer_wall:
+    return ";TYPE:WALL-OUTER\n";
+  case sse::Feature::inner_wall:
+    return ";TYPE:WALL-INNER\n";
+  case sse::Feature::fill:
+    return ";TYPE:FILL\n";
+  case sse::Feature::none:
+    break;
+  }
+  return {};
+}
+
+/**
+ * @brief split_comment Split a line into its command and comment
+ * @param line Line, without the newline
+ * @return Command and comment, without the ';' and surrounding spaces; no comment if there's no ';'
  */
+static std::pair<std::string_view, std::optional<std::string_view>> split_comment(std::string_view line) {
+  const auto semicolon = line.find(';');
+  auto command = line.substr(0, semicolon);
+  while (!command.empty() && command.back() == ' ') {
+    command.remove_suffix(1);
+  }
+  if (semicolon == std::string_view::npos) {
+    return {command, std::nullopt};
+  }
+
+  auto comment = line.substr(semicolon + 1);
+  while (!comment.empty() && comment.front() == ' ') {
+    comment.remove_prefix(1);
+  }
+  return {command, comment};
+}
 
-#include <sse/GCodeWriter.hpp>
+/**
+ * @brief parenthesize Write a comment in parentheses, which can't be nested
+ */
+static void parenthesize(std::string &out, std::string_view comment) {
+  out += '(';
+  for (const auto c : comment) {
+    out += (c == '(') ? '[' : (c == ')') ? ']' : c;
+  }
+  out += ')';
+}
+
+/**
+ * @brief checksum XOR of every byte, as used by Marlin's line checksums
+ */
+static unsigned checksum(std::string_view text) {
+  unsigned result = 0;
+  for (const auto c : text) {
+    result ^= static_cast<unsigned char>(c);
+  }
+  return result & 0xff;
+}
 
 namespace sse {
 
-GCodeWriter::GCodeWriter() : config(sse::Settings::getInstance()) {
-  data = std::string();
-  // reserve a large buffer upfront
-  data.reserve(INITIAL_GCODE_SIZE);
+template <typename Dialect>
+BasicGCodeWriter<Dialect>::BasicGCodeWriter(GCodeBuffer &out, GCodePrecision precision, ModalMode mode) noexcept
+    : out{out}, number_precision{precision}, modal_mode{mode} {}
+
+template <typename Dialect> void BasicGCodeWriter<Dialect>::set_extruder_axis(char axis) {
+  if constexpr (Dialect::extruder_axis == 'E') {
+    if (axis != 'E') {
+      spdlog::error("{} always moves the extruder as E, not {}", Dialect::name, axis);
+      throw std::invalid_argument("dialect has an E axis");
+    }
+  } else {
+    if (std::string_view("ABCUVW").find(axis) == std::string_view::npos) {
+      spdlog::error("Invalid extruder axis: {}, expected one of A, B, C, U, V, W", axis);
+      throw std::invalid_argument("invalid extruder axis");
+    }
+  }
+  extruder_letter = axis;
 }
 
-void GCodeWriter::create_header() {
+template <typename Dialect> void BasicGCodeWriter<Dialect>::linear(double x, double y, double e, double f) {
+  auto line = start(1);
+  auto written = word(line, 'X', x, number_precision.xy, state.x);
+  written |= word(line, 'Y', y, number_precision.xy, state.y);
+  written |= extruder_word(line, e);
+  written |= word(line, 'F', f, number_precision.f, state.f);
+  finish(line, 1, written);
+}
 
+template <typename Dialect>
+void BasicGCodeWriter<Dialect>::arc(bool clockwise, double x, double y, double i, double j, double e, double f) {
+  if constexpr (Dialect::arcs) {
+    const auto motion = clockwise ? 2 : 3;
+    auto line = start(motion);
+    word(line, 'X', x, number_precision.xy, state.x);
+    word(line, 'Y', y, number_precision.xy, state.y);
+    line.word('I', i, number_precision.xy).word('J', j, number_precision.xy);
+    extruder_word(line, e);
+    word(line, 'F', f, number_precision.f, state.f);
+    finish(line, motion, true);
+  } else {
+    // without a start point, the best that can be done is a line to the end point
+    const auto from = position(e);
+    if (!from) {
+      linear(x, y, e, f);
+      return;
+    }
+
+    const auto [x0, y0, e0] = *from;
+    const auto cx = x0 + i;
+    const auto cy = y0 + j;
+    const auto radius = std::hypot(i, j);
+
+    const auto start_angle = std::atan2(y0 - cy, x0 - cx);
+    auto sweep = std::atan2(y - cy, x - cx) - start_angle;
+    if (clockwise && sweep >= 0) {
+      sweep -= 2 * cavc::utils::pi<double>();
+    } else if (!clockwise && sweep <= 0) {
+      sweep += 2 * cavc::utils::pi<double>();
+    }
+
+    // each line spans an angle with a sagitta of at most curve_tolerance
+    std::size_t count = 1;
+    if (radius > curve_tolerance) {
+      const auto step = 2 * std::acos(1 - curve_tolerance / radius);
+      count = std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(std::abs(sweep) / step)));
+    }
+
+    for (std::size_t k = 1; k < count; ++k) {
+      const auto t = static_cast<double>(k) / static_cast<double>(count);
+      const auto angle = start_angle + sweep * t;
+      linear(cx + radius * std::cos(angle), cy + radius * std::sin(angle), e0 + (e - e0) * t, f);
+    }
+    // n.b. the end point is exact
+    linear(x, y, e, f);
+  }
 }
 
-void GCodeWriter::add_rapid(double x, double y, double z) {
-  // get settings
-  auto feedrate = config.get_setting<uint>("rapid");
-  std::string move = fmt::format("G0 X{} Y{} Z{} F{};\n", x, y, z, feedrate);
+template <typename Dialect>
+void BasicGCodeWriter<Dialect>::bezier(double x, double y, const BezierControls &controls, double e, double f) {
+  if constexpr (Dialect::splines) {
+    auto line = start(5);
+    word(line, 'X', x, number_precision.xy, state.x);
+    word(line, 'Y', y, number_precision.xy, state.y);
+    line.word('I', controls.i, number_precision.xy).word('J', controls.j, number_precision.xy);
+    line.word('P', controls.p, number_precision.xy).word('Q', controls.q, number_precision.xy);
+    extruder_word(line, e);
+    word(line, 'F', f, number_precision.f, state.f);
+    finish(line, 5, true);
+  } else {
+    const auto from = position(e);
+    if (!from) {
+      linear(x, y, e, f);
+      return;
+    }
+
+    const auto [x0, y0, e0] = *from;
+    const auto points = flatten_bezier(x0, y0, x, y, controls, curve_tolerance);
+
+    double total = 0;
+    auto px = x0, py = y0;
+    for (const auto &[qx, qy] : points) {
+      total += std::hypot(qx - px, qy - py);
+      px = qx;
+      py = qy;
+    }
+
+    double length = 0;
+    px = x0;
+    py = y0;
+    for (std::size_t k = 0; k + 1 < points.size(); ++k) {
+      const auto &[qx, qy] = points[k];
+      length += std::hypot(qx - px, qy - py);
+      linear(qx, qy, e0 + (e - e0) * (total > 0 ? length / total : 1), f);
+      px = qx;
+      py = qy;
+    }
+    // n.b. the end point is exact
+    linear(x, y, e, f);
+  }
 }
 
-std::string GCodeWriter::add_rapid(const gp_Pnt destination) {
-  return fmt::format("G0 X{} Y{} Z{}", destination.X(), destination.Y(), destination.Z());
+template <typename Dialect> void BasicGCodeWriter<Dialect>::travel(double x, double y) {
+  auto line = start(0);
+  auto written = word(line, 'X', x, number_precision.xy, state.x);
+  written |= word(line, 'Y', y, number_precision.xy, state.y);
+  finish(line, 0, written);
 }
 
-std::string GCodeWriter::add_line(Geom_Line c) {
-  // get settings
-  auto feedrate = config.get_setting<uint>("E0.print_speed");
-  auto a = c.Value(c.FirstParameter());
-  double x, y, z;
-  a.Coord(x, y, z);
+template <typename Dialect> void BasicGCodeWriter<Dialect>::travel_z(double z, std::optional<double> f) {
+  auto line = start(0);
+  auto written = word(line, 'Z', z, number_precision.z, state.z);
+  if (f) {
+    written |= word(line, 'F', *f, number_precision.f, state.f);
+  }
+  finish(line, 0, written);
+}
 
-  auto b = c.Value(c.LastParameter());
-  b.Coord(x, y, z);
+template <typename Dialect> void BasicGCodeWriter<Dialect>::extrude(double e, double f) {
+  auto line = start(1);
+  auto written = extruder_word(line, e);
+  written |= word(line, 'F', f, number_precision.f, state.f);
+  finish(line, 1, written);
+}
 
-  // calculate line distance
-  auto distance = a.Distance(b);
+template <typename Dialect> void BasicGCodeWriter<Dialect>::reset_extruder() {
+  if constexpr (Dialect::extrusion == ExtrusionMode::absolute) {
+    if (modal_mode != ModalMode::off && state.e == 0.0) {
+      return;
+    }
+    write_line(GCodeLine("G92").word(extruder_letter, 0, 0).str());
+  }
+  state.e = 0.0;
+}
 
-  std::string move =
-      fmt::format("G1 X{} Y{} Z{} E{} F{}\n;", x, y, z, distance, feedrate);
+template <typename Dialect> void BasicGCodeWriter<Dialect>::layer(std::size_t number) {
+  invalidate();
+  line_number = 0;
 
-  return move;
+  if constexpr (Dialect::comments == CommentStyle::semicolon) {
+    out.format_compiled(FMT_COMPILE(";LAYER: {:d}\n"), number);
+  } else {
+    out.format_compiled(FMT_COMPILE("(LAYER: {:d})\n"), number);
+  }
 }
 
-void GCodeWriter::add_wire(TopoDS_Wire w) {
-  // explore the wire
-  auto a = BRep_Tool();
-  for (BRepTools_WireExplorer we(w); we.More(); we.Next()) {
-    // get current edge
-    auto &edge = we.Current();
-    Standard_Real u_min, u_max;
-    // get handle to unbounded curve
-    // auto curve = BRepAdaptor_Curve(edge);
-    auto curve = BRep_Tool::Curve(edge, u_min, u_max);
-    // trim curve
-    auto z = Geom_TrimmedCurve(curve, u_min, u_max);
-    // auto a = Handle(Geom_Line)::DownCast(z);
-    // z->IsKind() == STANDARD_TYPE(Geom_Line);
-    // process curve
-    add_segment(curve);
+template <typename Dialect> void BasicGCodeWriter<Dialect>::comment(std::string_view text) {
+  if constexpr (Dialect::comments == CommentStyle::semicolon) {
+    out.append(text);
+  } else {
+    std::string result;
+    while (!text.empty()) {
+      const auto end = std::min(text.find('\n'), text.size());
+      const auto line = text.substr(0, end);
+      text.remove_prefix(std::min(end + 1, text.size()));
+
+      parenthesize(result, split_comment(line).second.value_or(line));
+      result += '\n';
+    }
+    out.append(result);
   }
 }
 
-std::string GCodeWriter::add_segment(Handle(Geom_Curve) c) {
-  // get settings
-  auto feedrate = config.get_setting<uint>("E0.print_speed");
+template <typename Dialect> void BasicGCodeWriter<Dialect>::append(std::string_view text) {
+  if constexpr (Dialect::comments == CommentStyle::parentheses || Dialect::line_numbers) {
+    // n.b. only used for headers and footers, so converting line by line is fine
+    std::string line;
+    while (!text.empty()) {
+      const auto end = std::min(text.find('\n'), text.size());
+      const auto [command, remark] = split_comment(text.substr(0, end));
+      text.remove_prefix(std::min(end + 1, text.size()));
 
-  if (c->IsKind(STANDARD_TYPE(Geom_Line))) {
+      line.assign(command);
+      if constexpr (Dialect::line_numbers) {
+        // numbered commands can't have comments, so the comment goes on its own line first
+        if (remark) {
+          comment(fmt::format(";{}\n", *remark));
+        }
+        if (!command.empty()) {
+          write_line(line.append("\n"));
+        }
+        continue;
+      }
 
-    auto t = Handle(Geom_Line)::DownCast(c);
-    return add_line(t);
-  } else if (c->IsKind(STANDARD_TYPE(Geom_Circle))) {
-    auto t = Handle(Geom_Circle)::DownCast(c);
-    return add_arc(t);
-  } else if (c->IsKind(STANDARD_TYPE(Geom_BezierCurve))) {
-    auto t = Handle(Geom_BezierCurve)::DownCast(c);
-  } else if (c->IsKind(STANDARD_TYPE(Geom_BSplineCurve))) {
-    auto t = Handle(Geom_BSplineCurve)::DownCast(c);
+      if (remark) {
+        if (!command.empty()) {
+          line += ' ';
+        }
+        parenthesize(line, *remark);
+      }
+      line += '\n';
+      out.append(line);
+    }
   } else {
-    throw new std::runtime_error(
-        fmt::format("GCodeWriter: Invalid edge type: {}", c->get_type_name()));
+    out.append(text);
   }
+  invalidate();
+}
 
-  /*
-  switch (c.GetType()) {
-  case GeomAbs_Line:
-    return add_line(c.Line());
-  case GeomAbs_Circle:
+template <typename Dialect> void BasicGCodeWriter<Dialect>::subroutine(std::size_t number, const Toolpath &body) {
+  if constexpr (Dialect::subroutines) {
+    invalidate();
+    write_line(fmt::format(FMT_COMPILE("o{:d} sub\n"), number));
+    write_toolpath(body, *this);
+    invalidate();
+    write_line(fmt::format(FMT_COMPILE("o{:d} endsub\n"), number));
+  } else {
+    spdlog::error("{} has no subroutines", Dialect::name);
+    throw std::invalid_argument("dialect has no subroutines");
+  }
+}
 
-    return add_arc(c);
-  case GeomAbs_Ellipse:
-    break;
-/*
-  case GeomAbs_NonUniform:
-    return "G5.2";
-    break;
+template <typename Dialect> void BasicGCodeWriter<Dialect>::call(std::size_t number, double x, double y, double z) {
+  if constexpr (Dialect::subroutines) {
+    auto offset = GCodeLine("G52");
+    offset.word('X', x, number_precision.xy).word('Y', y, number_precision.xy).word('Z', z, number_precision.z);
+    write_line(offset.str());
+    write_line(fmt::format(FMT_COMPILE("o{:d} call\n"), number));
+    write_line("G52 X0 Y0 Z0\n");
+    invalidate();
+  } else {
+    spdlog::error("{} has no subroutines", Dialect::name);
+    throw std::invalid_argument("dialect has no subroutines");
+  }
+}
 
-  case GeomAbs_BezierCurve:
-    // split curve
-    return add_bezier(c);
-  case GeomAbs_BSplineCurve:
-    // split spline
-    return add_bspline(c);
-  default:
-    throw new std::runtime_error("GCodeWriter: Invalid segment type");
-    break;
+template <typename Dialect> void BasicGCodeWriter<Dialect>::invalidate() noexcept {
+  if constexpr (Dialect::extrusion == ExtrusionMode::relative) {
+    state = State{std::nullopt, std::nullopt, std::nullopt, std::nullopt, state.e, std::nullopt};
+  } else {
+    state = State{};
+  }
+}
+
+template <typename Dialect> std::optional<std::array<double, 3>> BasicGCodeWriter<Dialect>::position(double e) const {
+  if (!state.x || !state.y) {
+    return std::nullopt;
   }
-  */
+
+  const auto xy_scale = std::pow(10.0, std::clamp(number_precision.xy, 0, max_number_precision));
+  const auto e_scale = std::pow(10.0, std::clamp(number_precision.e, 0, max_number_precision));
+  return std::array<double, 3>{*state.x / xy_scale, *state.y / xy_scale, state.e ? *state.e / e_scale : e};
 }
 
-void GCodeWriter::retract(double distance) {
-  auto retraction_speed = config.get_setting<uint>("E0.retraction_speed");
-  std::string move = fmt::format("G92 E0;\nG1 E{} F{};\nG92 E0;\n", distance,
-                                 retraction_speed);
-  data.append(move);
+template <typename Dialect> GCodeLine BasicGCodeWriter<Dialect>::start(int motion) const {
+  if (modal_mode == ModalMode::commands && state.motion == motion) {
+    return GCodeLine("");
+  }
+  return GCodeLine(motion_commands[motion]);
 }
 
-} // namespace sse
+template <typename Dialect>
+bool BasicGCodeWriter<Dialect>::word(GCodeLine &line, char letter, double value, int precision,
+                                     std::optional<double> &current) const {
+  const auto units = number_units(value, precision);
+  if (modal_mode != ModalMode::off && current == units) {
+    return false;
+  }
+
+  line.word(letter, value, precision);
+  current = units;
+  return true;
+}
+
+template <typename Dialect> bool BasicGCodeWriter<Dialect>::extruder_word(GCodeLine &line, double e) {
+  if constexpr (Dialect::extrusion == ExtrusionMode::absolute) {
+    return word(line, extruder_letter, e, number_precision.e, state.e);
+  } else {
+    // the distance between rounded positions, so rounding errors don't accumulate
+    const auto units = number_units(e, number_precision.e);
+    const auto distance = units - state.e.value_or(0.0);
+    if (modal_mode != ModalMode::off && distance == 0) {
+      return false;
+    }
+
+    const auto scale = std::pow(10.0, std::clamp(number_precision.e, 0, max_number_precision));
+    line.word(extruder_letter, distance / scale, number_precision.e);
+    state.e = units;
+    return true;
+  }
+}
 
+template <typename Dialect>
+void BasicGCodeWriter<Dialect>::finish(const GCodeLine &line, int motion, bool written) {
+  // n.b. with modal mode off every word is written
+  if (!written) {
+    return;
+  }
+
+  if constexpr (Dialect::line_numbers) {
+    write_line(line.str());
+  } else {
+    out.append(line);
+  }
+  state.motion = motion;
+}
+
+template <typename Dialect> void BasicGCodeWriter<Dialect>::write_line(std::string_view line) {
+  if constexpr (Dialect::line_numbers) {
+    // the first line resets the printer's line number
+    if (line_number == 0) {
+      constexpr std::string_view reset = "N0 M110 N0";
+      out.format_compiled(FMT_COMPILE("{}*{:d}\n"), reset, checksum(reset));
+      line_number = 1;
+    }
+
+    char text[GCodeLine::capacity + 32];
+    const auto body = line.substr(0, line.size() - 1);
+    const auto numbered = fmt::format_to_n(text, sizeof(text) - 8, FMT_COMPILE("N{:d} {}"), line_number++, body);
+    const auto size = std::min<std::size_t>(numbered.size, sizeof(text) - 8);
+    const auto view = std::string_view(text, size);
+    out.format_compiled(FMT_COMPILE("{}*{:d}\n"), view, checksum(view));
+  } else {
+    out.append(line);
+  }
+}
+
+/**
+ * @brief write_moves Write a range of the moves of a toolpath
+ * @param path Toolpath
+ * @param begin, end Indices of the moves
+ * @param out Writer to append the gcode to
+ */
+template <typename Dialect>
+static void write_moves(const Toolpath &path, std::size_t begin, std::size_t end, BasicGCodeWriter<Dialect> &out) {
+  for (auto i = begin; i < end; ++i) {
+    const auto &move = path[i];
+    switch (move.type) {
+    case MoveType::travel:
+      out.travel(move.x, move.y);
+      break;
+    case MoveType::travel_z:
+      out.travel_z(move.x, move.feedrate());
+      break;
+    case MoveType::line:
+      out.linear(move.x, move.y, move.e, move.f);
+      break;
+    case MoveType::arc_cw:
+    case MoveType::arc_ccw: {
+      const auto &center = path.center(move);
+      out.arc(move.type == MoveType::arc_cw, move.x, move.y, center.i, center.j, move.e, move.f);
+      break;
+    }
+    case MoveType::bezier:
+      out.bezier(move.x, move.y, path.controls(move), move.e, move.f);
+      break;
+    case MoveType::retract:
+      out.extrude(move.e, move.f);
+      break;
+    case MoveType::reset_extruder:
+      out.reset_extruder();
+      break;
+    case MoveType::feature:
+      out.comment(feature_comment(move.feature));
+      break;
+    }
+  }
+}
+
+template <typename Dialect> void write_toolpath(const Toolpath &path, BasicGCodeWriter<Dialect> &out) {
+  write_moves(path, 0, path.size(), out);
+}
+
+template <typename Dialect>
+void write_toolpath(const Toolpath &path, const std::vector<SubroutineCall> &calls, BasicGCodeWriter<Dialect> &out) {
+  std::size_t next = 0;
+  for (const auto &call : calls) {
+    write_moves(path, next, call.begin, out);
+    out.call(call.subroutine + 1, call.x, call.y, call.z);
+    next = call.end;
+  }
+  write_moves(path, next, path.size(), out);
+}
+
+template class BasicGCodeWriter<Marlin>;
+template class BasicGCodeWriter<MarlinNumbered>;
+template class BasicGCodeWriter<Klipper>;
+template class BasicGCodeWriter<LinuxCNC>;
+template class BasicGCodeWriter<Machinekit>;
+template class BasicGCodeWriter<Redeem>;
+
+template void write_toolpath(const Toolpath &, BasicGCodeWriter<Marlin> &);
+template void write_toolpath(const Toolpath &, BasicGCodeWriter<MarlinNumbered> &);
+template void write_toolpath(const Toolpath &, BasicGCodeWriter<Klipper> &);
+template void write_toolpath(const Toolpath &, BasicGCodeWriter<LinuxCNC> &);
+template void write_toolpath(const Toolpath &, BasicGCodeWriter<Machinekit> &);
+template void write_toolpath(const Toolpath &, BasicGCodeWriter<Redeem> &);
+
+template void write_toolpath(const Toolpath &, const std::vector<SubroutineCall> &, BasicGCodeWriter<Marlin> &);
+template void write_toolpath(const Toolpath &, const std::vector<SubroutineCall> &, BasicGCodeWriter<MarlinNumbered> &);
+template void write_toolpath(const Toolpath &, const std::vector<SubroutineCall> &, BasicGCodeWriter<Klipper> &);
+template void write_toolpath(const Toolpath &, const std::vector<SubroutineCall> &, BasicGCodeWriter<LinuxCNC> &);
+template void write_toolpath(const Toolpath &, const std::vector<SubroutineCall> &, BasicGCodeWriter<Machinekit> &);
+template void write_toolpath(const Toolpath &, const std::vector<SubroutineCall> &, BasicGCodeWriter<Redeem> &);
+
+} // namespace sse
@@ -0,0 +1,170 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file OffsetBackend.cpp
+ * @brief Algorithms for offsetting the outline of a slice into shells
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+// OCCT headers
+#include <BRepOffsetAPI_MakeOffset.hxx>
+#include <GeomAbs_JoinType.hxx>
+#include <Standard_Failure.hxx>
+#include <TopExp_Explorer.hxx>
+#include <TopoDS.hxx>
+// external headers
+#include <spdlog/spdlog.h>
+#include "cavc/polylineoffsetislands.hpp"
+// project headers
+#include "sse/Flatten.hpp"
+#include "sse/OffsetBackend.hpp"
+
+/**
+ * @brief make_shell Sort the loops of an offset into a shell
+ *
+ * The loop with the largest area is the outer loop, and every other loop
+ * must run the opposite direction, i.e. be an island.
+ *
+ * @param loops Closed loops, in any direction
+ * @throw invalid_argument if there isn't exactly one outer loop
+ */
+[[nodiscard]] static sse::Shell make_shell(std::vector<cavc::Polyline<double>> loops) {
+  sse::Shell result;
+
+  if (loops.empty()) {
+    spdlog::error("OffsetBackend: Expected 1 outer polyline. received: 0");
+    throw std::invalid_argument("OffsetBackend: only 1 outer pline allowed");
+  }
+
+  std::vector<double> areas;
+  areas.reserve(loops.size());
+  std::size_t outer = 0;
+  for (std::size_t i = 0; i < loops.size(); ++i) {
+    areas.push_back(cavc::getArea(loops[i]));
+    if (std::abs(areas[i]) > std::abs(areas[outer])) {
+      outer = i;
+    }
+  }
+
+  const auto outer_is_ccw = areas[outer] > 0;
+  result.islands.reserve(loops.size() - 1);
+
+  for (std::size_t i = 0; i < loops.size(); ++i) {
+    if (i == outer) {
+      continue;
+    }
+    if ((areas[i] > 0) == outer_is_ccw) {
+      spdlog::error("OffsetBackend: Expected 1 outer polyline. received: more than 1");
+      throw std::invalid_argument("OffsetBackend: only 1 outer pline allowed");
+    }
+    if (!outer_is_ccw) {
+      cavc::invertDirection(loops[i]);
+    }
+    result.islands.push_back(std::move(loops[i]));
+  }
+
+  if (!outer_is_ccw) {
+    cavc::invertDirection(loops[outer]);
+  }
+  result.outer = std::move(loops[outer]);
+
+  return result;
+}
+
+namespace sse {
+
+std::vector<Shell> CavcOffsetBackend::offset(const TopoDS_Face &, const Shell &outline,
+                                             const std::vector<double> &distances) const {
+  cavc::OffsetLoopSet<double> loopset;
+  loopset.ccwLoops.push_back({0, outline.outer, cavc::createApproxSpatialIndex(outline.outer)});
+  loopset.cwLoops.reserve(outline.islands.size());
+  for (const auto &island : outline.islands) {
+    loopset.cwLoops.push_back({0, island, cavc::createApproxSpatialIndex(island)});
+  }
+
+  cavc::ParallelOffsetIslands<double> alg;
+
+  std::vector<Shell> result;
+  result.reserve(distances.size());
+  for (const auto distance : distances) {
+    auto offset = alg.compute(loopset, distance);
+    result.emplace_back(offset);
+  }
+
+  return result;
+}
+
+std::vector<Shell> OcctOffsetBackend::offset(const TopoDS_Face &face, const Shell &,
+                                             const std::vector<double> &distances) const {
+  if (face.IsNull()) {
+    spdlog::error("OcctOffsetBackend: face has already been released");
+    throw std::invalid_argument("OcctOffsetBackend: null face");
+  }
+
+  std::vector<Shell> result;
+  result.reserve(distances.size());
+
+  for (const auto distance : distances) {
+    auto maker = BRepOffsetAPI_MakeOffset(face, GeomAbs_Arc);
+
+    try {
+      // negative offsets shrink the face
+      maker.Perform(-distance);
+    } catch (const Standard_Failure &e) {
+      spdlog::error("OcctOffsetBackend: offset by {} failed: {}", distance, e.GetMessageString());
+      throw std::runtime_error("OcctOffsetBackend: offset failed");
+    }
+
+    if (!maker.IsDone()) {
+      spdlog::error("OcctOffsetBackend: offset by {} failed", distance);
+      throw std::runtime_error("OcctOffsetBackend: offset failed");
+    }
+
+    std::vector<cavc::Polyline<double>> loops;
+    for (auto exp = TopExp_Explorer(maker.Shape(), TopAbs_WIRE); exp.More(); exp.Next()) {
+      auto pline = flatten_wire(TopoDS::Wire(exp.Current()));
+      if (pline.size() > 1) {
+        loops.push_back(std::move(pline));
+      }
+    }
+
+    result.push_back(make_shell(std::move(loops)));
+  }
+
+  return result;
+}
+
+std::unique_ptr<OffsetBackend> make_offset_backend(const std::string &name) {
+  if (name == "cavc") {
+    return std::make_unique<CavcOffsetBackend>();
+  }
+  if (name == "occt") {
+    return std::make_unique<OcctOffsetBackend>();
+  }
+
+  spdlog::error("OffsetBackend: unknown backend: {}", name);
+  throw std::invalid_argument("OffsetBackend: unknown backend");
+}
+
+} // namespace sse
@@ -0,0 +1,229 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Ordering.cpp
+ * @brief Order slices to minimize travel between objects and islands
+ *
+ * Slices are grouped into layers by Z position. Each layer is an open,
+ * asymmetric travelling salesman problem: a slice is entered at one point and
+ * left at another, and the tour starts where the previous layer ended. A
+ * nearest-neighbour tour is built first, then refined with Or-opt (relocating
+ * single slices), which unlike 2-opt doesn't reverse the direction of travel
+ * through the other slices.
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <optional>
+#include <utility>
+#include <vector>
+// external headers
+#include <spdlog/spdlog.h>
+// project headers
+#include "sse/slicer.hpp"
+
+using point = cavc::Vector2<double>;
+
+//! slices whose Z position differs less than this are in the same layer
+constexpr double layer_tolerance = 1e-6;
+//! Or-opt is quadratic in the number of slices per layer; skip it for huge layers
+constexpr std::size_t max_optimize_stops = 256;
+//! upper bound on Or-opt passes per layer
+constexpr int max_optimize_passes = 8;
+//! minimum travel saved (mm) for a relocation to be worth making
+constexpr double min_improvement = 1e-6;
+
+/**
+ * @struct Stop
+ * @brief A slice to visit, with the points where its toolpath starts and ends
+ */
+struct Stop {
+  //! index of the slice in the input list
+  std::size_t index;
+  //! start of the slice's toolpath
+  point entry;
+  //! end of the slice's toolpath
+  point exit;
+};
+
+[[nodiscard]] static inline double distance(const point &a, const point &b) {
+  return cavc::length(b - a);
+}
+
+/**
+ * @brief Build a tour by repeatedly visiting the closest unvisited entry point
+ * @param stops Stops to visit
+ * @param seed Starting position
+ * @return stops, in visiting order
+ */
+[[nodiscard]] static std::vector<Stop> nearest_neighbour(std::vector<Stop> stops, point seed) {
+  std::vector<Stop> tour;
+  tour.reserve(stops.size());
+
+  while (!stops.empty()) {
+    auto closest = std::min_element(stops.cbegin(), stops.cend(), [&seed](const Stop &lhs, const Stop &rhs) {
+      return cavc::distSquared(seed, lhs.entry) < cavc::distSquared(seed, rhs.entry);
+    });
+
+    seed = closest->exit;
+    tour.push_back(*closest);
+    stops.erase(closest);
+  }
+
+  return tour;
+}
+
+/**
+ * @brief Improve a tour by relocating single stops (Or-opt)
+ * @param tour Tour to improve, modified in place
+ * @param seed Starting position
+ */
+static void relocate_stops(std::vector<Stop> &tour, const point &seed) {
+  const auto n = tour.size();
+  // position from which the stop at index i is entered
+  auto previous_exit = [&](std::size_t i) -> const point & { return i == 0 ? seed : tour[i - 1].exit; };
+
+  for (int pass = 0; pass < max_optimize_passes; ++pass) {
+    bool improved = false;
+
+    for (std::size_t k = 0; k < n; ++k) {
+      const auto &stop = tour[k];
+      // travel saved by removing the stop from its current position
+      auto removal_gain = distance(previous_exit(k), stop.entry);
+      if (k + 1 < n) {
+        removal_gain += distance(stop.exit, tour[k + 1].entry) - distance(previous_exit(k), tour[k + 1].entry);
+      }
+
+      // find the cheapest position to reinsert the stop, i.e. in front of tour[j]
+      auto best_cost = removal_gain;
+      std::optional<std::size_t> best_position;
+      for (std::size_t j = 0; j <= n; ++j) {
+        // both positions are equivalent to leaving the stop where it is
+        if (j == k || j == k + 1) {
+          continue;
+        }
+
+        auto cost = distance(previous_exit(j), stop.entry);
+        if (j < n) {
+          cost += distance(stop.exit, tour[j].entry) - distance(previous_exit(j), tour[j].entry);
+        }
+
+        if (cost < best_cost - min_improvement) {
+          best_cost = cost;
+          best_position = j;
+        }
+      }
+
+      if (best_position) {
+        auto moved = tour[k];
+        tour.erase(tour.begin() + k);
+        tour.insert(tour.begin() + (*best_position > k ? *best_position - 1 : *best_position), moved);
+        improved = true;
+      }
+    }
+
+    if (!improved) {
+      break;
+    }
+  }
+}
+
+std::vector<std::size_t> sse::slice_order(const std::vector<Slice> &slices) {
+  std::vector<std::size_t> layers;
+  return slice_order(slices, layers);
+}
+
+std::vector<std::size_t> sse::slice_order(const std::vector<Slice> &slices, std::vector<std::size_t> &layers) {
+  spdlog::debug("Ordering: sorting {} slices by z position", slices.size());
+  std::vector<std::size_t> by_height(slices.size());
+  std::iota(by_height.begin(), by_height.end(), 0);
+  // stable, so the result doesn't depend on the sort implementation
+  std::stable_sort(by_height.begin(), by_height.end(),
+                   [&slices](std::size_t lhs, std::size_t rhs) { return slices[lhs].z_position() < slices[rhs].z_position(); });
+
+  std::vector<std::size_t> order;
+  order.reserve(slices.size());
+  layers.clear();
+
+  // the first layer starts at the machine origin
+  auto position = point{0, 0};
+
+  for (std::size_t begin = 0, end = 0; begin < by_height.size(); begin = end) {
+    const auto layer_z = slices[by_height[begin]].z_position();
+    end = begin + 1;
+    while (end < by_height.size() && std::abs(slices[by_height[end]].z_position() - layer_z) < layer_tolerance) {
+      ++end;
+    }
+    layers.push_back(order.size());
+
+    std::vector<Stop> stops;
+    stops.reserve(end - begin);
+    // slices without toolpaths don't produce any moves, so they go last
+    std::vector<std::size_t> empty;
+
+    for (auto i = begin; i < end; ++i) {
+      const auto &slice = slices[by_height[i]];
+      auto entry = slice.entry_point();
+      auto exit = slice.exit_point();
+      if (entry && exit) {
+        stops.push_back({by_height[i], *entry, *exit});
+      } else {
+        empty.push_back(by_height[i]);
+      }
+    }
+
+    auto tour = nearest_neighbour(std::move(stops), position);
+    if (tour.size() <= max_optimize_stops) {
+      relocate_stops(tour, position);
+    } else {
+      spdlog::debug("Ordering: {} slices at z={:.3f}, skipping tour refinement", tour.size(), layer_z);
+    }
+
+    for (const auto &stop : tour) {
+      order.push_back(stop.index);
+    }
+    order.insert(order.end(), empty.cbegin(), empty.cend());
+
+    if (!tour.empty()) {
+      position = tour.back().exit;
+    }
+  }
+
+  return order;
+}
+
+void sse::order_slices(std::vector<Slice> &slices) {
+  if (slices.size() < 2) {
+    return;
+  }
+
+  const auto order = slice_order(slices);
+
+  // apply the permutation
+  std::vector<Slice> result;
+  result.reserve(slices.size());
+  for (auto i : order) {
+    result.push_back(std::move(slices[i]));
+  }
+  slices = std::move(result);
+}
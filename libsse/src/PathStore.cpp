@@ -0,0 +1,145 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file PathStore.cpp
+ * @brief Compact storage for the paths of a slice
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <limits>
+#include <stdexcept>
+// external headers
+#include <spdlog/spdlog.h>
+// project headers
+#include "sse/PathStore.hpp"
+
+namespace sse {
+
+void PathStore::add(const cavc::Polyline<double> &pline, PathKind kind, bool island, std::uint16_t shell) {
+#ifdef SSE_FIXED_POINT
+  // snapping merges vertices closer than 1nm
+  const auto fixed = to_fixed(pline);
+  const auto size = fixed.size();
+#else
+  const auto size = pline.size();
+#endif
+
+  if (size == 0) {
+    return;
+  }
+
+  if (xs.size() + size > std::numeric_limits<std::uint32_t>::max()) {
+    spdlog::error("PathStore: too many vertices");
+    throw std::length_error("PathStore: too many vertices");
+  }
+
+  const auto begin = static_cast<std::uint32_t>(xs.size());
+
+#ifdef SSE_FIXED_POINT
+  xs.insert(xs.end(), fixed.xs.begin(), fixed.xs.end());
+  ys.insert(ys.end(), fixed.ys.begin(), fixed.ys.end());
+  bulges.insert(bulges.end(), fixed.bulges.begin(), fixed.bulges.end());
+#else
+  for (const auto &v : pline.vertexes()) {
+    xs.push_back(static_cast<path_coordinate>(v.x()));
+    ys.push_back(static_cast<path_coordinate>(v.y()));
+    bulges.push_back(static_cast<path_bulge>(v.bulge()));
+  }
+#endif
+
+  const auto end = static_cast<std::uint32_t>(xs.size());
+
+  // the last vertex of an open path doesn't start a segment
+  const auto segments = pline.isClosed() ? size : size - 1;
+  std::size_t arcs = 0;
+  for (auto i = begin; i < begin + segments; ++i) {
+    arcs += !vertex(i).bulgeIsZero();
+  }
+
+  auto shape = PathShape::mixed;
+  if (arcs == 0) {
+    shape = PathShape::lines;
+  } else if (arcs == segments) {
+    shape = PathShape::arcs;
+  }
+
+  paths.push_back({begin, end, kind, shape, pline.isClosed(), island, shell});
+}
+
+void PathStore::erase(PathKind kind) {
+  std::size_t path_out = 0;
+  std::size_t vertex_out = 0;
+
+  for (const auto &path : paths) {
+    if (path.kind == kind) {
+      continue;
+    }
+
+    auto moved = path;
+    moved.begin = static_cast<std::uint32_t>(vertex_out);
+    for (auto i = path.begin; i < path.end; ++i, ++vertex_out) {
+      xs[vertex_out] = xs[i];
+      ys[vertex_out] = ys[i];
+      bulges[vertex_out] = bulges[i];
+    }
+    moved.end = static_cast<std::uint32_t>(vertex_out);
+    paths[path_out++] = moved;
+  }
+
+  paths.resize(path_out);
+  xs.resize(vertex_out);
+  ys.resize(vertex_out);
+  bulges.resize(vertex_out);
+}
+
+void PathStore::clear() noexcept {
+  xs.clear();
+  ys.clear();
+  bulges.clear();
+  paths.clear();
+}
+
+void PathStore::shrink_to_fit() {
+  xs.shrink_to_fit();
+  ys.shrink_to_fit();
+  bulges.shrink_to_fit();
+  paths.shrink_to_fit();
+}
+
+cavc::Polyline<double> PathStore::polyline(std::size_t path) const {
+  const auto &info = paths[path];
+
+  cavc::Polyline<double> result;
+  result.isClosed() = info.closed;
+  result.vertexes().reserve(info.size());
+  for (auto i = info.begin; i < info.end; ++i) {
+    result.vertexes().push_back(vertex(i));
+  }
+
+  return result;
+}
+
+std::size_t PathStore::memory_usage() const noexcept {
+  return (xs.capacity() + ys.capacity()) * sizeof(path_coordinate) + bulges.capacity() * sizeof(path_bulge) +
+         paths.capacity() * sizeof(PathInfo);
+}
+
+} // namespace sse
@@ -0,0 +1,137 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Segments.cpp
+ * @brief Batch computation of segment lengths, extrusion and arc centers
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+// SIMD headers
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+// project headers
+#include "sse/Segments.hpp"
+
+//! coordinates in a PathStore, converted to mm
+[[nodiscard]] static inline double to_mm(double value) noexcept {
+  return value;
+}
+[[nodiscard]] static inline double to_mm(float value) noexcept {
+  return static_cast<double>(value);
+}
+[[nodiscard]] static inline double to_mm(std::int64_t value) noexcept {
+  return sse::from_fixed(value);
+}
+
+/**
+ * @brief line_lengths Lengths of the line segments between consecutive points
+ *
+ * Only double precision coordinates are loaded straight into SIMD registers,
+ * other coordinate types are converted one at a time.
+ *
+ * @param xs X coordinates, n + 1 values
+ * @param ys Y coordinates, n + 1 values
+ * @param n Number of segments
+ * @param out Lengths, n values
+ */
+template <typename T> static void line_lengths(const T *xs, const T *ys, std::size_t n, double *out) {
+  std::size_t i = 0;
+
+  if constexpr (std::is_same_v<T, double>) {
+#if defined(__AVX__)
+    for (; i + 4 <= n; i += 4) {
+      const auto dx = _mm256_sub_pd(_mm256_loadu_pd(xs + i + 1), _mm256_loadu_pd(xs + i));
+      const auto dy = _mm256_sub_pd(_mm256_loadu_pd(ys + i + 1), _mm256_loadu_pd(ys + i));
+      const auto squared = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+      _mm256_storeu_pd(out + i, _mm256_sqrt_pd(squared));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    for (; i + 2 <= n; i += 2) {
+      const auto dx = _mm_sub_pd(_mm_loadu_pd(xs + i + 1), _mm_loadu_pd(xs + i));
+      const auto dy = _mm_sub_pd(_mm_loadu_pd(ys + i + 1), _mm_loadu_pd(ys + i));
+      const auto squared = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+      _mm_storeu_pd(out + i, _mm_sqrt_pd(squared));
+    }
+#endif
+  }
+
+  // remainder, or everything without SIMD
+  for (; i < n; ++i) {
+    const auto dx = to_mm(xs[i + 1]) - to_mm(xs[i]);
+    const auto dy = to_mm(ys[i + 1]) - to_mm(ys[i]);
+    out[i] = std::sqrt(dx * dx + dy * dy);
+  }
+}
+
+namespace sse {
+
+void compute_segments(const PathStore &paths, const PathInfo &path, double extrusion_ratio, SegmentBatch &batch) {
+  // the closing segment is printed first
+  const std::size_t offset = path.closed ? 1 : 0;
+  const auto segments = path.size() - 1 + offset;
+
+  batch.length.resize(segments);
+  batch.extrusion.resize(segments);
+  batch.center_i.assign(segments, 0.0);
+  batch.center_j.assign(segments, 0.0);
+
+  if (path.shape == PathShape::lines) {
+    line_lengths(paths.x_data() + path.begin, paths.y_data() + path.begin, path.size() - 1,
+                 batch.length.data() + offset);
+
+    if (path.closed) {
+      const auto dx = paths.x(path.begin) - paths.x(path.end - 1);
+      const auto dy = paths.y(path.begin) - paths.y(path.end - 1);
+      batch.length[0] = std::sqrt(dx * dx + dy * dy);
+    }
+  } else {
+    for (std::size_t k = 0; k < segments; ++k) {
+      const auto [i, j] = segment_vertices(path, k);
+      const auto source = paths.vertex(i);
+      const auto destination = paths.vertex(j);
+
+      batch.length[k] = cavc::segLength(source, destination);
+
+      if (!source.bulgeIsZero()) {
+        // center is an absolute location (point), G(2|3) needs offsets relative to
+        // starting point
+        const auto arc = cavc::arcRadiusAndCenter(source, destination);
+        batch.center_i[k] = arc.center.x() - source.x();
+        batch.center_j[k] = arc.center.y() - source.y();
+      }
+    }
+  }
+
+  // n.b. summed in order, so the result doesn't depend on the instruction set
+  double extrusion_total = 0.0;
+  for (std::size_t k = 0; k < segments; ++k) {
+    extrusion_total += (batch.length[k] * extrusion_ratio);
+    batch.extrusion[k] = extrusion_total;
+  }
+}
+
+} // namespace sse
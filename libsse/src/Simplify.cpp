@@ -0,0 +1,378 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Simplify.cpp
+ * @brief Reduce the number of vertices in a polyline, within a tolerance
+ *
+ * Outlines from tessellated models (STL, OBJ, or STEP exported from mesh
+ * tools) are made of many tiny line segments. Every later stage (offsetting,
+ * infill clipping, gcode) pays for each of them, so they're reduced once,
+ * before offsetting.
+ *
+ * Each stage treats a closed polyline as an open one that ends with a copy of
+ * its first vertex, so the first vertex is never removed.
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <utility>
+#include <vector>
+// external headers
+#include <spdlog/spdlog.h>
+#include "cavc/mathutils.hpp"
+// project headers
+#include "sse/Simplify.hpp"
+
+using point = cavc::Vector2<double>;
+using vertex = cavc::PlineVertex<double>;
+
+//! line segments whose directions differ less than this (radians) are collinear
+constexpr double collinear_angle = 1e-5;
+//! an arc must replace at least this many line segments
+constexpr std::size_t min_arc_segments = 3;
+//! checking a run is quadratic in its length, so cap it
+constexpr std::size_t max_arc_segments = 128;
+
+/**
+ * @brief unroll Vertices of a polyline; closed polylines end with a copy of the first vertex
+ */
+[[nodiscard]] static std::vector<vertex> unroll(const cavc::Polyline<double> &pline) {
+  auto result = pline.vertexes();
+  if (pline.isClosed() && !result.empty()) {
+    result.push_back(result.front());
+  }
+  return result;
+}
+
+/**
+ * @brief reroll Replace the vertices of a polyline with the result of unroll()
+ */
+static void reroll(cavc::Polyline<double> &pline, std::vector<vertex> vertexes) {
+  if (pline.isClosed() && !vertexes.empty()) {
+    vertexes.pop_back();
+  }
+  pline.vertexes() = std::move(vertexes);
+}
+
+/**
+ * @brief distance Distance from a point to a line segment
+ */
+[[nodiscard]] static double distance(const point &p, const point &a, const point &b) {
+  const auto ab = b - a;
+  const auto length_squared = cavc::dot(ab, ab);
+  if (length_squared < cavc::utils::realThreshold<double>()) {
+    return cavc::length(p - a);
+  }
+
+  const auto t = std::clamp(cavc::dot(p - a, ab) / length_squared, 0.0, 1.0);
+  return cavc::length(p - (a + t * ab));
+}
+
+/**
+ * @brief arc_through Bulge of an arc from the first to the last vertex of a run of line segments
+ * @param u Vertices
+ * @param first Index of the first vertex of the run
+ * @param last Index of the last vertex of the run
+ * @param tolerance Maximum distance between the arc and the line segments
+ * @param bulge Set to the bulge of the arc
+ * @return false if the line segments don't fit an arc
+ */
+[[nodiscard]] static bool arc_through(const std::vector<vertex> &u, std::size_t first, std::size_t last,
+                                      double tolerance, double &bulge) {
+  // circle through the ends of the run, and its middle
+  const auto &a = u[first].pos();
+  const auto &m = u[(first + last) / 2].pos();
+  const auto &b = u[last].pos();
+
+  const auto d = 2 * (a.x() * (m.y() - b.y()) + m.x() * (b.y() - a.y()) + b.x() * (a.y() - m.y()));
+  if (std::abs(d) < cavc::utils::realThreshold<double>()) {
+    // collinear
+    return false;
+  }
+
+  const auto aa = cavc::dot(a, a);
+  const auto mm = cavc::dot(m, m);
+  const auto bb = cavc::dot(b, b);
+  const auto center = point((aa * (m.y() - b.y()) + mm * (b.y() - a.y()) + bb * (a.y() - m.y())) / d,
+                            (aa * (b.x() - m.x()) + mm * (a.x() - b.x()) + bb * (m.x() - a.x())) / d);
+  const auto radius = cavc::length(a - center);
+  const auto counter_clockwise = cavc::perpDot(m - a, b - m) > 0;
+
+  double sweep = 0;
+  for (auto k = first; k < last; ++k) {
+    const auto &p = u[k].pos();
+    const auto &q = u[k + 1].pos();
+
+    // vertices on the circle
+    if (std::abs(cavc::length(q - center) - radius) > tolerance) {
+      return false;
+    }
+
+    // every segment turns the same way, and stays close to the circle
+    const auto half_chord = cavc::length(q - p) / 2;
+    if (half_chord > radius || radius - std::sqrt(radius * radius - half_chord * half_chord) > tolerance) {
+      return false;
+    }
+
+    const auto step = cavc::utils::deltaAngle(cavc::angle(center, p), cavc::angle(center, q));
+    if ((step > 0) != counter_clockwise) {
+      return false;
+    }
+    sweep += step;
+  }
+
+  // keep the bulge at most 1
+  if (std::abs(sweep) > cavc::utils::pi<double>()) {
+    return false;
+  }
+
+  bulge = std::tan(sweep / 4);
+  return true;
+}
+
+/**
+ * @brief rotate_to_corner Rotate a closed polyline to start at the end of an arc, or else at its sharpest corner
+ */
+static void rotate_to_corner(cavc::Polyline<double> &pline) {
+  auto &v = pline.vertexes();
+  const auto n = v.size();
+
+  std::size_t start = 0;
+  double sharpest = -1;
+
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto &previous = v[(i + n - 1) % n];
+    if (!previous.bulgeIsZero() || !v[i].bulgeIsZero()) {
+      start = i;
+      break;
+    }
+
+    const auto a = v[i].pos() - previous.pos();
+    const auto b = v[(i + 1) % n].pos() - v[i].pos();
+    const auto turn = std::abs(std::atan2(cavc::perpDot(a, b), cavc::dot(a, b)));
+    if (turn > sharpest) {
+      sharpest = turn;
+      start = i;
+    }
+  }
+
+  std::rotate(v.begin(), v.begin() + start, v.end());
+}
+
+namespace sse {
+
+void merge_collinear(cavc::Polyline<double> &pline) {
+  if (pline.size() < 2) {
+    return;
+  }
+
+  std::vector<vertex> result;
+  result.reserve(pline.size());
+
+  // duplicate vertices, i.e. zero length segments
+  for (const auto &v : pline.vertexes()) {
+    if (!result.empty() && cavc::fuzzyEqual(result.back().pos(), v.pos())) {
+      result.back().bulge() = v.bulge();
+      continue;
+    }
+    result.push_back(v);
+  }
+
+  if (pline.isClosed() && result.size() > 1 && cavc::fuzzyEqual(result.back().pos(), result.front().pos())) {
+    result.pop_back();
+  }
+
+  pline.vertexes() = std::move(result);
+  if (pline.size() < 3) {
+    return;
+  }
+
+  auto u = unroll(pline);
+  result.clear();
+
+  for (const auto &v : u) {
+    while (result.size() >= 2) {
+      const auto &a = result[result.size() - 2];
+      const auto &b = result.back();
+      if (!a.bulgeIsZero() || !b.bulgeIsZero()) {
+        break;
+      }
+
+      const auto ab = b.pos() - a.pos();
+      const auto bc = v.pos() - b.pos();
+      // same direction, not doubling back
+      const auto collinear = cavc::dot(ab, bc) > 0 &&
+                             std::abs(cavc::perpDot(ab, bc)) <= collinear_angle * cavc::length(ab) * cavc::length(bc);
+      if (!collinear) {
+        break;
+      }
+      result.pop_back();
+    }
+    result.push_back(v);
+  }
+
+  reroll(pline, std::move(result));
+}
+
+void refit_arcs(cavc::Polyline<double> &pline, double tolerance) {
+  std::vector<std::size_t> sources;
+  refit_arcs(pline, tolerance, sources);
+}
+
+void refit_arcs(cavc::Polyline<double> &pline, double tolerance, std::vector<std::size_t> &sources) {
+  sources.resize(pline.size());
+  std::iota(sources.begin(), sources.end(), 0);
+  if (pline.size() <= min_arc_segments) {
+    return;
+  }
+
+  const auto u = unroll(pline);
+  std::vector<vertex> result;
+  result.reserve(u.size());
+  sources.clear();
+
+  for (std::size_t i = 0; i < u.size();) {
+    result.push_back(u[i]);
+    sources.push_back(i);
+
+    // find the longest run of line segments from i that fits an arc
+    auto end = i;
+    double bulge = 0;
+    for (auto j = i + 1; j < u.size() && j - i <= max_arc_segments; ++j) {
+      if (!u[j - 1].bulgeIsZero()) {
+        break;
+      }
+      if (j - i < min_arc_segments) {
+        continue;
+      }
+
+      double b;
+      if (!arc_through(u, i, j, tolerance, b)) {
+        break;
+      }
+      end = j;
+      bulge = b;
+    }
+
+    if (end == i) {
+      ++i;
+      continue;
+    }
+
+    result.back().bulge() = bulge;
+    i = end;
+  }
+
+  // the copy of the first vertex is dropped by reroll()
+  if (pline.isClosed()) {
+    sources.pop_back();
+  }
+  reroll(pline, std::move(result));
+}
+
+void douglas_peucker(cavc::Polyline<double> &pline, double tolerance) {
+  if (pline.size() < 3) {
+    return;
+  }
+
+  const auto u = unroll(pline);
+  const auto n = u.size();
+  std::vector<bool> keep(n, false);
+  keep.front() = keep.back() = true;
+
+  // arcs are kept as they are
+  bool has_arcs = false;
+  for (std::size_t i = 0; i + 1 < n; ++i) {
+    if (!u[i].bulgeIsZero()) {
+      keep[i] = keep[i + 1] = true;
+      has_arcs = true;
+    }
+  }
+
+  // ranges of line segments to simplify
+  std::vector<std::pair<std::size_t, std::size_t>> ranges;
+  for (std::size_t i = 0, j = 1; j < n; ++j) {
+    if (keep[j]) {
+      if (j > i + 1) {
+        ranges.emplace_back(i, j);
+      }
+      i = j;
+    }
+  }
+
+  while (!ranges.empty()) {
+    const auto [first, last] = ranges.back();
+    ranges.pop_back();
+
+    auto farthest = first;
+    double max_distance = 0;
+    for (auto k = first + 1; k < last; ++k) {
+      const auto d = distance(u[k].pos(), u[first].pos(), u[last].pos());
+      if (d > max_distance) {
+        max_distance = d;
+        farthest = k;
+      }
+    }
+
+    if (max_distance > tolerance) {
+      keep[farthest] = true;
+      if (farthest > first + 1) {
+        ranges.emplace_back(first, farthest);
+      }
+      if (last > farthest + 1) {
+        ranges.emplace_back(farthest, last);
+      }
+    }
+  }
+
+  std::vector<vertex> result;
+  result.reserve(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    if (keep[i]) {
+      result.push_back(u[i]);
+    }
+  }
+
+  // don't collapse a closed polygon into a line
+  if (pline.isClosed() && !has_arcs && result.size() < 4) {
+    return;
+  }
+
+  reroll(pline, std::move(result));
+}
+
+void simplify(cavc::Polyline<double> &pline, double tolerance) {
+  if (tolerance <= 0 || pline.size() < 3) {
+    return;
+  }
+
+  if (pline.isClosed()) {
+    rotate_to_corner(pline);
+  }
+
+  merge_collinear(pline);
+  refit_arcs(pline, tolerance);
+  douglas_peucker(pline, tolerance);
+}
+
+} // namespace sse
@@ -34,16 +34,12 @@
 #include <map>
 #include <string>
 // OCCT headers
-#include <BRepAdaptor_Curve.hxx>
 #include <BRepAdaptor_Surface.hxx>
 #include <BRepBuilderAPI_MakeVertex.hxx>
 #include <BRepOffsetAPI_MakeOffset.hxx>
 #include <BRepTools.hxx>
-#include <BRepTools_WireExplorer.hxx>
 #include <BRep_Tool.hxx>
 #include <GeomLProp_SLProps.hxx>
-#include <Geom_BezierCurve.hxx>
-#include <Geom_TrimmedCurve.hxx>
 #include <ShapeAnalysis.hxx>
 #include <ShapeAnalysis_Wire.hxx>
 #include <Standard_Version.hxx>
@@ -53,262 +49,221 @@
 #include <TopoDS_Face.hxx>
 #include <TopoDS_Shape.hxx>
 #include <TopoDS_Wire.hxx>
-#include <gp_Circ.hxx>
-#include <gp_Elips.hxx>
-#include <gp_Lin.hxx>
 // external headers
 #include <spdlog/spdlog.h>
 // project headers
+#include <sse/Flatten.hpp>
+#include <sse/GCodeBuffer.hpp>
+#include <sse/GCodeWriter.hpp>
+#include <sse/OffsetBackend.hpp>
+#include <sse/Segments.hpp>
 #include <sse/Slice.hpp>
+#include <sse/Toolpath.hpp>
+#include <sse/TravelPlanner.hpp>
 
 #include "cavc/polylinecombine.hpp"
 #include "cavc/polylineoffsetislands.hpp"
 
 using namespace std::string_literals;
 
-static cavc::Polyline<double> flatten(const gp_Circ &curve,
-                                      const Geom_TrimmedCurve &trimmed_curve) {
-  cavc::Polyline<double> result;
-
-  auto radius = curve.Radius();
-  auto center_point = curve.Location();
-  auto angle =
-      abs(trimmed_curve.LastParameter() - trimmed_curve.FirstParameter());
-  auto first = trimmed_curve.FirstParameter();
-  auto last = trimmed_curve.LastParameter();
-  // TODO: verify
-  auto clockwise =
-      trimmed_curve.FirstParameter() < trimmed_curve.LastParameter() ? 1 : -1;
+/**
+ * @brief Position where polyline_toolpath starts (and, for closed paths, ends) a path
+ *
+ * n.b. for closed paths, this is the *last* vertex, because the closing segment is visited first
+ */
+static cavc::Vector2<double> start_position(const sse::PathStore &paths, const sse::PathInfo &path) {
+  return paths.vertex(path.closed ? path.end - 1 : path.begin).pos();
+}
 
-  auto start_point = trimmed_curve.StartPoint();
+/**
+ * @brief segments_toolpath Convert the segments of a path into moves
+ *
+ * Specialized on the shape of the path, so only mixed paths check the bulge
+ * of each segment.
+ *
+ * @param paths Path storage
+ * @param path Path with at least 2 vertices
+ * @param batch Segment lengths, extrusion and arc centers, see compute_segments()
+ * @param out Toolpath to append the moves to
+ */
+template <sse::PathShape shape>
+static void segments_toolpath(const sse::PathStore &paths, const sse::PathInfo &path, const sse::SegmentBatch &batch,
+                              sse::Toolpath &out) {
+  for (std::size_t k = 0; k < batch.size(); ++k) {
+    const auto [i, j] = sse::segment_vertices(path, k);
+
+    if constexpr (shape != sse::PathShape::arcs) {
+      // short-circuit for straight segment
+      if (shape == sse::PathShape::lines || paths.vertex(i).bulgeIsZero()) {
+        out.linear(paths.x(j), paths.y(j), batch.extrusion[k], 1000);
+        continue;
+      }
+    }
 
-  // anything over a semicircle must be split
-  if (angle > M_PI) {
-    result.addVertex(start_point.X(), start_point.Y(), clockwise);
-    // move start point
-    start_point = trimmed_curve.Value(trimmed_curve.FirstParameter() +
-                                      (clockwise * M_PI));
-    // recompute angle
-    angle -= M_PI;
+    // negative bulge = clockwise
+    out.arc(paths.vertex(i).bulgeIsNeg(), paths.x(j), paths.y(j), batch.center_i[k], batch.center_j[k],
+            batch.extrusion[k], 1000);
   }
-
-  double bulge = clockwise * tan(angle / 4);
-
-  result.addVertex(start_point.X(), start_point.Y(), bulge);
-
-  return result;
 }
 
-static cavc::Polyline<double> flatten(const gp_Elips &curve,
-                                      const Geom_TrimmedCurve &trimmed_curve) {
-  cavc::Polyline<double> result;
-  // flatten the ellipse into arcs
-  auto major_radius = curve.MajorRadius();
-  auto minor_radius = curve.MinorRadius();
-  auto center_point = curve.Location();
-  auto angle = trimmed_curve.LastParameter() - trimmed_curve.FirstParameter();
-  // TODO: verify
-  auto clockwise =
-      trimmed_curve.FirstParameter() < trimmed_curve.LastParameter() ? 1 : -1;
-  auto bulge = 0.0;
-
-  result.addVertex(trimmed_curve.StartPoint().X(),
-                   trimmed_curve.StartPoint().Y(), 0);
-  return {};
-}
+/**
+ * @brief polyline_toolpath Convert a path into moves
+ *
+ * Traverse the path, converting each segment to a move. The
+ * nozzle must already be at the start of the path, see start_position().
+ *
+ * @param paths Path storage
+ * @param path Path to convert
+ * @param batch Scratch space, reused between calls
+ * @param out Toolpath to append the moves to
+ */
+static void polyline_toolpath(const sse::PathStore &paths, const sse::PathInfo &path, double filament_diameter,
+                              double extrusion_width, double layer_height, double extrusion_multiplier,
+                              sse::SegmentBatch &batch, sse::Toolpath &out) {
 
-static cavc::Polyline<double> flatten(Geom_BSplineCurve &curve,
-                                      const Geom_TrimmedCurve &trimmed_curve) {
+  // TODO: configurable extruder
+  // either pull in setting here, or do a second format pass elsewhere
+  // i.e. "{{extruder}}{:.3f}"
 
-  cavc::Polyline<double> result;
-  result.addVertex(trimmed_curve.StartPoint().X(),
-                   trimmed_curve.StartPoint().Y(), 0);
-  return {};
-}
+  if (path.size() == 0) {
+    return;
+  }
 
-static cavc::Polyline<double> flatten(Geom_BezierCurve &curve,
-                                      const Geom_TrimmedCurve &trimmed_curve) {
-  cavc::Polyline<double> result;
+  out.reset_extruder();
 
-  curve.NbPoles();
-  curve.Degree();
+  if (path.size() < 2) {
+    return;
+  }
 
-  result.addVertex(trimmed_curve.StartPoint().X(),
-                   trimmed_curve.StartPoint().Y(), 0);
+  // multiply this by segment length to determine extrusion value
+  // https://3dprinting.stackexchange.com/questions/6289/how-is-the-e-argument-calculated-for-a-given-g1-command
+  auto extrusion_ratio = extrusion_multiplier * layer_height * 4 / (M_PI * filament_diameter);
 
-  return result;
+  // compute everything first, then format
+  sse::compute_segments(paths, path, extrusion_ratio, batch);
+
+  switch (path.shape) {
+  case sse::PathShape::lines:
+    segments_toolpath<sse::PathShape::lines>(paths, path, batch, out);
+    break;
+  case sse::PathShape::arcs:
+    segments_toolpath<sse::PathShape::arcs>(paths, path, batch, out);
+    break;
+  case sse::PathShape::mixed:
+    segments_toolpath<sse::PathShape::mixed>(paths, path, batch, out);
+    break;
+  }
 }
 
-static cavc::Polyline<double> process_wire(TopoDS_Wire w) {
-  cavc::Polyline<double> result;
-// reserve enough space for the child edges
-// TODO: consider reserving a multiple of known children
-#if OCC_VERSION_HEX >= 0x070400
-  result.vertexes().reserve(w.NbChildren());
-#endif
-
-  // we only care about closed wires
-  result.isClosed() = true;
-
-  if (!w.Closed()) {
-    spdlog::trace("Slice: Wire is open, skipping");
-    return result;
+/**
+ * @brief travel_toolpath Convert a planned travel into moves
+ *
+ * Retraction (and z-hop) is only performed when the travel crosses the
+ * outline of the slice.
+ *
+ * @param travel Planned travel
+ * @param z Z position of the slice
+ * @param settings Retraction settings
+ * @param out Toolpath to append the moves to
+ */
+static void travel_toolpath(const sse::Travel &travel, double z, const sse::TravelSettings &settings,
+                            sse::Toolpath &out) {
+  const auto retract = travel.retract && settings.retraction_distance > 0;
+  const auto hop = travel.retract && settings.z_hop > 0;
+
+  // n.b. every polyline resets the extruder position
+  if (retract) {
+    out.reset_extruder();
+    out.extrude(-settings.retraction_distance, settings.retraction_speed);
   }
-
-  // reverse wire if necessary
-  if (w.Orientation() == TopAbs_REVERSED) {
-    spdlog::trace("Slice: Reversing wire");
-    w.Reverse();
+  if (hop) {
+    out.travel_z(z + settings.z_hop);
   }
 
-  // loop over edges in wire
-  auto exp = BRepTools_WireExplorer(w);
-
-  while (exp.More()) {
-    // get underlying curve
-    auto curve = BRepAdaptor_Curve(exp.Current());
-    Standard_Real first_parameter, last_parameter;
-    auto c2 = BRep_Tool::Curve(exp.Current(), first_parameter, last_parameter);
-    // trim the curve
-    auto trim = Geom_TrimmedCurve(c2, first_parameter, last_parameter);
-
-    // if the geometry is reversed from the topology, reverse the former
-    if (exp.Current().Orientation() == TopAbs_REVERSED) {
-      spdlog::trace("Slice: Geometry of trimmed curve is opposite of Topology, "
-                    "reversing geom_curve");
-      trim.Reverse();
-    }
-
-    auto first = trim.FirstParameter();
-    auto last = trim.LastParameter();
-
-    auto start_point = trim.StartPoint();
-
-    switch (curve.GetType()) {
-    case GeomAbs_Line: {
-      result.addVertex(start_point.X(), start_point.Y(), 0);
-      break;
-    }
-
-    case GeomAbs_Circle: {
-      auto z = flatten(curve.Circle(), trim);
-      // append result to
-      result.vertexes().insert(result.vertexes().end(), z.vertexes().begin(),
-                               z.vertexes().end());
-      break;
-    }
-
-    case GeomAbs_Ellipse: {
-      auto z = flatten(curve.Ellipse(), trim);
-
-      break;
-    }
-    case GeomAbs_BezierCurve: {
-      // flatten the bezier into lines and arcs
-      curve.Bezier();
-      break;
-    }
-    case GeomAbs_BSplineCurve:
-      result.addVertex(start_point.X(), start_point.Y(), 0);
-      break;
-    case GeomAbs_Hyperbola:
-      result.addVertex(start_point.X(), start_point.Y(), 0);
-      break;
-    case GeomAbs_Parabola:
-      result.addVertex(start_point.X(), start_point.Y(), 0);
-      break;
-    case GeomAbs_OffsetCurve:
-      result.addVertex(start_point.X(), start_point.Y(), 0);
-      break;
-    case GeomAbs_OtherCurve:
-      result.addVertex(start_point.X(), start_point.Y(), 0);
-      break;
-    default:
-      // something is wrong, throw an error
-
-      break;
-    }
+  for (const auto &p : travel.path) {
+    out.travel(p.x(), p.y());
+  }
 
-    exp.Next();
+  if (hop) {
+    out.travel_z(z);
   }
+  if (retract) {
+    out.extrude(0, settings.retraction_speed);
+  }
+}
 
+/**
+ * @brief vertex_count Total number of vertices in a shell
+ */
+static std::size_t vertex_count(const sse::Shell &shell) {
+  auto result = shell.outer.size();
+  for (const auto &island : shell.islands) {
+    result += island.size();
+  }
   return result;
 }
 
 /**
- * @brief polyline_gcode Convert a polyline into gcode commands
- *
- * Traverse the polyline, converting each segment to a gcode command.
- *
- * @param pline Polyline to convert
- * @return String containing list of gcode commands
+ * @brief simplify_shell Simplify every loop of a shell, and report the vertex counts
+ * @param shell Shell to simplify
+ * @param tolerance Simplification tolerance (mm)
+ * @param feature Name of the feature, for logging
  */
-static std::string polyline_gcode(const cavc::Polyline<double> &pline, double filament_diameter,
-                                  double extrusion_width, double layer_height, double extrusion_multiplier) {
-
-  // TODO: configurable extruder
-  // either pull in setting here, or do a second format pass elsewhere
-  // i.e. "{{extruder}}{:.3f}"
-
-  if (pline.size() == 0) {
-    return ""s;
+static void simplify_shell(sse::Shell &shell, double tolerance, const char *feature) {
+  if (tolerance <= 0) {
+    return;
   }
 
-  std::string result = "G92 E0\n"s;
-
-  double extrusion_total = 0.0;
+  const auto before = vertex_count(shell);
 
-
-  // TODO: profile preallocation length
-  // TODO: refine
-  const int gcode_string_length = fmt::format("G2 X{:.6f} Y{:.6f} I{:.6f} J{:.6f} E{:.6f} F1000\n",
-                                              1.0, 1.0, 1.0, 1.0, 1.0).size() + 100;
-  result.reserve(pline.size() * gcode_string_length);
-
-  // travel to start of polyline
-  // n.b. for closed polylines, this travels to the *last* point in polyline, because the visit function doesn't close the loop
-  // there's probably a much better way to do this
-  if(pline.isClosed()) {
-    result += fmt::format("G0 X{:.6f} Y{:.6f}\n", pline.lastVertex().x(), pline.lastVertex().y());
-  } else {
-    result += fmt::format("G0 X{:.6f} Y{:.6f}\n", pline[0].x(), pline[0].y());
+  sse::simplify(shell.outer, tolerance);
+  for (auto &island : shell.islands) {
+    sse::simplify(island, tolerance);
   }
 
-  // multiply this by segment length to determine extrusion value
-  // https://3dprinting.stackexchange.com/questions/6289/how-is-the-e-argument-calculated-for-a-given-g1-command
-  auto extrusion_ratio = extrusion_multiplier * layer_height * 4 / (M_PI * filament_diameter);
-
-  auto segment_to_gcode = [&](std::size_t i, std::size_t j) {
-    auto &source = pline[i];
-    auto &destination = pline[j];
+  spdlog::debug("Slice: simplified {} from {} to {} vertices", feature, before, vertex_count(shell));
+}
 
-    extrusion_total += (cavc::segLength(source, destination) * extrusion_ratio);
+/**
+ * @brief add_shell Append the loops of a shell to a path store
+ */
+static void add_shell(sse::PathStore &paths, const sse::Shell &shell, sse::PathKind kind, std::uint16_t index = 0) {
+  paths.add(shell.outer, kind, false, index);
+  for (const auto &island : shell.islands) {
+    paths.add(island, kind, true, index);
+  }
+}
 
-    // short-circuit for straight segment
-    if (source.bulgeIsZero()) {
-      result += fmt::format("G1 X{:.6f} Y{:.6f} E{:.6f} F1000\n", destination.x(),
-                            destination.y(), extrusion_total);
-      return true;
+/**
+ * @brief get_shell Copy the loops of a shell out of a path store
+ */
+static sse::Shell get_shell(const sse::PathStore &paths, sse::PathKind kind, std::uint16_t index = 0) {
+  sse::Shell result;
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    const auto &info = paths.info(i);
+    if (info.kind != kind || info.shell != index) {
+      continue;
     }
+    if (info.island) {
+      result.islands.push_back(paths.polyline(i));
+    } else {
+      result.outer = paths.polyline(i);
+    }
+  }
+  return result;
+}
 
-    auto [radius, center] = cavc::arcRadiusAndCenter(source, destination);
-
-    // negative bulge = clockwise
-    // center is an absolute location (point), G(2|3) needs offsets relative to
-    // starting point
-    result += fmt::format("G{:s} X{:.6f} Y{:.6f} I{:.6f} J{:.6f} E{:.6f} F1000\n",
-                          source.bulgeIsNeg() ? "2" : "3",
-                          destination.x(),
-                          destination.y(), center.x() - source.x(),
-                          center.y() - source.y(),
-                          extrusion_total);
-
-    // visit all segments
-    return true;
-  };
-
-  pline.visitSegIndices(segment_to_gcode);
-
+/**
+ * @brief shell_count Number of walls in a path store
+ */
+static std::uint16_t shell_count(const sse::PathStore &paths) {
+  std::uint16_t result = 0;
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    const auto &info = paths.info(i);
+    if (info.kind == sse::PathKind::wall) {
+      result = std::max<std::uint16_t>(result, info.shell + 1);
+    }
+  }
   return result;
 }
 
@@ -321,8 +276,6 @@ Slice::Slice(const Object *parent, TopoDS_Face face, double thickness)
     throw std::invalid_argument("Empty face");
   }
 
-  wires = TopTools_ListOfShape();
-
   // get the parametric boundaries of the face
   Standard_Real umin, umax, vmin, vmax;
   BRepTools::UVBounds(face, umin, umax, vmin, vmax);
@@ -335,7 +288,8 @@ Slice::Slice(const Object *parent, TopoDS_Face face, double thickness)
   z = props.Value().Z();
 }
 
-void Slice::generate_shells(const int num_shells, const double line_width, const double overlap) {
+void Slice::generate_shells(const int num_shells, const double line_width, const double overlap,
+                            const SimplifySettings &simplify, const OffsetBackend *backend, EdgeCache *edges) {
   if(num_shells < 0) {
     spdlog::error("Slice: cannot generate less that zero shells");
     throw std::invalid_argument("Slice: cannot generate less than zero shells");
@@ -346,63 +300,90 @@ void Slice::generate_shells(const int num_shells, const double line_width, const
     return;
   }
 
-  cavc::OffsetLoopSet<double> loopset;
-  loopset.cwLoops.reserve(2);
+  auto outline = Shell();
 
-#if OCC_VERSION_HEX >= 0x070400
-  loopset.ccwLoops.reserve(face.NbChildren());
-#endif
+  if (face.IsNull()) {
+    // the face was released after the first call, reuse its outline
+    outline = get_shell(paths, PathKind::outline);
+  } else {
+    auto outer_wire = ShapeAnalysis::OuterWire(face);
+    // wires of a face can share edges, only fit them once
+    EdgeCache face_edges;
+    if (!edges) {
+      edges = &face_edges;
+    }
 
-  auto outer_wire = ShapeAnalysis::OuterWire(face);
+    for (auto exp = TopExp_Explorer(face, TopAbs_WIRE); exp.More(); exp.Next()) {
+      auto r = flatten_wire(TopoDS::Wire(exp.Current()), SSE_FALLBACK_CHORDAL_TOLERANCE, edges);
+      const auto is_outer = outer_wire.IsSame(exp.Current());
 
-  for (auto exp = TopExp_Explorer(face, TopAbs_WIRE); exp.More(); exp.Next()) {
-    auto r = process_wire(TopoDS::Wire(exp.Current()));
+      // outer wire is counter-clockwise, islands are clockwise
+      // n.b. the wire's direction depends on the orientation of the face
+      if ((cavc::getArea(r) < 0) == is_outer) {
+        cavc::invertDirection(r);
+      }
 
-    // outer wire is counter-clockwise, islands are clockwise
-    if (outer_wire.IsSame(exp.Current())) {
-      loopset.ccwLoops.push_back({0, r, cavc::createApproxSpatialIndex(r)});
-    } else {
-      loopset.cwLoops.push_back({0, r, cavc::createApproxSpatialIndex(r)});
+#ifdef SSE_FIXED_POINT
+      // merge vertices closer than 1nm, which break offsetting
+      snap(r);
+#endif
+
+      if (is_outer) {
+        outline.outer = r;
+      } else {
+        outline.islands.push_back(r);
+      }
     }
   }
 
-  cavc::ParallelOffsetIslands<double> alg;
+  // every shell is offset from the outline, so simplify it before offsetting
+  simplify_shell(outline, simplify.outer_wall, "outer wall");
+
+  const auto default_backend = CavcOffsetBackend();
+  const auto &offsetter = backend ? *backend : static_cast<const OffsetBackend &>(default_backend);
 
   // n.b. first shell must be 1/2 * line_width offset, or else extrusion will inflate exterior dimensions
+  std::vector<double> distances;
+  distances.reserve(num_shells + 1);
   for (int i = 0; i < num_shells; ++i) {
-    auto result = alg.compute(loopset, (i + 0.5) * line_width);
-    this->shells.emplace_back(result);
+    distances.push_back((i + 0.5) * line_width);
   }
+  // innermost offset, used for clipping infill
+  distances.push_back((num_shells + 1 + overlap) * line_width);
 
-  // generate innermost offset, used for clipping infill
-  const auto innermost_offset = (num_shells + 1 + overlap) * line_width;
+  auto shells = offsetter.offset(face, outline, distances);
 
-  // TODO: this is very ugly. can't construct Shell for some reason
-  const auto tmp = alg.compute(loopset, innermost_offset);
-  auto &outer = innermost_shell.outer;
-  auto &z = tmp.ccwLoops.front().polyline;
+  // everything else is derived from the outline, including infill
+  paths.clear();
+  add_shell(paths, outline, PathKind::outline);
 
-  innermost_shell.outer = z;
+  simplify_shell(shells.back(), simplify.infill_boundary, "infill boundary");
+  add_shell(paths, shells.back(), PathKind::infill_boundary);
+  shells.pop_back();
 
-  /*
-  std::swap(outer, z);
-  std::swap(outer, tmp.ccwLoops.front().polyline);
-  for(auto &loopset: tmp.cwLoops) {
-    innermost_shell.islands.push_back(std::move(loopset.polyline));
+  for (std::size_t i = 0; i < shells.size(); ++i) {
+    if (i > 0) {
+      simplify_shell(shells[i], simplify.inner_wall, "inner wall");
+    }
+    add_shell(paths, shells[i], PathKind::wall, static_cast<std::uint16_t>(i));
   }
-  */
 
+  paths.shrink_to_fit();
+
+  // all the geometry that's needed has been extracted
+  face.Nullify();
 }
 
 void Slice::generate_infill(cavc::Polyline<double> infill_pattern) {
 
-  if (shells.empty()) {
+  if (shell_count(paths) == 0) {
     spdlog::error("Slice: cannot generate infill before offsetting");
     return;
   }
 
   // intersect with innermost polyline
-  auto infill = cavc::intersect_open_polyline(innermost_shell.outer, infill_pattern);
+  const auto boundary = get_shell(paths, PathKind::infill_boundary);
+  auto infill = cavc::intersect_open_polyline(boundary.outer, infill_pattern);
   
   auto &result = infill.remaining;
 
@@ -410,7 +391,7 @@ void Slice::generate_infill(cavc::Polyline<double> infill_pattern) {
   // TODO: optimize. this is extremely inefficient
   // TODO: cavc hasn't implemented exclude operation on open polylines
   /*
-  for(const auto &pline: innermost_shell.islands) {
+  for(const auto &pline: boundary.islands) {
 
     std::vector<cavc::Polyline<double>> tmp;
     tmp.reserve(result.size());
@@ -424,40 +405,141 @@ void Slice::generate_infill(cavc::Polyline<double> infill_pattern) {
   }
   */
 
-  infill_polylines = result;
+  paths.erase(PathKind::infill);
+  for (const auto &pline : result) {
+    paths.add(pline, PathKind::infill);
+  }
+  paths.shrink_to_fit();
+}
+
+
+std::string Slice::gcode(double filament_diameter, double extrusion_width, double extrusion_multiplier,
+                         const TravelSettings &travel_settings, const std::optional<cavc::Vector2<double>> &from) const {
+  // chunks from 1KiB to 1MiB took the same time for slices of 4KB to 400KB, since formatting dominates.
+  // 64KiB holds most slices in one chunk, and is only allocated for the duration of the call
+  auto buffer = GCodeBuffer(1 << 16);
+  auto writer = GCodeWriter(buffer);
+  write_gcode(writer, filament_diameter, extrusion_width, extrusion_multiplier, travel_settings, from);
+  return buffer.str();
 }
 
+void Slice::write_gcode(GCodeWriter &out, double filament_diameter, double extrusion_width,
+                        double extrusion_multiplier, const TravelSettings &travel_settings,
+                        const std::optional<cavc::Vector2<double>> &from) const {
+  Toolpath path;
+  toolpath(path, filament_diameter, extrusion_width, extrusion_multiplier, travel_settings, from);
+  write_toolpath(path, out);
+}
 
-std::string Slice::gcode(double filament_diameter, double extrusion_width, double extrusion_multiplier) const {
-  std::string result;
+void Slice::toolpath(Toolpath &out, double filament_diameter, double extrusion_width, double extrusion_multiplier,
+                     const TravelSettings &travel_settings, const std::optional<cavc::Vector2<double>> &from) const {
+  ToolpathScratch scratch;
+  toolpath(out, filament_diameter, extrusion_width, extrusion_multiplier, travel_settings, from, scratch);
+}
 
-  if(shells.empty()) {
+void Slice::toolpath(Toolpath &out, double filament_diameter, double extrusion_width, double extrusion_multiplier,
+                     const TravelSettings &travel_settings, const std::optional<cavc::Vector2<double>> &from,
+                     ToolpathScratch &scratch) const {
+  const auto num_shells = shell_count(paths);
+  if (num_shells == 0) {
     spdlog::warn("Slice: generating infill with no shells or infill");
-    return result;
+    return;
   }
 
-  // TODO: profile whether 1KB is a good choice for preallocation
-  result.reserve(1000);
+  // route travels inside the innermost shell
+  auto &planner = scratch.planner;
+  planner.reset(paths, num_shells - 1);
+  auto position = from;
+  auto &travel = scratch.travel;
+  auto &batch = scratch.batch;
+
+  auto add_path = [&](const PathInfo &path) {
+    const auto start = start_position(paths, path);
+    if (position) {
+      planner.plan(*position, start, travel);
+    } else {
+      // nozzle position is unknown, can't plan anything
+      travel.path.assign(1, start);
+      travel.retract = false;
+    }
 
-  // shells first
-  for(auto shell = shells.cbegin(); shell != shells.cend(); ++shell) {
-    result += ";TYPE:WALL-"s;
-    result += (shell == shells.cbegin()) ? "OUTER\n"s : "INNER\n"s;
+    travel_toolpath(travel, this->z, travel_settings, out);
+    polyline_toolpath(paths, path, filament_diameter, extrusion_width, this->thickness, extrusion_multiplier, batch, out);
+    position = paths.vertex(path.end - 1).pos();
+  };
 
-    result += polyline_gcode(shell->outer, filament_diameter, extrusion_width, this->thickness, extrusion_multiplier);
+  // shells first, outermost first
+  for (std::uint16_t shell = 0; shell < num_shells; ++shell) {
+    out.feature((shell == 0) ? Feature::outer_wall : Feature::inner_wall);
 
-    for(const auto &pline: shell->islands) {
-      result += polyline_gcode(pline, filament_diameter, extrusion_width, this->thickness, extrusion_multiplier);
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+      const auto &path = paths.info(i);
+      if (path.kind == PathKind::wall && path.shell == shell) {
+        add_path(path);
+      }
     }
   }
 
   // infill second
   // TODO: sort infill segments
-  if(infill_polylines.size() > 0) {
-    result += ";TYPE:FILL\n"s;
+  bool infill_header = false;
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    const auto &path = paths.info(i);
+    if (path.kind != PathKind::infill) {
+      continue;
+    }
+    if (!infill_header) {
+      out.feature(Feature::fill);
+      infill_header = true;
+    }
+    add_path(path);
   }
-  for (const auto &pline : infill_polylines) {
-    result += polyline_gcode(pline, filament_diameter, extrusion_width, this->thickness, extrusion_multiplier);
+}
+
+std::optional<cavc::Vector2<double>> Slice::entry_point() const {
+  // gcode() starts with the outer loop of the first shell
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    const auto &path = paths.info(i);
+    if (path.kind == PathKind::wall && path.shell == 0 && !path.island) {
+      return start_position(paths, path);
+    }
+  }
+
+  return std::nullopt;
+}
+
+std::optional<cavc::Vector2<double>> Slice::exit_point() const {
+  const auto num_shells = shell_count(paths);
+  if (num_shells == 0) {
+    return std::nullopt;
+  }
+
+  // infill is emitted last
+  for (auto i = paths.size(); i-- > 0;) {
+    const auto &path = paths.info(i);
+    if (path.kind == PathKind::infill) {
+      return paths.vertex(path.end - 1).pos();
+    }
+  }
+
+  // otherwise, the last loop of the innermost shell
+  for (auto i = paths.size(); i-- > 0;) {
+    const auto &path = paths.info(i);
+    if (path.kind == PathKind::wall && path.shell == num_shells - 1) {
+      return paths.vertex(path.end - 1).pos();
+    }
+  }
+
+  return std::nullopt;
+}
+
+std::vector<Shell> Slice::get_shells() const {
+  const auto num_shells = shell_count(paths);
+
+  std::vector<Shell> result;
+  result.reserve(num_shells);
+  for (std::uint16_t shell = 0; shell < num_shells; ++shell) {
+    result.push_back(get_shell(paths, PathKind::wall, shell));
   }
 
   return result;
@@ -0,0 +1,240 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Subroutines.cpp
+ * @brief Find repeated toolpaths, so they can be written once as subroutines
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+// external headers
+#include <spdlog/spdlog.h>
+// project headers
+#include "sse/Subroutines.hpp"
+
+/**
+ * @brief append_word Append a value, rounded to a precision, to a key
+ */
+static void append_word(std::string &key, double value, int precision) {
+  // n.b. adding 0 turns -0 into 0, so both have the same bytes
+  const auto units = sse::number_units(value, precision) + 0.0;
+  char bytes[sizeof(units)];
+  std::memcpy(bytes, &units, sizeof(units));
+  key.append(bytes, sizeof(bytes));
+}
+
+/**
+ * @brief append_move Append a move to a key, relative to an offset
+ * @param key Key to append to
+ * @param path Toolpath the move belongs to
+ * @param move Move
+ * @param x0, y0, z0 Offset
+ * @param precision Decimal places the move is written with
+ */
+static void append_move(std::string &key, const sse::Toolpath &path, const sse::ToolpathMove &move, double x0,
+                        double y0, double z0, const sse::GCodePrecision &precision) {
+  key += static_cast<char>(move.type);
+  switch (move.type) {
+  case sse::MoveType::travel:
+    append_word(key, move.x - x0, precision.xy);
+    append_word(key, move.y - y0, precision.xy);
+    break;
+  case sse::MoveType::travel_z:
+    append_word(key, move.x - z0, precision.z);
+    append_word(key, move.f, precision.f);
+    break;
+  case sse::MoveType::line:
+  case sse::MoveType::arc_cw:
+  case sse::MoveType::arc_ccw:
+  case sse::MoveType::bezier:
+    append_word(key, move.x - x0, precision.xy);
+    append_word(key, move.y - y0, precision.xy);
+    append_word(key, move.e, precision.e);
+    append_word(key, move.f, precision.f);
+    if (move.is_arc()) {
+      append_word(key, path.center(move).i, precision.xy);
+      append_word(key, path.center(move).j, precision.xy);
+    } else if (move.type == sse::MoveType::bezier) {
+      const auto &controls = path.controls(move);
+      append_word(key, controls.i, precision.xy);
+      append_word(key, controls.j, precision.xy);
+      append_word(key, controls.p, precision.xy);
+      append_word(key, controls.q, precision.xy);
+    }
+    break;
+  case sse::MoveType::retract:
+    append_word(key, move.e, precision.e);
+    append_word(key, move.f, precision.f);
+    break;
+  case sse::MoveType::feature:
+    key += static_cast<char>(move.feature);
+    break;
+  case sse::MoveType::reset_extruder:
+    break;
+  }
+}
+
+/**
+ * @brief copy_relative Append a move to a toolpath, relative to an offset
+ * @param from Toolpath the move belongs to
+ * @param move Move
+ * @param x0, y0, z0 Offset
+ * @param to Toolpath to append to
+ */
+static void copy_relative(const sse::Toolpath &from, const sse::ToolpathMove &move, double x0, double y0, double z0,
+                          sse::Toolpath &to) {
+  switch (move.type) {
+  case sse::MoveType::travel:
+    to.travel(move.x - x0, move.y - y0);
+    break;
+  case sse::MoveType::travel_z:
+    to.travel_z(move.x - z0, move.feedrate());
+    break;
+  case sse::MoveType::line:
+    to.linear(move.x - x0, move.y - y0, move.e, move.f);
+    break;
+  case sse::MoveType::arc_cw:
+  case sse::MoveType::arc_ccw: {
+    const auto &center = from.center(move);
+    to.arc(move.type == sse::MoveType::arc_cw, move.x - x0, move.y - y0, center.i, center.j, move.e, move.f);
+    break;
+  }
+  case sse::MoveType::bezier:
+    to.bezier(move.x - x0, move.y - y0, from.controls(move), move.e, move.f);
+    break;
+  case sse::MoveType::retract:
+    to.extrude(move.e, move.f);
+    break;
+  case sse::MoveType::reset_extruder:
+    to.reset_extruder();
+    break;
+  case sse::MoveType::feature:
+    to.feature(move.feature);
+    break;
+  }
+}
+
+/**
+ * @brief is_slice_start A slice's moves start with its outer wall, see Slice::toolpath()
+ */
+static bool is_slice_start(const sse::ToolpathMove &move) {
+  return move.type == sse::MoveType::feature && move.feature == sse::Feature::outer_wall;
+}
+
+namespace sse {
+
+std::size_t Subroutines::call_count() const noexcept {
+  std::size_t result = 0;
+  for (const auto &layer : calls) {
+    result += layer.size();
+  }
+  return result;
+}
+
+Subroutines find_subroutines(const std::vector<ToolpathLayer> &layers, const GCodePrecision &precision,
+                             std::size_t min_moves) {
+  // every occurrence of each distinct run of moves, in the order they were first found
+  std::vector<std::vector<std::pair<std::size_t, SubroutineCall>>> found;
+  std::unordered_map<std::string, std::size_t> index;
+  std::string key;
+
+  for (std::size_t layer = 0; layer < layers.size(); ++layer) {
+    const auto &path = layers[layer].path;
+
+    for (std::size_t begin = 0; begin < path.size();) {
+      if (!is_slice_start(path[begin])) {
+        ++begin;
+        continue;
+      }
+      auto end = begin + 1;
+      while (end < path.size() && !is_slice_start(path[end])) {
+        ++end;
+      }
+
+      // skip the travel into the slice, which depends on where the previous slice ended
+      auto first = begin;
+      while (first < end && !path[first].is_extrusion()) {
+        ++first;
+      }
+      std::optional<std::pair<double, double>> start;
+      for (auto k = first; k-- > begin;) {
+        if (path[k].type == MoveType::travel) {
+          start = {path[k].x, path[k].y};
+          break;
+        }
+      }
+
+      if (start && end - first >= min_moves) {
+        const auto [x0, y0] = *start;
+        const auto z0 = layers[layer].z;
+        key.clear();
+        for (auto k = first; k < end; ++k) {
+          append_move(key, path, path[k], x0, y0, z0, precision);
+        }
+
+        const auto [it, inserted] = index.try_emplace(key, found.size());
+        if (inserted) {
+          found.emplace_back();
+        }
+        found[it->second].push_back({layer, SubroutineCall{first, end, 0, x0, y0, z0}});
+      }
+
+      begin = end;
+    }
+  }
+
+  Subroutines result;
+  result.calls.resize(layers.size());
+  for (const auto &occurrences : found) {
+    if (occurrences.size() < 2) {
+      continue;
+    }
+
+    // the first occurrence is the body, relative to where it starts
+    const auto &[layer, call] = occurrences.front();
+    const auto &path = layers[layer].path;
+    auto &body = result.bodies.emplace_back();
+    for (auto k = call.begin; k < call.end; ++k) {
+      copy_relative(path, path[k], call.x, call.y, call.z, body);
+    }
+
+    for (auto occurrence : occurrences) {
+      occurrence.second.subroutine = result.bodies.size() - 1;
+      result.calls[occurrence.first].push_back(occurrence.second);
+    }
+  }
+
+  for (auto &calls : result.calls) {
+    std::sort(calls.begin(), calls.end(),
+              [](const SubroutineCall &a, const SubroutineCall &b) { return a.begin < b.begin; });
+  }
+
+  spdlog::debug("found {} subroutines, called {} times", result.bodies.size(), result.call_count());
+  return result;
+}
+
+} // namespace sse
@@ -0,0 +1,773 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Toolpath.cpp
+ * @brief Typed moves between slicing and gcode output
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+// external headers
+#include <spdlog/spdlog.h>
+#include "cavc/mathutils.hpp"
+#include "cavc/plinesegment.hpp"
+#include "cavc/polyline.hpp"
+// project headers
+#include "sse/Simplify.hpp"
+#include "sse/Toolpath.hpp"
+
+static constexpr double no_feedrate = std::numeric_limits<double>::quiet_NaN();
+//! line moves whose extrusion per mm differs more than this (relative) aren't fitted together
+static constexpr double extrusion_rate_tolerance = 0.05;
+//! moves that turn more than this where they meet (radians) aren't fitted with the same bezier
+static constexpr double max_smooth_turn = cavc::utils::pi<double>() / 12;
+//! arcs are sampled at least this often (radians) when fitting beziers
+static constexpr double max_sample_angle = cavc::utils::pi<double>() / 8;
+//! Newton iterations to improve the fit of a bezier before it's split
+static constexpr int max_reparameterizations = 4;
+//! the length of a bezier is measured along lines this close to it (mm)
+static constexpr double bezier_length_tolerance = 1e-4;
+//! most lines a bezier is flattened into
+static constexpr double max_bezier_lines = 65536;
+
+using point = cavc::Vector2<double>;
+using bezier_points = std::array<point, 4>;
+
+/**
+ * @brief arc_length Length of an arc
+ * @param x0, y0 Start point
+ * @param move Arc move
+ * @param center Center, relative to the start point
+ */
+static double arc_length(double x0, double y0, const sse::ToolpathMove &move, const sse::ArcCenter &center) {
+  const auto cx = x0 + center.i;
+  const auto cy = y0 + center.j;
+  const auto radius = std::hypot(center.i, center.j);
+
+  auto sweep = std::atan2(move.y - cy, move.x - cx) - std::atan2(y0 - cy, x0 - cx);
+  if (move.type == sse::MoveType::arc_cw) {
+    sweep = -sweep;
+  }
+  // the same start and end point is a full circle
+  if (sweep <= 0) {
+    sweep += 2 * cavc::utils::pi<double>();
+  }
+
+  return radius * sweep;
+}
+
+/**
+ * @brief bezier_length Length of a bezier
+ * @param x0, y0 Start point
+ * @param move Bezier move
+ * @param controls Control points
+ */
+static double bezier_length(double x0, double y0, const sse::ToolpathMove &move, const sse::BezierControls &controls) {
+  double length = 0;
+  for (const auto &[x, y] : sse::flatten_bezier(x0, y0, move.x, move.y, controls, bezier_length_tolerance)) {
+    length += std::hypot(x - x0, y - y0);
+    x0 = x;
+    y0 = y;
+  }
+  return length;
+}
+
+/**
+ * @brief bezier_at Point on a cubic bezier
+ * @param b Control points, including the ends
+ * @param t Parameter, 0 to 1
+ */
+static point bezier_at(const bezier_points &b, double t) {
+  const auto s = 1 - t;
+  return (s * s * s) * b[0] + (3 * s * s * t) * b[1] + (3 * s * t * t) * b[2] + (t * t * t) * b[3];
+}
+
+/**
+ * @brief reparameterize Improve the parameter of a point on a bezier with a Newton-Raphson step
+ * @param b Control points, including the ends
+ * @param p Point
+ * @param t Parameter of the point
+ * @return Improved parameter
+ */
+static double reparameterize(const bezier_points &b, const point &p, double t) {
+  const auto s = 1 - t;
+  const auto d = bezier_at(b, t) - p;
+  const auto d1 = (3 * s * s) * (b[1] - b[0]) + (6 * s * t) * (b[2] - b[1]) + (3 * t * t) * (b[3] - b[2]);
+  const auto d2 = (6 * s) * (b[2] - 2.0 * b[1] + b[0]) + (6 * t) * (b[3] - 2.0 * b[2] + b[1]);
+  const auto denominator = cavc::dot(d1, d1) + cavc::dot(d, d2);
+  if (std::abs(denominator) < cavc::utils::realThreshold<double>()) {
+    return t;
+  }
+  return std::clamp(t - cavc::dot(d, d1) / denominator, 0.0, 1.0);
+}
+
+/**
+ * @brief A point along a run of moves, for fit_beziers()
+ */
+struct BezierSample {
+  point position;
+  //! number of moves of the run that end at or before the point
+  std::size_t moves;
+  //! the point is the end of a move, so a bezier can end there
+  bool end;
+};
+
+/**
+ * @brief One bezier of a fitted run, or the moves that couldn't be fitted
+ */
+struct BezierPiece {
+  //! index of the last sample
+  std::size_t last;
+  //! control points, or empty to keep the original moves
+  std::optional<bezier_points> curve;
+};
+
+/**
+ * @brief generate_bezier Least squares fit of a bezier to samples, with the tangents at its ends given
+ *
+ * See Schneider, "An Algorithm for Automatically Fitting Digitized Curves", Graphics Gems (1990)
+ *
+ * @param samples Samples
+ * @param first, last Indices of the samples at the ends
+ * @param u Parameter of each sample from first to last
+ * @param tan1 Unit tangent at the start, pointing forwards
+ * @param tan2 Unit tangent at the end, pointing backwards
+ */
+static bezier_points generate_bezier(const std::vector<BezierSample> &samples, std::size_t first, std::size_t last,
+                                     const std::vector<double> &u, const point &tan1, const point &tan2) {
+  const auto &p0 = samples[first].position;
+  const auto &p3 = samples[last].position;
+
+  double c00 = 0, c01 = 0, c11 = 0, x0 = 0, x1 = 0;
+  for (auto k = first; k <= last; ++k) {
+    const auto t = u[k - first];
+    const auto s = 1 - t;
+    const auto a1 = (3 * s * s * t) * tan1;
+    const auto a2 = (3 * s * t * t) * tan2;
+    const auto rest = samples[k].position - ((s * s * s + 3 * s * s * t) * p0 + (3 * s * t * t + t * t * t) * p3);
+    c00 += cavc::dot(a1, a1);
+    c01 += cavc::dot(a1, a2);
+    c11 += cavc::dot(a2, a2);
+    x0 += cavc::dot(a1, rest);
+    x1 += cavc::dot(a2, rest);
+  }
+
+  const auto chord = cavc::length(p3 - p0);
+  const auto determinant = c00 * c11 - c01 * c01;
+  double alpha1 = chord / 3;
+  double alpha2 = chord / 3;
+  if (std::abs(determinant) > cavc::utils::realThreshold<double>()) {
+    alpha1 = (x0 * c11 - x1 * c01) / determinant;
+    alpha2 = (c00 * x1 - c01 * x0) / determinant;
+  }
+  // handles that are too short, or point backwards, are replaced with a third of the chord
+  if (alpha1 < 1e-6 * chord || alpha2 < 1e-6 * chord) {
+    alpha1 = alpha2 = chord / 3;
+  }
+
+  return {p0, p0 + alpha1 * tan1, p3 + alpha2 * tan2, p3};
+}
+
+/**
+ * @brief max_error Largest distance between the samples and a bezier
+ * @return Distance, and the index of the sample furthest away
+ */
+static std::pair<double, std::size_t> max_error(const std::vector<BezierSample> &samples, std::size_t first,
+                                                std::size_t last, const std::vector<double> &u,
+                                                const bezier_points &b) {
+  double result = 0;
+  auto worst = (first + last) / 2;
+  for (auto k = first + 1; k < last; ++k) {
+    const auto distance = cavc::length(bezier_at(b, u[k - first]) - samples[k].position);
+    if (distance > result) {
+      result = distance;
+      worst = k;
+    }
+  }
+  return {result, worst};
+}
+
+/**
+ * @brief fit_samples Fit beziers to samples, splitting at move ends until each is within tolerance
+ * @param samples Samples
+ * @param first, last Indices of the samples at the ends, both move ends
+ * @param tan1 Unit tangent at the start, pointing forwards
+ * @param tan2 Unit tangent at the end, pointing backwards
+ * @param tolerance Maximum distance between the samples and the beziers
+ * @param pieces List to append the beziers to
+ */
+static void fit_samples(const std::vector<BezierSample> &samples, std::size_t first, std::size_t last,
+                        const point &tan1, const point &tan2, double tolerance, std::vector<BezierPiece> &pieces) {
+  // a single move is better kept as it is
+  if (samples[last].moves - samples[first].moves < 2) {
+    pieces.push_back({last, std::nullopt});
+    return;
+  }
+
+  // chord length parameters
+  std::vector<double> u(last - first + 1, 0.0);
+  for (auto k = first + 1; k <= last; ++k) {
+    u[k - first] = u[k - first - 1] + cavc::length(samples[k].position - samples[k - 1].position);
+  }
+  for (auto &t : u) {
+    t /= u.back();
+  }
+
+  auto curve = generate_bezier(samples, first, last, u, tan1, tan2);
+  auto [error, worst] = max_error(samples, first, last, u, curve);
+  if (error > tolerance && error < 4 * tolerance) {
+    for (int iteration = 0; iteration < max_reparameterizations && error > tolerance; ++iteration) {
+      for (auto k = first + 1; k < last; ++k) {
+        u[k - first] = reparameterize(curve, samples[k].position, u[k - first]);
+      }
+      curve = generate_bezier(samples, first, last, u, tan1, tan2);
+      std::tie(error, worst) = max_error(samples, first, last, u, curve);
+    }
+  }
+  if (error <= tolerance) {
+    pieces.push_back({last, curve});
+    return;
+  }
+
+  // split at the move end closest to the worst sample
+  auto split = last;
+  for (auto k = first + 1; k < last; ++k) {
+    if (samples[k].end && (split == last || std::abs(static_cast<double>(k) - static_cast<double>(worst)) <
+                                                std::abs(static_cast<double>(split) - static_cast<double>(worst)))) {
+      split = k;
+    }
+  }
+
+  const auto tangent = cavc::normalize(samples[split + 1].position - samples[split - 1].position);
+  fit_samples(samples, first, split, tan1, -1.0 * tangent, tolerance, pieces);
+  fit_samples(samples, split, last, tangent, tan2, tolerance, pieces);
+}
+
+/**
+ * @brief move_tangents Unit tangents at the start and end of a line or arc
+ * @param start Start point
+ * @param move Line or arc move
+ * @param path Toolpath the move belongs to
+ */
+static std::pair<point, point> move_tangents(const point &start, const sse::ToolpathMove &move,
+                                             const sse::Toolpath &path) {
+  const auto end = point(move.x, move.y);
+  if (!move.is_arc()) {
+    const auto direction = cavc::normalize(end - start);
+    return {direction, direction};
+  }
+
+  const auto &center = path.center(move);
+  const auto c = start + point(center.i, center.j);
+  // perpendicular to the radius, turning left for counter-clockwise arcs
+  const auto side = move.type == sse::MoveType::arc_ccw ? 1.0 : -1.0;
+  return {side * cavc::unitPerp(start - c), side * cavc::unitPerp(end - c)};
+}
+
+/**
+ * @brief copy_move Append a move of one toolpath to another
+ * @param from Toolpath the move belongs to
+ * @param move Move to copy
+ * @param to Toolpath to append to
+ */
+static void copy_move(const sse::Toolpath &from, const sse::ToolpathMove &move, sse::Toolpath &to) {
+  switch (move.type) {
+  case sse::MoveType::travel:
+    to.travel(move.x, move.y);
+    break;
+  case sse::MoveType::travel_z:
+    to.travel_z(move.x, move.feedrate());
+    break;
+  case sse::MoveType::line:
+    to.linear(move.x, move.y, move.e, move.f);
+    break;
+  case sse::MoveType::arc_cw:
+  case sse::MoveType::arc_ccw: {
+    const auto &center = from.center(move);
+    to.arc(move.type == sse::MoveType::arc_cw, move.x, move.y, center.i, center.j, move.e, move.f);
+    break;
+  }
+  case sse::MoveType::bezier:
+    to.bezier(move.x, move.y, from.controls(move), move.e, move.f);
+    break;
+  case sse::MoveType::retract:
+    to.extrude(move.e, move.f);
+    break;
+  case sse::MoveType::reset_extruder:
+    to.reset_extruder();
+    break;
+  case sse::MoveType::feature:
+    to.feature(move.feature);
+    break;
+  }
+}
+
+/**
+ * @brief fit_run Fit beziers to a run of line and arc moves, see fit_beziers()
+ * @param path Toolpath the moves belong to
+ * @param run Indices of the moves
+ * @param start Point before the first move
+ * @param tolerance Maximum distance between the moves and the beziers
+ * @param out Toolpath to append the beziers, and the moves that weren't fitted, to
+ * @param stats Updated with the moves and beziers
+ */
+static void fit_run(const sse::Toolpath &path, const std::vector<std::size_t> &run, const point &start,
+                    double tolerance, sse::Toolpath &out, sse::BezierFitStats &stats) {
+  if (run.empty()) {
+    return;
+  }
+  stats.moves += run.size();
+
+  // ends of every move, the middle of lines, and points along arcs
+  std::vector<BezierSample> samples = {{start, 0, true}};
+  auto position = start;
+  for (std::size_t k = 0; k < run.size(); ++k) {
+    const auto &move = path[run[k]];
+    const auto end = point(move.x, move.y);
+    if (move.is_arc()) {
+      const auto &center = path.center(move);
+      const auto c = position + point(center.i, center.j);
+      const auto radius = std::hypot(center.i, center.j);
+      auto sweep = arc_length(position.x(), position.y(), move, center) / radius;
+      if (move.type == sse::MoveType::arc_cw) {
+        sweep = -sweep;
+      }
+      const auto count = static_cast<std::size_t>(std::ceil(std::abs(sweep) / max_sample_angle));
+      const auto start_angle = cavc::angle(c, position);
+      for (std::size_t step = 1; step < count; ++step) {
+        const auto angle = start_angle + sweep * static_cast<double>(step) / static_cast<double>(count);
+        samples.push_back({cavc::pointOnCircle(radius, c, angle), k, false});
+      }
+    } else {
+      samples.push_back({cavc::midpoint(position, end), k, false});
+    }
+    samples.push_back({end, k + 1, true});
+    position = end;
+  }
+
+  const auto &first = path[run.front()];
+  const auto &last = path[run.back()];
+  const auto last_start = run.size() > 1 ? point(path[run[run.size() - 2]].x, path[run[run.size() - 2]].y) : start;
+  const auto tan1 = move_tangents(start, first, path).first;
+  const auto tan2 = -1.0 * move_tangents(last_start, last, path).second;
+
+  std::vector<BezierPiece> pieces;
+  fit_samples(samples, 0, samples.size() - 1, tan1, tan2, tolerance, pieces);
+
+  std::size_t from = 0;
+  for (const auto &piece : pieces) {
+    const auto to = samples[piece.last].moves;
+    if (!piece.curve) {
+      for (auto k = from; k < to; ++k) {
+        copy_move(path, path[run[k]], out);
+      }
+    } else {
+      const auto &b = *piece.curve;
+      const auto &move = path[run[to - 1]];
+      const auto controls = sse::BezierControls{b[1].x() - b[0].x(), b[1].y() - b[0].y(), b[2].x() - b[3].x(),
+                                                b[2].y() - b[3].y()};
+      out.bezier(move.x, move.y, controls, move.e, move.f);
+      ++stats.beziers;
+      stats.replaced += to - from;
+    }
+    from = to;
+  }
+}
+
+namespace sse {
+
+void Toolpath::travel(double x, double y) {
+  add(MoveType::travel, x, y, 0, no_feedrate);
+}
+
+void Toolpath::travel_z(double z, std::optional<double> f) {
+  add(MoveType::travel_z, z, 0, 0, f.value_or(no_feedrate));
+}
+
+void Toolpath::linear(double x, double y, double e, double f) {
+  add(MoveType::line, x, y, e, f);
+}
+
+void Toolpath::arc(bool clockwise, double x, double y, double i, double j, double e, double f) {
+  if (centers.size() >= std::numeric_limits<std::uint32_t>::max()) {
+    spdlog::error("Toolpath: too many arcs");
+    throw std::length_error("Toolpath: too many arcs");
+  }
+
+  add(clockwise ? MoveType::arc_cw : MoveType::arc_ccw, x, y, e, f, static_cast<std::uint32_t>(centers.size()));
+  centers.push_back({i, j});
+}
+
+void Toolpath::bezier(double x, double y, const BezierControls &controls, double e, double f) {
+  if (beziers.size() >= std::numeric_limits<std::uint32_t>::max()) {
+    spdlog::error("Toolpath: too many beziers");
+    throw std::length_error("Toolpath: too many beziers");
+  }
+
+  add(MoveType::bezier, x, y, e, f, static_cast<std::uint32_t>(beziers.size()));
+  beziers.push_back(controls);
+}
+
+void Toolpath::extrude(double e, double f) {
+  add(MoveType::retract, 0, 0, e, f);
+}
+
+void Toolpath::reset_extruder() {
+  add(MoveType::reset_extruder, 0, 0, 0, no_feedrate);
+}
+
+void Toolpath::feature(Feature feature) {
+  current = feature;
+  add(MoveType::feature, 0, 0, 0, no_feedrate);
+}
+
+void Toolpath::clear() noexcept {
+  moves.clear();
+  centers.clear();
+  beziers.clear();
+  current = Feature::none;
+}
+
+std::size_t Toolpath::memory_usage() const noexcept {
+  return moves.capacity() * sizeof(ToolpathMove) + centers.capacity() * sizeof(ArcCenter) +
+         beziers.capacity() * sizeof(BezierControls);
+}
+
+ToolpathStats toolpath_stats(const Toolpath &path) {
+  ToolpathStats result;
+  std::optional<double> x, y;
+  double e = 0;
+  double f = 0;
+
+  for (const auto &move : path) {
+    if (auto feedrate = move.feedrate()) {
+      f = *feedrate;
+    }
+
+    switch (move.type) {
+    case MoveType::travel:
+      if (x && y) {
+        result.travel_distance += std::hypot(move.x - *x, move.y - *y);
+      }
+      x = move.x;
+      y = move.y;
+      break;
+    case MoveType::line:
+    case MoveType::arc_cw:
+    case MoveType::arc_ccw:
+    case MoveType::bezier: {
+      ++result.extrusions;
+      double length = 0;
+      if (move.is_arc()) {
+        ++result.arcs;
+        if (x && y) {
+          length = arc_length(*x, *y, move, path.center(move));
+        }
+      } else if (move.type == MoveType::bezier) {
+        ++result.beziers;
+        if (x && y) {
+          length = bezier_length(*x, *y, move, path.controls(move));
+        }
+      } else if (x && y) {
+        length = std::hypot(move.x - *x, move.y - *y);
+      }
+      result.print_distance += length;
+      result.filament += move.e - e;
+      if (f > 0) {
+        result.print_time += length / (f / 60);
+      }
+      x = move.x;
+      y = move.y;
+      e = move.e;
+      break;
+    }
+    case MoveType::retract:
+      if (move.e < e) {
+        ++result.retractions;
+      }
+      result.filament += move.e - e;
+      if (f > 0) {
+        result.print_time += std::abs(move.e - e) / (f / 60);
+      }
+      e = move.e;
+      break;
+    case MoveType::reset_extruder:
+      e = 0;
+      break;
+    case MoveType::travel_z:
+    case MoveType::feature:
+      break;
+    }
+  }
+
+  return result;
+}
+
+ArcFitStats fit_arcs(Toolpath &path, double tolerance) {
+  if (tolerance <= 0 || path.empty()) {
+    return {};
+  }
+
+  Toolpath result;
+  const auto stats = fit_arcs(path, tolerance, result);
+  path = std::move(result);
+  return stats;
+}
+
+ArcFitStats fit_arcs(const Toolpath &path, double tolerance, Toolpath &out) {
+  ArcFitStats stats;
+  if (tolerance <= 0 || path.empty()) {
+    out = path;
+    return stats;
+  }
+
+  out.clear();
+  auto &result = out;
+  // current run of line moves, starting with the point before the first move
+  cavc::Polyline<double> run;
+  std::vector<double> run_e;
+  double run_f = 0;
+  std::optional<double> run_rate;
+  // index in the run of each fitted vertex; points may repeat, so they can't be found by position
+  std::vector<std::size_t> sources;
+
+  auto flush = [&] {
+    if (run.size() < 2) {
+      run.vertexes().clear();
+      run_e.clear();
+      return;
+    }
+
+    auto fitted = run;
+    refit_arcs(fitted, tolerance, sources);
+
+    // the fitted vertices are a subset of the run, in order
+    for (std::size_t k = 0; k + 1 < fitted.size(); ++k) {
+      const auto &v = fitted[k];
+      const auto &next = fitted[k + 1];
+      const auto from = sources[k];
+      const auto to = sources[k + 1];
+
+      if (v.bulgeIsZero()) {
+        result.linear(next.x(), next.y(), run_e[to], run_f);
+      } else {
+        const auto arc = cavc::arcRadiusAndCenter(v, next);
+        result.arc(v.bulgeIsNeg(), next.x(), next.y(), arc.center.x() - v.x(), arc.center.y() - v.y(), run_e[to],
+                   run_f);
+        ++stats.arcs;
+        stats.replaced += to - from;
+      }
+    }
+
+    stats.lines += run.size() - 1;
+    run.vertexes().clear();
+    run_e.clear();
+  };
+
+  std::optional<double> x, y;
+  double e = 0;
+
+  for (const auto &move : path) {
+    if (move.type == MoveType::line && x && y) {
+      const auto length = std::hypot(move.x - *x, move.y - *y);
+      std::optional<double> rate;
+      if (length > 0) {
+        rate = (move.e - e) / length;
+      }
+
+      if (run.size() > 0 &&
+          (move.f != run_f || (rate && run_rate &&
+                               std::abs(*rate - *run_rate) > extrusion_rate_tolerance * std::abs(*run_rate)))) {
+        flush();
+      }
+      if (run.size() == 0) {
+        run.addVertex(*x, *y, 0);
+        run_e.push_back(e);
+        run_f = move.f;
+        run_rate.reset();
+      }
+      if (!run_rate) {
+        run_rate = rate;
+      }
+
+      run.addVertex(move.x, move.y, 0);
+      run_e.push_back(move.e);
+      x = move.x;
+      y = move.y;
+      e = move.e;
+      continue;
+    }
+
+    flush();
+    copy_move(path, move, result);
+
+    switch (move.type) {
+    case MoveType::travel:
+      x = move.x;
+      y = move.y;
+      break;
+    case MoveType::line:
+    case MoveType::arc_cw:
+    case MoveType::arc_ccw:
+    case MoveType::bezier:
+      x = move.x;
+      y = move.y;
+      e = move.e;
+      break;
+    case MoveType::retract:
+      e = move.e;
+      break;
+    case MoveType::reset_extruder:
+      e = 0;
+      break;
+    case MoveType::travel_z:
+    case MoveType::feature:
+      break;
+    }
+  }
+  flush();
+
+  return stats;
+}
+
+BezierFitStats fit_beziers(Toolpath &path, double tolerance) {
+  if (tolerance <= 0 || path.empty()) {
+    return {};
+  }
+
+  Toolpath result;
+  const auto stats = fit_beziers(path, tolerance, result);
+  path = std::move(result);
+  return stats;
+}
+
+BezierFitStats fit_beziers(const Toolpath &path, double tolerance, Toolpath &out) {
+  BezierFitStats stats;
+  if (tolerance <= 0 || path.empty()) {
+    out = path;
+    return stats;
+  }
+
+  out.clear();
+  auto &result = out;
+  // current run, and the point before its first move
+  std::vector<std::size_t> run;
+  point run_start;
+  double run_f = 0;
+  double run_rate = 0;
+  point run_tangent;
+
+  std::optional<point> position;
+  double e = 0;
+
+  for (std::size_t index = 0; index < path.size(); ++index) {
+    const auto &move = path[index];
+    if ((move.type == MoveType::line || move.is_arc()) && position) {
+      const auto end = point(move.x, move.y);
+      const auto length = move.is_arc() ? arc_length(position->x(), position->y(), move, path.center(move))
+                                         : cavc::length(end - *position);
+
+      if (length > 0) {
+        const auto rate = (move.e - e) / length;
+        const auto [start_tangent, end_tangent] = move_tangents(*position, move, path);
+        const auto joins = !run.empty() && move.f == run_f &&
+                           cavc::dot(run_tangent, start_tangent) >= std::cos(max_smooth_turn) &&
+                           std::abs(rate - run_rate) <= extrusion_rate_tolerance * std::abs(run_rate);
+        if (!joins) {
+          fit_run(path, run, run_start, tolerance, result, stats);
+          run.clear();
+          run_start = *position;
+          run_f = move.f;
+          run_rate = rate;
+        }
+
+        run.push_back(index);
+        run_tangent = end_tangent;
+        position = end;
+        e = move.e;
+        continue;
+      }
+    }
+
+    fit_run(path, run, run_start, tolerance, result, stats);
+    run.clear();
+    copy_move(path, move, result);
+
+    switch (move.type) {
+    case MoveType::travel:
+      position = point(move.x, move.y);
+      break;
+    case MoveType::line:
+    case MoveType::arc_cw:
+    case MoveType::arc_ccw:
+    case MoveType::bezier:
+      position = point(move.x, move.y);
+      e = move.e;
+      break;
+    case MoveType::retract:
+      e = move.e;
+      break;
+    case MoveType::reset_extruder:
+      e = 0;
+      break;
+    case MoveType::travel_z:
+    case MoveType::feature:
+      break;
+    }
+  }
+  fit_run(path, run, run_start, tolerance, result, stats);
+
+  return stats;
+}
+
+std::vector<std::pair<double, double>> flatten_bezier(double x0, double y0, double x, double y,
+                                                      const BezierControls &controls, double tolerance) {
+  const bezier_points b = {point(x0, y0), point(x0 + controls.i, y0 + controls.j),
+                           point(x + controls.p, y + controls.q), point(x, y)};
+
+  // n lines evenly spaced in the parameter are within |B''| / (8 n^2) of the curve,
+  // and |B''| is at most 6 times the largest second difference of the control points
+  const auto bend = std::max(cavc::length(b[0] - 2.0 * b[1] + b[2]), cavc::length(b[1] - 2.0 * b[2] + b[3]));
+  std::size_t count = 1;
+  if (tolerance > 0 && bend > 0) {
+    const auto lines = std::ceil(std::sqrt(6 * bend / (8 * tolerance)));
+    count = static_cast<std::size_t>(std::clamp(lines, 1.0, max_bezier_lines));
+  }
+
+  std::vector<std::pair<double, double>> result;
+  result.reserve(count);
+  for (std::size_t k = 1; k < count; ++k) {
+    const auto p = bezier_at(b, static_cast<double>(k) / static_cast<double>(count));
+    result.emplace_back(p.x(), p.y());
+  }
+  // n.b. the end point is exact
+  result.emplace_back(x, y);
+  return result;
+}
+
+} // namespace sse
@@ -0,0 +1,316 @@
+/**
+ * StepSlicerEngine
+ * Copyright (C) 2020 Karl Nilsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file TravelPlanner.cpp
+ * @brief Route travel moves inside a slice
+ *
+ * The shortest path between two points inside a polygon only bends at its
+ * reflex vertices, so the visibility graph is made of the innermost shell's
+ * vertices that turn away from the interior (right turns, given that outer
+ * loops are counter-clockwise and islands are clockwise), plus points along
+ * its clockwise arcs.
+ *
+ * With SSE_FIXED_POINT, the outline and every travel endpoint are on the
+ * fixed point grid, so the turn of each vertex, and crossings of the
+ * outline's line segments, are tested exactly. Arcs still use cavc.
+ *
+ * @author Karl Nilsson
+ */
+
+// std headers
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+// external headers
+#include <spdlog/spdlog.h>
+#include "cavc/mathutils.hpp"
+#include "cavc/plinesegment.hpp"
+// project headers
+#include "sse/FixedPoint.hpp"
+#include "sse/TravelPlanner.hpp"
+
+using point = cavc::Vector2<double>;
+
+//! visibility between nodes is cached for every pair, so cap the graph size
+constexpr std::size_t max_nodes = 256;
+//! arcs are split into pieces no larger than this angle, each piece adds a node
+constexpr double max_arc_step = cavc::utils::pi<double>() / 4;
+
+//! visibility cache states
+enum : std::uint8_t { unknown = 0, clear = 1, blocked = 2 };
+
+/**
+ * @brief Collect the points of a loop that a shortest path could bend around
+ * @param paths Paths of the slice
+ * @param loop Closed loop
+ * @param nodes List to append the reflex vertices to
+ * @param arc_nodes List to append the points splitting clockwise arcs to
+ */
+static void add_nodes(const sse::PathStore &paths, const sse::PathInfo &loop, std::vector<point> &nodes,
+                      std::vector<point> &arc_nodes) {
+  const auto n = loop.size();
+  if (n < 2) {
+    return;
+  }
+
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto previous = paths.vertex(loop.begin + (i + n - 1) % n);
+    const auto vertex = paths.vertex(loop.begin + i);
+    const auto next = paths.vertex(loop.begin + (i + 1) % n);
+
+#ifdef SSE_FIXED_POINT
+    const auto turn =
+        sse::orient2d(sse::to_fixed(previous.pos()), sse::to_fixed(vertex.pos()), sse::to_fixed(next.pos()));
+#else
+    const auto turn = cavc::perpDot(vertex.pos() - previous.pos(), next.pos() - vertex.pos());
+#endif
+    if (turn < 0 || previous.bulgeIsNeg() || vertex.bulgeIsNeg()) {
+      nodes.push_back(vertex.pos());
+    }
+
+    if (!vertex.bulgeIsNeg()) {
+      continue;
+    }
+
+    // split clockwise arcs, since paths wrap around them
+    const auto arc = cavc::arcRadiusAndCenter(vertex, next);
+    const auto start_angle = cavc::angle(arc.center, vertex.pos());
+    const auto sweep = 4 * std::atan(vertex.bulge());
+    const auto steps = static_cast<int>(std::ceil(std::abs(sweep) / max_arc_step));
+    for (int step = 1; step < steps; ++step) {
+      arc_nodes.push_back(cavc::pointOnCircle(arc.radius, arc.center, start_angle + sweep * step / steps));
+    }
+  }
+}
+
+/**
+ * @brief Keep an evenly spaced subset of points
+ * @param points List of points, modified in place
+ * @param count Number of points to keep, at most the number of points
+ */
+static void keep_evenly_spaced(std::vector<point> &points, std::size_t count) {
+  const auto stride = static_cast<double>(points.size()) / count;
+  for (std::size_t i = 0; i < count; ++i) {
+    points[i] = points[static_cast<std::size_t>(i * stride)];
+  }
+  points.resize(count);
+}
+
+namespace sse {
+
+TravelPlanner::TravelPlanner(const Shell &outline, const Shell &comb) {
+  shells.add(outline.outer, PathKind::outline);
+  for (const auto &island : outline.islands) {
+    shells.add(island, PathKind::outline, true);
+  }
+  shells.add(comb.outer, PathKind::wall);
+  for (const auto &island : comb.islands) {
+    shells.add(island, PathKind::wall, true);
+  }
+  reset(shells, 0);
+}
+
+void TravelPlanner::reset(const PathStore &paths, std::uint16_t comb_shell) {
+  this->paths = &paths;
+  // n.b. cavc's spatial index can't be refilled, so each slice builds its own
+  boundaries.clear();
+  nodes.clear();
+  arc_nodes.clear();
+
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    const auto &loop = paths.info(i);
+    // the spatial index can't be empty
+    if (loop.kind == PathKind::outline && loop.size() >= 2) {
+      cavc::StaticSpatialIndex<double> index(loop.size());
+      for (std::size_t k = 0; k < loop.size(); ++k) {
+        const auto next = (k + 1 == loop.size()) ? loop.begin : loop.begin + k + 1;
+        const auto box = cavc::createFastApproxBoundingBox(paths.vertex(loop.begin + k), paths.vertex(next));
+        index.add(box.xMin, box.yMin, box.xMax, box.yMax);
+      }
+      index.finish();
+      boundaries.push_back({loop, std::move(index)});
+    } else if (loop.kind == PathKind::wall && loop.shell == comb_shell) {
+      add_nodes(paths, loop, nodes, arc_nodes);
+    }
+  }
+
+  // too many nodes; the points splitting arcs only shorten routes, so they go first, then reflex vertices, which
+  // routes may need to get around a corner at all
+  if (nodes.size() > max_nodes) {
+    spdlog::debug("TravelPlanner: reducing {} reflex vertices to {}, some travels may retract", nodes.size(),
+                  max_nodes);
+    keep_evenly_spaced(nodes, max_nodes);
+    arc_nodes.clear();
+  }
+  const auto room = max_nodes - nodes.size();
+  if (arc_nodes.size() > room) {
+    spdlog::trace("TravelPlanner: reducing {} arc nodes to {}", arc_nodes.size(), room);
+    keep_evenly_spaced(arc_nodes, room);
+  }
+  nodes.insert(nodes.end(), arc_nodes.cbegin(), arc_nodes.cend());
+
+  visibility.assign(nodes.size() * nodes.size(), unknown);
+}
+
+bool TravelPlanner::crosses_outline(const point &a, const point &b) const {
+  const auto u1 = cavc::PlineVertex<double>(a, 0);
+  const auto u2 = cavc::PlineVertex<double>(b, 0);
+
+  const auto eps = cavc::utils::realThreshold<double>();
+  const auto min_x = std::min(a.x(), b.x()) - eps;
+  const auto min_y = std::min(a.y(), b.y()) - eps;
+  const auto max_x = std::max(a.x(), b.x()) + eps;
+  const auto max_y = std::max(a.y(), b.y()) + eps;
+
+#ifdef SSE_FIXED_POINT
+  const auto fixed_a = to_fixed(a);
+  const auto fixed_b = to_fixed(b);
+#endif
+
+  bool crosses = false;
+
+  for (const auto &boundary : boundaries) {
+    const auto &loop = boundary.loop;
+
+    boundary.index.visitQuery(min_x, min_y, max_x, max_y, [&](std::size_t i) {
+      const auto v1 = paths->vertex(loop.begin + i);
+      const auto v2 = paths->vertex((i + 1 == loop.size()) ? loop.begin : loop.begin + i + 1);
+#ifdef SSE_FIXED_POINT
+      if (v1.bulgeIsZero()) {
+        crosses = segments_intersect(fixed_a, fixed_b, to_fixed(v1.pos()), to_fixed(v2.pos()));
+        return !crosses;
+      }
+#endif
+      const auto intersect = cavc::intrPlineSegs(u1, u2, v1, v2);
+      crosses = intersect.intrType != cavc::PlineSegIntrType::NoIntersect;
+      // stop searching on the first intersection
+      return !crosses;
+    });
+
+    if (crosses) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool TravelPlanner::visible(std::size_t i, std::size_t j) const {
+  auto &cached = visibility[i * nodes.size() + j];
+
+  if (cached == unknown) {
+    cached = crosses_outline(nodes[i], nodes[j]) ? blocked : clear;
+    // visibility is symmetric
+    visibility[j * nodes.size() + i] = cached;
+  }
+
+  return cached == clear;
+}
+
+void TravelPlanner::plan(const point &from, const point &to, Travel &result) const {
+  result.path.clear();
+  result.retract = false;
+
+  // the common case: nothing in the way
+  if (!crosses_outline(from, to)) {
+    result.path.push_back(to);
+    return;
+  }
+
+  // A* over the nodes, with two extra nodes for the start and destination
+  const auto n = nodes.size();
+  const auto start = n;
+  const auto goal = n + 1;
+
+  distance.assign(n + 2, std::numeric_limits<double>::infinity());
+  parent.assign(n + 2, start);
+  closed.assign(n + 2, false);
+
+  auto position = [&](std::size_t i) -> const point & { return i == start ? from : (i == goal ? to : nodes[i]); };
+  auto heuristic = [&](std::size_t i) { return cavc::length(to - position(i)); };
+
+  // (estimated total length, node)
+  using entry = std::pair<double, std::size_t>;
+  std::priority_queue<entry, std::vector<entry>, std::greater<entry>> open;
+
+  distance[start] = 0;
+  open.emplace(heuristic(start), start);
+
+  while (!open.empty()) {
+    const auto current = open.top().second;
+    open.pop();
+
+    if (current == goal) {
+      break;
+    }
+
+    if (closed[current]) {
+      continue;
+    }
+    closed[current] = true;
+
+    auto relax = [&](std::size_t next) {
+      const auto d = distance[current] + cavc::length(position(next) - position(current));
+      if (d < distance[next]) {
+        distance[next] = d;
+        parent[next] = current;
+        open.emplace(d + heuristic(next), next);
+      }
+    };
+
+    // the direct line from the start to the destination is already known to be blocked
+    if (current != start && !crosses_outline(position(current), to)) {
+      relax(goal);
+    }
+
+    for (std::size_t next = 0; next < n; ++next) {
+      if (closed[next] || next == current) {
+        continue;
+      }
+
+      const auto can_see = (current == start) ? !crosses_outline(from, nodes[next]) : visible(current, next);
+      if (can_see) {
+        relax(next);
+      }
+    }
+  }
+
+  // no route, travel straight to the destination
+  if (std::isinf(distance[goal])) {
+    result.path.push_back(to);
+    result.retract = true;
+    return;
+  }
+
+  for (auto i = goal; i != start; i = parent[i]) {
+    result.path.push_back(position(i));
+  }
+  std::reverse(result.path.begin(), result.path.end());
+}
+
+Travel TravelPlanner::plan(const point &from, const point &to) const {
+  Travel result;
+  plan(from, to, result);
+  return result;
+}
+
+} // namespace sse
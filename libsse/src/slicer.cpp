@@ -18,13 +18,19 @@
 
 // std headers
 #include <math.h>
+#include <cmath>
 #include <algorithm>
 #include <iostream>
 #include <utility>
 #include <exception>
 #include <stdexcept>
+#include <atomic>
 #include <chrono>
-#include <set>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
 #include <vector>
 // OCCT headers
 #include <gp_Pln.hxx>
@@ -53,7 +59,14 @@
 #include <spdlog/cfg/env.h>
 // project headers
 #include <sse/slicer.hpp>
+#include <sse/BinaryGCode.hpp>
+#include <sse/GCodeBuffer.hpp>
+#include <sse/GCodeStream.hpp>
+#include <sse/Subroutines.hpp>
+#include <sse/TravelPlanner.hpp>
+#include <sse/GCodeWriter.hpp>
 #include <sse/Object.hpp>
+#include <sse/OffsetBackend.hpp>
 #include <sse/version.hpp>
 
 using namespace fmt::literals;
@@ -213,8 +226,17 @@ void Slicer::generate_shells(Slice& slice, const double line_width, const int co
     throw std::invalid_argument("Shell count must be > 0");
   }
 
+  SimplifySettings simplify;
+  simplify.outer_wall = settings.get_setting_fallback<double>("simplify.outer_wall", SSE_FALLBACK_SIMPLIFY_OUTER_WALL);
+  simplify.inner_wall = settings.get_setting_fallback<double>("simplify.inner_wall", SSE_FALLBACK_SIMPLIFY_INNER_WALL);
+  simplify.infill_boundary =
+      settings.get_setting_fallback<double>("simplify.infill_boundary", SSE_FALLBACK_SIMPLIFY_INFILL_BOUNDARY);
+
+  const auto backend =
+      make_offset_backend(settings.get_setting_fallback<std::string>("offset_backend", SSE_FALLBACK_OFFSET_BACKEND));
+
   spdlog::debug("generating shells");
-  slice.generate_shells(count, line_width, overlap);
+  slice.generate_shells(count, line_width, overlap, simplify, backend.get(), &edges);
 
 }
 
@@ -223,6 +245,9 @@ Slicer::slice_object(const Object * const object, double layer_height) {
   // find the z max
   double z = object->get_bound_box().CornerMax().Z();
 
+  // edges of another object are never shared with this one
+  edges.clear();
+
   TopTools_ListOfShape args;
   args.Append(object->get_shape());
 
@@ -271,24 +296,31 @@ Slicer::slice_object(const Object * const object, double layer_height) {
   return slices;
 }
 
-std::string generate_gcode_header(bool dump_settings) {
-  std::string result;
-  result.reserve(100);
-
+/**
+ * @brief sliced_by First line of every header
+ */
+static std::string sliced_by() {
   std::string short_sha = GIT_SHA1;
   short_sha = short_sha.substr(0,8);
   auto now =
       std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-  result += fmt::format(";Sliced by StepSlicerEngine v{:s} r{:s}, on {}\n", VERSION, short_sha, std::ctime(&now));
+  return fmt::format(";Sliced by StepSlicerEngine v{:s} r{:s}, on {}\n", VERSION, short_sha, std::ctime(&now));
+}
+
+std::string generate_gcode_header(bool dump_settings) {
+  std::string result;
+  result.reserve(100);
+
+  result += sliced_by();
 
-  result += ";FLAVOR:Marlin\n"
+  result += ";FLAVOR:{flavor}\n"
             ";Layer height:{layer_height}\n"
             "M104 S{hotend_temp:f}; Set hotend temp\n"
             "M190 S{bed_temp:f}; Set bed temp and wait\n"
             "M105\n"
             "M109; wait for hotend temp\n"
             "M105\n"
-            "M82; Absolute extrusion\n"
+            "{extrusion_mode}\n"
             "G92 E0; Reset extruder position\n"
             "G28; Home all axes\n"
             "M106 S{fan_speed:d}; set fan speed\n"
@@ -314,87 +346,842 @@ std::string generate_gcode_footer() {
 
 }
 
-std::string collate_gcode(std::vector<Slice> &slices) {
+/**
+ * @brief generate_cnc_header Header for dialects without printer commands, e.g. LinuxCNC
+ *
+ * Heaters and fans belong to the machine's configuration there, so the temperatures are only noted.
+ */
+static std::string generate_cnc_header() {
   std::string result;
+  result.reserve(100);
 
-  if(slices.empty()) {
-    spdlog::warn("Slicer: no slices provided");
-    return result;
-  }
+  result += sliced_by();
 
-  // reserve 10MiB
-  result.reserve((size_t)(10 << 20));
-  // kill when gcode file exceeds 1GiB
-  // TODO: consider preprocessor/env var
-  constexpr size_t max_string_size = 1 << 30;
+  result += ";FLAVOR:{flavor}\n"
+            ";Layer height:{layer_height}\n"
+            ";Hotend temp:{hotend_temp:f} bed temp:{bed_temp:f}\n"
+            "G21; Millimetres\n"
+            "G90; Absolute positioning\n"
+            "G17; XY plane\n"
+            "G92 {extruder_axis}0; Reset extruder position\n"
+            ";LAYER_COUNT:{layer_count}\n";
 
+  return result;
+}
 
+/**
+ * @brief generate_cnc_footer Footer for dialects without printer commands, e.g. LinuxCNC
+ */
+static std::string generate_cnc_footer() {
+  return "G0 X0 Y235; Present print\n"
+         "G92.1; Clear the extruder offset\n"
+         "M2; End of program\n";
+}
 
-  // TODO: implement better ordering
-  // currently, this simply sorts the slices by z-position, ascending
-  spdlog::debug("sorting slices");
-  std::sort(slices.begin(), slices.end(),
-    [](const Slice& lhs, const Slice& rhs){
-      return lhs.z_position() < rhs.z_position();
-  });
+/**
+ * @brief The slices at one z position, and where the nozzle is before printing them
+ */
+struct GCodeLayer {
+  double z;
+  //! indices of the slices, in printing order
+  std::vector<std::size_t> slices;
+  //! nozzle position at the end of the previous layer, if known
+  std::optional<cavc::Vector2<double>> from;
+};
 
-  std::set<double> layers_set;
+/**
+ * @brief travel_settings Read the retraction settings of the first extruder
+ *
+ * Speeds are given in mm/s in the profile, like the other speeds there.
+ *
+ * @throw invalid_argument if a setting is negative, or retraction is enabled with no speed
+ */
+static TravelSettings travel_settings() {
+  auto &settings = Settings::getInstance();
+  TravelSettings result;
+  result.retraction_distance = settings.get_setting_fallback<double>("printer.extruder_1.retraction_distance",
+                                                                     SSE_FALLBACK_RETRACTION_DISTANCE);
+  const auto speed =
+      settings.get_setting_fallback<double>("printer.extruder_1.retraction_speed", SSE_FALLBACK_RETRACTION_SPEED);
+  result.retraction_speed = speed * 60;
+  result.z_hop = settings.get_setting_fallback<double>("printer.extruder_1.z_hop", SSE_FALLBACK_Z_HOP);
+
+  if (result.retraction_distance < 0 || speed < 0 || result.z_hop < 0) {
+    spdlog::error("Retraction settings must not be negative");
+    throw std::invalid_argument("Retraction settings must not be negative");
+  }
+  if (result.retraction_distance > 0 && speed == 0) {
+    spdlog::error("Retraction distance is {:f}mm, but retraction speed is 0", result.retraction_distance);
+    throw std::invalid_argument("Retraction speed must be positive when retraction is enabled");
+  }
+  return result;
+}
 
-  for(const auto& slice: slices) {
-    layers_set.insert(slice.z_position());
+/**
+ * @brief extruder_axis_setting Read the extruder axis of the first extruder, for dialects without an E axis
+ * @return Axis letter, or nothing if it isn't set
+ * @throw invalid_argument if the setting isn't a single letter
+ */
+static std::optional<char> extruder_axis_setting() {
+  const auto axis = Settings::getInstance().get_setting_fallback<std::string>("printer.extruder_1.axis", "");
+  if (axis.empty()) {
+    return std::nullopt;
+  }
+  if (axis.size() != 1) {
+    spdlog::error("Extruder axis must be a single letter, got: {}", axis);
+    throw std::invalid_argument("Extruder axis must be a single letter");
   }
+  return axis.front();
+}
 
-  auto layer_count = layers_set.size();
-  double layer_height = slices.front().layer_thickness();
+/**
+ * @brief Settings used for every slice
+ */
+struct GCodeJob {
+  // TODO: pull these from settings
   double hotend_temp = 225;
   double bed_temp = 65;
   int fan_speed = 255;
   double extrusion_multiplier = 1.0;
   double filament_diameter = 1.75;
   double extrusion_width = 0.6;
+  TravelSettings travel = travel_settings();
+  //! extruder axis of dialects without an E axis, or the dialect's default; see BasicGCodeWriter::set_extruder_axis()
+  std::optional<char> extruder_axis = extruder_axis_setting();
+  //! fit arcs to runs of line moves, see fit_arcs()
+  double arc_tolerance = Settings::getInstance().get_setting_fallback<double>("arc_tolerance", SSE_FALLBACK_ARC_TOLERANCE);
+  //! fit beziers to smooth runs of lines and arcs, see fit_beziers()
+  double spline_tolerance =
+      Settings::getInstance().get_setting_fallback<double>("spline_tolerance", SSE_FALLBACK_SPLINE_TOLERANCE);
+};
 
+/**
+ * @brief gcode_layers Group slices into layers
+ *
+ * The nozzle position at the start of each layer is found up front, so
+ * layers can be written independently.
+ *
+ * @param slices List of slices
+ * @return Layers, in printing order
+ */
+static std::vector<GCodeLayer> gcode_layers(const std::vector<Slice> &slices) {
+  // sort the slices by z-position, ascending, then minimize travel within each layer
+  // n.b. only the indices are sorted, slices are never moved or copied
+  spdlog::debug("ordering slices");
+  std::vector<std::size_t> starts;
+  const auto order = slice_order(slices, starts);
+
+  std::vector<GCodeLayer> result;
+  result.reserve(starts.size());
+  std::optional<cavc::Vector2<double>> position;
+
+  // group the slices the same way slice_order() did, so nearly equal z positions share a layer
+  for (std::size_t layer = 0; layer < starts.size(); ++layer) {
+    const auto begin = starts[layer];
+    const auto end = layer + 1 < starts.size() ? starts[layer + 1] : order.size();
+    result.push_back({slices[order[begin]].z_position(), {}, position});
+    result.back().slices.assign(order.begin() + begin, order.begin() + end);
+
+    for (auto i = begin; i < end; ++i) {
+      if (auto exit = slices[order[i]].exit_point()) {
+        position = exit;
+      }
+    }
+  }
 
+  return result;
+}
+
+/**
+ * @brief job_writer Create a writer for a job, moving the extruder on the job's axis
+ */
+template <typename Dialect>
+static BasicGCodeWriter<Dialect> job_writer(GCodeBuffer &buffer, GCodePrecision precision, ModalMode mode,
+                                            const GCodeJob &job) {
+  auto result = BasicGCodeWriter<Dialect>(buffer, precision, mode);
+  if constexpr (Dialect::extruder_axis != 'E') {
+    if (job.extruder_axis) {
+      result.set_extruder_axis(*job.extruder_axis);
+    }
+  }
+  return result;
+}
+
+/**
+ * @brief gcode_header Format the header for a dialect
+ * @param layer_height Thickness of the first layer
+ * @param layer_count Number of layers
+ * @param job Settings used for every slice
+ * @param extruder_axis Letter the extruder moves on, see BasicGCodeWriter::extruder_axis()
+ */
+template <typename Dialect>
+static std::string gcode_header(double layer_height, std::size_t layer_count, const GCodeJob &job,
+                                char extruder_axis) {
   spdlog::trace("adding gcode header");
-  result += fmt::format(generate_gcode_header(true),
-                        "layer_height"_a = layer_height,
-                        "layer_count"_a = layer_count,
-                        "hotend_temp"_a = hotend_temp,
-                        "bed_temp"_a = bed_temp,
-                        "fan_speed"_a = fan_speed);
-
-  int current_layer_number = -1;
-  double current_layer = -1;
-
-
-  for(const auto& slice: slices) {
-    auto slice_gcode = slice.gcode(filament_diameter, extrusion_width, extrusion_multiplier);
-
-    if(result.size() + slice_gcode.size() > max_string_size) {
-      spdlog::error("GCode string size {:d}MiB exceeded maximum size: {:d}MiB",
-                    (result.size() + slice_gcode.size()) >> 20 ,
-                    max_string_size >> 20
-                    );
-      throw std::runtime_error("GCode getting too big, bailing");
+  if constexpr (!Dialect::printer_commands) {
+    return fmt::format(generate_cnc_header(),
+                       "flavor"_a = Dialect::name,
+                       "extruder_axis"_a = extruder_axis,
+                       "layer_height"_a = layer_height,
+                       "layer_count"_a = layer_count,
+                       "hotend_temp"_a = job.hotend_temp,
+                       "bed_temp"_a = job.bed_temp);
+  }
+  constexpr auto extrusion_mode = (Dialect::extrusion == ExtrusionMode::relative) ? "M83; Relative extrusion"
+                                                                                   : "M82; Absolute extrusion";
+  return fmt::format(generate_gcode_header(true),
+                     "flavor"_a = Dialect::name,
+                     "extrusion_mode"_a = extrusion_mode,
+                     "layer_height"_a = layer_height,
+                     "layer_count"_a = layer_count,
+                     "hotend_temp"_a = job.hotend_temp,
+                     "bed_temp"_a = job.bed_temp,
+                     "fan_speed"_a = job.fan_speed);
+}
+
+/**
+ * @brief gcode_footer Footer for a dialect
+ */
+template <typename Dialect>
+static std::string gcode_footer() {
+  if constexpr (!Dialect::printer_commands) {
+    return generate_cnc_footer();
+  }
+  return generate_gcode_footer();
+}
+
+/**
+ * @brief Storage for layer_toolpath(), kept by each worker and reused for every layer it generates
+ */
+struct LayerScratch {
+  ToolpathScratch slice;
+  //! toolpath of the layer, for callers that only write it
+  Toolpath path;
+  //! output of fit_arcs() and fit_beziers(), swapped with the layer's toolpath
+  Toolpath fitted;
+};
+
+/**
+ * @brief layer_toolpath Generate the moves of one layer, including the layer change
+ * @param slices List of slices
+ * @param layer Layer to generate
+ * @param job Settings used for every slice
+ * @param arcs Fit arcs, for dialects that write them as G2/G3; the others would only
+ * flatten them again
+ * @param splines Fit beziers, for dialects that write them as G5
+ * @param scratch Storage reused between layers
+ * @param out Toolpath to append the moves to
+ */
+static void layer_toolpath(const std::vector<Slice> &slices, const GCodeLayer &layer, const GCodeJob &job,
+                           bool arcs, bool splines, LayerScratch &scratch, Toolpath &out) {
+  // TODO: layer hop, configurable feedrate
+  out.travel_z(layer.z, 5000);
+
+  auto position = layer.from;
+  for (const auto index : layer.slices) {
+    const auto &slice = slices[index];
+    slice.toolpath(out, job.filament_diameter, job.extrusion_width, job.extrusion_multiplier, job.travel, position,
+                   scratch.slice);
+    if (auto exit = slice.exit_point()) {
+      position = exit;
+    }
+  }
+
+  if (arcs && job.arc_tolerance > 0) {
+    const auto stats = fit_arcs(out, job.arc_tolerance, scratch.fitted);
+    std::swap(out, scratch.fitted);
+    spdlog::debug("layer at z {}: replaced {} of {} lines with {} arcs", layer.z, stats.replaced, stats.lines,
+                  stats.arcs);
+  }
+  if (splines && job.spline_tolerance > 0) {
+    const auto stats = fit_beziers(out, job.spline_tolerance, scratch.fitted);
+    std::swap(out, scratch.fitted);
+    spdlog::debug("layer at z {}: replaced {} of {} moves with {} beziers", layer.z, stats.replaced, stats.moves,
+                  stats.beziers);
+  }
+}
+
+/**
+ * @brief layer_entry Index entry of one layer, with the layer's own totals; see index_layers()
+ * @param path Toolpath of the layer
+ * @param z Height of the layer
+ * @param size Length of the layer's gcode (bytes)
+ */
+static LayerIndexEntry layer_entry(const Toolpath &path, double z, std::uint64_t size) {
+  const auto stats = toolpath_stats(path);
+  return {0, size, z, stats.filament, stats.print_time};
+}
+
+/**
+ * @brief index_layers Set the offset of each layer, and turn each layer's totals into running totals
+ * @param index Entry of each layer, from layer_entry(), in order
+ * @param header_size Length of the gcode before the first layer (bytes)
+ */
+static void index_layers(std::vector<LayerIndexEntry> &index, std::uint64_t header_size) {
+  auto offset = header_size;
+  double filament = 0;
+  double time = 0;
+  for (auto &layer : index) {
+    layer.offset = offset;
+    offset += layer.size;
+    filament += layer.filament;
+    layer.filament = filament;
+    time += layer.time;
+    layer.time = time;
+  }
+}
+
+/**
+ * @brief render_layer Write one layer of a file, with its layer comment; the last layer ends with the footer
+ *
+ * The writer's modal state is reset first, so the output of a layer only
+ * depends on the layer. The footer continues the last layer, e.g. its line
+ * numbers, so it's written by the same writer.
+ *
+ * @param path Toolpath of the layer, see layer_toolpath()
+ * @param calls Subroutine calls into the toolpath, see find_subroutines(); nullptr to write every move
+ * @param number Layer number
+ * @param count Number of layers in the file; 0 to leave out the footer, e.g. when it's a block of its own
+ * @param out Writer to append the gcode to
+ * @return Length of the writer's buffer before the footer (bytes)
+ */
+template <typename Dialect>
+static std::size_t render_layer(const Toolpath &path, const std::vector<SubroutineCall> *calls, std::size_t number,
+                                std::size_t count, BasicGCodeWriter<Dialect> &out) {
+  out.layer(number);
+  if (calls) {
+    write_toolpath(path, *calls, out);
+  } else {
+    write_toolpath(path, out);
+  }
+  const auto size = out.buffer().size();
+  if (number + 1 == count) {
+    out.append(gcode_footer<Dialect>());
+  }
+  return size;
+}
+
+/**
+ * @brief render_layer Generate the toolpath of one layer, and write it
+ * @param slices List of slices
+ * @param layers Layers of the file, from gcode_layers()
+ * @param i Layer to write
+ * @param job Settings used for every slice
+ * @param scratch Storage reused between layers
+ * @param out Writer with an empty buffer, to write the layer to
+ * @param footer End the last layer with the footer
+ * @return Index entry of the layer, see layer_entry()
+ */
+template <typename Dialect>
+static LayerIndexEntry render_layer(const std::vector<Slice> &slices, const std::vector<GCodeLayer> &layers,
+                                    std::size_t i, const GCodeJob &job, LayerScratch &scratch,
+                                    BasicGCodeWriter<Dialect> &out, bool footer = true) {
+  auto &path = scratch.path;
+  path.clear();
+  layer_toolpath(slices, layers[i], job, Dialect::arcs, Dialect::splines, scratch, path);
+  const auto size = render_layer(path, nullptr, i, footer ? layers.size() : 0, out);
+  return layer_entry(path, layers[i].z, size);
+}
+
+/**
+ * @brief for_each_index Call body(i) for every i in [0, count), on worker threads
+ *
+ * Each worker takes the next index until there are none left, or a call has
+ * failed. The first exception is passed on to on_error() straight away, so
+ * e.g. waiting threads can be released, and rethrown once every worker has
+ * stopped.
+ *
+ * With a Scratch type, each worker creates one and calls body(i, scratch),
+ * so storage is reused for every index the worker takes.
+ *
+ * @param count Number of indices
+ * @param threads Number of worker threads; 0 for one per hardware thread
+ * @param body Called with each index
+ * @param on_error Called once, by the thread that failed first
+ */
+template <typename Scratch = std::nullptr_t, typename Body, typename OnError>
+static void for_each_index(std::size_t count, unsigned threads, Body &&body, OnError &&on_error) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = static_cast<unsigned>(std::min<std::size_t>(threads, count));
+
+  std::atomic<std::size_t> next{0};
+  std::atomic<bool> failed{false};
+  std::mutex error_mutex;
+  std::exception_ptr error;
+
+  auto worker = [&] {
+    try {
+      Scratch scratch{};
+      for (auto i = next++; i < count && !failed; i = next++) {
+        if constexpr (std::is_invocable_v<Body &, std::size_t, Scratch &>) {
+          body(i, scratch);
+        } else {
+          body(i);
+        }
+      }
+    } catch (...) {
+      std::lock_guard lock(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+        failed = true;
+        on_error();
+      }
     }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(threads);
+  for (unsigned i = 0; i < threads; ++i) {
+    workers.emplace_back(worker);
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
 
-    // add comment and move command on layer change
-    if(slice.z_position() > current_layer) {
-      current_layer = slice.z_position();
-      current_layer_number++;
-      result += fmt::format(";LAYER: {:d}\n", current_layer_number);
-      // TODO: layer hop, configurable feedrate
-      result += (fmt::format("G0 Z{:.6f} F5000\n", current_layer));
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+std::string collate_gcode(const std::vector<Slice> &slices, unsigned threads) {
+  // formatting dominates, so chunks from 16KiB to 4MiB took the same time for an 80MB file.
+  // the default 1MiB keeps the number of chunks small without wasting much of the last one
+  GCodeBuffer buffer;
+  GCodeWriter writer(buffer);
+  write_gcode(slices, writer, threads);
+  return buffer.str();
+}
+
+template <typename Dialect>
+void write_gcode(const std::vector<Slice> &slices, BasicGCodeWriter<Dialect> &out, unsigned threads) {
+  if(slices.empty()) {
+    spdlog::warn("Slicer: no slices provided");
+    return;
+  }
+
+  // kill when gcode file exceeds 1GiB
+  // TODO: consider preprocessor/env var
+  constexpr size_t max_string_size = 1 << 30;
+  // most layers are far smaller than a default chunk
+  constexpr std::size_t chunk_size = 1 << 16;
+
+  const auto layers = gcode_layers(slices);
+  const auto job = GCodeJob{};
+
+  out.append(gcode_header<Dialect>(slices[layers.front().slices.front()].layer_thickness(), layers.size(), job,
+                                   out.extruder_axis()));
+
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // each layer is rendered by a separate writer, into one of a window of buffers, then appended in order; a layer's
+  // output doesn't depend on earlier layers, see BasicGCodeWriter::layer(), so the output is the same for any number
+  // of threads. n.b. like GCodeStream, one set of workers renders the whole file, waiting for a free buffer
+  const std::size_t window = std::size_t{threads} * 4;
+  std::vector<GCodeBuffer> pending;
+  pending.reserve(window);
+  for (std::size_t k = 0; k < std::min(window, layers.size()); ++k) {
+    pending.emplace_back(chunk_size);
+  }
+  std::vector<bool> ready(pending.size(), false);
+  std::size_t appended = 0;
+  bool aborted = false;
+  std::mutex mutex;
+  std::condition_variable space;
+
+  for_each_index<LayerScratch>(layers.size(), threads, [&](std::size_t i, LayerScratch &scratch) {
+    auto &path = scratch.path;
+    path.clear();
+    layer_toolpath(slices, layers[i], job, Dialect::arcs, Dialect::splines, scratch, path);
+
+    {
+      std::unique_lock lock(mutex);
+      space.wait(lock, [&] { return aborted || i < appended + pending.size(); });
+      if (aborted) {
+        return;
+      }
     }
 
-    result.append(slice_gcode);
+    // the slot is only reused once its layer has been appended
+    auto &buffer = pending[i % pending.size()];
+    buffer.clear();
+    auto writer = BasicGCodeWriter<Dialect>(buffer, out.precision(), out.mode());
+    writer.set_extruder_axis(out.extruder_axis());
+    render_layer(path, nullptr, i, layers.size(), writer);
+
+    // whichever worker finishes the next layer in order appends every finished layer after it
+    std::lock_guard lock(mutex);
+    ready[i % pending.size()] = true;
+    while (appended < layers.size() && ready[appended % pending.size()]) {
+      pending[appended % pending.size()].for_each_chunk([&out](std::string_view chunk) { out.buffer().append(chunk); });
+      ready[appended % pending.size()] = false;
+      ++appended;
+
+      if(out.buffer().size() > max_string_size) {
+        spdlog::error("GCode string size {:d}MiB exceeded maximum size: {:d}MiB",
+                      out.buffer().size() >> 20,
+                      max_string_size >> 20
+                      );
+        throw std::runtime_error("GCode getting too big, bailing");
+      }
+    }
+    space.notify_all();
+  }, [&] {
+    // release the workers waiting for a buffer
+    std::lock_guard lock(mutex);
+    aborted = true;
+    space.notify_all();
+  });
+
+  // the layers were written around the writer
+  out.invalidate();
+}
+
+/**
+ * @brief stream_gcode write_gcode() to a stream, for a dialect
+ */
+template <typename Dialect>
+static std::vector<LayerIndexEntry> stream_gcode(const std::vector<Slice> &slices, GCodeStream &out,
+                                                 GCodePrecision precision, ModalMode mode, unsigned threads) {
+  const auto layers = gcode_layers(slices);
+  const auto job = GCodeJob{};
+
+  // block 0 is the header, then one block per layer; the last layer ends with the footer
+  auto header = out.acquire();
+  auto header_writer = job_writer<Dialect>(header, precision, mode, job);
+  header_writer.append(gcode_header<Dialect>(slices[layers.front().slices.front()].layer_thickness(), layers.size(),
+                                             job, header_writer.extruder_axis()));
+  const auto header_size = header.size();
+  out.submit(0, std::move(header));
+
+  std::vector<LayerIndexEntry> index(layers.size());
+  for_each_index<LayerScratch>(layers.size(), threads, [&](std::size_t i, LayerScratch &scratch) {
+    auto buffer = out.acquire();
+    auto writer = job_writer<Dialect>(buffer, precision, mode, job);
+    index[i] = render_layer(slices, layers, i, job, scratch, writer);
+    out.submit(i + 1, std::move(buffer));
+  }, [&out] {
+    // release the workers waiting on the layer that failed
+    out.abort();
+  });
+
+  index_layers(index, header_size);
+  return index;
+}
+
+std::vector<LayerIndexEntry> write_gcode(const std::vector<Slice> &slices, GCodeStream &out,
+                                         GCodePrecision precision, ModalMode mode, unsigned threads, Dialect dialect) {
+  if(slices.empty()) {
+    spdlog::warn("Slicer: no slices provided");
+    return {};
   }
 
-  result += generate_gcode_footer();
+  return with_dialect(dialect, [&](auto policy) {
+    return stream_gcode<decltype(policy)>(slices, out, precision, mode, threads);
+  });
+}
 
+/**
+ * @brief toolpath_layers generate_toolpaths(), fitting arcs and beziers or not
+ */
+static std::vector<ToolpathLayer> toolpath_layers(const std::vector<Slice> &slices, unsigned threads, bool arcs,
+                                                  bool splines) {
+  const auto layers = gcode_layers(slices);
+  const auto job = GCodeJob{};
+
+  std::vector<ToolpathLayer> result(layers.size());
+  for_each_index<LayerScratch>(layers.size(), threads, [&](std::size_t i, LayerScratch &scratch) {
+    const auto &layer = layers[i];
+    result[i].z = layer.z;
+    result[i].thickness = slices[layer.slices.front()].layer_thickness();
+    layer_toolpath(slices, layer, job, arcs, splines, scratch, result[i].path);
+  }, [] {});
 
   return result;
 }
 
+std::vector<ToolpathLayer> generate_toolpaths(const std::vector<Slice> &slices, unsigned threads, Dialect dialect) {
+  if(slices.empty()) {
+    spdlog::warn("Slicer: no slices provided");
+    return {};
+  }
+
+  return with_dialect(dialect, [&](auto policy) {
+    using Policy = decltype(policy);
+    return toolpath_layers(slices, threads, Policy::arcs, Policy::splines);
+  });
+}
+
+/**
+ * @brief stream_subroutines write_gcode_subroutines() for a dialect with subroutines
+ */
+template <typename Dialect>
+static std::vector<LayerIndexEntry> stream_subroutines(const std::vector<Slice> &slices, GCodeStream &out,
+                                                       GCodePrecision precision, ModalMode mode, unsigned threads) {
+  const auto layers = toolpath_layers(slices, threads, Dialect::arcs, Dialect::splines);
+  const auto subroutines = find_subroutines(layers, precision);
+  const auto job = GCodeJob{};
+
+  // block 0 is the header and every subroutine, then one block per layer; the last layer ends with the footer
+  auto header = out.acquire();
+  auto header_writer = job_writer<Dialect>(header, precision, mode, job);
+  header_writer.append(gcode_header<Dialect>(layers.front().thickness, layers.size(), job,
+                                             header_writer.extruder_axis()));
+  for (std::size_t i = 0; i < subroutines.bodies.size(); ++i) {
+    header_writer.subroutine(i + 1, subroutines.bodies[i]);
+  }
+  const auto header_size = header.size();
+  out.submit(0, std::move(header));
+
+  std::vector<LayerIndexEntry> index(layers.size());
+  for_each_index(layers.size(), threads, [&](std::size_t i) {
+    auto buffer = out.acquire();
+    auto writer = job_writer<Dialect>(buffer, precision, mode, job);
+    const auto size = render_layer(layers[i].path, &subroutines.calls[i], i, layers.size(), writer);
+    index[i] = layer_entry(layers[i].path, layers[i].z, size);
+    out.submit(i + 1, std::move(buffer));
+  }, [&out] {
+    // release the workers waiting on the layer that failed
+    out.abort();
+  });
+
+  index_layers(index, header_size);
+  return index;
+}
+
+std::vector<LayerIndexEntry> write_gcode_subroutines(const std::vector<Slice> &slices, GCodeStream &out,
+                                                     GCodePrecision precision, ModalMode mode, unsigned threads,
+                                                     Dialect dialect) {
+  if(slices.empty()) {
+    spdlog::warn("Slicer: no slices provided");
+    return {};
+  }
+
+  return with_dialect(dialect, [&](auto policy) {
+    using Policy = decltype(policy);
+    if constexpr (Policy::subroutines) {
+      return stream_subroutines<Policy>(slices, out, precision, mode, threads);
+    } else {
+      spdlog::warn("Slicer: {} has no subroutines, writing every move", Policy::name);
+      return stream_gcode<Policy>(slices, out, precision, mode, threads);
+    }
+  });
+}
+
+template <typename Dialect>
+void write_gcode(const std::vector<ToolpathLayer> &layers, BasicGCodeWriter<Dialect> &out) {
+  if(layers.empty()) {
+    spdlog::warn("Slicer: no layers provided");
+    return;
+  }
+
+  out.append(gcode_header<Dialect>(layers.front().thickness, layers.size(), GCodeJob{}, out.extruder_axis()));
+  for (std::size_t i = 0; i < layers.size(); ++i) {
+    render_layer(layers[i].path, nullptr, i, layers.size(), out);
+  }
+}
+
+/**
+ * @brief Storage for map_gcode(), kept by each worker
+ */
+struct MapScratch {
+  LayerScratch layer;
+  //! gcode of a layer that isn't kept, created on first use
+  std::optional<GCodeBuffer> buffer;
+};
+
+/**
+ * @brief map_gcode write_gcode_mapped() for a dialect
+ */
+template <typename Dialect>
+static std::vector<LayerIndexEntry> map_gcode(const std::vector<Slice> &slices, const fs::path &file,
+                                              GCodePrecision precision, ModalMode mode, unsigned threads) {
+  // most layers are far smaller than a default chunk
+  constexpr std::size_t chunk_size = 1 << 16;
+  // layers are kept until the file is mapped, up to this much gcode; the rest are generated again
+  constexpr std::uint64_t max_kept_size = 1 << 28;
+
+  const auto layers = gcode_layers(slices);
+  const auto job = GCodeJob{};
+
+  // block 0 is the header, then one block per layer; the last layer ends with the footer
+  std::vector<std::optional<GCodeBuffer>> blocks(layers.size() + 1);
+  auto header_writer = job_writer<Dialect>(blocks.front().emplace(chunk_size), precision, mode, job);
+  header_writer.append(gcode_header<Dialect>(slices[layers.front().slices.front()].layer_thickness(), layers.size(),
+                                             job, header_writer.extruder_axis()));
+
+  // write a layer to the worker's buffer, creating it if the last one was kept
+  auto render = [&](std::size_t i, MapScratch &scratch) {
+    auto &buffer = scratch.buffer ? *scratch.buffer : scratch.buffer.emplace(chunk_size);
+    buffer.clear();
+    auto writer = job_writer<Dialect>(buffer, precision, mode, job);
+    return render_layer(slices, layers, i, job, scratch.layer, writer);
+  };
+
+  // first pass: the size of every block, keeping the first ones
+  std::vector<LayerIndexEntry> index(layers.size());
+  std::vector<std::uint64_t> sizes(blocks.size(), blocks.front()->size());
+  std::atomic<std::uint64_t> kept{0};
+  for_each_index<MapScratch>(layers.size(), threads, [&](std::size_t i, MapScratch &scratch) {
+    index[i] = render(i, scratch);
+    auto &buffer = *scratch.buffer;
+    sizes[i + 1] = buffer.size();
+    if (const auto total = kept += buffer.size(); total <= max_kept_size) {
+      blocks[i + 1] = std::move(buffer);
+      scratch.buffer.reset();
+    } else {
+      kept -= buffer.size();
+    }
+  }, [] {});
+
+  // every block's size is known, so every block's offset is too
+  std::vector<std::uint64_t> offsets(blocks.size() + 1, 0);
+  for (std::size_t i = 0; i < blocks.size(); ++i) {
+    offsets[i + 1] = offsets[i] + sizes[i];
+  }
+
+  spdlog::debug("writing {:d}MiB of gcode, {:d}MiB of it kept in memory", offsets.back() >> 20, kept >> 20);
+  GCodeMappedFile out(file, offsets.back());
+  // second pass: write the kept blocks, and generate the others again
+  for_each_index<MapScratch>(blocks.size(), threads, [&](std::size_t i, MapScratch &scratch) {
+    if (blocks[i]) {
+      out.write(offsets[i], *blocks[i]);
+      blocks[i].reset();
+      return;
+    }
+    render(i - 1, scratch);
+    const auto &buffer = *scratch.buffer;
+    // n.b. a layer's gcode only depends on the layer, so this can only fail on a bug
+    if (buffer.size() != sizes[i]) {
+      spdlog::error("write_gcode_mapped: layer {} changed size from {} to {} bytes", i - 1, sizes[i], buffer.size());
+      throw std::runtime_error("write_gcode_mapped: layer changed size");
+    }
+    out.write(offsets[i], buffer);
+  }, [] {});
+  out.finish();
+
+  index_layers(index, offsets[1]);
+  return index;
+}
+
+std::vector<LayerIndexEntry> write_gcode_mapped(const std::vector<Slice> &slices, const fs::path &file,
+                                                GCodePrecision precision, ModalMode mode, unsigned threads,
+                                                Dialect dialect) {
+  if(slices.empty()) {
+    spdlog::warn("Slicer: no slices provided");
+    return {};
+  }
+
+  return with_dialect(dialect, [&](auto policy) {
+    return map_gcode<decltype(policy)>(slices, file, precision, mode, threads);
+  });
+}
+
+void write_bgcode(const std::vector<Slice> &slices, std::ostream &out, const BinaryGCodeSettings &settings,
+                  GCodePrecision precision, ModalMode mode, unsigned threads) {
+  if(slices.empty()) {
+    spdlog::warn("Slicer: no slices provided");
+    return;
+  }
+
+  constexpr std::size_t chunk_size = 1 << 16;
+
+  const auto layers = gcode_layers(slices);
+  const auto job = GCodeJob{};
+  const auto layer_height = slices[layers.front().slices.front()].layer_thickness();
+
+  // section 0 is the header, then one per layer, then the footer; each is one or more blocks
+  std::vector<std::string> sections(layers.size() + 2);
+  std::vector<std::size_t> block_counts(sections.size());
+  auto encode = [&](std::size_t i, const GCodeBuffer &buffer) {
+    block_counts[i] = write_bgcode_gcode(sections[i], buffer.str(), settings);
+  };
+
+  {
+    GCodeBuffer buffer(chunk_size);
+    GCodeWriter(buffer, precision, mode).append(gcode_header<Marlin>(layer_height, layers.size(), job, Marlin::extruder_axis));
+    encode(0, buffer);
+  }
+
+  // the footer is a section of its own, for the layer index
+  std::vector<LayerIndexEntry> stats(layers.size());
+  for_each_index<LayerScratch>(layers.size(), threads, [&](std::size_t i, LayerScratch &scratch) {
+    GCodeBuffer buffer(chunk_size);
+    auto writer = GCodeWriter(buffer, precision, mode);
+    stats[i] = render_layer(slices, layers, i, job, scratch, writer, false);
+    encode(i + 1, buffer);
+  }, [] {});
+
+  {
+    GCodeBuffer buffer(chunk_size);
+    GCodeWriter(buffer, precision, mode).append(generate_gcode_footer());
+    encode(sections.size() - 1, buffer);
+  }
+
+  // first block of each layer, then of the footer
+  std::string index;
+  auto block = block_counts.front();
+  for (std::size_t i = 1; i < sections.size(); ++i) {
+    index += fmt::format(i == 1 ? "{:d}" : ",{:d}", block);
+    block += block_counts[i];
+  }
+
+  double filament = 0;
+  double print_time = 0;
+  for (const auto &layer : stats) {
+    filament += layer.filament;
+    print_time += layer.time;
+  }
+  const auto seconds = static_cast<long>(std::lround(print_time));
+  const auto estimate = fmt::format("{:d}h {:d}m {:d}s", seconds / 3600, seconds / 60 % 60, seconds % 60);
+  const auto used = fmt::format("{:.2f}", filament);
+
+  std::string file;
+  write_bgcode_header(file, settings);
+  write_bgcode_metadata(file, BlockType::printer_metadata,
+                        {{"temperature", fmt::format("{}", job.hotend_temp)},
+                         {"bed_temperature", fmt::format("{}", job.bed_temp)},
+                         {"layer_height", fmt::format("{}", layer_height)},
+                         {"max_layer_z", fmt::format("{}", layers.back().z)},
+                         {"filament used [mm]", used},
+                         {"estimated printing time (normal mode)", estimate}},
+                        settings);
+  write_bgcode_metadata(file, BlockType::print_metadata,
+                        {{"filament used [mm]", used}, {"estimated printing time (normal mode)", estimate}}, settings);
+  write_bgcode_metadata(file, BlockType::slicer_metadata,
+                        {{"producer", fmt::format("StepSlicerEngine {:s}", VERSION)},
+                         {std::string(bgcode_layer_key), index}},
+                        settings);
+
+  out.write(file.data(), static_cast<std::streamsize>(file.size()));
+  for (auto &section : sections) {
+    out.write(section.data(), static_cast<std::streamsize>(section.size()));
+    section = {};
+  }
+  out.flush();
+  if (!out) {
+    spdlog::error("write_bgcode: failed to write the file");
+    throw std::runtime_error("write_bgcode: failed to write the file");
+  }
+}
+
+template void write_gcode(const std::vector<Slice> &, BasicGCodeWriter<Marlin> &, unsigned);
+template void write_gcode(const std::vector<Slice> &, BasicGCodeWriter<MarlinNumbered> &, unsigned);
+template void write_gcode(const std::vector<Slice> &, BasicGCodeWriter<Klipper> &, unsigned);
+template void write_gcode(const std::vector<Slice> &, BasicGCodeWriter<LinuxCNC> &, unsigned);
+template void write_gcode(const std::vector<Slice> &, BasicGCodeWriter<Machinekit> &, unsigned);
+template void write_gcode(const std::vector<Slice> &, BasicGCodeWriter<Redeem> &, unsigned);
+
+template void write_gcode(const std::vector<ToolpathLayer> &, BasicGCodeWriter<Marlin> &);
+template void write_gcode(const std::vector<ToolpathLayer> &, BasicGCodeWriter<MarlinNumbered> &);
+template void write_gcode(const std::vector<ToolpathLayer> &, BasicGCodeWriter<Klipper> &);
+template void write_gcode(const std::vector<ToolpathLayer> &, BasicGCodeWriter<LinuxCNC> &);
+template void write_gcode(const std::vector<ToolpathLayer> &, BasicGCodeWriter<Machinekit> &);
+template void write_gcode(const std::vector<ToolpathLayer> &, BasicGCodeWriter<Redeem> &);
+
 void Slicer::dump_shapes(const std::vector<TopoDS_Shape> &shapes) {
   spdlog::debug("--------Shape Dump-------");
   for (const auto &s : shapes) {
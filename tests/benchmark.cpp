@@ -2,6 +2,12 @@
 #include <nanobench.h>
 
 #include "sse/slicer.hpp"
+#include "sse/OffsetBackend.hpp"
+#include "sse/Segments.hpp"
+#include "sse/GCodeBuffer.hpp"
+#include "sse/GCodeNumber.hpp"
+#include "sse/GCodeParser.hpp"
+#include "sse/GCodeWriter.hpp"
 
 #include <BRepPrimAPI_MakeBox.hxx>
 #include <gp.hxx>
@@ -13,9 +19,13 @@
 #include <cmath>
 #include <iostream>
 #include <memory>
+#include <random>
+#include <string>
 
 using Objects = std::vector<std::unique_ptr<sse::Object>>;
 
+using namespace std::string_literals;
+
 namespace bench = ankerl::nanobench;
 
 // make a bed large enough for any test object
@@ -78,6 +88,179 @@ TEST_SUITE("Benchmarks") {
 
   }
 
+  TEST_CASE("Shell offset backends") {
+    sse::setup_logger(spdlog::level::off);
+    Message::DefaultMessenger()->RemovePrinters(STANDARD_TYPE(Message_PrinterOStream));
+
+    std::filesystem::path p;
+    auto slicer = sse::Slicer{p};
+    const auto layer_height = 0.4;
+    const auto line_width = 0.4;
+    const auto num_shells = 3;
+
+    const auto cavc = sse::CavcOffsetBackend();
+    const auto occt = sse::OcctOffsetBackend();
+
+    for (const auto *model : {"box.step", "cylinder.step", "arc_test.step", "curve_test.step", "bullseye.step",
+                              "sphere.step", "text_test.step", "box.stl"}) {
+      auto shape = sse::import("resources/"s + model);
+      const auto object = sse::Object{shape, model};
+
+      // slices release their face after offsetting, so each backend gets fresh slices and a single run
+      auto bench = bench::Bench().title("Shell offset: "s + model).relative(true).epochs(1).epochIterations(1);
+
+      for (const sse::OffsetBackend *backend : {static_cast<const sse::OffsetBackend *>(&cavc),
+                                                static_cast<const sse::OffsetBackend *>(&occt)}) {
+        auto slices = slicer.slice_object(&object, layer_height);
+        std::size_t failures = 0;
+
+        bench.run(backend->name(), [&] {
+          failures = 0;
+          for (auto &slice : slices) {
+            try {
+              slice.generate_shells(num_shells, line_width, 0.0, {}, backend);
+            } catch (const std::exception &) {
+              ++failures;
+            }
+          }
+        });
+
+        std::size_t vertices = 0;
+        for (const auto &slice : slices) {
+          for (const auto &shell : slice.get_shells()) {
+            vertices += shell.outer.size();
+            for (const auto &island : shell.islands) {
+              vertices += island.size();
+            }
+          }
+        }
+        std::cout << model << " (" << backend->name() << "): " << slices.size() << " slices, " << vertices
+                  << " shell vertices, " << failures << " failures\n";
+      }
+    }
+  }
+
+  TEST_CASE("Segment kernel") {
+    // tessellated circle, as found in STL files, and the same circle as arcs
+    const auto radius = 100.0;
+    const auto line_segments = 100000;
+    const auto arc_segments = 1000;
+
+    cavc::Polyline<double> lines;
+    lines.isClosed() = true;
+    for (int i = 0; i < line_segments; ++i) {
+      const auto angle = 2 * M_PI * i / line_segments;
+      lines.addVertex(radius * std::cos(angle), radius * std::sin(angle), 0);
+    }
+
+    cavc::Polyline<double> arcs;
+    arcs.isClosed() = true;
+    const auto bulge = std::tan(2 * M_PI / arc_segments / 4);
+    for (int i = 0; i < arc_segments; ++i) {
+      const auto angle = 2 * M_PI * i / arc_segments;
+      arcs.addVertex(radius * std::cos(angle), radius * std::sin(angle), bulge);
+    }
+
+    sse::PathStore paths;
+    paths.add(lines, sse::PathKind::wall);
+    paths.add(arcs, sse::PathKind::wall);
+    sse::SegmentBatch batch;
+
+    auto bench = bench::Bench().title("Segment kernel").unit("segment").relative(false);
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+      const auto &path = paths.info(i);
+      bench.batch(path.size()).run(i == 0 ? "lines" : "arcs", [&] {
+        sse::compute_segments(paths, path, 0.033, batch);
+        bench::doNotOptimizeAway(batch.extrusion.back());
+      });
+    }
+  }
+
+  TEST_CASE("Gcode number formatting") {
+    // random moves on a 300mm bed
+    const std::size_t moves = 1 << 20;
+    auto generator = std::mt19937(42);
+    auto position = std::uniform_real_distribution<double>(0, 300);
+    auto extrusion = std::uniform_real_distribution<double>(0, 10);
+
+    std::vector<double> xs(moves), ys(moves), es(moves);
+    for (std::size_t i = 0; i < moves; ++i) {
+      xs[i] = position(generator);
+      ys[i] = position(generator);
+      es[i] = extrusion(generator);
+    }
+
+    auto buffer = sse::GCodeBuffer();
+    const auto precision = sse::GCodePrecision{};
+
+    auto bench = bench::Bench().title("Gcode number formatting").unit("move").batch(moves).relative(true);
+
+    bench.run("fmt::format", [&] {
+      std::string result;
+      for (std::size_t i = 0; i < moves; ++i) {
+        result += fmt::format("G1 X{:.6f} Y{:.6f} E{:.6f} F1000\n", xs[i], ys[i], es[i]);
+      }
+      bench::doNotOptimizeAway(result.size());
+    });
+
+    bench.run("GCodeBuffer::format", [&] {
+      buffer.clear();
+      for (std::size_t i = 0; i < moves; ++i) {
+        buffer.format("G1 X{:.6f} Y{:.6f} E{:.6f} F1000\n", xs[i], ys[i], es[i]);
+      }
+      bench::doNotOptimizeAway(buffer.size());
+    });
+
+    bench.run("FMT_COMPILE", [&] {
+      buffer.clear();
+      for (std::size_t i = 0; i < moves; ++i) {
+        buffer.format_compiled(FMT_COMPILE("G1 X{:.6f} Y{:.6f} E{:.6f} F1000\n"), xs[i], ys[i], es[i]);
+      }
+      bench::doNotOptimizeAway(buffer.size());
+    });
+
+    bench.run("GCodeLine", [&] {
+      buffer.clear();
+      for (std::size_t i = 0; i < moves; ++i) {
+        buffer.append(sse::GCodeLine("G1")
+                          .word('X', xs[i], precision.xy)
+                          .word('Y', ys[i], precision.xy)
+                          .word('E', es[i], precision.e)
+                          .word('F', 1000, precision.f));
+      }
+      bench::doNotOptimizeAway(buffer.size());
+    });
+
+    bench.run("GCodeWriter (modal, compact)", [&] {
+      buffer.clear();
+      auto writer = sse::GCodeWriter(buffer, sse::GCodePrecision::compact(), sse::ModalMode::words);
+      for (std::size_t i = 0; i < moves; ++i) {
+        writer.linear(xs[i], ys[i], es[i], 1000);
+      }
+      bench::doNotOptimizeAway(buffer.size());
+    });
+  }
+
+  TEST_CASE("Gcode analysis") {
+    // random moves on a 300mm bed
+    const std::size_t moves = 1 << 20;
+    auto generator = std::mt19937(42);
+    auto position = std::uniform_real_distribution<double>(0, 300);
+
+    auto buffer = sse::GCodeBuffer();
+    auto writer = sse::GCodeWriter(buffer);
+    double e = 0;
+    for (std::size_t i = 0; i < moves; ++i) {
+      e += 0.1;
+      writer.linear(position(generator), position(generator), e, 1800);
+    }
+    const auto gcode = buffer.str();
+
+    bench::Bench().title("Gcode analysis").unit("byte").batch(gcode.size()).run("analyze_gcode", [&] {
+      bench::doNotOptimizeAway(sse::analyze_gcode(gcode).print_distance);
+    });
+  }
+
   TEST_CASE("Import objects") {
     sse::setup_logger(spdlog::level::off);
     // suppress output of STEPControl_Reader
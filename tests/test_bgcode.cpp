@@ -0,0 +1,168 @@
+#include <doctest/doctest.h>
+
+#include <sse/BinaryGCode.hpp>
+#include <sse/GCodeCompression.hpp>
+#include <sse/slicer.hpp>
+
+#include "test_helpers.hpp"
+
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @brief What MeatPack keeps of gcode: commands without spaces, and no comments or empty lines
+ */
+static std::string without_spaces(const std::string &gcode) {
+  std::istringstream lines(gcode);
+  std::string line;
+  std::string result;
+  while (std::getline(lines, line)) {
+    std::string command;
+    for (const auto c : line.substr(0, line.find(';'))) {
+      if (c != ' ') {
+        command.push_back(c);
+      }
+    }
+    if (!command.empty()) {
+      result += command + "\n";
+    }
+  }
+  return result;
+}
+
+TEST_SUITE("BinaryGCode") {
+
+  const std::string gcode = ";LAYER: 0\nG0 Z0.2 F5000\nG1 X10.5 Y-2 E0.12346 F1000 ; move\n\nM104 S200\nG2 X1 Y2 I-1 J0 E1.5\n";
+
+  TEST_CASE("MeatPack round trip") {
+    const auto packed = sse::meatpack_encode(gcode);
+    CHECK(packed.size() < without_spaces(gcode).size());
+    // an odd number of characters is padded with an empty line
+    CHECK(without_spaces(sse::meatpack_decode(packed)) == without_spaces(gcode));
+
+    SUBCASE("Comments") {
+      const auto decoded = sse::meatpack_decode(sse::meatpack_encode(gcode, true));
+      CHECK(decoded.find(";LAYER: 0\n") == 0);
+      CHECK(decoded.find("G1X10.5Y-2E0.12346F1000; move\n") != std::string::npos);
+    }
+
+    SUBCASE("Truncated") {
+      // 'M' is a whole byte after the nibbles
+      const auto truncated = packed.substr(0, packed.find('M'));
+      CHECK_THROWS_AS((void)sse::meatpack_decode(truncated), std::runtime_error);
+    }
+  }
+
+  TEST_CASE("Heatshrink round trip") {
+    auto generator = std::mt19937(42);
+    std::string random(5000, '\0');
+    for (auto &c : random) {
+      c = static_cast<char>(std::uniform_int_distribution<int>(0, 255)(generator));
+    }
+    std::string repeated;
+    for (int i = 0; i < 500; ++i) {
+      repeated += gcode;
+    }
+
+    for (const auto window : {8, 11, 12}) {
+      for (const auto &data : {random, repeated, std::string(), std::string(1, 'x')}) {
+        const auto compressed = sse::heatshrink_compress(data, window, 4);
+        CHECK(sse::heatshrink_decompress(compressed, window, 4, data.size()) == data);
+      }
+      CHECK(sse::heatshrink_compress(repeated, window, 4).size() < repeated.size() / 4);
+    }
+
+    CHECK_THROWS_AS((void)sse::heatshrink_compress(repeated, 16, 4), std::invalid_argument);
+    CHECK_THROWS_AS((void)sse::heatshrink_compress(repeated, 11, 11), std::invalid_argument);
+    const auto compressed = sse::heatshrink_compress(repeated, 11, 4);
+    CHECK_THROWS_AS((void)sse::heatshrink_decompress(compressed, 11, 4, repeated.size() + 1), std::runtime_error);
+  }
+
+  TEST_CASE("Blocks") {
+    sse::BinaryGCodeSettings settings;
+    settings.block_size = 32;
+
+    std::string file;
+    sse::write_bgcode_header(file, settings);
+    sse::write_bgcode_metadata(file, sse::BlockType::slicer_metadata, {{"producer", "test"}, {"layer_blocks", "0,2"}},
+                               settings);
+    const auto blocks = sse::write_bgcode_gcode(file, gcode, settings);
+    CHECK(blocks == 3);
+    CHECK(file.compare(0, 4, "GCDE") == 0);
+
+    const auto reader = sse::BinaryGCodeReader(file);
+    CHECK(reader.block_count() == blocks);
+    CHECK(without_spaces(reader.gcode()) == without_spaces(gcode));
+    CHECK(reader.metadata(sse::BlockType::slicer_metadata).front().second == "test");
+    CHECK(reader.metadata(sse::BlockType::printer_metadata).empty());
+    REQUIRE(reader.layer_count() == 1);
+    CHECK(without_spaces(reader.layer(0)) == without_spaces(gcode.substr(0, gcode.find("M104"))));
+    CHECK_THROWS_AS((void)reader.layer(1), std::out_of_range);
+
+    SUBCASE("Plain text") {
+      for (const auto compression : {sse::BlockCompression::none, sse::BlockCompression::heatshrink_11_4}) {
+        settings.compression = compression;
+        settings.encoding = sse::GCodeEncoding::none;
+        settings.checksum = false;
+        std::string plain;
+        sse::write_bgcode_header(plain, settings);
+        sse::write_bgcode_gcode(plain, gcode, settings);
+        CHECK(sse::BinaryGCodeReader(plain).gcode() == gcode);
+      }
+    }
+
+    SUBCASE("Corrupt") {
+      auto corrupt = file;
+      corrupt[corrupt.size() - 10] ^= 1;
+      CHECK_THROWS_AS((void)sse::BinaryGCodeReader(corrupt), std::runtime_error);
+      CHECK_THROWS_AS((void)sse::BinaryGCodeReader(file.substr(0, file.size() - 1)), std::runtime_error);
+      CHECK_THROWS_AS((void)sse::BinaryGCodeReader("G28\n"), std::runtime_error);
+    }
+
+    SUBCASE("Deflate") {
+      settings.compression = sse::BlockCompression::deflate;
+      if (sse::stream_compression_supported(sse::StreamCompression::zlib)) {
+        std::string deflated;
+        sse::write_bgcode_header(deflated, settings);
+        sse::write_bgcode_gcode(deflated, gcode, settings);
+        CHECK(without_spaces(sse::BinaryGCodeReader(deflated).gcode()) == without_spaces(gcode));
+      } else {
+        CHECK_THROWS_AS(sse::write_bgcode_gcode(file, gcode, settings), std::invalid_argument);
+      }
+    }
+  }
+
+  TEST_CASE("Slices round trip") {
+    std::vector<sse::Slice> slices;
+    for (int layer = 0; layer < 10; ++layer) {
+      slices.push_back(make_slice(0, 0, layer * 0.2));
+      slices.push_back(make_slice(20, 0, layer * 0.2));
+    }
+    const auto expected = without_timestamp(sse::collate_gcode(slices));
+
+    sse::BinaryGCodeSettings settings;
+    settings.encoding = sse::GCodeEncoding::none;
+    for (const auto threads : {1u, 4u}) {
+      std::ostringstream out;
+      sse::write_bgcode(slices, out, settings, {}, sse::ModalMode::off, threads);
+      const auto reader = sse::BinaryGCodeReader(out.str());
+      CHECK(without_timestamp(reader.gcode()) == expected);
+
+      REQUIRE(reader.layer_count() == 10);
+      for (std::size_t i = 0; i < reader.layer_count(); ++i) {
+        CHECK(reader.layer(i).find(fmt::format(";LAYER: {:d}\n", i)) == 0);
+      }
+      CHECK(!reader.metadata(sse::BlockType::printer_metadata).empty());
+    }
+
+    SUBCASE("MeatPack") {
+      std::ostringstream out;
+      sse::write_bgcode(slices, out);
+      CHECK(out.str().size() < expected.size() / 2);
+      CHECK(without_spaces(sse::BinaryGCodeReader(out.str()).gcode()) == without_spaces(expected));
+    }
+  }
+}
@@ -0,0 +1,77 @@
+#include <doctest/doctest.h>
+
+#include <sse/FixedPoint.hpp>
+
+#include <stdexcept>
+
+TEST_SUITE("FixedPoint") {
+
+  TEST_CASE("Conversion") {
+    CHECK(sse::to_fixed(1.0) == 1000000);
+    CHECK(sse::to_fixed(-0.0000004) == 0);
+    CHECK(sse::to_fixed(0.0000006) == 1);
+    CHECK(sse::from_fixed(sse::to_fixed(123.456789)) == doctest::Approx(123.456789));
+
+    CHECK_THROWS_AS(static_cast<void>(sse::to_fixed(2000.0)), std::out_of_range);
+    CHECK_THROWS_AS(static_cast<void>(sse::to_fixed(std::nan(""))), std::out_of_range);
+  }
+
+  TEST_CASE("Orientation is exact") {
+    // the products differ by 1, which double precision rounds away
+    const auto a = sse::FixedPoint{0, 0};
+    const auto b = sse::FixedPoint{1000000001, 1000000000};
+    const auto c = sse::FixedPoint{1000000000, 999999999};
+
+    CHECK(sse::orient2d(a, b, c) == -1);
+    CHECK(sse::orient2d(a, c, b) == 1);
+    CHECK(sse::orient2d(a, b, sse::FixedPoint{2000000002, 2000000000}) == 0);
+
+    // largest possible coordinates don't overflow
+    const auto max = sse::fixed_point_max;
+    CHECK(sse::orient2d({-max, -max}, {max, -max}, {max, max}) > 0);
+    CHECK(sse::orient2d({-max, max}, {max, -max}, {-max, -max}) < 0);
+  }
+
+  TEST_CASE("Segment intersection") {
+    const auto a = sse::FixedPoint{0, 0};
+    const auto b = sse::FixedPoint{10, 10};
+
+    CHECK(sse::segments_intersect(a, b, {0, 10}, {10, 0}));
+    // touching
+    CHECK(sse::segments_intersect(a, b, {5, 5}, {10, 0}));
+    CHECK_FALSE(sse::segments_intersect(a, b, {0, 1}, {9, 10}));
+    // collinear
+    CHECK(sse::segments_intersect(a, b, {5, 5}, {20, 20}));
+    CHECK_FALSE(sse::segments_intersect(a, b, {11, 11}, {20, 20}));
+    // degenerate
+    CHECK(sse::segments_intersect(a, b, {3, 3}, {3, 3}));
+    CHECK_FALSE(sse::segments_intersect(a, b, {3, 4}, {3, 4}));
+  }
+
+  TEST_CASE("Snapping") {
+    cavc::Polyline<double> pline;
+    pline.isClosed() = true;
+    pline.addVertex(0, 0, 0);
+    pline.addVertex(10, 0, 0);
+    // within 1nm of the previous vertex
+    pline.addVertex(10.0000000001, 0, 0.5);
+    pline.addVertex(10, 10, 0);
+    pline.addVertex(0, 10, 0);
+    // duplicate of the first vertex
+    pline.addVertex(0, 0.0000000001, 0);
+
+    const auto fixed = sse::to_fixed(pline);
+
+    REQUIRE(fixed.size() == 4);
+    CHECK(fixed.closed);
+    CHECK(fixed.xs[1] == 10000000);
+    CHECK(fixed.ys[1] == 0);
+    // the arc starts at the merged vertex
+    CHECK(fixed.bulges[1] == doctest::Approx(0.5));
+
+    const auto square = sse::from_fixed(fixed);
+    REQUIRE(square.size() == 4);
+    CHECK(square[2].x() == doctest::Approx(10));
+    CHECK(square[2].y() == doctest::Approx(10));
+  }
+}
@@ -0,0 +1,132 @@
+#include <doctest/doctest.h>
+
+#include <sse/Flatten.hpp>
+#include <sse/Slice.hpp>
+
+#include "cavc/plinesegment.hpp"
+
+#include <BRepBuilderAPI_MakeEdge.hxx>
+#include <BRepBuilderAPI_MakeFace.hxx>
+#include <BRepBuilderAPI_MakeWire.hxx>
+#include <Geom_BezierCurve.hxx>
+#include <TColgp_Array1OfPnt.hxx>
+
+#include <gp.hxx>
+#include <gp_Elips.hxx>
+#include <gp_Pnt.hxx>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+constexpr double tolerance = 0.01;
+
+/**
+ * @brief Distance from a point to the closest segment of a polyline
+ */
+static double distance(const cavc::Polyline<double> &pline, const gp_Pnt &p) {
+  const auto point = cavc::Vector2<double>(p.X(), p.Y());
+  auto result = std::numeric_limits<double>::infinity();
+  pline.visitSegIndices([&](std::size_t i, std::size_t j) {
+    const auto closest = cavc::closestPointOnSeg(pline[i], pline[j], point);
+    result = std::min(result, cavc::length(closest - point));
+    return true;
+  });
+  return result;
+}
+
+/**
+ * @brief S-shaped cubic bezier, from (0, 0) to (30, 0)
+ */
+static Handle(Geom_BezierCurve) make_bezier() {
+  TColgp_Array1OfPnt poles(1, 4);
+  poles(1) = gp_Pnt(0, 0, 0);
+  poles(2) = gp_Pnt(10, 20, 0);
+  poles(3) = gp_Pnt(20, -20, 0);
+  poles(4) = gp_Pnt(30, 0, 0);
+  return new Geom_BezierCurve(poles);
+}
+
+TEST_SUITE("Flatten") {
+
+  TEST_CASE("Ellipse") {
+    const auto ellipse = gp_Elips(gp_Ax2(gp::Origin(), gp::DZ()), 20, 10);
+    const auto wire = BRepBuilderAPI_MakeWire(BRepBuilderAPI_MakeEdge(ellipse)).Wire();
+
+    const auto pline = sse::flatten_wire(wire, tolerance);
+
+    CHECK(pline.isClosed());
+    // a handful of arcs, rather than a tessellation
+    CHECK(pline.size() > 4);
+    CHECK(pline.size() < 100);
+    CHECK(cavc::getArea(pline) == doctest::Approx(M_PI * 20 * 10).epsilon(0.001));
+
+    for (int i = 0; i < 360; ++i) {
+      const auto u = 2 * M_PI * i / 360;
+      CHECK(distance(pline, gp_Pnt(20 * std::cos(u), 10 * std::sin(u), 0)) <= tolerance);
+    }
+  }
+
+  TEST_CASE("Bezier") {
+    const auto bezier = make_bezier();
+    const auto wire = BRepBuilderAPI_MakeWire(BRepBuilderAPI_MakeEdge(bezier),
+                                              BRepBuilderAPI_MakeEdge(gp_Pnt(30, 0, 0), gp_Pnt(0, 0, 0)))
+                          .Wire();
+
+    const auto pline = sse::flatten_wire(wire, tolerance);
+
+    CHECK(pline.size() > 2);
+    for (int i = 0; i <= 100; ++i) {
+      CHECK(distance(pline, bezier->Value(i / 100.0)) <= tolerance);
+    }
+  }
+
+  TEST_CASE("Edges are only fitted once") {
+    const auto ellipse = gp_Elips(gp_Ax2(gp::Origin(), gp::DZ()), 20, 10);
+    const auto wire = BRepBuilderAPI_MakeWire(BRepBuilderAPI_MakeEdge(ellipse)).Wire();
+
+    sse::EdgeCache cache;
+    const auto first = sse::flatten_wire(wire, tolerance, &cache);
+    const auto second = sse::flatten_wire(wire, tolerance, &cache);
+
+    CHECK(cache.size() == 1);
+    REQUIRE(first.size() == second.size());
+    for (std::size_t i = 0; i < first.size(); ++i) {
+      CHECK(first[i].x() == second[i].x());
+      CHECK(first[i].y() == second[i].y());
+      CHECK(first[i].bulge() == second[i].bulge());
+    }
+  }
+
+  TEST_CASE("Edges are shared between slices") {
+    const auto ellipse = gp_Elips(gp_Ax2(gp::Origin(), gp::DZ()), 20, 10);
+    const auto wire = BRepBuilderAPI_MakeWire(BRepBuilderAPI_MakeEdge(ellipse)).Wire();
+
+    // both faces are bounded by the same edge
+    auto first = sse::Slice(nullptr, BRepBuilderAPI_MakeFace(wire, true).Face(), 0.2);
+    auto second = sse::Slice(nullptr, BRepBuilderAPI_MakeFace(wire, true).Face(), 0.2);
+
+    sse::EdgeCache cache;
+    first.generate_shells(2, 0.5, 0.0, {}, nullptr, &cache);
+    CHECK(cache.size() == 1);
+    second.generate_shells(2, 0.5, 0.0, {}, nullptr, &cache);
+    CHECK(cache.size() == 1);
+    CHECK(first.gcode(1.75, 0.5, 1) == second.gcode(1.75, 0.5, 1));
+
+    cache.clear();
+    CHECK(cache.size() == 0);
+  }
+
+  TEST_CASE("Slice with a free-form outline") {
+    const auto ellipse = gp_Elips(gp_Ax2(gp::Origin(), gp::DZ()), 20, 10);
+    const auto wire = BRepBuilderAPI_MakeWire(BRepBuilderAPI_MakeEdge(ellipse)).Wire();
+    const auto face = BRepBuilderAPI_MakeFace(wire, true).Face();
+
+    auto slice = sse::Slice(nullptr, face, 0.2);
+    REQUIRE_NOTHROW(slice.generate_shells(2, 0.5));
+
+    const auto gcode = slice.gcode(1.75, 0.5, 1);
+    // arcs, not just lines
+    CHECK(gcode.find("G3 ") != std::string::npos);
+  }
+}
@@ -0,0 +1,62 @@
+#include <doctest/doctest.h>
+
+#include <sse/GCodeBuffer.hpp>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+TEST_SUITE("GCodeBuffer") {
+
+  TEST_CASE("Formatting spans chunks") {
+    auto buffer = sse::GCodeBuffer(1024);
+    std::string expected;
+
+    for (int i = 0; i < 100; ++i) {
+      buffer.format("G1 X{:.6f} Y{:.6f}\n", i * 1.5, i * 2.5);
+      expected += fmt::format("G1 X{:.6f} Y{:.6f}\n", i * 1.5, i * 2.5);
+    }
+    buffer.append(";TYPE:FILL\n");
+    expected += ";TYPE:FILL\n";
+
+    CHECK(buffer.chunk_count() > 1);
+    CHECK(buffer.size() == expected.size());
+    CHECK(buffer.str() == expected);
+
+    std::ostringstream stream;
+    buffer.write(stream);
+    CHECK(stream.str() == expected);
+  }
+
+  TEST_CASE("Long text is split between chunks") {
+    auto buffer = sse::GCodeBuffer(256);
+    const auto text = std::string(1000, ';');
+
+    buffer.append(text);
+
+    CHECK(buffer.chunk_count() > 1);
+    CHECK(buffer.str() == text);
+  }
+
+  TEST_CASE("Clear keeps the chunks") {
+    auto buffer = sse::GCodeBuffer(1024);
+    for (int i = 0; i < 100; ++i) {
+      buffer.format("G0 X{:d}\n", i);
+    }
+    const auto chunks = buffer.chunk_count();
+    const auto text = buffer.str();
+
+    buffer.clear();
+    CHECK(buffer.empty());
+
+    for (int i = 0; i < 100; ++i) {
+      buffer.format("G0 X{:d}\n", i);
+    }
+    CHECK(buffer.chunk_count() == chunks);
+    CHECK(buffer.str() == text);
+  }
+
+  TEST_CASE("Chunk size") {
+    CHECK_THROWS_AS(sse::GCodeBuffer(16), std::invalid_argument);
+  }
+}
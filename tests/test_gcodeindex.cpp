@@ -0,0 +1,94 @@
+#include <doctest/doctest.h>
+
+#include <sse/GCodeIndex.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Write a whole file
+ */
+static void write_file(const std::filesystem::path &path, const std::string &text) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out << text;
+}
+
+TEST_SUITE("GCodeIndex") {
+
+  const auto file = std::filesystem::temp_directory_path() / "sse_test_index.gcode";
+
+  TEST_CASE("Index files") {
+    CHECK(sse::layer_index_path("part.gcode") == std::filesystem::path("part.gcode.idx"));
+
+    const std::vector<sse::LayerIndexEntry> layers = {{120, 30, 0.2, 1.5, 10.25},
+                                                      {150, 45, 0.4, 3.0000001, 20.5},
+                                                      {195, 5, 0.6, 3.1, 1e-7}};
+    const auto index = sse::layer_index_path(file);
+    sse::write_layer_index(index, layers);
+
+    const auto read = sse::read_layer_index(index);
+    REQUIRE(read.size() == layers.size());
+    for (std::size_t i = 0; i < layers.size(); ++i) {
+      CHECK(read[i].offset == layers[i].offset);
+      CHECK(read[i].size == layers[i].size);
+      // doubles are written exactly
+      CHECK(read[i].z == layers[i].z);
+      CHECK(read[i].filament == layers[i].filament);
+      CHECK(read[i].time == layers[i].time);
+    }
+
+    SUBCASE("Empty") {
+      sse::write_layer_index(index, {});
+      CHECK(sse::read_layer_index(index).empty());
+    }
+
+    SUBCASE("Invalid") {
+      write_file(index, "G1 X0\n");
+      CHECK_THROWS_AS((void)sse::read_layer_index(index), std::runtime_error);
+      write_file(index, std::string(sse::layer_index_magic) + "\n1 2 z\n");
+      CHECK_THROWS_AS((void)sse::read_layer_index(index), std::runtime_error);
+      CHECK_THROWS_AS((void)sse::read_layer_index(file / "not_a_directory"), std::runtime_error);
+    }
+  }
+
+  TEST_CASE("Layers are read by seeking") {
+    const std::string header = ";header\nG28\n";
+    const std::vector<std::string> text = {";LAYER: 0\nG1 X1 E1\n", ";LAYER: 1\nG1 X2 E2\n", ";LAYER: 2\nG1 X3 E3\n"};
+
+    std::string gcode = header;
+    std::vector<sse::LayerIndexEntry> layers;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+      layers.push_back({gcode.size(), text[i].size(), 0.2 * (i + 1), 1.0 * (i + 1), 2.0 * (i + 1)});
+      gcode += text[i];
+    }
+    gcode += ";footer\n";
+    write_file(file, gcode);
+    sse::write_layer_index(sse::layer_index_path(file), layers);
+
+    sse::GCodeLayerReader reader(file);
+    REQUIRE(reader.layer_count() == 3);
+    // out of order
+    CHECK(reader.layer(2) == text[2]);
+    CHECK(reader.layer(0) == text[0]);
+    CHECK(reader.layer(1) == text[1]);
+    CHECK(reader.info(1).filament == 2.0);
+    CHECK_THROWS_AS((void)reader.layer(3), std::out_of_range);
+
+    CHECK(reader.find(0) == 0);
+    CHECK(reader.find(0.4) == 1);
+    CHECK(reader.find(0.5) == 2);
+    CHECK(reader.find(1) == 3);
+
+    SUBCASE("Index of another file") {
+      write_file(file, header);
+      CHECK_THROWS_AS(sse::GCodeLayerReader{file}, std::runtime_error);
+    }
+
+    SUBCASE("Compressed") {
+      CHECK_THROWS_AS(sse::GCodeLayerReader{"part.gcode.gz"}, std::invalid_argument);
+    }
+  }
+}
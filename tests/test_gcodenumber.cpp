@@ -0,0 +1,104 @@
+#include <doctest/doctest.h>
+
+#include <sse/GCodeBuffer.hpp>
+#include <sse/GCodeNumber.hpp>
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+/**
+ * @brief Format a number with write_number
+ */
+static std::string number(double value, int precision) {
+  char text[sse::max_number_length];
+  return {text, sse::write_number(text, value, precision)};
+}
+
+/**
+ * @brief Format a number with fmt, and trim trailing zeros
+ */
+static std::string reference(double value, int precision) {
+  auto result = fmt::format("{:.{}f}", value, precision);
+  if (result.find('.') != std::string::npos) {
+    result.erase(result.find_last_not_of('0') + 1);
+    if (result.back() == '.') {
+      result.pop_back();
+    }
+  }
+  if (result == "-0") {
+    result = "0";
+  }
+  return result;
+}
+
+TEST_SUITE("GCodeNumber") {
+
+  TEST_CASE("Trailing zeros are trimmed") {
+    CHECK(number(10.5, 6) == "10.5");
+    CHECK(number(10, 6) == "10");
+    CHECK(number(0.05, 6) == "0.05");
+    CHECK(number(0.000001, 6) == "0.000001");
+    CHECK(number(-3.25, 6) == "-3.25");
+    CHECK(number(-0.5, 3) == "-0.5");
+    CHECK(number(1000, 0) == "1000");
+    CHECK(number(123.456, 2) == "123.46");
+  }
+
+  TEST_CASE("Negative zero") {
+    CHECK(number(-0.0, 6) == "0");
+    CHECK(number(-0.0000001, 6) == "0");
+    CHECK(number(-0.4, 0) == "0");
+  }
+
+  TEST_CASE("Precision is clamped") {
+    CHECK(number(1.5, -1) == "2");
+    CHECK(number(0.1234567891234, 20) == "0.123456789");
+  }
+
+  TEST_CASE("Out of range") {
+    CHECK(number(1e300, 6).size() <= sse::max_number_length);
+    CHECK(number(1e12, 6) == "1000000000000");
+    CHECK(number(std::numeric_limits<double>::infinity(), 6) == "inf");
+    CHECK(number(std::numeric_limits<double>::quiet_NaN(), 6) == "nan");
+  }
+
+  TEST_CASE("Matches fmt") {
+    auto generator = std::mt19937(42);
+    auto distribution = std::uniform_real_distribution<double>(-500, 500);
+
+    for (int i = 0; i < 10000; ++i) {
+      // quantize, so no value is within an ulp of a rounding boundary
+      const auto value = std::round(distribution(generator) * 1e7) / 1e7 + 1e-8;
+      CHECK(number(value, 6) == reference(value, 6));
+      CHECK(number(value, 3) == reference(value, 3));
+    }
+  }
+
+  TEST_CASE("Lines") {
+    auto line = sse::GCodeLine("G1");
+    CHECK(line.str() == "G1\n");
+    CHECK(sse::GCodeLine("").word('X', 1, 3).word('Y', 2, 3).str() == "X1 Y2\n");
+
+    line.word('X', 10.5, 3).word('Y', -2, 3).word('E', 0.123456789, 5).word('F', 1000, 0);
+    CHECK(line.str() == "G1 X10.5 Y-2 E0.12346 F1000\n");
+
+    SUBCASE("Buffer") {
+      auto buffer = sse::GCodeBuffer(1024);
+      buffer.append(line);
+      buffer.format_compiled(FMT_COMPILE(";LAYER: {:d}\n"), 7);
+      CHECK(buffer.str() == "G1 X10.5 Y-2 E0.12346 F1000\n;LAYER: 7\n");
+    }
+
+    SUBCASE("Overflow") {
+      const auto overflow = [&line] {
+        for (int i = 0; i < 10; ++i) {
+          line.word('X', -1.0e17, 9);
+        }
+      };
+      CHECK_THROWS_AS(overflow(), std::length_error);
+    }
+  }
+}
@@ -0,0 +1,285 @@
+#include <doctest/doctest.h>
+
+#include <sse/GCodeBuffer.hpp>
+#include <sse/GCodeParser.hpp>
+#include <sse/GCodeWriter.hpp>
+#include <sse/Toolpath.hpp>
+#include <sse/slicer.hpp>
+
+#include "test_helpers.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Parse a whole string as a number
+ */
+static double number(const std::string &text) {
+  double value = 0;
+  const auto end = sse::parse_number(text.data(), text.data() + text.size(), value);
+  CHECK(end == text.data() + text.size());
+  return value;
+}
+
+TEST_SUITE("GCodeParser") {
+
+  TEST_CASE("Line ends") {
+    std::string text(1000, 'x');
+    for (const std::size_t position : {0, 1, 15, 16, 31, 32, 33, 63, 64, 500, 999}) {
+      text[position] = '\n';
+      const auto begin = text.data() + (position > 7 ? position - 7 : 0);
+      CHECK(sse::find_line_end(begin, text.data() + text.size()) == text.data() + position);
+      text[position] = 'x';
+    }
+    CHECK(sse::find_line_end(text.data(), text.data() + text.size()) == text.data() + text.size());
+    CHECK(sse::find_line_end(text.data(), text.data()) == text.data());
+  }
+
+  TEST_CASE("Numbers") {
+    CHECK(number("10") == 10);
+    CHECK(number("-12.345") == -12.345);
+    CHECK(number("+0.5") == 0.5);
+    CHECK(number(".25") == 0.25);
+    CHECK(number("7.") == 7);
+    CHECK(number("0.000001") == 0.000001);
+    CHECK(number("000123.4500") == 123.45);
+    CHECK(std::signbit(number("-0")));
+    // from_chars
+    CHECK(number("12345678901234567890") == 12345678901234567890.0);
+    CHECK(number("-0.12345678901234567890") == -0.12345678901234567890);
+
+    double value = 0;
+    const std::string text = "X";
+    CHECK(sse::parse_number(text.data(), text.data() + text.size(), value) == nullptr);
+
+    // no exponent, the letter is the next word
+    const std::string word = "1.5e3";
+    CHECK(sse::parse_number(word.data(), word.data() + word.size(), value) == word.data() + 3);
+    CHECK(value == 1.5);
+
+    SUBCASE("Matches strtod") {
+      auto generator = std::mt19937(42);
+      auto distribution = std::uniform_real_distribution<double>(-500, 500);
+      for (int i = 0; i < 10000; ++i) {
+        for (const auto precision : {0, 3, 6, 9}) {
+          const auto formatted = fmt::format("{:.{}f}", distribution(generator), precision);
+          CHECK(number(formatted) == std::strtod(formatted.c_str(), nullptr));
+        }
+      }
+    }
+  }
+
+  TEST_CASE("Lines") {
+    sse::GCodeCommand command;
+    REQUIRE(sse::parse_line("G1 X10.5 Y-2 E0.12346 F1000 ; comment", command));
+    CHECK(command.is('G', 1));
+    CHECK(command.value('X') == 10.5);
+    CHECK(command.value('Y') == -2);
+    CHECK(command.value('E') == 0.12346);
+    CHECK(command.value('F') == 1000);
+    CHECK_FALSE(command.has('Z'));
+    CHECK(command.comment == " comment");
+
+    REQUIRE(sse::parse_line("g0x1y2", command));
+    CHECK(command.is('G', 0));
+    CHECK(command.value('Y') == 2);
+
+    REQUIRE(sse::parse_line("G1X10E0.5F1000", command));
+    CHECK(command.is('G', 1));
+    CHECK(command.value('X') == 10);
+    CHECK(command.value('E') == 0.5);
+    CHECK(command.value('F') == 1000);
+
+    REQUIRE(sse::parse_line("G1 X10E2", command));
+    CHECK(command.value('X') == 10);
+    CHECK(command.value('E') == 2);
+
+    REQUIRE(sse::parse_line("G1 X1.5E-2", command));
+    CHECK(command.value('X') == 1.5);
+    CHECK(command.value('E') == -2);
+
+    REQUIRE(sse::parse_line("N12 G1 X1*57", command));
+    CHECK(command.value('N') == 12);
+    CHECK(command.value('X') == 1);
+
+    REQUIRE(sse::parse_line("G28 X Y", command));
+    CHECK(command.has('X'));
+    CHECK(std::isnan(command.value('Y')));
+
+    REQUIRE(sse::parse_line("(LAYER: 3)", command));
+    CHECK(command.words == 0);
+    CHECK(command.comment == "LAYER: 3");
+
+    REQUIRE(sse::parse_line("", command));
+    CHECK(command.words == 0);
+
+    CHECK_FALSE(sse::parse_line("o1 call", command));
+    CHECK_FALSE(sse::parse_line("SET_FAN_SPEED FAN=part SPEED=0.5", command));
+    CHECK_FALSE(sse::parse_line("G1 X1 (unclosed", command));
+  }
+
+  TEST_CASE("Analysis") {
+    const std::string gcode = "G28\n"
+                              "G92 E0\n"
+                              ";LAYER: 0\n"
+                              "G0 Z0.2 F5000\n"
+                              "G0 X10 Y0\n"
+                              "G1 X20 Y0 E1 F1800\n"
+                              "G1 X20 Y10 E2 F1800\n"
+                              "G1 E1.5 F2400\n"
+                              "G0 X0 Y0\n"
+                              "G1 E2\n"
+                              "G3 X0 Y0 I5 J0 E3\n"
+                              ";LAYER: 1\n"
+                              "G0 Z0.4\n"
+                              "X10\n"
+                              "M117 Hello\n";
+
+    const auto check = [](const sse::GCodeAnalysis &result) {
+      CHECK(result.lines == 15);
+      CHECK(result.comments == 2);
+      CHECK(result.unparsed == 1);
+      CHECK(result.travels == 3);
+      CHECK(result.extrusions == 3);
+      CHECK(result.arcs == 1);
+      CHECK(result.retractions == 1);
+      CHECK(result.z_moves == 2);
+      CHECK(result.print_distance == doctest::Approx(20 + 10 * M_PI));
+      CHECK(result.travel_distance == doctest::Approx(10 + std::hypot(20, 10) + 10));
+      CHECK(result.filament == doctest::Approx(3));
+      // Y0 twice, X20 and F1800, X0 Y0 of the full circle; and the G0 and G1 that repeat the motion mode
+      CHECK(result.redundant_words == 6);
+      CHECK(result.redundant_commands == 3);
+
+      REQUIRE(result.layers.size() == 2);
+      CHECK(result.layers[0].z == doctest::Approx(0.2));
+      CHECK(result.layers[0].extrusions == 3);
+      CHECK(result.layers[0].min_x == 0);
+      CHECK(result.layers[0].max_x == 20);
+      CHECK(result.layers[0].max_y == 10);
+      CHECK(result.layers[0].filament == doctest::Approx(3));
+      CHECK(result.layers[1].z == doctest::Approx(0.4));
+      CHECK(result.layers[1].extrusions == 0);
+    };
+
+    check(sse::analyze_gcode(gcode));
+
+    SUBCASE("Pieces") {
+      // every line is split somewhere
+      for (const std::size_t size : {1, 3, 7, 64}) {
+        sse::GCodeAnalyzer analyzer;
+        for (std::size_t i = 0; i < gcode.size(); i += size) {
+          analyzer.feed(std::string_view(gcode).substr(i, size));
+        }
+        check(analyzer.finish());
+      }
+    }
+
+    SUBCASE("File") {
+      const auto file = std::filesystem::temp_directory_path() / "sse_test_parser.gcode";
+      std::ofstream(file, std::ios::binary) << gcode;
+      check(sse::analyze_gcode_file(file));
+      CHECK_THROWS_AS((void)sse::analyze_gcode_file(file / "not_a_directory"), std::runtime_error);
+    }
+  }
+
+  TEST_CASE("Subroutines, offsets and extruder axis") {
+    // as written by write_gcode_subroutines() for LinuxCNC, with relative extrusion
+    const std::string gcode = "M83\n"
+                              "o1 sub\n"
+                              "G0 X0 Y0\n"
+                              "G1 X10 Y0 A1 F1800\n"
+                              "G1 X10 Y10 A1\n"
+                              "o1 endsub\n"
+                              ";LAYER: 0\n"
+                              "G0 X0 Y0 Z0.2\n"
+                              "G52 X100 Y0 Z0\n"
+                              "o1 call\n"
+                              "G52 X0 Y0 Z0\n"
+                              "o1 call\n"
+                              "o2 call\n";
+
+    const auto result = sse::analyze_gcode(gcode, 'A');
+    CHECK(result.lines == 13);
+    // the call of a subroutine that doesn't exist
+    CHECK(result.unparsed == 1);
+    CHECK(result.extrusions == 4);
+    CHECK(result.print_distance == doctest::Approx(40));
+    CHECK(result.travel_distance == doctest::Approx(100 + std::hypot(110, 10)));
+    CHECK(result.filament == doctest::Approx(4));
+    REQUIRE(result.layers.size() == 1);
+    CHECK(result.layers[0].min_x == doctest::Approx(10));
+    CHECK(result.layers[0].max_x == doctest::Approx(110));
+
+    // A is just another word with the default extruder
+    CHECK(sse::analyze_gcode(gcode).extrusions == 0);
+    CHECK_THROWS_AS(sse::GCodeAnalyzer('X'), std::invalid_argument);
+  }
+
+  TEST_CASE("Written toolpaths round trip") {
+    sse::Toolpath path;
+    path.travel(0, 0);
+    path.reset_extruder();
+    for (int i = 1; i <= 100; ++i) {
+      path.linear(i, (i % 2) * 3.0, 0.05 * i, 1800);
+    }
+    path.arc(false, 100, 10, 0, 5, 6, 1200);
+    path.extrude(5, 2400);
+    path.travel(50, 50);
+
+    const auto expected = sse::toolpath_stats(path);
+    for (const auto mode : {sse::ModalMode::off, sse::ModalMode::words}) {
+      sse::GCodeBuffer buffer;
+      sse::GCodeWriter writer(buffer, {}, mode);
+      sse::write_toolpath(path, writer);
+      const auto result = sse::analyze_gcode(buffer.str());
+
+      CHECK(result.unparsed == 0);
+      CHECK(result.extrusions == expected.extrusions);
+      CHECK(result.arcs == expected.arcs);
+      CHECK(result.retractions == expected.retractions);
+      CHECK(result.print_distance == doctest::Approx(expected.print_distance));
+      CHECK(result.travel_distance == doctest::Approx(expected.travel_distance));
+      CHECK(result.filament == doctest::Approx(expected.filament));
+      if (mode == sse::ModalMode::off) {
+        CHECK(result.redundant_words > 0);
+      } else {
+        CHECK(result.redundant_words == 0);
+      }
+    }
+  }
+
+  TEST_CASE("Collated gcode round trip") {
+    std::vector<sse::Slice> slices;
+    for (int layer = 0; layer < 10; ++layer) {
+      slices.push_back(make_slice(0, 0, layer * 0.2));
+      slices.push_back(make_slice(20, 0, layer * 0.2));
+    }
+
+    const auto layers = sse::generate_toolpaths(slices);
+    const auto result = sse::analyze_gcode(sse::collate_gcode(slices));
+    REQUIRE(result.layers.size() == layers.size());
+    CHECK(result.unparsed == 0);
+
+    double print_distance = 0;
+    for (std::size_t i = 0; i < layers.size(); ++i) {
+      const auto stats = sse::toolpath_stats(layers[i].path);
+      print_distance += stats.print_distance;
+      CHECK(result.layers[i].z == doctest::Approx(layers[i].z));
+      // n.b. a segment too short to extrude anything after rounding isn't an extrusion
+      CHECK(result.layers[i].extrusions > 0);
+      CHECK(result.layers[i].extrusions <= stats.extrusions);
+      CHECK(result.layers[i].filament == doctest::Approx(stats.filament).epsilon(1e-4));
+      // two cylinders of radius 5, at x = 0 and x = 20
+      CHECK(result.layers[i].min_x >= -5);
+      CHECK(result.layers[i].max_x <= 25);
+    }
+    CHECK(result.print_distance == doctest::Approx(print_distance).epsilon(1e-3));
+  }
+}
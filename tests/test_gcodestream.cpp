@@ -0,0 +1,282 @@
+#include <doctest/doctest.h>
+
+#include <sse/GCodeCompression.hpp>
+#include <sse/GCodeIndex.hpp>
+#include <sse/GCodeStream.hpp>
+#include <sse/GCodeWriter.hpp>
+#include <sse/Settings.hpp>
+#include <sse/slicer.hpp>
+
+#include "test_helpers.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_SUITE("GCodeStream") {
+
+  const auto file = std::filesystem::temp_directory_path() / "sse_test_stream.gcode";
+
+  TEST_CASE("Blocks are written in order") {
+    const std::size_t blocks = 200;
+    std::string expected;
+    for (std::size_t i = 0; i < blocks; ++i) {
+      expected += fmt::format(";LAYER: {:d}\n", i) + std::string(i * 37 % 5000, 'x') + "\n";
+    }
+
+    sse::GCodeStream stream(file, 8);
+
+    // submitted out of order, by several threads
+    std::atomic<std::size_t> next{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&] {
+        for (auto i = next++; i < blocks; i = next++) {
+          auto buffer = stream.acquire();
+          buffer.format(";LAYER: {:d}\n", i);
+          buffer.append(std::string(i * 37 % 5000, 'x'));
+          buffer.append("\n");
+          stream.submit(i, std::move(buffer));
+        }
+      });
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+    stream.finish();
+
+    CHECK(stream.bytes_written() == expected.size());
+    CHECK(read_file(file) == expected);
+  }
+
+  TEST_CASE("Invalid blocks") {
+    sse::GCodeStream stream(file, 4);
+    stream.submit(0, stream.acquire());
+
+    SUBCASE("Duplicate") {
+      CHECK_THROWS_AS(stream.submit(0, stream.acquire()), std::invalid_argument);
+    }
+
+    SUBCASE("Missing") {
+      stream.submit(2, stream.acquire());
+      CHECK_THROWS_AS(stream.finish(), std::runtime_error);
+    }
+
+    SUBCASE("Abort releases waiting threads") {
+      std::thread aborter([&stream] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        stream.abort();
+      });
+      // more than the window ahead of the writer
+      CHECK_THROWS_AS(stream.submit(10, stream.acquire()), std::runtime_error);
+      aborter.join();
+      CHECK_THROWS_AS(stream.finish(), std::runtime_error);
+    }
+  }
+
+  TEST_CASE("Mapped blocks are written at their offsets") {
+    sse::GCodeBuffer first(1024), second(1024);
+    first.append(";first\n");
+    second.append(std::string(3000, 'x'));
+
+    {
+      sse::GCodeMappedFile mapped(file, first.size() + second.size());
+      // written in reverse
+      mapped.write(first.size(), second);
+      mapped.write(0, first);
+      CHECK_THROWS_AS(mapped.write(first.size() + 1, second), std::out_of_range);
+      mapped.finish();
+    }
+    CHECK(read_file(file) == first.str() + second.str());
+
+    SUBCASE("Empty") {
+      sse::GCodeMappedFile mapped(file, 0);
+      mapped.write(0, sse::GCodeBuffer(1024));
+      mapped.finish();
+      CHECK(read_file(file).empty());
+    }
+  }
+
+  TEST_CASE("Invalid file") {
+    CHECK_THROWS_AS(sse::GCodeStream(file, 0), std::invalid_argument);
+    CHECK_THROWS_AS(sse::GCodeStream(file / "not_a_directory"), std::runtime_error);
+    CHECK_THROWS_AS(sse::GCodeMappedFile(file / "not_a_directory", 10), std::runtime_error);
+  }
+
+  TEST_CASE("Compressed files") {
+    CHECK(sse::stream_compression("part.gcode.gz") == sse::StreamCompression::gzip);
+    CHECK(sse::stream_compression("part.gcode.zst") == sse::StreamCompression::zstd);
+    CHECK(sse::stream_compression("part.gcode") == sse::StreamCompression::none);
+
+    const std::size_t blocks = 300;
+    std::string expected;
+    for (std::size_t i = 0; i < blocks; ++i) {
+      expected += fmt::format(";LAYER: {:d}\nG1 X{:d} Y0 E1\n", i, i % 7);
+    }
+
+    for (const auto *extension : {".gcode.gz", ".gcode.zst"}) {
+      const auto compressed = std::filesystem::temp_directory_path() / fmt::format("sse_test_stream{}", extension);
+      const auto compression = sse::stream_compression(compressed);
+      if (!sse::stream_compression_supported(compression)) {
+        CHECK_THROWS_AS((void)sse::GCodeStream(compressed), std::invalid_argument);
+        continue;
+      }
+
+      sse::GCodeStream stream(compressed, 4);
+      for (std::size_t i = 0; i < blocks; ++i) {
+        auto buffer = stream.acquire();
+        buffer.format(";LAYER: {:d}\nG1 X{:d} Y0 E1\n", i, i % 7);
+        stream.submit(i, std::move(buffer));
+      }
+      stream.finish();
+
+      const auto data = read_file(compressed);
+      CHECK(stream.bytes_written() == data.size());
+      CHECK(data.size() < expected.size() / 4);
+      CHECK(sse::stream_decompress(data, compression) == expected);
+      // e.g. files that were appended to
+      CHECK(sse::stream_decompress(data + data, compression) == expected + expected);
+      CHECK_THROWS_AS((void)sse::stream_decompress(data.substr(0, data.size() / 2), compression), std::runtime_error);
+    }
+  }
+
+  TEST_CASE("Retraction settings") {
+    // the travel from one cylinder to the other crosses the outline of the second
+    std::vector<sse::Slice> slices;
+    slices.push_back(make_slice(0, 0, 0.2));
+    slices.push_back(make_slice(20, 0, 0.2));
+
+    auto &settings = sse::Settings::getInstance();
+    settings.parse("resources/retraction_profile.toml");
+    const auto gcode = sse::collate_gcode(slices);
+    settings.parse("resources/profile.toml");
+    const auto disabled = sse::collate_gcode(slices);
+
+    // 2.5mm at 35mm/s, with a 0.4mm hop
+    CHECK(gcode.find(" E-2.5 F2100\n") != std::string::npos);
+    CHECK(gcode.find(" Z0.6") != std::string::npos);
+    CHECK(disabled.find(" E-") == std::string::npos);
+    CHECK(disabled.find(" Z0.6") == std::string::npos);
+  }
+
+  TEST_CASE("Streamed slices match collated gcode") {
+    std::vector<sse::Slice> slices;
+    for (int layer = 0; layer < 20; ++layer) {
+      slices.push_back(make_slice(0, 0, layer * 0.2));
+      slices.push_back(make_slice(20, 0, layer * 0.2));
+    }
+
+    const auto expected = without_timestamp(sse::collate_gcode(slices, 1));
+
+    for (const auto threads : {1u, 3u, 8u}) {
+      CHECK(without_timestamp(sse::collate_gcode(slices, threads)) == expected);
+
+      sse::GCodeStream stream(file, 4);
+      sse::write_gcode(slices, stream, {}, sse::ModalMode::off, threads);
+      stream.finish();
+      CHECK(without_timestamp(read_file(file)) == expected);
+    }
+
+    SUBCASE("Mapped") {
+      for (const auto threads : {1u, 8u}) {
+        sse::write_gcode_mapped(slices, file, {}, sse::ModalMode::off, threads);
+        CHECK(without_timestamp(read_file(file)) == expected);
+      }
+    }
+
+    SUBCASE("Compressed") {
+      const auto compressed = std::filesystem::temp_directory_path() / "sse_test_stream.gcode.gz";
+      if (sse::stream_compression_supported(sse::StreamCompression::gzip)) {
+        sse::GCodeStream stream(compressed);
+        sse::write_gcode(slices, stream);
+        stream.finish();
+        const auto gcode = sse::stream_decompress(read_file(compressed), sse::StreamCompression::gzip);
+        CHECK(without_timestamp(gcode) == expected);
+      }
+    }
+
+    SUBCASE("Dialect") {
+      sse::GCodeBuffer buffer;
+      sse::BasicGCodeWriter<sse::Klipper> writer(buffer);
+      sse::write_gcode(slices, writer);
+      CHECK(buffer.str().find(";FLAVOR:Klipper\n") != std::string::npos);
+      CHECK(buffer.str().find("G2 ") == std::string::npos);
+
+      sse::GCodeStream stream(file);
+      sse::write_gcode(slices, stream, {}, sse::ModalMode::off, 4, sse::Dialect::klipper);
+      stream.finish();
+      CHECK(without_timestamp(read_file(file)) == without_timestamp(buffer.str()));
+    }
+
+    SUBCASE("Line numbers") {
+      // every layer is written with one writer, in order
+      sse::GCodeBuffer serial;
+      sse::BasicGCodeWriter<sse::MarlinNumbered> serial_writer(serial);
+      sse::write_gcode(sse::generate_toolpaths(slices, 1), serial_writer);
+
+      const auto numbered = without_timestamp(serial.str());
+      // the footer continues the numbers of the last layer
+      CHECK(numbered.find("N1 G1 X0 Y235*") == std::string::npos);
+
+      for (const auto threads : {1u, 8u}) {
+        sse::GCodeBuffer buffer;
+        sse::BasicGCodeWriter<sse::MarlinNumbered> writer(buffer);
+        sse::write_gcode(slices, writer, threads);
+        CHECK(without_timestamp(buffer.str()) == numbered);
+
+        sse::GCodeStream stream(file, 4);
+        sse::write_gcode(slices, stream, {}, sse::ModalMode::off, threads, sse::Dialect::marlin_numbered);
+        stream.finish();
+        CHECK(without_timestamp(read_file(file)) == numbered);
+
+        sse::write_gcode_mapped(slices, file, {}, sse::ModalMode::off, threads, sse::Dialect::marlin_numbered);
+        CHECK(without_timestamp(read_file(file)) == numbered);
+      }
+    }
+
+    SUBCASE("Layer index") {
+      sse::GCodeStream stream(file);
+      const auto index = sse::write_gcode(slices, stream, {}, sse::ModalMode::off, 4);
+      stream.finish();
+      const auto gcode = read_file(file);
+
+      REQUIRE(index.size() == 20);
+      for (std::size_t i = 0; i < index.size(); ++i) {
+        const auto text = gcode.substr(index[i].offset, index[i].size);
+        CHECK(text.find(fmt::format(";LAYER: {:d}\n", i)) == 0);
+        CHECK(text.find(";LAYER: ", 1) == std::string::npos);
+        CHECK(index[i].z == doctest::Approx(i * 0.2));
+        if (i > 0) {
+          CHECK(index[i].offset == index[i - 1].offset + index[i - 1].size);
+          CHECK(index[i].filament > index[i - 1].filament);
+          CHECK(index[i].time > index[i - 1].time);
+        }
+      }
+
+      const auto mapped = sse::write_gcode_mapped(slices, file, {}, sse::ModalMode::off, 4);
+      REQUIRE(mapped.size() == index.size());
+      CHECK(mapped.back().offset == index.back().offset);
+      CHECK(mapped.back().filament == doctest::Approx(index.back().filament));
+
+      sse::write_layer_index(sse::layer_index_path(file), mapped);
+      sse::GCodeLayerReader reader(file);
+      CHECK(reader.layer_count() == 20);
+      CHECK(reader.layer(7) == read_file(file).substr(mapped[7].offset, mapped[7].size));
+      CHECK(reader.find(1.0) == 5);
+    }
+
+    SUBCASE("Modal") {
+      sse::GCodeBuffer buffer;
+      sse::GCodeWriter writer(buffer, sse::GCodePrecision::compact(), sse::ModalMode::words);
+      sse::write_gcode(slices, writer);
+
+      sse::GCodeStream stream(file);
+      sse::write_gcode(slices, stream, sse::GCodePrecision::compact(), sse::ModalMode::words, 4);
+      stream.finish();
+      CHECK(without_timestamp(read_file(file)) == without_timestamp(buffer.str()));
+    }
+  }
+}
@@ -0,0 +1,364 @@
+#include <doctest/doctest.h>
+
+#include <sse/GCodeBuffer.hpp>
+#include <sse/GCodeDialect.hpp>
+#include <sse/GCodeWriter.hpp>
+
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @brief State of the machine after a move
+ */
+struct Move {
+  int motion = -1;
+  double x = NAN, y = NAN, z = NAN, e = NAN, f = NAN, i = 0, j = 0;
+};
+
+/**
+ * @brief Interpret gcode, with modal motion commands and words
+ * @return State after every command that moves the machine or sets its position
+ */
+static std::vector<Move> parse(const std::string &gcode) {
+  std::vector<Move> result;
+  Move state;
+
+  std::istringstream lines(gcode);
+  std::string line;
+  while (std::getline(lines, line)) {
+    line = line.substr(0, line.find(';'));
+    std::istringstream words(line);
+    std::string word;
+
+    auto next = state;
+    next.i = next.j = 0;
+    bool moved = false;
+    bool set_position = false;
+    while (words >> word) {
+      const auto value = std::stod(word.substr(1));
+      switch (word[0]) {
+      case 'G':
+        // G92 isn't a motion command
+        if (value == 92) {
+          set_position = true;
+        } else {
+          next.motion = static_cast<int>(value);
+        }
+        break;
+      case 'X': next.x = value; moved = true; break;
+      case 'Y': next.y = value; moved = true; break;
+      case 'Z': next.z = value; moved = true; break;
+      case 'E': next.e = value; moved = true; break;
+      case 'F': next.f = value; break;
+      case 'I': next.i = value; moved = true; break;
+      case 'J': next.j = value; moved = true; break;
+      }
+    }
+
+    if (set_position) {
+      result.push_back(next);
+      result.back().motion = -1;
+    } else if (moved) {
+      result.push_back(next);
+    }
+    state = next;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Compare moves, ignoring moves that don't change the position
+ */
+static void check_equivalent(const std::vector<Move> &expected, const std::vector<Move> &actual,
+                             double tolerance) {
+  auto same = [tolerance](double a, double b) {
+    return (std::isnan(a) && std::isnan(b)) || std::abs(a - b) <= tolerance;
+  };
+  auto changes = [&](const std::vector<Move> &moves) {
+    std::vector<Move> result;
+    for (const auto &move : moves) {
+      if (!result.empty() && move.i == 0 && move.j == 0 && same(move.x, result.back().x) &&
+          same(move.y, result.back().y) && same(move.z, result.back().z) && same(move.e, result.back().e)) {
+        continue;
+      }
+      result.push_back(move);
+    }
+    return result;
+  };
+
+  const auto a = changes(expected);
+  const auto b = changes(actual);
+  REQUIRE(a.size() == b.size());
+  for (std::size_t k = 0; k < a.size(); ++k) {
+    CHECK(a[k].motion == b[k].motion);
+    CHECK(same(a[k].x, b[k].x));
+    CHECK(same(a[k].y, b[k].y));
+    CHECK(same(a[k].z, b[k].z));
+    CHECK(same(a[k].e, b[k].e));
+    CHECK(same(a[k].f, b[k].f));
+    CHECK(same(a[k].i, b[k].i));
+    CHECK(same(a[k].j, b[k].j));
+  }
+}
+
+/**
+ * @brief Write the same random program with a writer
+ */
+static std::string random_program(sse::GCodePrecision precision, sse::ModalMode mode) {
+  // few distinct values, so words repeat often
+  auto generator = std::mt19937(42);
+  auto coordinate = [&generator] { return std::uniform_int_distribution<int>(0, 4)(generator) * 2.5; };
+  auto feedrate = [&generator] { return std::uniform_int_distribution<int>(1, 3)(generator) * 1000.0; };
+  auto choice = std::uniform_int_distribution<int>(0, 7);
+
+  sse::GCodeBuffer buffer(1024);
+  sse::GCodeWriter writer(buffer, precision, mode);
+  double e = 0;
+  for (int k = 0; k < 2000; ++k) {
+    switch (choice(generator)) {
+    case 0:
+      writer.travel(coordinate(), coordinate());
+      break;
+    case 1:
+      writer.travel_z(coordinate(), feedrate());
+      break;
+    case 2:
+      writer.reset_extruder();
+      e = 0;
+      break;
+    case 3:
+      writer.extrude(e - 1.0000001, feedrate());
+      break;
+    case 4:
+      writer.arc(k % 2, coordinate(), coordinate(), 1.2345678, -2.5, e += 0.5, feedrate());
+      break;
+    case 5:
+      writer.comment(";TYPE:FILL\n");
+      break;
+    default:
+      e += std::uniform_int_distribution<int>(0, 1)(generator) * 0.1234567;
+      writer.linear(coordinate(), coordinate(), e, feedrate());
+      break;
+    }
+  }
+
+  return buffer.str();
+}
+
+TEST_SUITE("GCodeWriter") {
+
+  TEST_CASE("Every word is written by default") {
+    sse::GCodeBuffer buffer(1024);
+    sse::GCodeWriter writer(buffer);
+
+    writer.linear(10, 0, 1, 1000);
+    writer.linear(10, 0, 1, 1000);
+    writer.reset_extruder();
+    writer.reset_extruder();
+
+    CHECK(buffer.str() == "G1 X10 Y0 E1 F1000\nG1 X10 Y0 E1 F1000\nG92 E0\nG92 E0\n");
+  }
+
+  TEST_CASE("Modal words are omitted") {
+    SUBCASE("Words") {
+      sse::GCodeBuffer buffer(1024);
+      sse::GCodeWriter writer(buffer, sse::GCodePrecision::compact(), sse::ModalMode::words);
+      writer.travel(0, 0);
+      writer.linear(10, 0, 1, 1000);
+      writer.linear(10, 5.00001, 2, 1000);
+      writer.linear(10, 5, 2, 1000);
+      writer.travel_z(0.2, 5000);
+      writer.extrude(1.5, 1800);
+      writer.arc(true, 10, 5, 1, 0, 2.5, 1800);
+
+      CHECK(buffer.str() == "G0 X0 Y0\nG1 X10 E1 F1000\nG1 Y5 E2\nG0 Z0.2 F5000\nG1 E1.5 F1800\nG2 I1 J0 E2.5\n");
+    }
+
+    SUBCASE("Commands") {
+      sse::GCodeBuffer buffer(1024);
+      sse::GCodeWriter writer(buffer, sse::GCodePrecision::compact(), sse::ModalMode::commands);
+      writer.travel(0, 0);
+      writer.linear(10, 0, 1, 1000);
+      writer.linear(10, 5, 2, 1000);
+      writer.travel_z(0.2, 5000);
+      writer.travel(1, 1);
+
+      CHECK(buffer.str() == "G0 X0 Y0\nG1 X10 E1 F1000\nY5 E2\nG0 Z0.2 F5000\nX1 Y1\n");
+    }
+  }
+
+  TEST_CASE("Appending forgets the state") {
+    sse::GCodeBuffer buffer(1024);
+    sse::GCodeWriter writer(buffer, {}, sse::ModalMode::commands);
+
+    writer.travel(1, 2);
+    writer.comment(";comment\n");
+    writer.travel(1, 3);
+    writer.append("G28\n");
+    writer.travel(1, 3);
+
+    CHECK(buffer.str() == "G0 X1 Y2\n;comment\nY3\nG28\nG0 X1 Y3\n");
+  }
+
+  TEST_CASE("Modal output is equivalent") {
+    const auto expected = parse(random_program({}, sse::ModalMode::off));
+    REQUIRE(expected.size() > 1000);
+
+    SUBCASE("Words") {
+      check_equivalent(expected, parse(random_program({}, sse::ModalMode::words)), 0);
+    }
+
+    SUBCASE("Commands") {
+      check_equivalent(expected, parse(random_program({}, sse::ModalMode::commands)), 0);
+    }
+
+    SUBCASE("Compact precision") {
+      const auto compact = random_program(sse::GCodePrecision::compact(), sse::ModalMode::words);
+      check_equivalent(expected, parse(compact), 0.0005);
+      CHECK(compact.size() < random_program({}, sse::ModalMode::off).size());
+    }
+  }
+
+  TEST_CASE("Dialects") {
+    CHECK(sse::parse_dialect("klipper") == sse::Dialect::klipper);
+    CHECK_THROWS_AS(sse::parse_dialect("grbl"), std::invalid_argument);
+
+    SUBCASE("Relative extrusion") {
+      sse::GCodeBuffer buffer(1024);
+      sse::BasicGCodeWriter<sse::Klipper> writer(buffer);
+      writer.reset_extruder();
+      writer.linear(10, 0, 1, 1000);
+      writer.linear(20, 0, 3.5, 1000);
+      writer.reset_extruder();
+      writer.extrude(-1, 2400);
+      writer.extrude(0, 2400);
+
+      CHECK(buffer.str() == "G1 X10 Y0 E1 F1000\nG1 X20 Y0 E2.5 F1000\nG1 E-1 F2400\nG1 E1 F2400\n");
+    }
+
+    SUBCASE("Arcs as lines") {
+      sse::GCodeBuffer buffer(1024);
+      sse::BasicGCodeWriter<sse::Klipper> writer(buffer);
+      writer.travel(10, 0);
+      writer.reset_extruder();
+      // quarter circle, counter-clockwise around the origin
+      writer.arc(false, 0, 10, -10, 0, 1, 1000);
+
+      const auto moves = parse(buffer.str());
+      REQUIRE(moves.size() > 10);
+      double extruded = 0;
+      for (const auto &move : moves) {
+        CHECK(move.motion != 2);
+        CHECK(move.motion != 3);
+        CHECK(std::hypot(move.x, move.y) == doctest::Approx(10).epsilon(0.001));
+        CHECK(move.x >= -1e-6);
+        CHECK(move.y >= -1e-6);
+        if (move.motion == 1) {
+          extruded += move.e;
+        }
+      }
+      CHECK(moves.back().x == doctest::Approx(0));
+      CHECK(moves.back().y == 10);
+      CHECK(extruded == doctest::Approx(1));
+    }
+
+    SUBCASE("Beziers") {
+      const auto controls = sse::BezierControls{3, 6, -3, 6};
+
+      sse::GCodeBuffer native(1024);
+      sse::BasicGCodeWriter<sse::LinuxCNC> linuxcnc(native);
+      linuxcnc.travel(0, 0);
+      linuxcnc.bezier(10, 0, controls, 1, 1000);
+      CHECK(native.str() == "G0 X0 Y0\nG5 X10 Y0 I3 J6 P-3 Q6 A1 F1000\n");
+
+      sse::GCodeBuffer buffer(1024);
+      sse::GCodeWriter writer(buffer);
+      writer.travel(0, 0);
+      writer.reset_extruder();
+      writer.bezier(10, 0, controls, 1, 1000);
+
+      const auto moves = parse(buffer.str());
+      REQUIRE(moves.size() > 10);
+      double e = 0;
+      for (const auto &move : moves) {
+        CHECK(move.motion != 5);
+        CHECK(move.y >= -1e-6);
+        CHECK(move.y <= 4.5 + 1e-6);
+        if (move.motion == 1) {
+          CHECK(move.e >= e);
+          e = move.e;
+        }
+      }
+      CHECK(moves.back().x == 10);
+      CHECK(moves.back().y == 0);
+      CHECK(moves.back().e == 1);
+    }
+
+    SUBCASE("Comments in parentheses") {
+      sse::GCodeBuffer buffer(1024);
+      sse::BasicGCodeWriter<sse::LinuxCNC> writer(buffer);
+      writer.append("M104 S200; Set hotend temp\n;note (1)\nG28\n");
+      writer.layer(3);
+      writer.comment(";TYPE:FILL\n");
+
+      CHECK(buffer.str() == "M104 S200 (Set hotend temp)\n(note [1])\nG28\n(LAYER: 3)\n(TYPE:FILL)\n");
+    }
+
+    SUBCASE("Extruder axis") {
+      sse::GCodeBuffer buffer(1024);
+      sse::BasicGCodeWriter<sse::LinuxCNC> writer(buffer);
+      CHECK(writer.extruder_axis() == 'A');
+      writer.set_extruder_axis('U');
+      writer.reset_extruder();
+      writer.linear(10, 0, 1, 1000);
+      CHECK(buffer.str() == "G92 U0\nG1 X10 Y0 U1 F1000\n");
+      CHECK_THROWS_AS(writer.set_extruder_axis('X'), std::invalid_argument);
+      CHECK_THROWS_AS(writer.set_extruder_axis('E'), std::invalid_argument);
+
+      sse::GCodeBuffer marlin(1024);
+      sse::GCodeWriter printer(marlin);
+      CHECK(printer.extruder_axis() == 'E');
+      CHECK_NOTHROW(printer.set_extruder_axis('E'));
+      CHECK_THROWS_AS(printer.set_extruder_axis('A'), std::invalid_argument);
+    }
+
+    SUBCASE("Line numbers") {
+      sse::GCodeBuffer buffer(1024);
+      sse::BasicGCodeWriter<sse::MarlinNumbered> writer(buffer);
+      writer.append("G28; Home\n");
+      writer.layer(0);
+      writer.travel(1, 2);
+      writer.reset_extruder();
+
+      const auto gcode = buffer.str();
+      CHECK(gcode.find(";Home\n") != std::string::npos);
+      CHECK(gcode.find(";LAYER: 0\n") != std::string::npos);
+
+      // every command is numbered from 0 after each reset, with a valid checksum
+      std::istringstream lines(gcode);
+      std::string line;
+      std::vector<std::string> commands;
+      while (std::getline(lines, line)) {
+        if (line[0] == ';') {
+          continue;
+        }
+        const auto star = line.find('*');
+        REQUIRE(star != std::string::npos);
+        int checksum = 0;
+        for (std::size_t k = 0; k < star; ++k) {
+          checksum ^= static_cast<unsigned char>(line[k]);
+        }
+        CHECK(std::stoi(line.substr(star + 1)) == checksum);
+        commands.push_back(line.substr(0, star));
+      }
+
+      const std::vector<std::string> expected = {"N0 M110 N0", "N1 G28", "N0 M110 N0", "N1 G0 X1 Y2", "N2 G92 E0"};
+      CHECK(commands == expected);
+    }
+  }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <sse/Slice.hpp>
+
+#include <BRepBuilderAPI_MakeEdge.hxx>
+#include <BRepBuilderAPI_MakeFace.hxx>
+#include <BRepBuilderAPI_MakeWire.hxx>
+#include <gp.hxx>
+#include <gp_Circ.hxx>
+#include <gp_Pnt.hxx>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+/**
+ * @brief Create a slice of a cylinder with radius 5, with shells
+ */
+inline sse::Slice make_slice(double x, double y, double z, int shells = 2) {
+  auto wire = BRepBuilderAPI_MakeWire(BRepBuilderAPI_MakeEdge(gp_Circ(gp_Ax2(gp_Pnt(x, y, z), gp::DZ()), 5)));
+  auto face = BRepBuilderAPI_MakeFace(wire.Wire(), true).Face();
+  auto slice = sse::Slice(nullptr, face, 0.2);
+  slice.generate_shells(shells, 0.5);
+  return slice;
+}
+
+/**
+ * @brief Drop the first line, i.e. the header comment with a timestamp
+ */
+inline std::string without_timestamp(const std::string &gcode) {
+  return gcode.substr(gcode.find('\n') + 1);
+}
+
+/**
+ * @brief Read a whole file
+ */
+inline std::string read_file(const std::filesystem::path &path) {
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream result;
+  result << in.rdbuf();
+  return result.str();
+}
@@ -0,0 +1,95 @@
+#include <doctest/doctest.h>
+
+#include "sse/slicer.hpp"
+
+#include "test_helpers.hpp"
+
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+// slices own their toolpaths, and are too expensive to copy
+static_assert(!std::is_copy_constructible_v<sse::Slice>);
+static_assert(std::is_move_constructible_v<sse::Slice>);
+
+TEST_SUITE("Ordering") {
+
+  TEST_CASE("Empty list") {
+    auto slices = std::vector<sse::Slice>{};
+    CHECK_NOTHROW(sse::order_slices(slices));
+    CHECK(slices.empty());
+  }
+
+  TEST_CASE("Layers are sorted by z position") {
+    auto slices = std::vector<sse::Slice>{};
+    for (auto z : {0.6, 0.2, 0.4, 0.0}) {
+      slices.push_back(make_slice(0, 0, z, 1));
+    }
+
+    sse::order_slices(slices);
+
+    REQUIRE(slices.size() == 4);
+    for (std::size_t i = 1; i < slices.size(); ++i) {
+      CHECK(slices[i - 1].z_position() <= slices[i].z_position());
+    }
+  }
+
+  TEST_CASE("Islands are visited in order of proximity") {
+    auto slices = std::vector<sse::Slice>{};
+    // first layer, out of order
+    slices.push_back(make_slice(100, 0, 0, 1));
+    slices.push_back(make_slice(0, 0, 0, 1));
+    slices.push_back(make_slice(50, 0, 0, 1));
+    // second layer, out of order
+    slices.push_back(make_slice(50, 0, 0.2, 1));
+    slices.push_back(make_slice(0, 0, 0.2, 1));
+    slices.push_back(make_slice(100, 0, 0.2, 1));
+
+    sse::order_slices(slices);
+
+    REQUIRE(slices.size() == 6);
+    // islands are 50mm apart, with a radius of 5mm; round to the island center
+    auto island = [&slices](std::size_t i) { return std::round(slices[i].entry_point()->x() / 50.0) * 50.0; };
+
+    // first layer starts at the origin, moving away from it
+    CHECK(island(0) == 0);
+    CHECK(island(1) == 50);
+    CHECK(island(2) == 100);
+    // second layer continues from where the first one ended
+    CHECK(island(3) == 100);
+    CHECK(island(4) == 50);
+    CHECK(island(5) == 0);
+  }
+
+  TEST_CASE("Order without moving slices") {
+    auto slices = std::vector<sse::Slice>{};
+    for (auto z : {0.4, 0.0, 0.2}) {
+      slices.push_back(make_slice(0, 0, z, 1));
+    }
+
+    const auto order = sse::slice_order(slices);
+
+    REQUIRE(order.size() == 3);
+    CHECK(order[0] == 1);
+    CHECK(order[1] == 2);
+    CHECK(order[2] == 0);
+    // untouched
+    CHECK(slices[0].z_position() == doctest::Approx(0.4));
+  }
+
+  TEST_CASE("Layers group nearly equal z positions") {
+    auto slices = std::vector<sse::Slice>{};
+    for (auto z : {0.2, 0.0, 0.2 + 1e-9, 0.2 - 1e-9}) {
+      slices.push_back(make_slice(0, 0, z, 1));
+    }
+
+    std::vector<std::size_t> layers;
+    const auto order = sse::slice_order(slices, layers);
+
+    REQUIRE(order.size() == 4);
+    REQUIRE(layers.size() == 2);
+    CHECK(layers[0] == 0);
+    CHECK(layers[1] == 1);
+    CHECK(order[0] == 1);
+  }
+}
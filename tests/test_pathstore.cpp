@@ -0,0 +1,100 @@
+#include <doctest/doctest.h>
+
+#include <sse/PathStore.hpp>
+
+/**
+ * @brief Square with one arc, side length 10
+ */
+static cavc::Polyline<double> make_square(double x) {
+  cavc::Polyline<double> result;
+  result.isClosed() = true;
+  result.addVertex(x, 0, 0);
+  result.addVertex(x + 10, 0, 0.5);
+  result.addVertex(x + 10, 10, 0);
+  result.addVertex(x, 10, 0);
+  return result;
+}
+
+TEST_SUITE("PathStore") {
+
+  TEST_CASE("Round trip") {
+    sse::PathStore store;
+    const auto square = make_square(0);
+
+    cavc::Polyline<double> line;
+    line.addVertex(0, 0, 0);
+    line.addVertex(5, 5, 0);
+
+    store.add(square, sse::PathKind::wall, false, 1);
+    store.add(line, sse::PathKind::infill);
+    // empty paths are skipped
+    store.add(cavc::Polyline<double>(), sse::PathKind::infill);
+
+    REQUIRE(store.size() == 2);
+    CHECK(store.vertex_count() == 6);
+
+    const auto &info = store.info(0);
+    CHECK(info.kind == sse::PathKind::wall);
+    CHECK(info.closed);
+    CHECK_FALSE(info.island);
+    CHECK(info.shell == 1);
+    CHECK(info.size() == 4);
+    CHECK_FALSE(store.info(1).closed);
+
+    const auto copy = store.polyline(0);
+    REQUIRE(copy.size() == square.size());
+    CHECK(copy.isClosed());
+    for (std::size_t i = 0; i < copy.size(); ++i) {
+      CHECK(copy[i].x() == doctest::Approx(square[i].x()));
+      CHECK(copy[i].y() == doctest::Approx(square[i].y()));
+      CHECK(copy[i].bulge() == doctest::Approx(square[i].bulge()));
+    }
+    CHECK(cavc::getArea(copy) == doctest::Approx(cavc::getArea(square)));
+  }
+
+  TEST_CASE("Erase compacts the store") {
+    sse::PathStore store;
+    store.add(make_square(0), sse::PathKind::wall);
+    store.add(make_square(20), sse::PathKind::infill);
+    store.add(make_square(40), sse::PathKind::wall, false, 1);
+
+    store.erase(sse::PathKind::infill);
+
+    REQUIRE(store.size() == 2);
+    CHECK(store.vertex_count() == 8);
+    CHECK(store.info(1).begin == 4);
+    CHECK(store.info(1).shell == 1);
+    CHECK(store.vertex(store.info(1).begin).x() == doctest::Approx(40));
+
+    store.clear();
+    store.shrink_to_fit();
+    CHECK(store.empty());
+    CHECK(store.memory_usage() == 0);
+  }
+
+  TEST_CASE("Paths are classified by segment kind") {
+    sse::PathStore store;
+
+    auto square = make_square(0);
+    square[1].bulge() = 0;
+    store.add(square, sse::PathKind::wall);
+    store.add(make_square(0), sse::PathKind::wall);
+
+    cavc::Polyline<double> circle;
+    circle.isClosed() = true;
+    circle.addVertex(0, 0, 1);
+    circle.addVertex(10, 0, 1);
+    store.add(circle, sse::PathKind::wall);
+
+    // the bulge of the last vertex of an open path doesn't matter
+    circle.isClosed() = false;
+    circle.lastVertex().bulge() = 0;
+    store.add(circle, sse::PathKind::infill);
+
+    REQUIRE(store.size() == 4);
+    CHECK(store.info(0).shape == sse::PathShape::lines);
+    CHECK(store.info(1).shape == sse::PathShape::mixed);
+    CHECK(store.info(2).shape == sse::PathShape::arcs);
+    CHECK(store.info(3).shape == sse::PathShape::arcs);
+  }
+}
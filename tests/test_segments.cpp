@@ -0,0 +1,59 @@
+#include <doctest/doctest.h>
+
+#include <sse/Segments.hpp>
+
+#include <cavc/mathutils.hpp>
+
+#include <cmath>
+
+TEST_SUITE("Segments") {
+
+  TEST_CASE("Straight path") {
+    // long enough to use every SIMD width, plus a remainder
+    cavc::Polyline<double> pline;
+    pline.isClosed() = true;
+    for (int i = 0; i <= 10; ++i) {
+      pline.addVertex(i * 3.0, i * 4.0, 0);
+    }
+
+    sse::PathStore paths;
+    paths.add(pline, sse::PathKind::wall);
+    sse::SegmentBatch batch;
+    sse::compute_segments(paths, paths.info(0), 0.5, batch);
+
+    REQUIRE(batch.size() == 11);
+    // closing segment first
+    CHECK(batch.length[0] == doctest::Approx(50));
+    CHECK(batch.extrusion[0] == doctest::Approx(25));
+    for (std::size_t k = 1; k < batch.size(); ++k) {
+      CHECK(batch.length[k] == doctest::Approx(5));
+      CHECK(batch.extrusion[k] == doctest::Approx(25 + 2.5 * k));
+      CHECK(batch.center_i[k] == 0);
+    }
+
+    const auto [i, j] = sse::segment_vertices(paths.info(0), 0);
+    CHECK(i == 10);
+    CHECK(j == 0);
+  }
+
+  TEST_CASE("Arcs") {
+    // circle of radius 5, as two semicircles
+    cavc::Polyline<double> pline;
+    pline.isClosed() = false;
+    pline.addVertex(0, 0, 1);
+    pline.addVertex(10, 0, 1);
+    pline.addVertex(0, 0, 0);
+
+    sse::PathStore paths;
+    paths.add(pline, sse::PathKind::infill);
+    sse::SegmentBatch batch;
+    sse::compute_segments(paths, paths.info(0), 1.0, batch);
+
+    REQUIRE(batch.size() == 2);
+    CHECK(batch.length[0] == doctest::Approx(5 * cavc::utils::pi<double>()));
+    CHECK(batch.extrusion[1] == doctest::Approx(10 * cavc::utils::pi<double>()));
+    CHECK(batch.center_i[0] == doctest::Approx(5));
+    CHECK(batch.center_j[0] == doctest::Approx(0));
+    CHECK(batch.center_i[1] == doctest::Approx(-5));
+  }
+}
@@ -70,6 +70,15 @@ TEST_SUITE("Settings") {
       // settings.get_nested_setting<int>("level1", "level2", "level3");
     }
 
+    SUBCASE("Get Nested Setting w/Fallback") {
+      settings.parse("resources/profile.toml");
+      CHECK_EQ(settings.get_setting_fallback<double>("printer.extruder_1.nozzle_diameter", 1.0), 0.4);
+      CHECK_EQ(settings.get_setting_fallback<double>("printer.extruder_1.invalid", 1.0), 1.0);
+      CHECK_EQ(settings.get_setting_fallback<double>("invalid.extruder_1.nozzle_diameter", 1.0), 1.0);
+      // not a table
+      CHECK_EQ(settings.get_setting_fallback<double>("layer_height.invalid", 1.0), 1.0);
+    }
+
 
 
   }
@@ -0,0 +1,128 @@
+#include <doctest/doctest.h>
+
+#include <sse/Simplify.hpp>
+
+#include <cavc/mathutils.hpp>
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Create a closed polyline out of a list of points
+ */
+static cavc::Polyline<double> make_loop(const std::vector<std::pair<double, double>> &points) {
+  cavc::Polyline<double> result;
+  result.isClosed() = true;
+  for (const auto &[x, y] : points) {
+    result.addVertex(x, y, 0);
+  }
+  return result;
+}
+
+/**
+ * @brief Tessellated circle, as found in STL files
+ */
+static cavc::Polyline<double> make_tessellated_circle(double radius, int segments) {
+  cavc::Polyline<double> result;
+  result.isClosed() = true;
+  for (int i = 0; i < segments; ++i) {
+    const auto angle = 2 * cavc::utils::pi<double>() * i / segments;
+    result.addVertex(radius * std::cos(angle), radius * std::sin(angle), 0);
+  }
+  return result;
+}
+
+TEST_SUITE("Simplify") {
+
+  TEST_CASE("Collinear segments") {
+    auto pline = make_loop({{0, 0}, {5, 0}, {10, 0}, {10, 5}, {10, 10}, {10, 10}, {5, 10}, {0, 10}, {0, 5}});
+
+    sse::merge_collinear(pline);
+
+    CHECK(pline.size() == 4);
+    CHECK(cavc::getArea(pline) == doctest::Approx(100));
+  }
+
+  TEST_CASE("Spikes aren't collinear") {
+    auto pline = make_loop({{0, 0}, {10, 0}, {5, 0}, {5, 5}});
+
+    sse::merge_collinear(pline);
+
+    CHECK(pline.size() == 4);
+  }
+
+  TEST_CASE("Tessellated circle becomes arcs") {
+    auto pline = make_tessellated_circle(10, 360);
+    const auto area = cavc::getArea(pline);
+
+    sse::simplify(pline, 0.01);
+
+    CHECK(pline.size() <= 4);
+    for (const auto &v : pline.vertexes()) {
+      CHECK_FALSE(v.bulgeIsZero());
+    }
+    CHECK(cavc::getArea(pline) == doctest::Approx(area).epsilon(0.001));
+  }
+
+  TEST_CASE("Coarse tessellation is out of tolerance") {
+    // sagitta of each segment is ~0.76mm
+    auto pline = make_tessellated_circle(10, 8);
+
+    sse::simplify(pline, 0.01);
+
+    CHECK(pline.size() == 8);
+  }
+
+  TEST_CASE("Douglas-Peucker") {
+    cavc::Polyline<double> pline;
+    pline.isClosed() = false;
+    for (int i = 0; i <= 100; ++i) {
+      // zig-zag with 0.001mm amplitude
+      pline.addVertex(i, (i % 2) ? 0.001 : 0, 0);
+    }
+
+    SUBCASE("Within tolerance") {
+      sse::douglas_peucker(pline, 0.01);
+      REQUIRE(pline.size() == 2);
+      CHECK(pline[0].x() == doctest::Approx(0));
+      CHECK(pline[1].x() == doctest::Approx(100));
+    }
+
+    SUBCASE("Out of tolerance") {
+      sse::douglas_peucker(pline, 0.0001);
+      CHECK(pline.size() == 101);
+    }
+  }
+
+  TEST_CASE("Arcs are preserved") {
+    cavc::Polyline<double> pline;
+    pline.isClosed() = true;
+    pline.addVertex(0, 0, 0);
+    pline.addVertex(5, 0.001, 0);
+    pline.addVertex(10, 0, 1);
+    pline.addVertex(10, 10, 0);
+    pline.addVertex(0, 10, 0);
+
+    sse::simplify(pline, 0.01);
+
+    REQUIRE(pline.size() == 4);
+    auto arcs = 0;
+    for (const auto &v : pline.vertexes()) {
+      if (!v.bulgeIsZero()) {
+        ++arcs;
+        CHECK(v.bulge() == doctest::Approx(1));
+      }
+    }
+    CHECK(arcs == 1);
+  }
+
+  TEST_CASE("Closed polylines don't collapse") {
+    // thin sliver, narrower than the tolerance
+    auto pline = make_loop({{0, 0}, {10, 0}, {5, 0.001}});
+
+    sse::simplify(pline, 0.01);
+
+    CHECK(pline.size() == 3);
+  }
+}
@@ -1,5 +1,8 @@
 #include <doctest/doctest.h>
 
+#include <sse/GCodeBuffer.hpp>
+#include <sse/GCodeWriter.hpp>
+#include <sse/OffsetBackend.hpp>
 #include <sse/Slice.hpp>
 
 #include <BRepBuilderAPI_MakeFace.hxx>
@@ -85,6 +88,78 @@ TEST_SUITE("Slice") {
       CHECK_NOTHROW(slice.generate_shells(1, 1));
       CHECK_NOTHROW(static_cast<void>(slice.gcode(1, 1, 1)));
     }
+
+    SUBCASE("Offset backends agree") {
+      auto wire = BRepBuilderAPI_MakeWire(BRepBuilderAPI_MakeEdge(gp_Circ(gp_Ax2(gp::Origin(), gp::DZ()), 10)));
+      auto face_maker = BRepBuilderAPI_MakeFace(wire.Wire(), true);
+      TopoDS_Face f = face_maker.Face();
+
+      auto cavc_slice = sse::Slice(nullptr, f, layer_height);
+      auto occt_slice = sse::Slice(nullptr, f, layer_height);
+      const auto occt = sse::make_offset_backend("occt");
+
+      cavc_slice.generate_shells(2, 1);
+      occt_slice.generate_shells(2, 1, 0.0, {}, occt.get());
+
+      REQUIRE(cavc_slice.get_shells().size() == 2);
+      REQUIRE(occt_slice.get_shells().size() == 2);
+      for (std::size_t i = 0; i < 2; ++i) {
+        const auto radius = 10 - (i + 0.5);
+        CHECK(cavc::getArea(cavc_slice.get_shells()[i].outer) == doctest::Approx(M_PI * radius * radius));
+        CHECK(cavc::getArea(occt_slice.get_shells()[i].outer) == doctest::Approx(M_PI * radius * radius));
+      }
+    }
+
+    SUBCASE("Face is released after offsetting") {
+      auto wire = BRepBuilderAPI_MakeWire(BRepBuilderAPI_MakeEdge(gp_Circ(gp_Ax2(gp::Origin(), gp::DZ()), 10)));
+      auto face_maker = BRepBuilderAPI_MakeFace(wire.Wire(), true);
+      TopoDS_Face f = face_maker.Face();
+
+      auto slice = sse::Slice(nullptr, f, layer_height);
+      const auto occt = sse::make_offset_backend("occt");
+
+      slice.generate_shells(1, 1);
+      const auto outer = slice.get_shells().front().outer;
+
+      // the stored outline is offset again
+      slice.generate_shells(1, 1);
+      REQUIRE(slice.get_shells().size() == 1);
+      CHECK(cavc::getArea(slice.get_shells().front().outer) == doctest::Approx(cavc::getArea(outer)));
+
+      // OCCT needs the face
+      CHECK_THROWS_AS(slice.generate_shells(1, 1, 0.0, {}, occt.get()), std::invalid_argument);
+    }
+
+    SUBCASE("Gcode buffer") {
+      auto wire = BRepBuilderAPI_MakeWire(BRepBuilderAPI_MakeEdge(gp_Circ(gp_Ax2(gp::Origin(), gp::DZ()), 10)));
+      auto face_maker = BRepBuilderAPI_MakeFace(wire.Wire(), true);
+      TopoDS_Face f = face_maker.Face();
+
+      auto slice = sse::Slice(nullptr, f, layer_height);
+      slice.generate_shells(3, 0.5);
+
+      auto buffer = sse::GCodeBuffer();
+      auto writer = sse::GCodeWriter(buffer);
+      slice.write_gcode(writer, 1.75, 0.5, 1.0);
+      const auto chunks = buffer.chunk_count();
+
+      CHECK(buffer.str() == slice.gcode(1.75, 0.5, 1.0));
+
+      // the next layer reuses the chunks
+      buffer.clear();
+      slice.write_gcode(writer, 1.75, 0.5, 1.0);
+      CHECK(buffer.chunk_count() == chunks);
+
+      // omitting modal words only shrinks the output
+      auto compact = sse::GCodeBuffer();
+      auto compact_writer = sse::GCodeWriter(compact, sse::GCodePrecision::compact(), sse::ModalMode::words);
+      slice.write_gcode(compact_writer, 1.75, 0.5, 1.0);
+      CHECK(compact.size() < buffer.size());
+    }
+
+    SUBCASE("Unknown offset backend") {
+      CHECK_THROWS_AS(static_cast<void>(sse::make_offset_backend("invalid")), std::invalid_argument);
+    }
   }
 
 }
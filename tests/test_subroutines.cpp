@@ -0,0 +1,159 @@
+#include <doctest/doctest.h>
+
+#include <sse/GCodeBuffer.hpp>
+#include <sse/GCodeParser.hpp>
+#include <sse/GCodeStream.hpp>
+#include <sse/GCodeWriter.hpp>
+#include <sse/Subroutines.hpp>
+#include <sse/slicer.hpp>
+
+#include "test_helpers.hpp"
+
+#include <cmath>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Append the moves of a slice-like polygon with n sides and radius r, centered on x, y
+ */
+static void add_polygon(sse::Toolpath &path, double x, double y, int n, double r = 5) {
+  const auto pi = std::acos(-1.0);
+  path.feature(sse::Feature::outer_wall);
+  path.travel(x + r, y);
+  path.reset_extruder();
+  for (int i = 1; i <= n; ++i) {
+    const auto a = 2 * pi * i / n;
+    path.linear(x + r * std::cos(a), y + r * std::sin(a), 0.1 * i, 1800);
+  }
+}
+
+TEST_SUITE("Subroutines") {
+
+  TEST_CASE("Repeated slices are found") {
+    std::vector<sse::ToolpathLayer> layers(2);
+    layers[0].z = 0.2;
+    layers[1].z = 0.4;
+    add_polygon(layers[0].path, 0, 0, 40);
+    add_polygon(layers[0].path, 20, 0, 40);
+    // a different shape
+    add_polygon(layers[0].path, 40, 0, 50);
+    layers[1].path.travel_z(0.4);
+    add_polygon(layers[1].path, 0, 20, 40);
+
+    const auto result = sse::find_subroutines(layers);
+    REQUIRE(result.bodies.size() == 1);
+    REQUIRE(result.calls.size() == 2);
+    CHECK(result.calls[0].size() == 2);
+    CHECK(result.calls[1].size() == 1);
+    CHECK(result.call_count() == 3);
+
+    // body and offset reproduce the moves they replace
+    const auto &body = result.bodies.front();
+    for (std::size_t layer = 0; layer < layers.size(); ++layer) {
+      const auto &path = layers[layer].path;
+      for (const auto &call : result.calls[layer]) {
+        CHECK(call.subroutine == 0);
+        CHECK(call.z == doctest::Approx(layers[layer].z));
+        REQUIRE(call.end - call.begin == body.size());
+        for (std::size_t k = 0; k < body.size(); ++k) {
+          CHECK(body[k].type == path[call.begin + k].type);
+          CHECK(body[k].x + call.x == doctest::Approx(path[call.begin + k].x));
+          CHECK(body[k].y + call.y == doctest::Approx(path[call.begin + k].y));
+          CHECK(body[k].e == doctest::Approx(path[call.begin + k].e));
+        }
+      }
+    }
+    CHECK(result.calls[0][0].begin < result.calls[0][1].begin);
+    CHECK(result.calls[0][1].x == doctest::Approx(25));
+
+    SUBCASE("Short slices") {
+      CHECK(sse::find_subroutines(layers, {}, 41).bodies.empty());
+    }
+
+    SUBCASE("Unique slices") {
+      std::vector<sse::ToolpathLayer> unique(1);
+      add_polygon(unique[0].path, 0, 0, 40, 5);
+      add_polygon(unique[0].path, 20, 0, 40, 6);
+      const auto none = sse::find_subroutines(unique);
+      CHECK(none.bodies.empty());
+      CHECK(none.call_count() == 0);
+    }
+  }
+
+  TEST_CASE("Subroutines are written") {
+    sse::Toolpath body;
+    body.linear(10, 0, 1, 1000);
+
+    sse::GCodeBuffer buffer;
+    sse::BasicGCodeWriter<sse::LinuxCNC> writer(buffer);
+    writer.subroutine(1, body);
+    writer.call(1, 5, 2.5, 0.2);
+    CHECK(buffer.str() == "o1 sub\nG1 X10 Y0 A1 F1000\no1 endsub\nG52 X5 Y2.5 Z0.2\no1 call\nG52 X0 Y0 Z0\n");
+
+    SUBCASE("Calls replace moves") {
+      std::vector<sse::ToolpathLayer> layers(1);
+      add_polygon(layers[0].path, 0, 0, 40);
+      add_polygon(layers[0].path, 20, 0, 40);
+      const auto result = sse::find_subroutines(layers);
+      REQUIRE(result.bodies.size() == 1);
+
+      sse::GCodeBuffer calls;
+      sse::BasicGCodeWriter<sse::LinuxCNC> out(calls);
+      sse::write_toolpath(layers[0].path, result.calls[0], out);
+      CHECK(calls.str().find("o1 call\n") != std::string::npos);
+      CHECK(calls.str().find("G1 ") == std::string::npos);
+    }
+
+    SUBCASE("Dialects without subroutines") {
+      sse::GCodeBuffer marlin;
+      sse::BasicGCodeWriter<sse::Marlin> out(marlin);
+      CHECK_THROWS_AS(out.subroutine(1, body), std::invalid_argument);
+      CHECK_THROWS_AS(out.call(1, 0, 0, 0), std::invalid_argument);
+    }
+  }
+
+  TEST_CASE("Repeated objects are called") {
+    const auto file = std::filesystem::temp_directory_path() / "sse_test_subroutines.ngc";
+    std::vector<sse::Slice> slices;
+    for (int layer = 0; layer < 10; ++layer) {
+      slices.push_back(make_slice(0, 0, layer * 0.2));
+      slices.push_back(make_slice(20, 0, layer * 0.2));
+    }
+
+    sse::GCodeStream plain(file);
+    sse::write_gcode(slices, plain, {}, sse::ModalMode::off, 4, sse::Dialect::linuxcnc);
+    plain.finish();
+    const auto expected = read_file(file);
+
+    sse::GCodeStream stream(file);
+    sse::write_gcode_subroutines(slices, stream, {}, sse::ModalMode::off, 4, sse::Dialect::linuxcnc);
+    stream.finish();
+    const auto gcode = read_file(file);
+    CHECK(gcode.find("o1 sub\n") != std::string::npos);
+    CHECK(gcode.find("o1 call\n") != std::string::npos);
+    CHECK(gcode.size() < expected.size());
+
+    // the calls print the same moves
+    const auto plain_analysis = sse::analyze_gcode(expected, 'A');
+    const auto called_analysis = sse::analyze_gcode(gcode, 'A');
+    CHECK(called_analysis.unparsed == 0);
+    CHECK(called_analysis.print_distance == doctest::Approx(plain_analysis.print_distance).epsilon(1e-3));
+    CHECK(called_analysis.filament == doctest::Approx(plain_analysis.filament).epsilon(1e-3));
+
+    // LinuxCNC has no printer M-codes, and moves the extruder as the A axis
+    CHECK(expected.find("M104") == std::string::npos);
+    CHECK(expected.find("G28") == std::string::npos);
+    CHECK(expected.find(" E") == std::string::npos);
+    CHECK(expected.find("G92 A0") != std::string::npos);
+    CHECK(expected.substr(expected.size() - 3) == "M2\n");
+
+    SUBCASE("Dialects without subroutines") {
+      sse::GCodeStream marlin(file);
+      sse::write_gcode_subroutines(slices, marlin, {}, sse::ModalMode::off, 4, sse::Dialect::marlin);
+      marlin.finish();
+      CHECK(read_file(file).find(" call\n") == std::string::npos);
+    }
+  }
+}
@@ -0,0 +1,340 @@
+#include <doctest/doctest.h>
+
+#include <sse/GCodeBuffer.hpp>
+#include <sse/GCodeWriter.hpp>
+#include <sse/Settings.hpp>
+#include <sse/Toolpath.hpp>
+#include <sse/slicer.hpp>
+
+#include "test_helpers.hpp"
+
+#include <BRepBuilderAPI_MakeFace.hxx>
+#include <BRepBuilderAPI_MakePolygon.hxx>
+#include <gp_Pnt.hxx>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+TEST_SUITE("Toolpath") {
+
+  TEST_CASE("Moves are typed and tagged") {
+    sse::Toolpath path;
+    path.travel_z(0.2, 5000);
+    path.feature(sse::Feature::outer_wall);
+    path.travel(0, 0);
+    path.reset_extruder();
+    path.linear(10, 0, 1, 1000);
+    path.arc(true, 10, 10, 0, 5, 2, 1000);
+    path.extrude(1, 2400);
+
+    REQUIRE(path.size() == 7);
+    CHECK(path[0].type == sse::MoveType::travel_z);
+    CHECK(path[0].feature == sse::Feature::none);
+    CHECK(path[0].x == 0.2);
+    CHECK(path[1].type == sse::MoveType::feature);
+    CHECK(path[1].feature == sse::Feature::outer_wall);
+    CHECK(path[2].feedrate() == std::nullopt);
+    CHECK(path[4].feature == sse::Feature::outer_wall);
+    CHECK(path[5].type == sse::MoveType::arc_cw);
+    CHECK(path.center(path[5]).j == 5);
+    CHECK(path[6].type == sse::MoveType::retract);
+
+    SUBCASE("Gcode") {
+      sse::GCodeBuffer buffer(1024);
+      sse::GCodeWriter writer(buffer);
+      sse::write_toolpath(path, writer);
+      CHECK(buffer.str() == "G0 Z0.2 F5000\n;TYPE:WALL-OUTER\nG0 X0 Y0\nG92 E0\nG1 X10 Y0 E1 F1000\n"
+                            "G2 X10 Y10 I0 J5 E2 F1000\nG1 E1 F2400\n");
+    }
+
+    SUBCASE("Stats") {
+      const auto stats = sse::toolpath_stats(path);
+      CHECK(stats.extrusions == 2);
+      CHECK(stats.arcs == 1);
+      CHECK(stats.retractions == 1);
+      CHECK(stats.print_distance == doctest::Approx(10 + 5 * M_PI));
+      CHECK(stats.filament == doctest::Approx(1));
+      CHECK(stats.print_time == doctest::Approx((10 + 5 * M_PI) / (1000.0 / 60) + 1 / (2400.0 / 60)));
+    }
+
+    SUBCASE("Clear") {
+      path.clear();
+      CHECK(path.empty());
+      CHECK(path.memory_usage() > 0);
+    }
+  }
+
+  TEST_CASE("Toolpaths write the same gcode as slices") {
+    std::vector<sse::Slice> slices;
+    for (int layer = 0; layer < 10; ++layer) {
+      slices.push_back(make_slice(0, 0, layer * 0.2));
+      slices.push_back(make_slice(20, 0, layer * 0.2));
+    }
+
+    const auto layers = sse::generate_toolpaths(slices, 4);
+    REQUIRE(layers.size() == 10);
+    CHECK(layers[3].z == doctest::Approx(0.6));
+    CHECK(sse::toolpath_stats(layers[3].path).print_distance > 0);
+
+    // geometry is only generated once, for any writer
+    for (const auto mode : {sse::ModalMode::off, sse::ModalMode::words}) {
+      sse::GCodeBuffer expected, actual;
+      sse::GCodeWriter expected_writer(expected, sse::GCodePrecision::compact(), mode);
+      sse::GCodeWriter actual_writer(actual, sse::GCodePrecision::compact(), mode);
+      sse::write_gcode(slices, expected_writer);
+      sse::write_gcode(layers, actual_writer);
+      CHECK(without_timestamp(actual.str()) == without_timestamp(expected.str()));
+    }
+  }
+
+  TEST_CASE("Beziers are only fitted for dialects with splines") {
+    std::vector<sse::Slice> slices;
+    for (int layer = 0; layer < 3; ++layer) {
+      slices.push_back(make_slice(0, 0, layer * 0.2));
+    }
+
+    auto &settings = sse::Settings::getInstance();
+    settings.parse("resources/spline_profile.toml");
+    const auto marlin = sse::generate_toolpaths(slices, 1);
+    const auto linuxcnc = sse::generate_toolpaths(slices, 1, sse::Dialect::linuxcnc);
+    settings.parse("resources/profile.toml");
+
+    REQUIRE(marlin.size() == linuxcnc.size());
+    std::size_t beziers = 0;
+    for (std::size_t i = 0; i < marlin.size(); ++i) {
+      CHECK(sse::toolpath_stats(marlin[i].path).beziers == 0);
+      beziers += sse::toolpath_stats(linuxcnc[i].path).beziers;
+    }
+    CHECK(beziers > 0);
+  }
+
+  TEST_CASE("Arcs are only fitted for dialects with arcs") {
+    // a cylinder of radius 5 as a 64-sided prism, whose walls are only lines
+    std::vector<sse::Slice> slices;
+    for (int layer = 0; layer < 3; ++layer) {
+      BRepBuilderAPI_MakePolygon polygon;
+      for (int i = 0; i < 64; ++i) {
+        const auto angle = 2 * M_PI * i / 64;
+        polygon.Add(gp_Pnt(5 * std::cos(angle), 5 * std::sin(angle), layer * 0.2));
+      }
+      polygon.Close();
+      auto slice = sse::Slice(nullptr, BRepBuilderAPI_MakeFace(polygon.Wire(), true).Face(), 0.2);
+      slice.generate_shells(2, 0.5);
+      slices.push_back(std::move(slice));
+    }
+
+    auto &settings = sse::Settings::getInstance();
+    settings.parse("resources/arc_profile.toml");
+    const auto marlin = sse::generate_toolpaths(slices, 1);
+    const auto klipper = sse::generate_toolpaths(slices, 1, sse::Dialect::klipper);
+    settings.parse("resources/profile.toml");
+
+    REQUIRE(marlin.size() == klipper.size());
+    std::size_t arcs = 0;
+    for (std::size_t i = 0; i < marlin.size(); ++i) {
+      arcs += sse::toolpath_stats(marlin[i].path).arcs;
+      CHECK(sse::toolpath_stats(klipper[i].path).arcs == 0);
+    }
+    CHECK(arcs > 0);
+  }
+
+  TEST_CASE("Arc fitting") {
+    // circle of radius 10, as 64 line moves, whose chords are 0.012mm from the circle
+    const int segments = 64;
+    sse::Toolpath path;
+    path.feature(sse::Feature::outer_wall);
+    path.travel(10, 0);
+    path.reset_extruder();
+    double e = 0;
+    for (int k = 1; k <= segments; ++k) {
+      const auto angle = 2 * M_PI * k / segments;
+      e += 0.05;
+      path.linear(10 * std::cos(angle), 10 * std::sin(angle), e, 1800);
+    }
+    path.travel(20, 0);
+    const auto before = sse::toolpath_stats(path);
+
+    SUBCASE("Disabled") {
+      const auto stats = sse::fit_arcs(path, 0);
+      CHECK(stats.arcs == 0);
+      CHECK(path.size() == segments + 4);
+    }
+
+    SUBCASE("Circle") {
+      const auto stats = sse::fit_arcs(path, 0.05);
+      CHECK(stats.lines == segments);
+      CHECK(stats.replaced == segments);
+      CHECK(stats.arcs >= 2);
+      CHECK(stats.arcs <= 4);
+
+      const auto after = sse::toolpath_stats(path);
+      CHECK(after.arcs == stats.arcs);
+      CHECK(after.extrusions == stats.arcs);
+      CHECK(after.filament == doctest::Approx(before.filament));
+      CHECK(after.print_distance == doctest::Approx(before.print_distance).epsilon(0.01));
+      CHECK(after.travel_distance == doctest::Approx(before.travel_distance));
+
+      // arcs are counter-clockwise around the origin, and end on the circle
+      double x = 10, y = 0;
+      for (const auto &move : path) {
+        if (move.is_arc()) {
+          CHECK(move.type == sse::MoveType::arc_ccw);
+          CHECK(move.feature == sse::Feature::outer_wall);
+          CHECK(move.f == 1800);
+          CHECK(x + path.center(move).i == doctest::Approx(0).epsilon(0.01));
+          CHECK(y + path.center(move).j == doctest::Approx(0).epsilon(0.01));
+          CHECK(std::hypot(move.x, move.y) == doctest::Approx(10));
+          x = move.x;
+          y = move.y;
+        }
+      }
+      CHECK(x == doctest::Approx(10));
+      CHECK(y == doctest::Approx(0).epsilon(1e-9));
+    }
+
+    SUBCASE("Runs are split by feedrate and extrusion") {
+      sse::Toolpath mixed;
+      mixed.travel(10, 0);
+      e = 0;
+      for (int k = 1; k <= segments / 2; ++k) {
+        const auto angle = 2 * M_PI * k / segments;
+        // half the moves extrude twice as much
+        e += k <= segments / 4 ? 0.05 : 0.1;
+        mixed.linear(10 * std::cos(angle), 10 * std::sin(angle), e, k % 2 ? 1800 : 1200);
+      }
+      const auto alternating = sse::fit_arcs(mixed, 0.05);
+      CHECK(alternating.arcs == 0);
+      CHECK(mixed.size() == segments / 2 + 1);
+
+      sse::Toolpath halves;
+      halves.travel(10, 0);
+      e = 0;
+      for (int k = 1; k <= segments / 2; ++k) {
+        const auto angle = 2 * M_PI * k / segments;
+        e += k <= segments / 4 ? 0.05 : 0.1;
+        halves.linear(10 * std::cos(angle), 10 * std::sin(angle), e, 1800);
+      }
+      const auto stats = sse::fit_arcs(halves, 0.05);
+      CHECK(stats.arcs == 2);
+      REQUIRE(halves.size() == 3);
+      CHECK(halves[1].e == doctest::Approx(0.05 * segments / 4));
+      CHECK(halves[2].e == doctest::Approx(0.15 * segments / 4));
+    }
+
+    SUBCASE("Repeated points keep their extrusion") {
+      // a clockwise arc, ending with a move in place that primes the nozzle
+      sse::Toolpath primed;
+      primed.travel(0, 10);
+      double x = 0, y = 10;
+      for (int k = 1; k <= 4; ++k) {
+        const auto angle = M_PI / 2 - 0.1 * k;
+        x = 10 * std::cos(angle);
+        y = 10 * std::sin(angle);
+        primed.linear(x, y, k, 1800);
+      }
+      primed.linear(x, y, 4.5, 1800);
+      const auto stats = sse::fit_arcs(primed, 0.05);
+      CHECK(stats.arcs == 1);
+      CHECK(stats.replaced == 5);
+      REQUIRE(primed.size() == 2);
+      CHECK(primed[1].type == sse::MoveType::arc_cw);
+      CHECK(primed[1].e == 4.5);
+    }
+
+    SUBCASE("Straight lines are kept") {
+      sse::Toolpath lines;
+      lines.travel(0, 0);
+      lines.linear(10, 0, 1, 1800);
+      lines.linear(10, 10, 2, 1800);
+      lines.linear(0, 10, 3, 1800);
+      lines.linear(0, 0, 4, 1800);
+      const auto stats = sse::fit_arcs(lines, 0.05);
+      CHECK(stats.lines == 4);
+      CHECK(stats.arcs == 0);
+      CHECK(lines.size() == 5);
+      CHECK(lines[4].x == 0);
+      CHECK(lines[4].e == 4);
+    }
+  }
+
+  TEST_CASE("Bezier fitting") {
+    // a wave, as 120 line moves
+    const int segments = 120;
+    auto wave = [](double x) { return 5 * std::sin(x / 5); };
+    sse::Toolpath path;
+    path.feature(sse::Feature::outer_wall);
+    path.travel(0, 0);
+    path.reset_extruder();
+    double e = 0, x0 = 0;
+    for (int k = 1; k <= segments; ++k) {
+      const auto x = 30.0 * k / segments;
+      e += 0.05 * std::hypot(x - x0, wave(x) - wave(x0));
+      path.linear(x, wave(x), e, 1800);
+      x0 = x;
+    }
+    path.travel(0, 0);
+    const auto before = sse::toolpath_stats(path);
+
+    SUBCASE("Disabled") {
+      const auto stats = sse::fit_beziers(path, 0);
+      CHECK(stats.beziers == 0);
+      CHECK(path.size() == segments + 4);
+    }
+
+    SUBCASE("Wave") {
+      const auto stats = sse::fit_beziers(path, 0.01);
+      CHECK(stats.moves == segments);
+      CHECK(stats.replaced == segments);
+      CHECK(stats.beziers > 0);
+      CHECK(stats.beziers <= 10);
+
+      const auto after = sse::toolpath_stats(path);
+      CHECK(after.beziers == stats.beziers);
+      CHECK(after.extrusions == stats.beziers);
+      CHECK(after.filament == doctest::Approx(before.filament));
+      CHECK(after.print_distance == doctest::Approx(before.print_distance).epsilon(0.005));
+
+      // beziers end on the wave, and stay close to it
+      double x = 0, y = 0;
+      for (const auto &move : path) {
+        if (move.type == sse::MoveType::bezier) {
+          CHECK(move.feature == sse::Feature::outer_wall);
+          CHECK(move.f == 1800);
+          CHECK(move.y == wave(move.x));
+          for (const auto &[px, py] : sse::flatten_bezier(x, y, move.x, move.y, path.controls(move), 0.001)) {
+            CHECK(std::abs(py - wave(px)) < 0.02);
+          }
+          x = move.x;
+          y = move.y;
+        }
+      }
+      CHECK(x == 30);
+    }
+
+    SUBCASE("Corners are kept") {
+      sse::Toolpath square;
+      square.travel(0, 0);
+      square.linear(10, 0, 1, 1800);
+      square.linear(10, 10, 2, 1800);
+      square.linear(0, 10, 3, 1800);
+      square.linear(0, 0, 4, 1800);
+      const auto stats = sse::fit_beziers(square, 0.01);
+      CHECK(stats.moves == 4);
+      CHECK(stats.beziers == 0);
+      REQUIRE(square.size() == 5);
+      CHECK(square[2].type == sse::MoveType::line);
+      CHECK(square[2].y == 10);
+    }
+
+    SUBCASE("Stats") {
+      sse::Toolpath straight;
+      straight.travel(0, 0);
+      straight.bezier(10, 0, {10.0 / 3, 0, -10.0 / 3, 0}, 1, 600);
+      const auto stats = sse::toolpath_stats(straight);
+      CHECK(stats.beziers == 1);
+      CHECK(stats.print_distance == doctest::Approx(10));
+      CHECK(stats.print_time == doctest::Approx(1));
+    }
+  }
+}
@@ -0,0 +1,102 @@
+#include <doctest/doctest.h>
+
+#include <sse/TravelPlanner.hpp>
+
+#include <vector>
+
+/**
+ * @brief Create a closed polyline out of a list of points
+ */
+static cavc::Polyline<double> make_loop(const std::vector<std::pair<double, double>> &points) {
+  cavc::Polyline<double> result;
+  result.isClosed() = true;
+  for (const auto &[x, y] : points) {
+    result.addVertex(x, y, 0);
+  }
+  return result;
+}
+
+/**
+ * @brief U-shaped outline, with a notch from y=10 to y=30 between the arms
+ */
+static sse::Shell make_outline() {
+  sse::Shell result;
+  result.outer = make_loop({{0, 0}, {30, 0}, {30, 30}, {20, 30}, {20, 10}, {10, 10}, {10, 30}, {0, 30}});
+  return result;
+}
+
+/**
+ * @brief Innermost shell of the U-shaped outline, 1mm inside
+ */
+static sse::Shell make_comb() {
+  sse::Shell result;
+  result.outer = make_loop({{1, 1}, {29, 1}, {29, 29}, {21, 29}, {21, 9}, {9, 9}, {9, 29}, {1, 29}});
+  return result;
+}
+
+TEST_SUITE("TravelPlanner") {
+  const auto outline = make_outline();
+  const auto comb = make_comb();
+  const auto planner = sse::TravelPlanner(outline, comb);
+
+  TEST_CASE("Only reflex vertices are nodes") {
+    CHECK(planner.node_count() == 2);
+  }
+
+  TEST_CASE("Direct travel") {
+    auto travel = planner.plan({5, 5}, {25, 5});
+
+    CHECK_FALSE(travel.retract);
+    REQUIRE(travel.path.size() == 1);
+    CHECK(travel.path.back().x() == doctest::Approx(25));
+    CHECK(travel.path.back().y() == doctest::Approx(5));
+  }
+
+  TEST_CASE("Travel around the notch") {
+    auto travel = planner.plan({5, 25}, {25, 25});
+
+    CHECK_FALSE(travel.retract);
+    REQUIRE(travel.path.size() == 3);
+    // route goes under the notch
+    CHECK(travel.path[0].y() == doctest::Approx(9));
+    CHECK(travel.path[1].y() == doctest::Approx(9));
+    CHECK(travel.path.back().x() == doctest::Approx(25));
+    CHECK(travel.path.back().y() == doctest::Approx(25));
+
+    // every leg stays inside the outline
+    auto previous = cavc::Vector2<double>{5, 25};
+    for (const auto &p : travel.path) {
+      CHECK_FALSE(planner.crosses_outline(previous, p));
+      previous = p;
+    }
+  }
+
+  TEST_CASE("Reflex vertices are kept over arc nodes") {
+    // round holes in the innermost shell, each adding 2 vertices and 6 points along its arcs
+    auto crowded_comb = make_comb();
+    for (int k = 0; k < 100; ++k) {
+      cavc::Polyline<double> hole;
+      hole.isClosed() = true;
+      hole.addVertex(1.9 + 0.24 * k, 4, -1);
+      hole.addVertex(2.1 + 0.24 * k, 4, -1);
+      crowded_comb.islands.push_back(hole);
+    }
+    const auto crowded = sse::TravelPlanner(outline, crowded_comb);
+    CHECK(crowded.node_count() == 256);
+
+    // the corners of the notch are still there to route around
+    auto travel = crowded.plan({5, 25}, {25, 25});
+    CHECK_FALSE(travel.retract);
+    REQUIRE(travel.path.size() == 3);
+    CHECK(travel.path[0].y() == doctest::Approx(9));
+    CHECK(travel.path[1].y() == doctest::Approx(9));
+  }
+
+  TEST_CASE("Travel from outside the outline retracts") {
+    auto travel = planner.plan({50, 50}, {5, 5});
+
+    CHECK(travel.retract);
+    REQUIRE(travel.path.size() == 1);
+    CHECK(travel.path.back().x() == doctest::Approx(5));
+  }
+}